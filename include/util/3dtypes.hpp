@@ -1,7 +1,10 @@
 #pragma once
 
 #include <numbers>
+#include <cassert>
 #include <cmath>
+#include <cstddef>
+#include <limits>
 
 namespace util
 {
@@ -10,7 +13,136 @@ constexpr inline float to_radian(float x) { return x * std::numbers::pi_v<float>
 
 constexpr inline float to_degree(float x) { return x * 180.0f / std::numbers::pi_v<float>; }
 
-/// Returns random float in the range of [0.0, 1.0]
+// Helpers of the constexpr_* functions below, in double precision.
+namespace detail
+{
+
+// The Taylor polynomials of sin and cos up to r^15 and r^14; on [-pi/4, pi/4]
+// the terms left out are below 1e-15.
+constexpr double sin_poly(double r)
+{
+    double term = r;
+    double sum = r;
+    for (int kk = 1; kk <= 7; ++kk)
+    {
+        term *= -r * r / ((2 * kk) * (2 * kk + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double cos_poly(double r)
+{
+    double term = 1.0;
+    double sum = 1.0;
+    for (int kk = 1; kk <= 7; ++kk)
+    {
+        term *= -r * r / ((2 * kk - 1) * (2 * kk));
+        sum += term;
+    }
+    return sum;
+}
+
+// x = quadrant * pi / 2 + r with r in [-pi/4, pi/4], for angles of a few
+// turns; the reduction loses precision for huge ones.
+constexpr double reduce_angle(double x, long long& quadrant)
+{
+    constexpr double half_pi = std::numbers::pi / 2.0;
+    const double qq = x / half_pi;
+    quadrant = static_cast<long long>(qq < 0.0 ? qq - 0.5 : qq + 0.5);
+    return x - static_cast<double>(quadrant) * half_pi;
+}
+
+constexpr double sin_cos(double x, bool cosine)
+{
+    long long quadrant = 0;
+    const double r = reduce_angle(x, quadrant);
+    // cos(x) = sin(x + pi / 2)
+    const long long qq = ((quadrant + (cosine ? 1 : 0)) % 4 + 4) % 4;
+    switch (qq)
+    {
+        case 0:
+            return sin_poly(r);
+        case 1:
+            return cos_poly(r);
+        case 2:
+            return -sin_poly(r);
+        default:
+            return -cos_poly(r);
+    }
+}
+
+}
+
+/// sinf(), cosf(), tanf() and sqrtf() that can be evaluated at compile time,
+/// so transformations built from constants fold to constants. Constant
+/// evaluation uses the polynomials above (Newton's method for the square
+/// root) in double precision; at run time they are the C library functions,
+/// so the two can differ in the last bit.
+constexpr inline float constexpr_sin(float x)
+{
+    if consteval
+    {
+        return static_cast<float>(detail::sin_cos(x, false));
+    }
+    else
+    {
+        return sinf(x);
+    }
+}
+
+constexpr inline float constexpr_cos(float x)
+{
+    if consteval
+    {
+        return static_cast<float>(detail::sin_cos(x, true));
+    }
+    else
+    {
+        return cosf(x);
+    }
+}
+
+constexpr inline float constexpr_tan(float x)
+{
+    if consteval
+    {
+        return static_cast<float>(detail::sin_cos(x, false) / detail::sin_cos(x, true));
+    }
+    else
+    {
+        return tanf(x);
+    }
+}
+
+constexpr inline float constexpr_sqrt(float x)
+{
+    if consteval
+    {
+        if (x < 0.0f || x != x)
+            return std::numeric_limits<float>::quiet_NaN();
+        if (x == 0.0f || x == std::numeric_limits<float>::infinity())
+            return x;
+        // Newton's method until the iterate stops decreasing, from a start
+        // above the root.
+        const double xx = x;
+        double root = xx > 1.0 ? xx : 1.0;
+        for (;;)
+        {
+            const double next = 0.5 * (root + xx / root);
+            if (next >= root)
+                return static_cast<float>(root);
+            root = next;
+        }
+    }
+    else
+    {
+        return sqrtf(x);
+    }
+}
+
+/// Returns random float in the range of [0.0, 1.0) from the calling thread's
+/// generator, see util/random.hpp for seeding and batches.
 float random_float();
 
 struct Vec3f
@@ -33,25 +165,25 @@ struct Vec3f
         float b;
     };
 
-    Vec3f() {}
+    constexpr Vec3f() {}
 
-    Vec3f(float _x, float _y, float _z)
+    constexpr Vec3f(float _x, float _y, float _z)
     {
         x = _x;
         y = _y;
         z = _z;
     }
 
-    Vec3f(const float* float_arr)
+    constexpr Vec3f(const float* float_arr)
     {
         x = float_arr[0];
         y = float_arr[1];
         z = float_arr[2];
     }
 
-    Vec3f(float f) { x = y = z = f; }
+    constexpr Vec3f(float f) { x = y = z = f; }
 
-    Vec3f& operator+=(const Vec3f& r)
+    constexpr Vec3f& operator+=(const Vec3f& r)
     {
         x += r.x;
         y += r.y;
@@ -60,7 +192,7 @@ struct Vec3f
         return *this;
     }
 
-    Vec3f& operator-=(const Vec3f& r)
+    constexpr Vec3f& operator-=(const Vec3f& r)
     {
         x -= r.x;
         y -= r.y;
@@ -69,7 +201,7 @@ struct Vec3f
         return *this;
     }
 
-    Vec3f& operator*=(float f)
+    constexpr Vec3f& operator*=(float f)
     {
         x *= f;
         y *= f;
@@ -78,45 +210,100 @@ struct Vec3f
         return *this;
     }
 
-    bool operator==(const Vec3f& r) { return ((x == r.x) && (y == r.y) && (z == r.z)); }
+    constexpr bool operator==(const Vec3f& r) const
+    {
+        return ((x == r.x) && (y == r.y) && (z == r.z));
+    }
+
+    constexpr bool operator!=(const Vec3f& r) const { return !(*this == r); }
 
-    bool operator!=(const Vec3f& r) { return !(*this == r); }
+    constexpr Vec3f cross(const Vec3f& v) const
+    {
+        const float _x = y * v.z - z * v.y;
+        const float _y = z * v.x - x * v.z;
+        const float _z = x * v.y - y * v.x;
 
-    Vec3f cross(const Vec3f& v) const;
+        return Vec3f(_x, _y, _z);
+    }
 
-    float dot(const Vec3f& v) const
+    constexpr float dot(const Vec3f& v) const
     {
         float ret = x * v.x + y * v.y + z * v.z;
         return ret;
     }
 
-    float distance(const Vec3f& v) const
+    constexpr float distance(const Vec3f& v) const
     {
         float delta_x = x - v.x;
         float delta_y = y - v.y;
         float delta_z = z - v.z;
-        float distance = sqrtf(delta_x * delta_x + delta_y * delta_y + delta_z * delta_z);
+        float distance =
+            constexpr_sqrt(delta_x * delta_x + delta_y * delta_y + delta_z * delta_z);
         return distance;
     }
 
-    float length() const
+    constexpr float length() const
     {
-        float len = sqrtf(x * x + y * y + z * z);
+        float len = constexpr_sqrt(x * x + y * y + z * z);
         return len;
     }
 
-    bool is_zero() const { return ((x + y + z) == 0.0f); }
+    constexpr bool is_zero() const { return ((x + y + z) == 0.0f); }
+
+    constexpr Vec3f& normalize()
+    {
+        float len = length();
+
+        assert(len != 0);
 
-    Vec3f& normalize();
+        x /= len;
+        y /= len;
+        z /= len;
+
+        return *this;
+    }
+};
+
+struct Vec4f
+{
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+    float w = 0.0f;
+
+    constexpr Vec4f() {}
+
+    constexpr Vec4f(float _x, float _y, float _z, float _w)
+    {
+        x = _x;
+        y = _y;
+        z = _z;
+        w = _w;
+    }
+
+    constexpr Vec4f(const Vec3f& v, float _w)
+    {
+        x = v.x;
+        y = v.y;
+        z = v.z;
+        w = _w;
+    }
 };
 
 using mat4x4f_t = float[4][4];
 
+/// Row major 4x4 matrix, transforming column vectors. Everything here is
+/// constexpr, so transformations built from constants fold to constants:
+///
+///     constexpr util::Mat4x4f view_projection = projection * camera;
+///
+/// At run time operator* uses the SIMD kernels (see util/simd.hpp) and the
+/// rotations call the C library trigonometry.
 struct Mat4x4f
 {
     mat4x4f_t mat;
-    Mat4x4f() {};
-    Mat4x4f(
+    constexpr Mat4x4f() {};
+    constexpr Mat4x4f(
         // row 0
         float a00, float a01, float a02, float a03,
         // row 1
@@ -124,20 +311,389 @@ struct Mat4x4f
         // row 2
         float a20, float a21, float a22, float a23,
         // row 3
-        float a30, float a31, float a32, float a33);
-    Mat4x4f operator*(const Mat4x4f& other) const;
+        float a30, float a31, float a32, float a33)
+        : mat{ { a00, a01, a02, a03 },
+               { a10, a11, a12, a13 },
+               { a20, a21, a22, a23 },
+               { a30, a31, a32, a33 } }
+    {
+    }
+
+    constexpr Mat4x4f operator*(const Mat4x4f& other) const
+    {
+        Mat4x4f res;
+        if consteval
+        {
+            // Same as the scalar kernel.
+            for (int ii = 0; ii < 4; ++ii)
+            {
+                for (int jj = 0; jj < 4; ++jj)
+                {
+                    float dot = 0.0f;
+                    for (int kk = 0; kk < 4; ++kk)
+                    {
+                        dot += mat[ii][kk] * other.mat[kk][jj];
+                    }
+                    res.mat[ii][jj] = dot;
+                }
+            }
+        }
+        else
+        {
+            multiply(*this, other, res);
+        }
+        return res;
+    }
+
+    // res = a * b on the active SIMD kernels, operator* at run time.
+    static void multiply(const Mat4x4f& a, const Mat4x4f& b, Mat4x4f& res);
+
+    constexpr void init_scale_transform(float scale_x, float scale_y, float scale_z)
+    {
+        float scales[3]{ scale_x, scale_y, scale_z };
+        init_scale_transform(scales);
+    }
+
+    constexpr void init_scale_transform(float scale)
+    {
+        float scales[3]{ scale, scale, scale };
+        init_scale_transform(scales);
+    }
+
+    constexpr void init_scale_transform(float scales[3])
+    {
+        for (short ii = 0; ii < 4; ++ii)
+        {
+            for (short jj = 0; jj < 4; ++jj)
+            {
+                if (ii == jj)
+                {
+                    mat[ii][ii] = (ii < 3) ? scales[ii] : 1.0f;
+                }
+                else
+                {
+                    mat[ii][jj] = 0.0f;
+                }
+            }
+        }
+    }
+
+    // In degrees, see Quatf for these two.
+    constexpr void init_rotate_transform(float rotate_x, float rotate_y, float rotate_z);
+    constexpr void init_rotate_transform_zyx(float rotate_x, float rotate_y, float rotate_z);
+
+    // In radians, clockwise seen from the tip of the axis.
+    constexpr void init_rotate_transform_x(float x)
+    {
+        const float cc = constexpr_cos(x);
+        const float ss = constexpr_sin(x);
+        *this = Mat4x4f(
+            // row 0
+            1.0f, 0.0f, 0.0f, 0.0f,
+            // row 1
+            0.0f, cc, ss, 0.0f,
+            // row 2
+            0.0f, -ss, cc, 0.0f,
+            // row 3
+            0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    constexpr void init_rotate_transform_y(float y)
+    {
+        const float cc = constexpr_cos(y);
+        const float ss = constexpr_sin(y);
+        *this = Mat4x4f(
+            // row 0
+            cc, 0.0f, -ss, 0.0f,
+            // row 1
+            0.0f, 1.0f, 0.0f, 0.0f,
+            // row 2
+            ss, 0.0f, cc, 0.0f,
+            // row 3
+            0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    constexpr void init_rotate_transform_z(float z)
+    {
+        const float cc = constexpr_cos(z);
+        const float ss = constexpr_sin(z);
+        *this = Mat4x4f(
+            // row 0
+            cc, ss, 0.0f, 0.0f,
+            // row 1
+            -ss, cc, 0.0f, 0.0f,
+            // row 2
+            0.0f, 0.0f, 1.0f, 0.0f,
+            // row 3
+            0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    constexpr void init_translation_transform(float x, float y, float z)
+    {
+        *this = Mat4x4f(
+            // row 0
+            1.0f, 0.0f, 0.0f, x,
+            // row 1
+            0.0f, 1.0f, 0.0f, y,
+            // row 2
+            0.0f, 0.0f, 1.0f, z,
+            // row 3
+            0.0f, 0.0f, 0.0f, 1.0f);
+    }
+};
+
+using affine3f_t = float[3][4];
+
+/// Affine transformation: the first three rows of a Mat4x4f whose last row is
+/// (0, 0, 0, 1), as every matrix of init_scale_transform(),
+/// init_rotate_transform() and init_translation_transform() and their
+/// products. 48 bytes instead of 64, and a product of two of them takes 36
+/// multiplications instead of 64.
+///
+/// Multiplying a Mat4x4f, say a projection, by one gives a Mat4x4f:
+///
+///     util::Affine3f world = translation * rotation;
+///     util::Mat4x4f total = perspective * world;
+struct Affine3f
+{
+    affine3f_t mat;
+    Affine3f() {};
+    Affine3f(
+        // row 0
+        float a00, float a01, float a02, float a03,
+        // row 1
+        float a10, float a11, float a12, float a13,
+        // row 2
+        float a20, float a21, float a22, float a23);
+    // Drops the last row of mat, which has to be (0, 0, 0, 1).
+    explicit Affine3f(const Mat4x4f& mat);
+
+    Affine3f operator*(const Affine3f& other) const;
+
+    // The inverse transformation; the upper left 3x3 must be invertible.
+    Affine3f inverse() const;
+    // Same for a rotation and translation only, which is the transpose of the
+    // rotation and the translation rotated back.
+    Affine3f inverse_rigid() const;
+
+    Vec3f transform_point(const Vec3f& p) const
+    {
+        return Vec3f(mat[0][0] * p.x + mat[0][1] * p.y + mat[0][2] * p.z + mat[0][3],
+                     mat[1][0] * p.x + mat[1][1] * p.y + mat[1][2] * p.z + mat[1][3],
+                     mat[2][0] * p.x + mat[2][1] * p.y + mat[2][2] * p.z + mat[2][3]);
+    }
+
+    // Directions and offsets, which the translation does not move.
+    Vec3f transform_vector(const Vec3f& v) const
+    {
+        return Vec3f(mat[0][0] * v.x + mat[0][1] * v.y + mat[0][2] * v.z,
+                     mat[1][0] * v.x + mat[1][1] * v.y + mat[1][2] * v.z,
+                     mat[2][0] * v.x + mat[2][1] * v.y + mat[2][2] * v.z);
+    }
+
+    Mat4x4f to_matrix() const;
 
     void init_scale_transform(float scale_x, float scale_y, float scale_z);
     void init_scale_transform(float scale);
-    void init_scale_transform(float scales[3]);
 
     void init_rotate_transform(float rotate_x, float rotate_y, float rotate_z);
-    void init_rotate_transform_zyx(float rotate_x, float rotate_y, float rotate_z);
-    void init_rotate_transform_x(float x);
-    void init_rotate_transform_y(float y);
-    void init_rotate_transform_z(float z);
 
     void init_translation_transform(float x, float y, float z);
 };
 
+/// lhs * rhs as 4x4 matrices, skipping the known last row of rhs.
+Mat4x4f operator*(const Mat4x4f& lhs, const Affine3f& rhs);
+
+/// Rotation as a unit quaternion. from_axis_angle() turns counter-clockwise
+/// seen from the tip of the axis, the right handed convention of glm; the
+/// init_rotate_transform_* matrices turn the other way, so
+/// init_rotate_transform_y(a) gives the matrix of
+/// Quatf::from_axis_angle(Vec3f(0.0f, 1.0f, 0.0f), -a).
+///
+/// q * r rotates by r first and then by q, like the product of their
+/// matrices, for 16 multiplications instead of 64. to_matrix() needs no
+/// trigonometry.
+struct Quatf
+{
+    float x = 0.0f;
+    float y = 0.0f;
+    float z = 0.0f;
+    float w = 1.0f;
+
+    constexpr Quatf() {}
+
+    constexpr Quatf(float _x, float _y, float _z, float _w)
+    {
+        x = _x;
+        y = _y;
+        z = _z;
+        w = _w;
+    }
+
+    // The SIMD kernels in simd.cpp do the arithmetic below in the same order.
+
+    // axis must be normalized, angle is in radians.
+    static constexpr Quatf from_axis_angle(const Vec3f& axis, float angle)
+    {
+        const float half = angle * 0.5f;
+        const float s = constexpr_sin(half);
+        return Quatf(axis.x * s, axis.y * s, axis.z * s, constexpr_cos(half));
+    }
+
+    constexpr Quatf operator*(const Quatf& r) const
+    {
+        return Quatf(w * r.x + x * r.w + y * r.z - z * r.y,
+                     w * r.y - x * r.z + y * r.w + z * r.x,
+                     w * r.z + x * r.y - y * r.x + z * r.w,
+                     w * r.w - x * r.x - y * r.y - z * r.z);
+    }
+
+    // The inverse rotation, for unit quaternions.
+    constexpr Quatf conjugate() const { return Quatf(-x, -y, -z, w); }
+
+    constexpr float dot(const Quatf& q) const { return x * q.x + y * q.y + z * q.z + w * q.w; }
+
+    constexpr float length() const { return constexpr_sqrt(dot(*this)); }
+
+    constexpr Quatf& normalize()
+    {
+        float len = length();
+
+        assert(len != 0);
+
+        x /= len;
+        y /= len;
+        z /= len;
+        w /= len;
+
+        return *this;
+    }
+
+    constexpr Vec3f rotate(const Vec3f& v) const
+    {
+        // v + w * t + q x t with t = 2 * q x v.
+        const Vec3f q(x, y, z);
+        Vec3f t = q.cross(v);
+        t *= 2.0f;
+        Vec3f res = q.cross(t);
+        res += v;
+        t *= w;
+        res += t;
+        return res;
+    }
+
+    constexpr Mat4x4f to_matrix() const
+    {
+        const float x2 = x + x;
+        const float y2 = y + y;
+        const float z2 = z + z;
+        const float xx = x * x2;
+        const float yy = y * y2;
+        const float zz = z * z2;
+        const float xy = x * y2;
+        const float xz = x * z2;
+        const float yz = y * z2;
+        const float wx = w * x2;
+        const float wy = w * y2;
+        const float wz = w * z2;
+
+        return Mat4x4f(
+            // row 0
+            1.0f - (yy + zz), xy - wz, xz + wy, 0.0f,
+            // row 1
+            xy + wz, 1.0f - (xx + zz), yz - wx, 0.0f,
+            // row 2
+            xz - wy, yz + wx, 1.0f - (xx + yy), 0.0f,
+            // row 3
+            0.0f, 0.0f, 0.0f, 1.0f);
+    }
+};
+
+// The product of the rotations about each axis, in the order of the matrix
+// product, comes straight from the product of their quaternions; the angles
+// are negated for the clockwise matrices of init_rotate_transform_*.
+
+constexpr void Mat4x4f::init_rotate_transform(float rotate_x, float rotate_y, float rotate_z)
+{
+    const Quatf qx = Quatf::from_axis_angle(Vec3f(1.0f, 0.0f, 0.0f), -to_radian(rotate_x));
+    const Quatf qy = Quatf::from_axis_angle(Vec3f(0.0f, 1.0f, 0.0f), -to_radian(rotate_y));
+    const Quatf qz = Quatf::from_axis_angle(Vec3f(0.0f, 0.0f, 1.0f), -to_radian(rotate_z));
+
+    *this = (qz * qy * qx).to_matrix();
+}
+
+constexpr void Mat4x4f::init_rotate_transform_zyx(float rotate_x, float rotate_y, float rotate_z)
+{
+    const Quatf qx = Quatf::from_axis_angle(Vec3f(1.0f, 0.0f, 0.0f), -to_radian(rotate_x));
+    const Quatf qy = Quatf::from_axis_angle(Vec3f(0.0f, 1.0f, 0.0f), -to_radian(rotate_y));
+    const Quatf qz = Quatf::from_axis_angle(Vec3f(0.0f, 0.0f, 1.0f), -to_radian(rotate_z));
+
+    *this = (qx * qy * qz).to_matrix();
+}
+
+/// Interpolation from a (t = 0) to b (t = 1) along the shorter arc. slerp()
+/// turns at a constant rate; nlerp() normalizes the linear interpolation,
+/// which is cheaper and close to it for the small steps of an animation.
+Quatf slerp(const Quatf& a, const Quatf& b, float t);
+Quatf nlerp(const Quatf& a, const Quatf& b, float t);
+
+/// Rigid transformation, a rotation followed by a translation, as a unit
+/// dual quaternion real + eps * dual. Composes like Quatf with three
+/// quaternion products, and blending two of them with nlerp() does not
+/// shrink the object the way blending matrices does.
+struct DualQuatf
+{
+    Quatf real;
+    Quatf dual{ 0.0f, 0.0f, 0.0f, 0.0f };
+
+    DualQuatf() {}
+
+    DualQuatf(const Quatf& rotation, const Vec3f& translation);
+
+    DualQuatf operator*(const DualQuatf& r) const;
+
+    const Quatf& rotation() const { return real; }
+
+    Vec3f translation() const;
+
+    Vec3f transform_point(const Vec3f& p) const;
+
+    DualQuatf& normalize();
+
+    Mat4x4f to_matrix() const;
+};
+
+DualQuatf nlerp(const DualQuatf& a, const DualQuatf& b, float t);
+
+// Batch kernels. These use the same SSE/AVX2 code paths as Mat4x4f::operator*
+// (see util/simd.hpp) and are meant for transforming many objects per frame.
+
+/// out[i] = lhs * rhs[i] for 0 <= i < count. out must not alias lhs.
+void multiply_batch(const Mat4x4f& lhs, const Mat4x4f* rhs, Mat4x4f* out, size_t count);
+
+/// out[i] = mat * (points[i], 1.0) for 0 <= i < count. Unlike the other
+/// kernels, the results are the same bits with every instruction set.
+void transform_points(const Mat4x4f& mat, const Vec3f* points, Vec4f* out, size_t count);
+
+/// out[i] = mat * points[i] for 0 <= i < count.
+void transform_points(const Mat4x4f& mat, const Vec4f* points, Vec4f* out, size_t count);
+
+/// out[i] = lhs * rhs[i] for 0 <= i < count. out must not alias lhs.
+void multiply_batch(const Affine3f& lhs, const Affine3f* rhs, Affine3f* out, size_t count);
+
+/// out[i] = lhs * rhs[i] for 0 <= i < count, e.g. the view projection matrix
+/// times the world transformation of each instance.
+void multiply_batch(const Mat4x4f& lhs, const Affine3f* rhs, Mat4x4f* out, size_t count);
+
+/// out[i] = lhs * rhs[i] for 0 <= i < count.
+void multiply_batch(const Quatf& lhs, const Quatf* rhs, Quatf* out, size_t count);
+void multiply_batch(const DualQuatf& lhs, const DualQuatf* rhs, DualQuatf* out, size_t count);
+
+/// out[i] = nlerp(a[i], b[i], t) for 0 <= i < count.
+void nlerp_batch(const Quatf* a, const Quatf* b, float t, Quatf* out, size_t count);
+
+/// out[i] = quats[i].to_matrix() for 0 <= i < count.
+void to_matrix_batch(const Quatf* quats, Mat4x4f* out, size_t count);
+void to_matrix_batch(const DualQuatf* quats, Mat4x4f* out, size_t count);
+
 }
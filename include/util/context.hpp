@@ -0,0 +1,168 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <util/frame_capture.hpp>
+#include <util/profiler.hpp>
+#include <util/shader_watcher.hpp>
+#include <util/uniform_table.hpp>
+
+#include <memory>
+#include <string>
+
+struct GLFWwindow;
+
+namespace util
+{
+
+/// Where a Context renders to.
+enum class Backend
+{
+    // A GLFW window, the default.
+    window,
+    // An EGL surfaceless context rendering into an offscreen framebuffer
+    // object. Needs neither a display nor a GPU (works with Mesa llvmpipe).
+    headless,
+};
+
+struct ContextOptions
+{
+    int width = 800;
+    int height = 600;
+    const char* title = "Learn OpenGL";
+    int gl_major = 3;
+    int gl_minor = 3;
+    Backend backend = Backend::window;
+    // Number of frames to render before Context::should_close() returns true.
+    // 0 means until the window is closed, which for headless contexts is
+    // replaced by default_headless_frames.
+    long frames = 0;
+    // Profile every frame with a FrameProfiler and print its summary on exit.
+    bool profile = false;
+    // Also write the profile there: JSON if it ends in .json, CSV otherwise.
+    std::string profile_output;
+    // Reload shaders when their source files change, see util::ShaderWatcher.
+    bool watch_shaders = false;
+    // Write the last frame there as a PPM image, see util::FrameCapture. With
+    // a frame count only that frame is read back, otherwise every frame is.
+    std::string capture_output;
+
+    static constexpr long default_headless_frames = 1;
+
+    ContextOptions() {}
+
+    ContextOptions(int width_, int height_)
+        : width{ width_ }
+        , height{ height_ }
+    {
+    }
+
+    /// Reads the backend, the frame count, profiling, shader watching and
+    /// frame capture from the environment (UTIL_HEADLESS=1, UTIL_FRAMES=N,
+    /// UTIL_PROFILE=1 or a file name, UTIL_WATCH_SHADERS=1, UTIL_CAPTURE=FILE)
+    /// and then from the command line (--headless, --window, --frames N,
+    /// --profile or --profile=FILE, --watch-shaders, --capture=FILE), which
+    /// wins. Other arguments are left for the caller.
+    ContextOptions& parse(int argc, char* argv[]);
+};
+
+/// Owns the OpenGL context of a sample and the frame loop around it:
+///
+///     util::Context context(argc, argv, width, height);
+///     if (context.error)
+///         return -1;
+///     while (!context.should_close())
+///     {
+///         // draw...
+///         context.end_frame();
+///     }
+///
+/// GLAD is initialized by the constructor. In headless mode everything is
+/// drawn into an offscreen framebuffer object of the requested size which is
+/// left bound as GL_FRAMEBUFFER, and the loop ends after a fixed frame count.
+class Context
+{
+public:
+    bool error;
+
+    explicit Context(const ContextOptions& options);
+    // Shorthand for Context(ContextOptions(width, height).parse(argc, argv)).
+    Context(int argc, char* argv[], int width, int height);
+    ~Context();
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    bool headless() const { return window == nullptr; }
+
+    // True once the window was closed, close() was called or the requested
+    // number of frames has been rendered. Otherwise a new frame starts, which
+    // is where the profiler begins timing it.
+    bool should_close();
+    void close() { close_requested = true; }
+
+    // Presents the frame (swaps buffers and polls events for windows).
+    void end_frame();
+
+    // Whether key (a GLFW_KEY_* code) is pressed. Always false when headless.
+    bool key_pressed(int key) const;
+
+    // Seconds since the context was created. Headless contexts advance a
+    // fixed 1/60 s per frame, so animations render the same on every run.
+    double time() const;
+
+    long frame() const { return frame_count; }
+
+    // glGetUniformLocation() calls (see UniformTable::driver_queries()) since
+    // the end of the first frame; frames should need none.
+    size_t lookups_after_first_frame() const
+    {
+        return frame_count > 0 ? UniformTable::driver_queries() - first_frame_lookups : 0;
+    }
+    int width() const { return fb_width; }
+    int height() const { return fb_height; }
+
+    // The profiler of the frame loop when profiling is on, else null. Frames
+    // run from should_close() to end_frame(); time parts of them with
+    // util::ProfileScope scope(context.profiler(), "name").
+    FrameProfiler* profiler() const { return frame_profiler.get(); }
+
+    // The shader watcher when shaders are watched, else null.
+    ShaderWatcher* shader_watcher() const { return watcher.get(); }
+
+    GLFWwindow* glfw_window() const { return window; }
+    // The offscreen framebuffer of headless contexts, 0 for windows.
+    GLuint framebuffer() const { return fbo; }
+
+private:
+    bool init_window(const ContextOptions& options);
+    bool init_headless(const ContextOptions& options);
+    bool init_framebuffer();
+    void report_profile();
+    void write_capture();
+    static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
+
+    GLFWwindow* window = nullptr;
+    // EGLDisplay and EGLContext, kept opaque to avoid leaking EGL headers.
+    void* egl_display = nullptr;
+    void* egl_context = nullptr;
+
+    GLuint fbo = 0;
+    GLuint color_rb = 0;
+    GLuint depth_rb = 0;
+
+    int fb_width = 0;
+    int fb_height = 0;
+    std::unique_ptr<FrameProfiler> frame_profiler;
+    std::string profile_output;
+    std::unique_ptr<ShaderWatcher> watcher;
+    std::unique_ptr<FrameCapture> capture;
+    std::string capture_output;
+
+    long frames_to_render = 0;
+    long frame_count = 0;
+    size_t first_frame_lookups = 0;
+    bool close_requested = false;
+};
+
+}
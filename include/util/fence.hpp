@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glad/glad.h>
+
+namespace util
+{
+
+/// Flushes and blocks until fence has signaled, for at most
+/// max_fence_wait_s. Returns GL_ALREADY_SIGNALED, GL_CONDITION_SATISFIED or
+/// GL_WAIT_FAILED like glClientWaitSync(), or GL_TIMEOUT_EXPIRED when the
+/// fence has not signaled by then, e.g. because the GPU hung; the caller
+/// decides whether to give up on what the fence guards.
+GLenum wait_fence(GLsync fence);
+
+constexpr int max_fence_wait_s = 10;
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace util
+{
+
+/// Reports files that were written, using inotify on Linux. Other platforms
+/// get a watcher with error set that never reports anything.
+///
+/// The directories of the files are watched rather than the files, because
+/// editors often save by writing a new file and renaming it over the old
+/// one, which would end a watch on the file itself.
+class FileWatcher
+{
+public:
+    bool error;
+
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Starts watching path. Adding a path twice is harmless.
+    bool add(const std::string& path);
+
+    // Returns the watched files written or replaced since the last call, each
+    // once, as normalized by normalize(). Never blocks.
+    std::vector<std::string> changed();
+
+    // The form of path changed() reports, e.g. "shaders/../shaders/a.vert"
+    // becomes "shaders/a.vert".
+    static std::string normalize(const std::string& path);
+
+private:
+    int fd = -1;
+    // Watch descriptor to directory.
+    std::unordered_map<int, std::string> directories;
+    std::unordered_set<std::string> files;
+};
+
+}
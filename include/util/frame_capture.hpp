@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+#include <util/image.hpp>
+
+namespace util
+{
+
+/// Reads frames back from the GPU without waiting for them:
+///
+///     util::FrameCapture capture(width, height);
+///     while (...)
+///     {
+///         // draw...
+///         capture.read(framebuffer);
+///         capture.poll();
+///         // swap buffers...
+///     }
+///     capture.finish();
+///     util::write_ppm("frame.ppm", capture.image());
+///
+/// read() starts a glReadPixels into one of a few pixel pack buffers and puts
+/// a fence after it, so the copy runs after the frame's draws while the CPU
+/// goes on with the next frame. poll() maps the buffers whose fences have
+/// signaled and keeps the most recent frame, finish() waits for the rest.
+/// Every buffer being in flight makes read() wait for the oldest one, which
+/// is counted as a stall.
+class FrameCapture
+{
+public:
+    struct Stats
+    {
+        size_t reads = 0;
+        size_t completed = 0;
+        // read() calls that had to wait for a buffer.
+        size_t stalls = 0;
+    };
+
+    static constexpr int max_buffers = 4;
+
+    bool error;
+
+    // buffers (1 to max_buffers) is the number of reads in flight.
+    FrameCapture(int width, int height, int buffers = 3);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Reads the color buffer of framebuffer, the back buffer for 0, as the
+    // frame with the given number. Leaves framebuffer bound for reading.
+    void read(GLuint framebuffer, long frame);
+    // Collects the reads that are done. Never blocks.
+    void poll();
+    // Waits for every read in flight.
+    void finish();
+
+    // The latest frame collected, empty before the first.
+    const Image& image() const { return latest; }
+    // Its number as given to read(), -1 before the first.
+    long image_frame() const { return latest_frame; }
+    const Stats& stats() const { return capture_stats; }
+
+private:
+    struct Pending
+    {
+        GLsync fence = nullptr;
+        long frame = -1;
+    };
+
+    // Maps buffer ii into latest once its fence has signaled, or right away
+    // when waiting. Returns whether the buffer is free again, which a wait
+    // that gives up (see wait_fence()) also makes it, without an image.
+    bool collect(int ii, bool wait);
+
+    int width;
+    int height;
+    int num_buffers;
+    GLuint buffers[max_buffers] = {};
+    Pending pending[max_buffers];
+    // The buffer the next read() goes to; reads complete in this order.
+    int next = 0;
+
+    Image latest;
+    long latest_frame = -1;
+    Stats capture_stats;
+};
+
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <util/3dtypes.hpp>
+
+namespace util
+{
+
+class ThreadPool;
+
+/// Plane a * x + b * y + c * z + d = 0 with (a, b, c) of unit length and
+/// pointing to the inside of the frustum.
+struct Plane
+{
+    float a = 0.0f;
+    float b = 0.0f;
+    float c = 0.0f;
+    float d = 0.0f;
+
+    // Signed distance of the point, positive inside.
+    float distance(const Vec3f& p) const { return a * p.x + b * p.y + c * p.z + d; }
+};
+
+/// The six planes of the volume a view projection matrix maps to the clip
+/// cube -w <= x, y, z <= w. With a projection alone the planes are in view
+/// space, with projection * view in world space, with projection * view *
+/// world in object space.
+struct Frustum
+{
+    enum Side
+    {
+        left,
+        right,
+        bottom,
+        top,
+        near,
+        far,
+    };
+
+    Plane planes[6];
+
+    Frustum() = default;
+    explicit Frustum(const Mat4x4f& view_projection);
+
+    // Conservative tests: true unless the bounds are fully outside one plane.
+    bool intersects_sphere(const Vec3f& center, float radius) const;
+    bool intersects_box(const Vec3f& min, const Vec3f& max) const;
+};
+
+/// Axis aligned boxes as a structure of arrays, so that the culling kernels
+/// load the same coordinate of 8 boxes at a time. Kept as centers and half
+/// extents: a box is outside a plane when distance(center) < -dot(|normal|,
+/// extent).
+struct BoxBounds
+{
+    std::vector<float> center_x, center_y, center_z;
+    std::vector<float> extent_x, extent_y, extent_z;
+
+    void add(const Vec3f& min, const Vec3f& max);
+    void reserve(size_t count);
+    void clear();
+    size_t size() const { return center_x.size(); }
+};
+
+/// Bounding spheres as a structure of arrays.
+struct SphereBounds
+{
+    std::vector<float> center_x, center_y, center_z;
+    std::vector<float> radius;
+
+    void add(const Vec3f& center, float radius);
+    void reserve(size_t count);
+    void clear();
+    size_t size() const { return center_x.size(); }
+};
+
+/// Frustum culling of many objects per frame:
+///
+///     util::BoxBounds boxes;  // one box per object, in world space
+///     ...
+///     util::cull(util::Frustum(projection * view), boxes, visible);
+///     for (uint32_t index: visible)
+///         draw(objects[index]);
+///
+/// visible is replaced by the indices of the objects intersecting the
+/// frustum, in increasing order, and its size is returned. The tests run 8
+/// objects at a time with AVX2, 4 with SSE, following util::simd::active().
+/// With a pool the objects are split into one range per worker, each culled
+/// into its own part of visible and then compacted; that pays off from
+/// some 100k objects. Only those ranges are waited for (see TaskGroup), so
+/// the pool may run other work and cull() may be called from its tasks.
+size_t cull(const Frustum& frustum, const BoxBounds& boxes, std::vector<uint32_t>& visible);
+size_t cull(const Frustum& frustum, const SphereBounds& spheres, std::vector<uint32_t>& visible);
+size_t cull(const Frustum& frustum, const BoxBounds& boxes, std::vector<uint32_t>& visible,
+            ThreadPool& pool);
+size_t cull(const Frustum& frustum, const SphereBounds& spheres, std::vector<uint32_t>& visible,
+            ThreadPool& pool);
+
+}
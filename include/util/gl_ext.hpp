@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glad/glad.h>
+
+// Enums of GL 4.3 and 4.4 used by util, not in the GL 3.3 core headers.
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace util
+{
+
+/// Entry points newer than the GL 3.3 core profile the samples load with
+/// GLAD. Context resolves them after creating the context; they stay null
+/// if the driver does not have them.
+namespace gl_ext
+{
+
+using MultiDrawElementsIndirect = void(APIENTRY*)(GLenum mode, GLenum type, const void* indirect,
+                                                  GLsizei draw_count, GLsizei stride);
+using MultiDrawArraysIndirect = void(APIENTRY*)(GLenum mode, const void* indirect,
+                                                GLsizei draw_count, GLsizei stride);
+using BufferStorage = void(APIENTRY*)(GLenum target, GLsizeiptr size, const void* data,
+                                      GLbitfield flags);
+
+extern MultiDrawElementsIndirect multi_draw_elements_indirect;
+extern MultiDrawArraysIndirect multi_draw_arrays_indirect;
+// glBufferStorage, or glBufferStorageARB where only the extension has it.
+extern BufferStorage buffer_storage;
+
+/// Resolves the entry points with get_proc (glfwGetProcAddress or
+/// eglGetProcAddress). Needs a current context.
+void load(GLADloadproc get_proc);
+
+/// Whether the current context is GL 4.3 or later with the multi-draw
+/// indirect entry points, which also means shader storage buffers and
+/// base instances.
+bool multi_draw_indirect_supported();
+
+/// Whether immutable buffer storage (GL 4.4 or ARB_buffer_storage) can be used,
+/// which persistently mapped buffers need.
+bool buffer_storage_supported();
+
+/// Whether the current context lists the extension name (e.g. "GL_ARB_buffer_storage").
+bool has_extension(const char* name);
+
+}
+
+}
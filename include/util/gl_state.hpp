@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+namespace util
+{
+
+/// Shadow copy of the GL state that render loops set over and over: the
+/// program, vertex array, buffer bindings, texture unit bindings and the
+/// cull/blend/depth state. Each setter only calls GL if the value changes and
+/// counts the calls it issued and those it elided.
+///
+/// Nothing is known at first, so the first call of each setter always goes
+/// through. Raw GL calls that change tracked state make the shadow copy stale:
+/// call invalidate() after them (or after switching contexts).
+class GLState
+{
+public:
+    struct Stats
+    {
+        size_t issued = 0;
+        size_t elided = 0;
+    };
+
+    // Units and targets beyond these are passed through untracked.
+    static constexpr GLuint max_texture_units = 32;
+
+    GLState() { invalidate(); }
+
+    void use_program(GLuint program);
+    void bind_vertex_array(GLuint vao);
+    // GL_ELEMENT_ARRAY_BUFFER is part of the vertex array state, so it is
+    // forgotten whenever a different vertex array is bound.
+    void bind_buffer(GLenum target, GLuint buffer);
+    // glBindBufferBase. The indexed binding is not tracked (so this always
+    // calls GL), but the generic binding of target it also changes is.
+    void bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+    // Binds texture to target of texture unit (0-based, not GL_TEXTURE0 + n),
+    // switching the active texture unit only if needed.
+    void bind_texture(GLuint unit, GLenum target, GLuint texture);
+    void active_texture(GLuint unit);
+
+    // glEnable/glDisable. GL_CULL_FACE, GL_BLEND, GL_DEPTH_TEST,
+    // GL_STENCIL_TEST, GL_SCISSOR_TEST and GL_PROGRAM_POINT_SIZE are tracked.
+    void set_enabled(GLenum capability, bool enabled);
+    void cull_face(GLenum face);
+    void front_face(GLenum mode);
+    void blend_func(GLenum src, GLenum dst);
+    void depth_func(GLenum func);
+    void depth_mask(bool enabled);
+
+    // Drops the binding of a deleted object so that a new object with the
+    // same name is bound again. Call before deleting it.
+    void forget_program(GLuint program);
+    void forget_vertex_array(GLuint vao);
+    void forget_buffer(GLuint buffer);
+    void forget_texture(GLuint texture);
+
+    // Forgets everything, the next call of every setter goes through.
+    void invalidate();
+
+    const Stats& stats() const { return call_stats; }
+    void reset_stats() { call_stats = Stats{}; }
+
+private:
+    static constexpr GLuint unknown = ~GLuint{ 0 };
+    static constexpr int num_buffer_targets = 8;
+    static constexpr int num_texture_targets = 9;
+    static constexpr int num_capabilities = 6;
+
+    static int buffer_target_index(GLenum target);
+    static int texture_target_index(GLenum target);
+    static int capability_index(GLenum capability);
+
+    // Returns true if GL has to be called, updating the shadow copy and counters.
+    template <typename T> bool change(T& current, T value)
+    {
+        if (current == value)
+        {
+            ++call_stats.elided;
+            return false;
+        }
+        current = value;
+        ++call_stats.issued;
+        return true;
+    }
+
+    GLuint program;
+    GLuint vertex_array;
+    GLuint buffers[num_buffer_targets];
+    GLuint active_unit;
+    GLuint textures[max_texture_units][num_texture_targets];
+    GLuint capabilities[num_capabilities]; // 0, 1 or unknown.
+    GLenum cull_face_mode;
+    GLenum front_face_mode;
+    GLenum blend_src;
+    GLenum blend_dst;
+    GLenum depth_func_value;
+    GLuint depth_mask_value;
+
+    Stats call_stats;
+};
+
+/// The state of the current context. The samples use one context per process.
+GLState& gl_state();
+
+}
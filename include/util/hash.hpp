@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace util
+{
+
+constexpr uint64_t fnv1a_offset = 0xcbf29ce484222325ull;
+
+/// 64 bit FNV-1a hash of data. Pass the result of a previous call as seed to
+/// hash several pieces of data as if they were concatenated.
+constexpr uint64_t fnv1a(std::string_view data, uint64_t seed = fnv1a_offset)
+{
+    uint64_t hh = seed;
+    for (char cc: data)
+    {
+        hh ^= static_cast<unsigned char>(cc);
+        hh *= 0x100000001b3ull;
+    }
+    return hh;
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace util
+{
+
+/// RGBA8 pixels, first row at the bottom like glReadPixels() returns them.
+struct Image
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> pixels;
+
+    bool empty() const { return pixels.empty(); }
+};
+
+/// Binary PPM (P6) files, which any image viewer opens and which need no
+/// library. The rows are flipped to the top-down order of the file and alpha
+/// is dropped on writing; reading gives an alpha of 255.
+bool write_ppm(const std::string& path, const Image& image);
+bool read_ppm(const std::string& path, Image& image);
+
+/// How far an image is from a reference one. Different drivers rasterize
+/// and filter slightly differently, so a channel may be off by up to a
+/// tolerance before its pixel counts as different, and some pixels may be
+/// different before the images do not match.
+struct ImageDiff
+{
+    // Whether the sizes differ, in which case nothing else was compared.
+    bool size_mismatch = false;
+    size_t pixels = 0;
+    // Pixels with a channel off by more than the tolerance.
+    size_t differing = 0;
+    // Largest difference of a channel, 0 to 255.
+    int max_difference = 0;
+    // Root mean square difference over all channels, 0 to 255.
+    double rms = 0.0;
+
+    double differing_fraction() const
+    {
+        return pixels ? static_cast<double>(differing) / static_cast<double>(pixels) : 0.0;
+    }
+    bool matches(double max_differing_fraction) const
+    {
+        return !size_mismatch && differing_fraction() <= max_differing_fraction;
+    }
+};
+
+// Compares the color channels; alpha is not compared, as PPM does not keep it.
+ImageDiff compare_images(const Image& image, const Image& reference, int tolerance);
+
+}
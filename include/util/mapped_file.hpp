@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace util
+{
+
+/// Read-only view of a whole file through mmap(), so its bytes can be handed
+/// to glShaderSource() or stbi_load_from_memory() without first copying them
+/// into a std::string. Pages are read in by the kernel on first touch;
+/// Advice tells it how they will be touched.
+///
+///     util::MappedFile file("resources/container.jpg");
+///     if (!file.error)
+///         decode(file.data(), file.size());
+///
+/// Files under 16 KB are read into memory instead, which is cheaper than
+/// setting up their mapping; the view is the same. An empty file gives an
+/// empty view without error. Platforms without mmap() read every file.
+/// Modifying a mapped file changes the view, truncating it makes touching the
+/// lost pages fail.
+class MappedFile
+{
+public:
+    enum class Advice
+    {
+        normal,
+        sequential, // read once front to back: more read-ahead, pages dropped sooner.
+        random,     // no read-ahead.
+        willneed,   // start reading all of it now.
+    };
+
+    bool error;
+
+    MappedFile();
+    explicit MappedFile(const std::string& path, Advice advice = Advice::sequential);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+    std::string_view view() const
+    {
+        return { reinterpret_cast<const char*>(bytes), length };
+    }
+
+private:
+    void release();
+
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+    // Whether bytes was allocated by the fallback rather than mapped.
+    bool owned = false;
+};
+
+}
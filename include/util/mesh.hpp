@@ -0,0 +1,266 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <util/3dtypes.hpp>
+
+namespace util
+{
+
+/// How a C++ type maps to a vertex attribute. Specialize it for more types.
+template <typename T> struct AttributeTraits;
+
+template <> struct AttributeTraits<float>
+{
+    static constexpr GLint components = 1;
+    static constexpr GLenum type = GL_FLOAT;
+    static constexpr bool normalized = false;
+    static constexpr bool integer = false;
+};
+
+template <size_t N> struct AttributeTraits<float[N]>
+{
+    static constexpr GLint components = N;
+    static constexpr GLenum type = GL_FLOAT;
+    static constexpr bool normalized = false;
+    static constexpr bool integer = false;
+};
+
+template <> struct AttributeTraits<Vec3f> : AttributeTraits<float[3]>
+{
+};
+
+template <> struct AttributeTraits<Vec4f> : AttributeTraits<float[4]>
+{
+};
+
+// Colors as bytes, read as floats in [0, 1] by the shader.
+template <size_t N> struct AttributeTraits<uint8_t[N]>
+{
+    static constexpr GLint components = N;
+    static constexpr GLenum type = GL_UNSIGNED_BYTE;
+    static constexpr bool normalized = true;
+    static constexpr bool integer = false;
+};
+
+// Read as int/ivecN by the shader.
+template <size_t N> struct AttributeTraits<int32_t[N]>
+{
+    static constexpr GLint components = N;
+    static constexpr GLenum type = GL_INT;
+    static constexpr bool normalized = false;
+    static constexpr bool integer = true;
+};
+
+/// Compile time description of an interleaved vertex: attribute location ii
+/// is the ii-th type, tightly packed in that order. For example
+///
+///     struct ColoredVertex { float x, y, z, r, g, b; };
+///     using ColoredFormat = util::VertexFormat<util::Vec3f, util::Vec3f>;
+template <typename... Attributes> struct VertexFormat
+{
+    static constexpr GLuint count = sizeof...(Attributes);
+    static constexpr GLsizei stride = (sizeof(Attributes) + ...);
+
+    /// Points the attributes of the bound vertex array at the bound
+    /// GL_ARRAY_BUFFER and enables them.
+    static void setup()
+    {
+        GLuint location = 0;
+        size_t offset = 0;
+        (setup_attribute<Attributes>(location++, offset), ...);
+    }
+
+private:
+    template <typename T> static void setup_attribute(GLuint location, size_t& offset)
+    {
+        using traits = AttributeTraits<T>;
+        const void* pointer = reinterpret_cast<const void*>(offset);
+        if constexpr (traits::integer)
+        {
+            glVertexAttribIPointer(location, traits::components, traits::type, stride, pointer);
+        }
+        else
+        {
+            glVertexAttribPointer(location, traits::components, traits::type,
+                                  traits::normalized ? GL_TRUE : GL_FALSE, stride, pointer);
+        }
+        glEnableVertexAttribArray(location);
+        offset += sizeof(T);
+    }
+};
+
+/// Index data as given to a mesh, either 16 or 32 bit wide. 32 bit indices
+/// are narrowed to 16 bit when all of them fit.
+struct IndexData
+{
+    const void* data = nullptr;
+    size_t count = 0;
+    GLenum type = GL_UNSIGNED_INT;
+
+    IndexData() {}
+    IndexData(std::span<const uint16_t> indices)
+        : data{ indices.data() }
+        , count{ indices.size() }
+        , type{ GL_UNSIGNED_SHORT }
+    {
+    }
+    IndexData(std::span<const uint32_t> indices)
+        : data{ indices.data() }
+        , count{ indices.size() }
+        , type{ GL_UNSIGNED_INT }
+    {
+    }
+};
+
+/// Non-template part of Mesh: owns a vertex array with its own vertex buffer
+/// and, if indexed, index buffer.
+class MeshBase
+{
+public:
+    MeshBase(const MeshBase&) = delete;
+    MeshBase& operator=(const MeshBase&) = delete;
+    MeshBase(MeshBase&& other) noexcept;
+    MeshBase& operator=(MeshBase&& other) noexcept;
+    ~MeshBase();
+
+    // glDrawElements if the mesh has indices, glDrawArrays otherwise.
+    void draw(GLenum mode = GL_TRIANGLES) const;
+    void bind() const;
+
+    GLuint vertex_array() const { return vao; }
+    size_t vertex_count() const { return num_vertices; }
+    size_t index_count() const { return num_indices; }
+    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT; 0 if not indexed.
+    GLenum index_type() const { return indices_type; }
+
+protected:
+    MeshBase() {}
+    // Creates the buffers with the vertex array bound. setup_attributes is
+    // called while both are bound.
+    void create(const void* vertices, size_t vertex_count, GLsizei stride, const IndexData& indices,
+                void (*setup_attributes)());
+
+private:
+    void release();
+
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ibo = 0;
+    size_t num_vertices = 0;
+    size_t num_indices = 0;
+    GLenum indices_type = 0;
+};
+
+/// A vertex array with vertices in Format and optional indices, which are
+/// stored as uint16_t whenever possible. Move-only.
+///
+///     util::Mesh<ColoredFormat> mesh(std::span<const ColoredVertex>(vertices), indices);
+///     mesh.draw();
+template <typename Format> class Mesh : public MeshBase
+{
+public:
+    Mesh() {}
+
+    template <typename Vertex>
+    explicit Mesh(std::span<const Vertex> vertices, const IndexData& indices = IndexData{})
+    {
+        static_assert(sizeof(Vertex) == Format::stride, "Vertex does not match the format");
+        create(vertices.data(), vertices.size(), Format::stride, indices, &Format::setup);
+    }
+
+    // For vertices given as a flat float array or similar.
+    Mesh(const void* vertices, size_t vertex_count, const IndexData& indices = IndexData{})
+    {
+        create(vertices, vertex_count, Format::stride, indices, &Format::setup);
+    }
+};
+
+/// Location of a mesh inside a MeshPool.
+struct SubMesh
+{
+    GLint base_vertex = 0;
+    size_t vertex_count = 0;
+    // Byte offset into the index buffer, as passed to glDrawElements*.
+    size_t index_offset = 0;
+    size_t index_count = 0;
+    GLenum index_type = 0; // 0 if not indexed.
+};
+
+/// Non-template part of MeshPool.
+class MeshPoolBase
+{
+public:
+    MeshPoolBase(const MeshPoolBase&) = delete;
+    MeshPoolBase& operator=(const MeshPoolBase&) = delete;
+    ~MeshPoolBase();
+
+    // Binds the vertex array shared by all meshes of the pool. Needed once
+    // before drawing any number of them.
+    void bind() const;
+    // Draws mesh with glDrawElementsBaseVertex (glDrawArrays if not indexed).
+    // Expects the pool to be bound.
+    void draw(const SubMesh& mesh, GLenum mode = GL_TRIANGLES) const;
+
+    GLuint vertex_array() const { return vao; }
+    size_t vertices_used() const { return vertex_end; }
+    size_t index_bytes_used() const { return index_end; }
+
+protected:
+    MeshPoolBase(size_t max_vertices, size_t index_bytes, GLsizei stride,
+                 void (*setup_attributes)());
+    bool add(const void* vertices, size_t vertex_count, const IndexData& indices, SubMesh& mesh);
+
+private:
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ibo = 0;
+    GLsizei vertex_stride;
+    size_t vertex_capacity;
+    size_t index_capacity; // bytes.
+    size_t vertex_end = 0;
+    size_t index_end = 0; // bytes.
+};
+
+/// Many meshes of one vertex format sub-allocated from one vertex buffer and
+/// one index buffer that share a single vertex array, so switching between
+/// them is just different draw parameters:
+///
+///     util::MeshPool<ColoredFormat> pool(1 << 16, 1 << 20);
+///     util::SubMesh cube, pyramid;
+///     pool.add(cube_vertices, cube_indices, cube);
+///     ...
+///     pool.bind();
+///     pool.draw(cube);
+///     pool.draw(pyramid);
+///
+/// Indices are relative to the first vertex of their mesh, so each mesh picks
+/// its own index width. Space is reserved up front and never freed.
+template <typename Format> class MeshPool : public MeshPoolBase
+{
+public:
+    MeshPool(size_t max_vertices, size_t index_bytes)
+        : MeshPoolBase(max_vertices, index_bytes, Format::stride, &Format::setup)
+    {
+    }
+
+    // Returns false if the pool is full.
+    template <typename Vertex>
+    bool add(std::span<const Vertex> vertices, const IndexData& indices, SubMesh& mesh)
+    {
+        static_assert(sizeof(Vertex) == Format::stride, "Vertex does not match the format");
+        return MeshPoolBase::add(vertices.data(), vertices.size(), indices, mesh);
+    }
+
+    bool add(const void* vertices, size_t vertex_count, const IndexData& indices, SubMesh& mesh)
+    {
+        return MeshPoolBase::add(vertices, vertex_count, indices, mesh);
+    }
+};
+
+}
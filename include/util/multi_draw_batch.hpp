@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include <util/mesh.hpp>
+#include <glad/glad.h>
+
+namespace util
+{
+
+/// Non-template part of MultiDrawBatch.
+class MultiDrawBatchBase
+{
+public:
+    bool error;
+
+    MultiDrawBatchBase(const MultiDrawBatchBase&) = delete;
+    MultiDrawBatchBase& operator=(const MultiDrawBatchBase&) = delete;
+    ~MultiDrawBatchBase();
+
+    // Forgets the draws added so far, the buffers are kept.
+    void clear();
+    size_t size() const { return num_draws; }
+
+    // Issues every draw added since clear(). Expects the program reading the
+    // draw data to be in use.
+    void draw(GLenum mode = GL_TRIANGLES);
+
+    // GL draw calls made by the last draw(): one per index type in use.
+    size_t draw_calls() const { return last_draw_calls; }
+
+protected:
+    MultiDrawBatchBase(const MeshPoolBase& pool, GLuint draw_id_location, GLuint storage_binding,
+                       size_t data_size);
+    void add(const SubMesh& mesh, const void* draw_data);
+
+private:
+    // The layouts glMultiDraw*Indirect read.
+    struct ElementsCommand
+    {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+    struct ArraysCommand
+    {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first;
+        GLuint base_instance;
+    };
+
+    // Makes the draw id attribute cover count draws.
+    void reserve_draw_ids(size_t count);
+
+    const MeshPoolBase& pool;
+    GLuint draw_id_location;
+    GLuint storage_binding;
+    size_t data_size;
+
+    std::vector<ElementsCommand> commands16;
+    std::vector<ElementsCommand> commands32;
+    std::vector<ArraysCommand> array_commands;
+    std::vector<unsigned char> draw_data;
+    size_t num_draws = 0;
+    size_t last_draw_calls = 0;
+
+    GLuint indirect_buffer = 0;
+    GLuint storage_buffer = 0;
+    GLuint draw_id_buffer = 0;
+    size_t draw_id_capacity = 0;
+};
+
+/// Draws any number of meshes of a MeshPool with one glMultiDrawElementsIndirect
+/// call per index type (and one glMultiDrawArraysIndirect for meshes without
+/// indices), instead of one draw call per mesh. Each draw has its own
+/// DrawData, for example its world matrix and color:
+///
+///     struct CubeData { util::std140::mat4 world; util::std140::vec4 color; };
+///     util::MultiDrawBatch<CubeData> batch(pool, 3);
+///     ...
+///     batch.clear();
+///     for (const Cube& cube: cubes)
+///         batch.add(cube_mesh, CubeData{ cube.world, cube.color });
+///     shader.use();
+///     batch.draw();
+///
+/// The commands and the draw data are built on the CPU and uploaded by
+/// draw(). The data goes to a shader storage buffer at storage_binding, as
+/// an array in std430 layout indexed by draw: DrawData has to match it,
+/// which the std140 types of util/uniform_block.hpp do for vec4 and mat4.
+/// The vertex shader finds its element through an unsigned integer
+/// attribute at draw_id_location, which the batch adds to the vertex array
+/// of the pool: each command draws one instance with the index of the draw
+/// as its base instance, and the attribute advances once per instance.
+///
+///     layout(location = 3) in uint draw_id;
+///     struct CubeData { mat4 world; vec4 color; };
+///     layout(std430, row_major, binding = 0) readonly buffer Draws { CubeData draws[]; };
+///
+/// Needs GL 4.3 (error is set otherwise, see gl_ext::multi_draw_indirect_supported()).
+/// gl_DrawID would need GL 4.6 or ARB_shader_draw_parameters.
+template <typename DrawData> class MultiDrawBatch : public MultiDrawBatchBase
+{
+    static_assert(std::is_trivially_copyable_v<DrawData>, "DrawData is copied bytewise");
+
+public:
+    MultiDrawBatch(const MeshPoolBase& pool, GLuint draw_id_location, GLuint storage_binding = 0)
+        : MultiDrawBatchBase(pool, draw_id_location, storage_binding, sizeof(DrawData))
+    {
+    }
+
+    void add(const SubMesh& mesh, const DrawData& data) { MultiDrawBatchBase::add(mesh, &data); }
+};
+
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+namespace util
+{
+
+/// Records CPU and GPU times of frames and of named scopes within them and
+/// keeps the last history_size frames for rolling statistics:
+///
+///     util::FrameProfiler profiler;
+///     while (...)
+///     {
+///         profiler.begin_frame();
+///         {
+///             util::ProfileScope scope(&profiler, "draw");
+///             // draw...
+///         }
+///         profiler.end_frame();
+///         // swap buffers...
+///     }
+///     profiler.print_summary();
+///
+/// GPU times never block: the queries of a frame are read back up to
+/// gpu_latency frames later, when the driver reports them available. The frame
+/// and every scope are measured with a pair of GL_TIMESTAMP counters rather
+/// than GL_TIME_ELAPSED queries, since those can not nest (and llvmpipe gets
+/// the first GL_TIME_ELAPSED of a context wrong).
+///
+/// The per scope cost is two clock reads and, with GPU timing, two
+/// glQueryCounter calls, so the profiler can stay on in release builds.
+class FrameProfiler
+{
+public:
+    struct Summary
+    {
+        size_t count = 0; // frames with a sample.
+        double min = 0.0; // milliseconds.
+        double avg = 0.0;
+        double p99 = 0.0;
+    };
+
+    struct SeriesSummary
+    {
+        std::string name;
+        Summary cpu;
+        Summary gpu;
+    };
+
+    static constexpr size_t default_history_size = 1024;
+    // Frames in flight before GPU results are given up on.
+    static constexpr size_t gpu_latency = 4;
+
+    // GPU timing needs a current GL context (also during destruction) and is
+    // turned off if the driver lacks timer queries.
+    explicit FrameProfiler(bool gpu_timing = true, size_t history_size = default_history_size);
+    ~FrameProfiler();
+
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    void begin_frame();
+    void end_frame();
+
+    // Frames ended so far.
+    uint64_t frames() const { return frame_number - (in_frame ? 1 : 0); }
+    bool gpu_timing() const { return gpu_enabled; }
+    // GPU samples lost because their queries were still pending after
+    // gpu_latency frames.
+    size_t gpu_dropped() const { return dropped; }
+
+    // Waits for the GPU results of all ended frames. Blocks, so only for when
+    // profiling is over, before reporting.
+    void finish();
+
+    // Statistics over the recorded history. The first series is the frame.
+    std::vector<SeriesSummary> summaries() const;
+    void print_summary() const;
+
+    // Per frame history, one row per frame and a cpu/gpu column pair per
+    // series. Missing samples are left empty.
+    bool write_csv(const std::string& path) const;
+    // Counts of the caller written next to the frame count, name first.
+    using Counters = std::vector<std::pair<std::string, uint64_t>>;
+    // The summaries along with the frame count and counters.
+    bool write_json(const std::string& path, const Counters& counters = {}) const;
+
+private:
+    friend class ProfileScope;
+    using clock = std::chrono::steady_clock;
+
+    struct Series
+    {
+        const char* name;
+        std::vector<float> cpu; // ms, ring indexed by frame number.
+        std::vector<float> gpu;
+    };
+
+    struct GpuScope
+    {
+        size_t series;
+        GLuint begin_query;
+        GLuint end_query;
+    };
+
+    // GPU queries of one frame in flight.
+    struct GpuFrame
+    {
+        uint64_t frame = 0;
+        bool pending = false;
+        GLuint frame_begin = 0;
+        std::vector<GLuint> timestamps; // pool, grows on demand.
+        size_t timestamps_used = 0;
+        std::vector<GpuScope> scopes;
+    };
+
+    size_t series_index(const char* name);
+    size_t slot(uint64_t frame) const { return frame % history; }
+    void add_cpu(size_t series, clock::time_point start);
+    GLuint next_timestamp();
+    void collect_gpu();
+    bool read_gpu(GpuFrame& gf, bool wait);
+
+    bool gpu_enabled;
+    size_t history;
+    std::vector<Series> series;
+    uint64_t frame_number = 0;
+    bool in_frame = false;
+    clock::time_point frame_start;
+
+    GpuFrame gpu_frames[gpu_latency];
+    GpuFrame* current_gpu = nullptr;
+    size_t dropped = 0;
+};
+
+/// Times the enclosing block as the scope name of the current frame. Several
+/// scopes with the same name in one frame add up. A null profiler makes this
+/// a no-op, so it can stay in code that runs with profiling off. name must
+/// outlive the profiler (a string literal).
+class ProfileScope
+{
+public:
+    ProfileScope(FrameProfiler* profiler, const char* name);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    FrameProfiler* profiler;
+    uint64_t frame = 0;
+    size_t series = 0;
+    FrameProfiler::clock::time_point start;
+    GLuint begin_query = 0;
+};
+
+}
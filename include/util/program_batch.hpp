@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace util
+{
+
+class Shader;
+
+/// Builds many shader programs at once. The Shader constructors taking a
+/// batch only read the sources and issue the compile and link calls; the
+/// results are checked by poll() or finish(), so the driver can compile the
+/// programs in parallel (GL_KHR_parallel_shader_compile) while the caller
+/// issues the next ones or does other setup:
+///
+///     util::ProgramBatch batch;
+///     util::Shader shader("shaders/vertex.vert", "shaders/fragment.frag", batch);
+///     util::Shader other("shaders/other.vert", "shaders/fragment.frag", { &mvp }, batch);
+///     // ... load meshes and textures ...
+///     if (!batch.finish())
+///         return 1; // shader.error and other.error tell which one failed.
+///
+/// A Shader of a batch is unusable (error is set) until the batch finished it.
+class ProgramBatch
+{
+public:
+    struct Timing
+    {
+        std::string vertex_path;
+        std::string fragment_path;
+        // Reading the sources and issuing the compile and link calls.
+        double issue_ms = 0.0;
+        // From the end of the issue until poll() or finish() found the
+        // program done.
+        double ready_ms = 0.0;
+        // Checking the link, reflecting the uniforms and storing the binary.
+        double finish_ms = 0.0;
+        bool ok = false;
+    };
+
+    ProgramBatch() {}
+    // Finishes the programs still pending.
+    ~ProgramBatch();
+
+    ProgramBatch(const ProgramBatch&) = delete;
+    ProgramBatch& operator=(const ProgramBatch&) = delete;
+
+    // Finishes the programs the driver reports done, without waiting.
+    // Returns true when no program is pending anymore.
+    bool poll();
+
+    // Finishes all programs, waiting for the driver where needed. Returns
+    // true if every program of the batch built.
+    bool finish();
+
+    size_t pending() const { return entries.size(); }
+
+    // One entry per Shader constructed with this batch, in that order.
+    const std::vector<Timing>& timings() const { return program_timings; }
+    // Prints the timings and their sums to std::cout.
+    void print_report() const;
+
+private:
+    friend class Shader;
+    using clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        Shader* shader;
+        size_t timing;
+        clock::time_point issued;
+    };
+
+    // Called by the Shader constructors and destructor.
+    void add(Shader& shader, clock::time_point start, bool issued);
+    void remove(Shader& shader);
+
+    void complete(const Entry& entry);
+
+    std::vector<Entry> entries;
+    std::vector<Timing> program_timings;
+    bool all_ok = true;
+};
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <span>
+#include <string_view>
+
+#include <glad/glad.h>
+
+namespace util
+{
+
+/// On-disk cache of linked program binaries (glGetProgramBinary/glProgramBinary).
+///
+/// Entries are keyed by a hash of the shader sources and of the GL_VENDOR,
+/// GL_RENDERER and GL_VERSION strings, so a driver update produces new keys.
+/// The driver can still reject a binary (e.g. after an update that kept the
+/// version string); load() then deletes the entry and the caller compiles the
+/// sources as usual.
+///
+/// The cache lives in $UTIL_PROGRAM_CACHE_DIR (default ".program_cache" in the
+/// working directory) and can be turned off with UTIL_PROGRAM_CACHE=0.
+namespace program_cache
+{
+
+struct Stats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t rejected = 0; // binaries the driver refused to load.
+    size_t stored = 0;
+};
+
+/// True if the cache is enabled and the driver supports program binaries.
+/// Needs a current GL context. Note that Mesa reports no binary formats when
+/// its own shader cache is off (MESA_SHADER_CACHE_DISABLE).
+bool enabled();
+
+/// Overrides the UTIL_PROGRAM_CACHE environment variable.
+void set_enabled(bool on);
+
+const std::string& directory();
+
+/// Computes the key for a program made of the given shader sources.
+/// Needs a current GL context.
+uint64_t key(std::string_view vertex_source, std::string_view fragment_source);
+
+/// Same as key() of the concatenated pieces of each source.
+uint64_t key(std::span<const std::string_view> vertex_pieces,
+             std::span<const std::string_view> fragment_pieces);
+
+/// Creates a linked program from the cached binary for key. Returns 0 if
+/// there is no usable entry.
+GLuint load(uint64_t key);
+
+/// Stores the binary of the linked program under key. The program should
+/// have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+bool store(uint64_t key, GLuint program);
+
+/// Removes all cached binaries.
+void clear();
+
+const Stats& stats();
+
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace util
+{
+
+/// xoshiro128+ (Blackman and Vigna): 128 bits of state, a few adds, xors and
+/// shifts per 32 bit output. The low bits are weak, so floats are made from
+/// the top 24 bits only. Not for anything security related.
+class Xoshiro128
+{
+public:
+    // Expands seed into the state with splitmix64, as recommended by the authors.
+    explicit Xoshiro128(uint64_t seed = 0) { this->seed(seed); }
+
+    void seed(uint64_t seed);
+
+    uint32_t next()
+    {
+        const uint32_t result = s[0] + s[3];
+        const uint32_t t = s[1] << 9;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = (s[3] << 11) | (s[3] >> 21);
+        return result;
+    }
+
+    // Uniform in [0, 1).
+    float next_float() { return static_cast<float>(next() >> 8) * 0x1.0p-24f; }
+
+private:
+    uint32_t s[4];
+};
+
+/// Generator for batches: lanes independent xoshiro128+ streams whose outputs
+/// are interleaved (output ii comes from lane ii % lanes). That is exactly the
+/// layout of the SSE and AVX2 kernels, so fill() produces the same numbers
+/// whichever instruction set util::simd::active() selects.
+class XoshiroBatch
+{
+public:
+    static constexpr size_t lanes = 8;
+
+    explicit XoshiroBatch(uint64_t seed = 0) { this->seed(seed); }
+
+    void seed(uint64_t seed);
+
+    // Fills out with uniform floats in [0, 1).
+    void fill(std::span<float> out);
+
+private:
+    // Structure of arrays: s[ii][lane].
+    alignas(32) uint32_t s[4][lanes];
+};
+
+/// Seeds the generators of the calling thread. The generators of other
+/// threads are unaffected; worker threads that need reproducible numbers
+/// seed themselves, e.g. with seed + worker index.
+///
+/// Without a call, each thread is seeded on first use from a process wide
+/// seed (random unless the UTIL_RANDOM_SEED environment variable sets it)
+/// mixed with the order in which the threads first asked for numbers.
+void seed_random(uint64_t seed);
+
+/// Uniform floats in [0, 1) from the calling thread's batch generator.
+void fill_uniform(std::span<float> out);
+/// Uniform floats between lo and hi.
+void fill_uniform(std::span<float> out, float lo, float hi);
+
+/// The calling thread's generator for single numbers; random_float()
+/// (util/3dtypes.hpp) draws from it.
+Xoshiro128& thread_rng();
+
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <util/shader.hpp>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+namespace util
+{
+
+/// Collects the draws of a frame and issues them sorted so that draws sharing
+/// state follow each other:
+///
+///     util::RenderQueue queue;
+///     ...
+///     util::RenderQueue::Packet packet;
+///     packet.shader = &shader;
+///     packet.vertex_array = vao;
+///     packet.textures[0] = texture;
+///     packet.count = 6;
+///     queue.submit(packet).set_matrix4f(transform, model);
+///     ...
+///     queue.flush();
+///
+/// The sort key has the program in the highest bits, then the set of
+/// textures, the vertex array and the depth (front to back), so a program is
+/// bound once per frame, textures once per program and so on. Adjacent
+/// packets with the same state and uniform values are merged into one draw,
+/// or into one glMultiDraw* call if their ranges are not contiguous.
+///
+/// Sorting reorders draws, so blended draws, which depend on their order,
+/// belong in a queue of their own flushed after the opaque one. Uniforms set
+/// through a packet bypass the caches of the Uniform objects of its shader:
+/// set each uniform one way or the other.
+class RenderQueue
+{
+public:
+    static constexpr int max_textures = 4;
+
+    struct Packet
+    {
+        Shader* shader = nullptr;
+        GLuint vertex_array = 0;
+        // Texture of each unit, 0 leaves the unit as it is.
+        GLuint textures[max_textures] = {};
+        GLenum texture_target = GL_TEXTURE_2D;
+        GLenum mode = GL_TRIANGLES;
+        // glDrawElements with indices of this type, or glDrawArrays if 0.
+        GLenum index_type = GL_UNSIGNED_INT;
+        // First index (or vertex) and number of them.
+        GLint first = 0;
+        GLsizei count = 0;
+        // 0 (near) to 1 (far), orders draws with the same state front to back.
+        float depth = 0.0f;
+    };
+
+    /// The uniform values of the packet submitted last.
+    class Uniforms
+    {
+    public:
+        Uniforms& set_int(UniformHandle handle, int value);
+        Uniforms& set_float(UniformHandle handle, float value);
+        Uniforms& set_vec4(UniformHandle handle, const glm::vec4& value);
+        Uniforms& set_matrix4f(UniformHandle handle, const glm::mat4& value);
+
+    private:
+        friend class RenderQueue;
+        explicit Uniforms(RenderQueue& queue_)
+            : queue{ queue_ }
+        {
+        }
+        RenderQueue& queue;
+    };
+
+    struct Stats
+    {
+        size_t packets = 0;
+        size_t draw_calls = 0;
+        // GL state calls issued by flush(), see GLState::Stats.
+        size_t state_changes = 0;
+        size_t uniform_uploads = 0;
+        double sort_ms = 0.0;
+    };
+
+    RenderQueue()
+        : uniforms{ *this }
+    {
+    }
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    // Queues a draw. Set its uniforms through the returned object before
+    // submitting the next one.
+    Uniforms& submit(const Packet& packet);
+
+    // Sorts and issues the queued draws and empties the queue.
+    void flush();
+
+    // Of the last flush().
+    const Stats& stats() const { return frame_stats; }
+
+    // Sums over the flushes of all queues, for Context --profile.
+    static const Stats& total_stats() { return all_stats; }
+    static size_t total_flushes() { return num_flushes; }
+
+private:
+    enum class Kind : uint8_t
+    {
+        int1,
+        float1,
+        vec4,
+        mat4,
+    };
+
+    struct UniformValue
+    {
+        UniformHandle handle;
+        Kind kind;
+        int int_value;
+        float values[16];
+    };
+
+    struct Entry
+    {
+        Packet packet;
+        uint32_t first_uniform;
+        uint32_t num_uniforms;
+    };
+
+    UniformValue& add_uniform(UniformHandle handle, Kind kind);
+    uint64_t sort_key(const Packet& packet);
+    bool same_state(const Entry& aa, const Entry& bb) const;
+    bool same_uniforms(const Entry& aa, const Entry& bb) const;
+    void bind_state(const Entry& entry);
+    // Skips the values previous (drawn just before) left in the program.
+    void upload_uniforms(const Entry& entry, const Entry* previous);
+    // Adds the range of packet to the draw being merged.
+    void add_range(const Packet& packet);
+    void issue_merged(const Packet& packet);
+
+    std::vector<Entry> entries;
+    std::vector<UniformValue> uniform_values;
+    // Sort key and index into entries.
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    // Small ids of the programs, texture sets and vertex arrays of this frame,
+    // so they fit in the sort key.
+    std::unordered_map<GLuint, uint16_t> program_ids;
+    std::unordered_map<uint64_t, uint16_t> texture_ids;
+    std::unordered_map<GLuint, uint16_t> vertex_array_ids;
+    // Ranges of the draw being merged.
+    std::vector<GLsizei> merged_counts;
+    std::vector<const void*> merged_offsets;
+    std::vector<GLint> merged_firsts;
+    Uniforms uniforms;
+    Stats frame_stats;
+
+    static Stats all_stats;
+    static size_t num_flushes;
+};
+
+}
@@ -1,38 +1,150 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include <util/program_batch.hpp>
+#include <util/shader_source.hpp>
 #include <util/uniforms.hpp>
+#include <util/uniform_table.hpp>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
 namespace util
 {
 
+/// Precomputed reference to a uniform variable of a Shader, see Shader::uniform().
+/// Setting a uniform through a handle involves no string hashing or driver queries.
+struct UniformHandle
+{
+    int index = -1;
+};
+
 class Shader
 {
 public:
     unsigned int ID;
     bool error;
 
-    // constructor that reads and builds the shader program.
+    // constructor that reads and builds the shader program. The sources go
+    // through util::preprocess_shader(), so they can #include other files.
     Shader(const char* vertex_path, const char* fragment_path);
     Shader(const char* vertex_path, const char* fragment_path, const std::vector<Uniform*>& unifs);
+    // Builds the permutation of the sources selected by defines.
+    Shader(const char* vertex_path, const char* fragment_path, const ShaderDefines& defines,
+           const std::vector<Uniform*>& unifs = {});
+    // Only start building the program, batch finishes it (see util::ProgramBatch).
+    Shader(const char* vertex_path, const char* fragment_path, ProgramBatch& batch);
+    Shader(const char* vertex_path, const char* fragment_path, const std::vector<Uniform*>& unifs,
+           ProgramBatch& batch);
+    Shader(const char* vertex_path, const char* fragment_path, const ShaderDefines& defines,
+           ProgramBatch& batch);
     ~Shader();
-    // activate the shader program.
+
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
+    // activate the shader program (a no-op if it already is, see util::gl_state()).
     void use();
-    // functions to set values to uniform variables.
+    // functions to set values to uniform variables. These always call GL;
+    // the Uniform objects passed to the constructor skip unchanged values.
     void set_bool(const std::string& name, bool value) const;
     void set_int(const std::string& name, int value) const;
     void set_float(const std::string& name, float value) const;
     void set_vec4(const std::string& name, const glm::vec4& vec4) const;
     void set_matrix4f(const std::string& name, const glm::mat4& mat4) const;
 
+    // Returns a handle for the uniform variable name. Meant to be called once
+    // at setup, so that the render loop can use the set_* overloads below.
+    UniformHandle uniform(const std::string& name);
+    void set_bool(UniformHandle handle, bool value) const;
+    void set_int(UniformHandle handle, int value) const;
+    void set_float(UniformHandle handle, float value) const;
+    void set_vec4(UniformHandle handle, const glm::vec4& vec4) const;
+    void set_matrix4f(UniformHandle handle, const glm::mat4& mat4) const;
+
+    const std::string& vertex_path() const { return vertex_file; }
+    const std::string& fragment_path() const { return fragment_file; }
+    const ShaderDefines& defines() const { return permutation; }
+    // The files read by the last build, includes too.
+    std::vector<std::string> source_files() const;
+
+    // Hot reloading, usually driven by util::ShaderWatcher. begin_reload()
+    // reads the sources again and starts compiling and linking a new program
+    // without waiting for the driver. finish_reload() then makes it the
+    // program of this shader: ID changes, uniform locations (of handles and
+    // of the Uniform objects given to the constructor) are resolved again
+    // and the values of the uniforms are copied from the old program, which
+    // is deleted. If anything fails the old program stays and false is
+    // returned. A successful reload also clears error.
+    bool begin_reload();
+    bool reload_pending() const { return pending.program != 0; }
+    // Whether finish_reload() would not block. Always true without
+    // GL_KHR_parallel_shader_compile (or the ARB version).
+    bool reload_ready() const { return pending_ready(); }
+    bool finish_reload();
+    // begin_reload() and finish_reload().
+    bool reload();
+
+    // Whether the driver compiles and links in the background, so that
+    // GL_COMPLETION_STATUS_KHR can be polled.
+    static bool parallel_compile_supported();
+
 private:
-    static bool load_shader(const std::string& fname, std::string& buffer);
-    static bool compile_shader(const char* shader_path, GLenum shader_type, GLuint& shader_id);
-    bool build_program(GLuint vertex_shader, GLuint fragment_shader, const std::vector<Uniform*>* unifs);
+    friend class ProgramBatch;
+
+    Shader(const char* vertex_path, const char* fragment_path, const ShaderDefines& defines,
+           const std::vector<Uniform*>& unifs, ProgramBatch* batch);
+
+    // A program whose compilation and linking were started but not checked.
+    struct PendingProgram
+    {
+        GLuint program = 0;
+        GLuint vertex_shader = 0;
+        GLuint fragment_shader = 0;
+        uint64_t cache_key = 0;
+        bool from_cache = false;
+    };
+
+    std::string vertex_file;
+    std::string fragment_file;
+    ShaderDefines permutation;
+    // Files of the last build of each stage, see ShaderSource::files.
+    std::vector<std::string> vertex_files;
+    std::vector<std::string> fragment_files;
+    // The Uniform objects passed to the constructor, resolved again on reload.
+    std::vector<Uniform*> uniform_objects;
+    PendingProgram pending;
+    // The batch building this shader, if any.
+    ProgramBatch* batch = nullptr;
+
+    // Active uniforms of the program, reflected at link time.
+    mutable UniformTable uniforms;
+    // Locations of the uniforms handed out by uniform(), indexed by UniformHandle::index.
+    std::vector<GLint> handle_locations;
+    std::vector<std::string> handle_names;
+
+    GLint location(const std::string& name) const;
+    GLint location(UniformHandle handle) const
+    {
+        return handle.index < 0 ? UniformTable::inactive : handle_locations[handle.index];
+    }
+
+    bool build();
+    // Reads the sources and starts building pending.
+    bool start_program();
+    // Waits for pending and returns the linked program, or 0 after reporting
+    // the errors.
+    GLuint finish_program();
+    void discard_pending();
+    bool pending_ready() const;
+    // Called by the batch: finishes the pending program and sets error.
+    bool finish_build();
+    void report_compile_errors(GLuint shader_id, GLenum shader_type) const;
+    // Resolves uniforms and validates the linked program ID.
+    bool init_program();
+    void resolve_uniforms();
 };
 
 }
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <util/mapped_file.hpp>
+
+namespace util
+{
+
+/// The #defines of one permutation of a shader. The same set of defines has
+/// the same key() whatever order it was built in.
+class ShaderDefines
+{
+public:
+    ShaderDefines() {}
+    // Each name is defined as 1: ShaderDefines{ "INSTANCED", "ALPHA_TEST" }.
+    ShaderDefines(std::initializer_list<const char*> names);
+
+    ShaderDefines& define(const std::string& name, const std::string& value = "1");
+
+    // "NAME=VALUE;..." sorted by name; empty without defines.
+    std::string key() const;
+    bool empty() const { return values.empty(); }
+
+    const std::map<std::string, std::string>& entries() const { return values; }
+
+private:
+    std::map<std::string, std::string> values;
+};
+
+/// A preprocessed shader source, as the list of strings glShaderSource()
+/// takes. Most pieces point into the mapped files and the rest are the lines
+/// the preprocessor generated, so the source is never copied as a whole.
+/// Move-only: the pieces point into the object.
+struct ShaderSource
+{
+    std::vector<std::string_view> pieces;
+    // The files read, the main file first. The source string number of the
+    // #line directives in the pieces is the index of the file in this list.
+    std::vector<std::string> files;
+
+    // Total length of the pieces.
+    size_t size() const;
+    // The pieces concatenated, for printing.
+    std::string text() const;
+
+    std::vector<MappedFile> mappings;
+    // A deque never moves its elements, so views of them stay valid.
+    std::deque<std::string> generated;
+};
+
+/// Reads the shader at path into out.pieces with two additions to GLSL:
+///  - #include "file" is replaced by file, looked up relative to the
+///    directory of the file including it. Like with #pragma once, a file is
+///    only included the first time. The #include lines are expanded whether
+///    or not they sit in an #if block, since that is left to the compiler.
+///  - The defines are inserted after the first #version line of the shader,
+///    or before everything if it has none, so #ifdef blocks in the source
+///    select the permutation at compile time.
+/// #line directives keep the line numbers of compile errors those of the
+/// files. Returns false after reporting a file that cannot be read.
+bool preprocess_shader(const std::string& path, const ShaderDefines& defines, ShaderSource& out);
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <util/shader.hpp>
+
+namespace util
+{
+
+/// The permutations of one pair of shader sources, built on first use and
+/// cached by ShaderDefines::key(). The sources select what a permutation does
+/// with #ifdef, so each variant only contains its own code path instead of
+/// branching on a uniform for every vertex or fragment:
+///
+///     util::ShaderVariants textured("shaders/vertex.vert", "shaders/fragment.frag");
+///     util::Shader& plain = textured.get({});
+///     util::Shader& alpha_tested = textured.get({ "ALPHA_TEST" });
+///
+/// Uniform objects are bound to a single program, so variants are set through
+/// Shader::uniform() handles or the set_* functions taking names.
+class ShaderVariants
+{
+public:
+    ShaderVariants(const char* vertex_path, const char* fragment_path);
+
+    // Returns the variant for defines, building it the first time (to be
+    // finished by batch if given). Check its error flag.
+    Shader& get(const ShaderDefines& defines, ProgramBatch* batch = nullptr);
+
+    // Number of variants built so far.
+    size_t size() const { return variants.size(); }
+
+private:
+    std::string vertex_file;
+    std::string fragment_file;
+    std::unordered_map<std::string, std::unique_ptr<Shader>> variants;
+};
+
+}
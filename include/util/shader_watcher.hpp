@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <util/file_watcher.hpp>
+
+namespace util
+{
+
+class Shader;
+
+/// Reloads shaders whose source files change on disk, see Shader::reload().
+///
+/// A Context created with --watch-shaders (or UTIL_WATCH_SHADERS=1) owns
+/// one, makes it active() so that every Shader constructed afterwards adds
+/// itself, and calls poll() at the start of each frame. poll() only starts
+/// the rebuild of a changed shader; the new program replaces the old one in
+/// a later poll() once the driver reports it done, so with parallel shader
+/// compilation the frames in between do not wait for the compiler. Without
+/// it the first poll() after the change waits for the link.
+///
+/// Every reload prints the time from the save of the file (its modification
+/// time) to the new program replacing the old one.
+class ShaderWatcher
+{
+public:
+    struct Stats
+    {
+        size_t reloads = 0;
+        size_t failures = 0;
+        double last_latency_ms = 0.0;
+        double max_latency_ms = 0.0;
+    };
+
+    ShaderWatcher() {}
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    bool error() const { return files.error; }
+
+    void add(Shader& shader);
+    void remove(Shader& shader);
+
+    // Starts rebuilding shaders with changed sources and swaps in those that
+    // finished. Needs the GL context of the shaders to be current.
+    void poll();
+
+    const Stats& stats() const { return reload_stats; }
+
+    // The watcher new shaders add themselves to, or null.
+    static ShaderWatcher* active();
+    static void set_active(ShaderWatcher* watcher);
+
+private:
+    struct Entry
+    {
+        Shader* shader;
+        bool pending = false;
+        // Modification time of the oldest change not yet in use.
+        std::chrono::file_clock::time_point saved;
+    };
+
+    // Whether file (normalized) is one of the sources of shader.
+    static bool uses(const Shader& shader, const std::string& file);
+
+    FileWatcher files;
+    std::vector<Entry> entries;
+    Stats reload_stats;
+};
+
+}
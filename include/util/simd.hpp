@@ -0,0 +1,32 @@
+#pragma once
+
+namespace util
+{
+
+namespace simd
+{
+
+/// Instruction sets the math kernels in util/3dtypes.hpp can run on.
+enum class Isa
+{
+    scalar,
+    sse,
+    avx2,
+};
+
+/// Returns the best instruction set supported by both the build and the CPU.
+Isa detect();
+
+/// Returns the instruction set currently used by the math kernels.
+Isa active();
+
+/// Selects the instruction set used by the math kernels. Requests for an
+/// instruction set that is not available fall back to detect().
+/// Mainly useful for benchmarks comparing the scalar and SIMD code paths.
+void set_active(Isa isa);
+
+const char* name(Isa isa);
+
+}
+
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <util/3dtypes.hpp>
+
+namespace util
+{
+
+class ThreadPool;
+
+/// RGBA8 image sampled by SoftRasterizer, first row at the bottom like a GL
+/// texture.
+struct SoftTexture
+{
+    int width = 0;
+    int height = 0;
+    // width * height texels of 4 bytes.
+    std::vector<uint8_t> texels;
+    // GL_LINEAR or GL_NEAREST. There are no mipmaps.
+    bool linear = true;
+    // GL_REPEAT or GL_CLAMP_TO_EDGE.
+    bool repeat = true;
+};
+
+/// Renders triangles on the CPU into an in-memory framebuffer, for measuring
+/// the samples on machines without a GPU:
+///
+///     util::ThreadPool pool;
+///     util::SoftRasterizer raster(width, height, &pool);
+///     util::SoftRasterizer::VertexLayout layout;
+///     layout.stride = sizeof(ColoredVertex);
+///     layout.color = offsetof(ColoredVertex, r);
+///     util::SoftRasterizer::DrawState state;
+///     state.cull_face = util::SoftRasterizer::CullFace::back;
+///     state.front_face = util::SoftRasterizer::FrontFace::cw;
+///     raster.clear(0.2f, 0.3f, 0.3f, 1.0f);
+///     state.transform = view_projection * world;
+///     raster.draw(state, layout, vertices, num_verts, indices);
+///     raster.finish();
+///     save(raster.pixels());
+///
+/// It covers what the samples ask of GL: the position transformed by one
+/// matrix, a color and texture coordinates interpolated perspective
+/// correctly, texture(t, uv) * vec4(color, 1.0), back-face culling, the
+/// GL_LESS depth test and the top-left fill rule. Everything outside the clip
+/// volume is clipped.
+///
+/// draw() only records the draw; its vertices and indices must stay valid
+/// until finish(), which renders in three passes over the pool's workers and
+/// the calling thread: transforming the vertices, setting up and binning the
+/// triangles into 64x64 tiles, and rasterizing the tiles. The tiles start out
+/// split evenly between the threads, and a thread that is done with its own
+/// steals tiles from the others. Each tile tests the coverage of 8 pixels at
+/// a time on integer edge functions, 4 sub-pixel bits, with AVX2 or SSE
+/// following util::simd::active(). The kernels round alike, so the image is
+/// the same with every instruction set and number of threads as long as
+/// util is built with -ffp-contract=off, as CMakeLists.txt does for GCC and
+/// Clang. src/bench/soft_raster.cpp checks this on its two scenes.
+class SoftRasterizer
+{
+public:
+    static constexpr int tile_size = 64;
+    static constexpr int max_size = 8192;
+
+    enum class CullFace
+    {
+        none, // glDisable(GL_CULL_FACE)
+        front,
+        back,
+        front_and_back,
+    };
+
+    enum class FrontFace
+    {
+        ccw,
+        cw,
+    };
+
+    /// Byte offsets of the attributes in a vertex, as given to
+    /// glVertexAttribPointer. The position is 3 floats, the color 3 floats
+    /// and the texture coordinates 2 floats; a negative offset means the
+    /// vertex has no such attribute, which then reads as white or (0, 0).
+    struct VertexLayout
+    {
+        size_t stride = 3 * sizeof(float);
+        int position = 0;
+        int color = -1;
+        int tex_coord = -1;
+    };
+
+    struct DrawState
+    {
+        // Object to clip space.
+        Mat4x4f transform{ 1.0f, 0.0f, 0.0f, 0.0f, //
+                           0.0f, 1.0f, 0.0f, 0.0f, //
+                           0.0f, 0.0f, 1.0f, 0.0f, //
+                           0.0f, 0.0f, 0.0f, 1.0f };
+        CullFace cull_face = CullFace::none;
+        FrontFace front_face = FrontFace::ccw;
+        // GL_LESS, and depth writes, when true.
+        bool depth_test = false;
+        // Multiplies the color when set.
+        const SoftTexture* texture = nullptr;
+    };
+
+    struct Stats
+    {
+        size_t triangles = 0;
+        // Back facing or with no area.
+        size_t culled = 0;
+        // Fully outside the clip volume.
+        size_t clipped = 0;
+        // Set up and binned, including the parts of the clipped ones.
+        size_t rasterized = 0;
+        size_t fragments = 0;
+        // Tiles rasterized by another thread than the one they started on.
+        size_t tiles_stolen = 0;
+    };
+
+    bool error;
+
+    // width and height are 1 to max_size. Without a pool everything runs on
+    // the calling thread.
+    SoftRasterizer(int width, int height, ThreadPool* pool = nullptr);
+    ~SoftRasterizer();
+
+    SoftRasterizer(const SoftRasterizer&) = delete;
+    SoftRasterizer& operator=(const SoftRasterizer&) = delete;
+
+    // glClear of the color and depth buffers, applied by the next finish().
+    void clear(float r, float g, float b, float a, float depth = 1.0f);
+
+    // glDrawElements(GL_TRIANGLES) and glDrawArrays(GL_TRIANGLES).
+    void draw(const DrawState& state, const VertexLayout& layout, const void* vertices,
+              size_t vertex_count, std::span<const uint16_t> indices);
+    void draw(const DrawState& state, const VertexLayout& layout, const void* vertices,
+              size_t vertex_count, std::span<const uint32_t> indices);
+    void draw(const DrawState& state, const VertexLayout& layout, const void* vertices,
+              size_t vertex_count);
+
+    // Renders the draws recorded since the last call.
+    void finish();
+
+    int width() const { return fb_width; }
+    int height() const { return fb_height; }
+    // RGBA8 rows from the bottom, like glReadPixels(GL_RGBA, GL_UNSIGNED_BYTE).
+    const uint8_t* pixels() const { return image.data(); }
+    // Of the last finish().
+    const Stats& stats() const { return raster_stats; }
+
+private:
+    struct Draw;
+    struct Triangle;
+    struct Worker;
+    struct ClipVertex;
+    struct Kernels;
+
+    struct alignas(64) TileQueue
+    {
+        // First and one past the last tile of the queue, in the high and low
+        // 32 bits. The owner takes from the front, thieves from the back.
+        std::atomic<uint64_t> range{ 0 };
+    };
+
+    void add_draw(const DrawState& state, const VertexLayout& layout, const void* vertices,
+                  size_t vertex_count, const void* indices, size_t index_count, int index_size);
+
+    // The passes of finish(), run by each worker.
+    void transform_vertices(size_t worker);
+    void setup_triangles(size_t worker);
+    void rasterize_tiles(size_t worker, const Kernels& kernels);
+
+    void setup_triangle(Worker& worker, uint32_t draw, const uint32_t (&vertices)[3]);
+    void emit_triangle(Worker& worker, uint32_t draw, const ClipVertex& v0, const ClipVertex& v1,
+                       const ClipVertex& v2);
+    bool take_tile(size_t worker, int& tile, bool& stolen);
+    void rasterize(const Triangle& triangle, int tile, const Kernels& kernels, Stats& stats);
+    // Copies the tile to the image.
+    void resolve(int tile);
+
+    int fb_width;
+    int fb_height;
+    int tiles_x = 0;
+    int tiles_y = 0;
+    ThreadPool* pool;
+
+    std::vector<Draw> draws;
+    // Clip space position of every vertex of every draw, from Draw::first_vertex.
+    std::vector<Vec4f> clip_positions;
+    size_t total_vertices = 0;
+    size_t total_triangles = 0;
+
+    // tile_size * tile_size pixels per tile, tile after tile.
+    std::vector<uint32_t> tile_color;
+    std::vector<float> tile_depth;
+    bool clear_pending = false;
+    uint32_t clear_color = 0;
+    float clear_depth = 1.0f;
+
+    std::vector<Worker> workers;
+    std::vector<TileQueue> tile_queues;
+
+    std::vector<uint8_t> image;
+    Stats raster_stats;
+};
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+namespace util
+{
+
+/// A buffer for data written anew every frame: animated vertices, particles,
+/// per-instance matrices.
+///
+///     util::StreamBuffer stream(GL_ARRAY_BUFFER, 1 << 20);
+///     ...
+///     while (!context.should_close())
+///     {
+///         util::StreamBuffer::Slice slice = stream.allocate(bytes);
+///         std::memcpy(slice.data, particles.data(), bytes);
+///         stream.flush();
+///         // draw, reading the buffer from slice.offset
+///         stream.end_frame();
+///         context.end_frame();
+///     }
+///
+/// With GL 4.4 or ARB_buffer_storage the buffer holds `regions` regions of
+/// frame_bytes each, mapped once with GL_MAP_PERSISTENT_BIT and
+/// GL_MAP_COHERENT_BIT. A frame writes into its region while the GPU still
+/// reads the previous ones; end_frame() puts a fence after the frame's draws
+/// and the first allocate() of a frame waits for the fence of the region it
+/// reuses, which is counted as a stall if the GPU was not done with it.
+///
+/// Without buffer storage the buffer is one region that the first allocate()
+/// of each frame orphans (glBufferData with no data) and maps with
+/// glMapBufferRange, so the driver hands out fresh memory instead of
+/// waiting for the previous frame. flush() then unmaps it, which has to
+/// happen before drawing from it.
+class StreamBuffer
+{
+public:
+    struct Slice
+    {
+        // Where to write, null if the frame's region is full.
+        void* data = nullptr;
+        // Byte offset of data in the buffer, for the draw calls.
+        size_t offset = 0;
+    };
+
+    struct Stats
+    {
+        size_t frames = 0;
+        size_t bytes = 0;
+        // Frames whose first allocate() had to wait for the GPU, and for how long.
+        size_t stalls = 0;
+        double stall_ms = 0.0;
+        // Allocations that did not fit in the frame's region.
+        size_t overflows = 0;
+        // glBufferData calls of the fallback.
+        size_t orphans = 0;
+    };
+
+    static constexpr int max_regions = 4;
+
+    bool error;
+
+    // target is where the buffer is bound for uploads (GL_ARRAY_BUFFER,
+    // GL_UNIFORM_BUFFER, ...); frame_bytes is the most one frame allocates.
+    // regions (1 to max_regions) is the number of frames in flight on the
+    // persistent path. allow_persistent false forces the fallback.
+    StreamBuffer(GLenum target, size_t frame_bytes, int regions = 3,
+                 bool allow_persistent = true);
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // Returns bytes to write for this frame, aligned to alignment (a power of
+    // two) from the start of the buffer.
+    Slice allocate(size_t bytes, size_t alignment = 16);
+    // Makes what was written visible to GL. A no-op for persistent buffers.
+    void flush();
+    // Ends the frame: fences its region, the next allocate() uses the next one.
+    void end_frame();
+
+    GLuint id() const { return buffer; }
+    bool persistent() const { return mapped_base != nullptr; }
+    const Stats& stats() const { return stream_stats; }
+
+private:
+    // Waits until the GPU is done with the current region.
+    void wait_for_region();
+
+    GLenum target;
+    GLuint buffer = 0;
+    size_t region_bytes;
+    int num_regions;
+    int region = 0;
+    // Bytes allocated from the current region.
+    size_t used = 0;
+    bool frame_started = false;
+
+    // Persistent path.
+    unsigned char* mapped_base = nullptr;
+    GLsync fences[max_regions] = {};
+
+    // Fallback path: the mapping of the part being written.
+    unsigned char* mapped_range = nullptr;
+    size_t mapped_offset = 0;
+
+    Stats stream_stats;
+};
+
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include <util/thread_pool.hpp>
+
+namespace util
+{
+
+struct TextureOptions
+{
+    GLint wrap = GL_REPEAT; // for both S and T.
+    GLint min_filter = GL_LINEAR;
+    GLint mag_filter = GL_LINEAR;
+    bool mipmaps = true;
+    // OpenGL expects the first row at the bottom, images usually store it at the top.
+    bool flip_vertically = true;
+    // RGBA of the single texel the texture has until the image is uploaded.
+    uint8_t placeholder[4] = { 128, 128, 128, 255 };
+};
+
+/// A texture requested from a TextureLoader. id() is a valid texture right
+/// away: it shows the placeholder texel until the image has been decoded and
+/// uploaded, after which ready() is true. Copies refer to the same texture.
+class TextureHandle
+{
+public:
+    TextureHandle() {}
+
+    GLuint id() const { return state ? state->texture : 0; }
+    bool ready() const { return state && state->status == Status::ready; }
+    bool failed() const { return state && state->status == Status::failed; }
+    // Size of the image, 0 until ready.
+    int width() const { return state ? state->width : 0; }
+    int height() const { return state ? state->height : 0; }
+
+private:
+    friend class TextureLoader;
+
+    enum class Status
+    {
+        loading,
+        ready,
+        failed,
+    };
+
+    struct State
+    {
+        GLuint texture = 0;
+        Status status = Status::loading;
+        int width = 0;
+        int height = 0;
+        std::string path;
+        TextureOptions options;
+    };
+
+    explicit TextureHandle(std::shared_ptr<State> state_)
+        : state{ std::move(state_) }
+    {
+    }
+
+    std::shared_ptr<State> state;
+};
+
+/// Loads image files into 2D textures without blocking the render thread:
+///
+///     util::TextureLoader loader;
+///     const util::TextureHandle texture = loader.load("resources/textures/container.jpg");
+///     while (!context.should_close())
+///     {
+///         loader.poll();
+///         util::gl_state().bind_texture(0, GL_TEXTURE_2D, texture.id());
+///         ...
+///     }
+///
+/// Files are read and decoded (stb_image) on a thread pool. poll() uploads
+/// the decoded images through a pixel unpack buffer, so the driver copies the
+/// pixels to the texture asynchronously instead of from client memory inside
+/// glTexImage2D. It uploads at most upload_budget bytes per call (but at least
+/// one image) to bound the time taken out of a frame.
+///
+/// All member functions must be called on the thread of the GL context. The
+/// loader owns the textures and deletes them when destroyed, so it must not
+/// outlive the context.
+class TextureLoader
+{
+public:
+    static constexpr size_t default_upload_budget = size_t{ 16 } << 20;
+
+    // 0 threads means one per hardware thread.
+    explicit TextureLoader(size_t threads = 0, size_t upload_budget = default_upload_budget);
+    ~TextureLoader();
+
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+
+    TextureHandle load(const std::string& path, const TextureOptions& options = TextureOptions{});
+
+    // Uploads decoded images, returns how many textures became ready or failed.
+    size_t poll();
+    // Blocks until every requested texture is ready or failed.
+    void finish();
+
+    // Textures requested but not yet ready or failed.
+    size_t pending() const { return num_pending; }
+
+private:
+    struct Decoded
+    {
+        std::shared_ptr<TextureHandle::State> state;
+        // From stbi_load, null if the file could not be loaded.
+        unsigned char* pixels = nullptr;
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+    };
+
+    void decode(std::shared_ptr<TextureHandle::State> state);
+    // Moves up to upload_budget bytes of decoded images out of the queue.
+    std::vector<Decoded> take_decoded(bool wait);
+    void upload(const Decoded& image);
+
+    size_t upload_budget;
+    size_t num_pending = 0;
+    GLuint pixel_buffer = 0;
+    std::vector<GLuint> textures;
+
+    std::mutex mutex;
+    std::condition_variable decoded_available;
+    std::vector<Decoded> decoded;
+    std::atomic<bool> cancelled{ false };
+
+    // Last, so that it is destroyed (and its workers joined) first.
+    ThreadPool workers;
+};
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+
+/// Fixed set of worker threads running submitted tasks in FIFO order.
+///
+///     util::ThreadPool pool;
+///     pool.submit([] { decode(...); });
+///     pool.wait_idle();
+///
+/// Tasks must not touch GL: the context is only current on the thread that
+/// created it.
+class ThreadPool
+{
+public:
+    // 0 threads means one per hardware thread.
+    explicit ThreadPool(size_t threads = 0);
+    // Runs the tasks still queued, then joins the workers.
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    // Blocks until the queue is empty and no task is running, including
+    // tasks submitted by others; see TaskGroup to wait for some tasks only.
+    void wait_idle();
+
+    size_t size() const { return workers.size(); }
+
+private:
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable idle;
+    std::deque<std::function<void()>> tasks;
+    size_t running = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+/// Tasks run on a pool that are waited for on their own:
+///
+///     util::TaskGroup group(pool);
+///     for (...)
+///         group.submit([&] { cull(range); });
+///     group.wait();
+///
+/// Unrelated tasks of the pool are not waited for. wait() runs the tasks of
+/// the group that no worker has started yet on the calling thread, so it may
+/// be called from a task of the same pool without deadlocking.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool& pool);
+    // Waits for the tasks.
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void submit(std::function<void()> task);
+    // Blocks until every task submitted so far has run.
+    void wait();
+
+private:
+    // Shared with the tasks queued on the pool, which may run after wait()
+    // has returned and find nothing left to do.
+    struct State
+    {
+        std::mutex mutex;
+        std::condition_variable done;
+        std::deque<std::function<void()>> tasks;
+        // Queued and running tasks.
+        size_t pending = 0;
+
+        // Runs the next queued task, if any. Returns whether there was one.
+        bool run_next();
+    };
+
+    ThreadPool& pool;
+    std::shared_ptr<State> state;
+};
+
+}
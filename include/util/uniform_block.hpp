@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+
+#include <glad/glad.h>
+
+#include <util/3dtypes.hpp>
+
+namespace util
+{
+
+/// Member types for C++ mirrors of std140 uniform blocks. Their alignment is
+/// the std140 base alignment, so the compiler puts each member at the offset
+/// GL expects; scalars (float, int32_t, uint32_t) need no wrapper. There is
+/// no vec3: std140 packs a following scalar into its last four bytes, which
+/// a C++ type cannot express. Use vec4, or three floats and a scalar.
+namespace std140
+{
+
+struct alignas(8) vec2
+{
+    float x = 0.0f, y = 0.0f;
+};
+
+struct alignas(16) vec4
+{
+    float x = 0.0f, y = 0.0f, z = 0.0f, w = 0.0f;
+
+    vec4() {}
+    vec4(float x_, float y_, float z_, float w_)
+        : x{ x_ }
+        , y{ y_ }
+        , z{ z_ }
+        , w{ w_ }
+    {
+    }
+    vec4(const Vec4f& vv)
+        : vec4(vv.x, vv.y, vv.z, vv.w)
+    {
+    }
+};
+
+/// Row major like Mat4x4f, so declare the block layout(std140, row_major) in GLSL.
+struct alignas(16) mat4
+{
+    mat4x4f_t mat = {};
+
+    mat4() {}
+    mat4(const Mat4x4f& mm) { *this = mm; }
+    mat4& operator=(const Mat4x4f& mm)
+    {
+        for (int ii = 0; ii < 4; ++ii)
+            for (int jj = 0; jj < 4; ++jj)
+                mat[ii][jj] = mm.mat[ii][jj];
+        return *this;
+    }
+};
+
+static_assert(sizeof(vec2) == 8 && sizeof(vec4) == 16 && sizeof(mat4) == 64);
+
+}
+
+/// Checks at compile time that member of the C++ mirror of a uniform block is
+/// at the std140 offset of the GLSL member.
+#define UTIL_STD140_OFFSET(Block, member, offset)                                                \
+    static_assert(offsetof(Block, member) == (offset),                                           \
+                  #Block "::" #member " is not at std140 offset " #offset)
+
+/// Non-template part of UniformBlock.
+class UniformBlockBase
+{
+public:
+    bool error;
+
+    UniformBlockBase(const UniformBlockBase&) = delete;
+    UniformBlockBase& operator=(const UniformBlockBase&) = delete;
+    ~UniformBlockBase();
+
+    // Makes the block called name in program read from this buffer. Fails if
+    // program has no such block or if its size differs from the C++ struct,
+    // which usually means a member is missing or laid out differently.
+    bool attach(GLuint program) const;
+
+    GLuint binding() const { return binding_point; }
+    GLuint buffer() const { return ubo; }
+
+protected:
+    UniformBlockBase(const char* name, GLuint binding, size_t size);
+    void upload(const void* data, size_t size) const;
+
+private:
+    std::string block_name;
+    GLuint binding_point;
+    size_t block_size;
+    GLuint ubo = 0;
+};
+
+/// A uniform buffer with the contents of the struct T, bound to a fixed
+/// binding point. Every program that attach()es to it reads the same buffer,
+/// so data shared by many programs (the camera, lights, the time) is uploaded
+/// once per change instead of once per program:
+///
+///     // layout(std140, row_major) uniform Camera { mat4 view_projection; vec4 eye; };
+///     struct Camera
+///     {
+///         util::std140::mat4 view_projection;
+///         util::std140::vec4 eye;
+///     };
+///     UTIL_STD140_OFFSET(Camera, eye, 64);
+///
+///     util::UniformBlock<Camera> camera("Camera", 0);
+///     camera.attach(shader.ID);
+///     ...
+///     camera.data.view_projection = projection * view;
+///     camera.upload(); // once per frame, for all programs.
+///
+/// Binding points are global to the context: give each block its own.
+template <typename T> class UniformBlock : public UniformBlockBase
+{
+    static_assert(std::is_standard_layout_v<T> && std::is_trivially_copyable_v<T>,
+                  "A uniform block must be a plain struct");
+    static_assert(sizeof(T) % 16 == 0,
+                  "std140 rounds the block size up to a multiple of 16 bytes (pad the struct)");
+
+public:
+    T data{};
+
+    UniformBlock(const char* name, GLuint binding)
+        : UniformBlockBase(name, binding, sizeof(T))
+    {
+        upload();
+    }
+
+    // Copies data into the buffer.
+    void upload() const { UniformBlockBase::upload(&data, sizeof(T)); }
+};
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <glad/glad.h>
+
+namespace util
+{
+
+/// Flat open addressing hash table mapping uniform names to their locations in
+/// a linked program. It is filled once at link time from the active uniforms
+/// reported by glGetActiveUniform, so looking up a name never talks to the driver.
+class UniformTable
+{
+public:
+    /// Location stored for names that are not active in the program.
+    static constexpr GLint inactive = -1;
+
+    /// Replaces the contents with the active uniforms of program.
+    void reflect(GLuint program);
+
+    /// Returns a pointer to the location of name or nullptr if name is unknown.
+    const GLint* find(std::string_view name) const;
+
+    /// Adds (or updates) an entry. Used to remember the result of driver
+    /// queries for names not reported by glGetActiveUniform, like array elements.
+    void insert(std::string_view name, GLint location);
+
+    size_t size() const { return count; }
+
+    void clear();
+
+    /// Number of glGetUniformLocation() calls made by all tables and shaders.
+    /// Compare it before and after a frame to assert the frame did no lookups.
+    static size_t driver_queries() { return num_driver_queries; }
+
+    /// glGetUniformLocation() wrapper that updates driver_queries().
+    static GLint query_location(GLuint program, const char* name);
+
+private:
+    struct Slot
+    {
+        uint64_t hash = 0;
+        GLint location = inactive;
+        std::string name; // empty for free slots.
+    };
+
+    void grow();
+
+    std::vector<Slot> slots; // capacity is always zero or a power of two.
+    size_t count = 0;
+
+    static size_t num_driver_queries;
+};
+
+}
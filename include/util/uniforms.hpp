@@ -1,6 +1,8 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
 #include <string>
 
 #include <util/3dtypes.hpp>
@@ -8,8 +10,20 @@
 namespace util
 {
 
+/// A uniform variable of one program, see the Shader constructor taking a
+/// list of them. The subclasses keep the value last uploaded to the program
+/// and their set() only calls GL when the new value differs (compared
+/// bitwise), so setting an unchanged value every frame costs a memcmp.
+///
+/// Like glUniform*, set() acts on the program in use.
 struct Uniform
 {
+    struct Stats
+    {
+        size_t issued = 0;
+        size_t elided = 0;
+    };
+
     GLint program;
     GLint location;
     std::string name;
@@ -20,6 +34,23 @@ struct Uniform
         , name{name_}
     {
     }
+
+    // Makes the next set() upload, e.g. after the program was relinked.
+    // Shader does this when it resolves the location.
+    void invalidate() { uploaded = false; }
+
+    // Uploads issued and elided by all uniforms.
+    static const Stats& stats() { return upload_stats; }
+    static void reset_stats() { upload_stats = Stats{}; }
+
+protected:
+    // Returns true if value (size bytes) has to be uploaded, i.e. differs
+    // from last or nothing was uploaded yet, and then copies it to last.
+    bool changed(void* last, const void* value, size_t size);
+
+private:
+    bool uploaded = false;
+    static Stats upload_stats;
 };
 
 struct Uniform1f : public Uniform
@@ -27,12 +58,86 @@ struct Uniform1f : public Uniform
     float value;
 
     Uniform1f(const std::string& name_, float vv)
-        : value{ vv }
-        , Uniform(name_)
+        : Uniform(name_)
+        , value{ vv }
     {
     }
 
     void set(float vv);
+
+private:
+    float last = 0.0f;
+};
+
+/// int and bool uniforms.
+struct Uniform1i : public Uniform
+{
+    int value;
+
+    Uniform1i(const std::string& name_, int vv = 0)
+        : Uniform(name_)
+        , value{ vv }
+    {
+    }
+
+    void set(int vv);
+
+private:
+    int last = 0;
+};
+
+/// A sampler and the texture unit (0-based, not GL_TEXTURE0 + n) it reads.
+/// The unit rarely changes, so this mostly uploads once.
+struct UniformSampler : public Uniform1i
+{
+    UniformSampler(const std::string& name_, int unit = 0)
+        : Uniform1i(name_, unit)
+    {
+    }
+};
+
+struct Uniform2f : public Uniform
+{
+    Uniform2f(const std::string& name_)
+        : Uniform(name_)
+    {
+    }
+
+    void set(float x, float y);
+    void set(const glm::vec2& vv) { set(vv.x, vv.y); }
+
+private:
+    float last[2] = {};
+};
+
+struct Uniform3f : public Uniform
+{
+    Uniform3f(const std::string& name_)
+        : Uniform(name_)
+    {
+    }
+
+    void set(float x, float y, float z);
+    void set(const Vec3f& vv) { set(vv.x, vv.y, vv.z); }
+    void set(const glm::vec3& vv) { set(vv.x, vv.y, vv.z); }
+
+private:
+    float last[3] = {};
+};
+
+struct Uniform4f : public Uniform
+{
+    Uniform4f(const std::string& name_)
+        : Uniform(name_)
+    {
+    }
+
+    void set(float x, float y, float z, float w);
+    void set(const Vec4f& vv) { set(vv.x, vv.y, vv.z, vv.w); }
+    void set(const glm::vec4& vv) { set(vv.x, vv.y, vv.z, vv.w); }
+
+private:
+    float last[4] = {};
 };
 
 struct Matrix4f: public Uniform
@@ -42,15 +147,19 @@ struct Matrix4f: public Uniform
     {
     }
 
+    // Uploads the matrix returned by get() if it changed.
     void set();
     void set(const mat4x4f_t& mat_);
     void set(const Mat4x4f& mat_);
+    // Column major glm matrix, stored transposed.
+    void set(const glm::mat4& mat_);
 
     mat4x4f_t& get();
     float* get_ptr();
 
 private:
     mat4x4f_t mat;
+    mat4x4f_t last;
 };
 
 }
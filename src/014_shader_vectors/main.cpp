@@ -2,6 +2,8 @@
 // GLFW (include after glad)
 #include <GLFW/glfw3.h>
 
+#include <util/context.hpp>
+
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -11,44 +13,19 @@ static bool add_compile_shader(unsigned int shader_object_id, const char** shade
 
 static bool load_shader(const std::string& fname, std::string& buffer);
 
-int main()
+int main(int argc, char* argv[])
 {
-    GLFWwindow* window;
-
-    // Initialize GLFW.
-    if (!glfwInit())
-        return -1;
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
     constexpr int width{ 800 };
     constexpr int height{ 600 };
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(width, height, "Learn OpenGL", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window!" << std::endl;
-        glfwTerminate();
+    // Create a window (or a headless offscreen context, see util/context.hpp)
+    // and its OpenGL context.
+    util::Context context(argc, argv, width, height);
+    if (context.error)
         return -1;
-    }
-
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLAD.
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
-    {
-        std::cout << "Failed to Initialize GLAD\n";
-        glfwTerminate();
-        return -1;
-    }
 
     std::string buffer;
     if (!load_shader("shaders/vec.vert", buffer))
     {
-        glfwTerminate();
         return -1;
     }
     const char* shader_code = buffer.c_str();
@@ -59,13 +36,11 @@ int main()
     if (!add_compile_shader(vertex_shader, &shader_code, GL_VERTEX_SHADER))
     {
         // Compile failed. add_compile_shader will output the error.
-        glfwTerminate();
         return 1;
     }
 
     glDeleteShader(vertex_shader);
 
-    glfwTerminate();
     return 0;
 }
 
@@ -3,54 +3,28 @@
 // GLFW (include after glad)
 #include <GLFW/glfw3.h>
 
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+
 #include <iostream>
 #include <string>
 #include <fstream>
 
-static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
-static void process_input(GLFWwindow* window);
+static void process_input(util::Context& context);
 
 static bool add_compile_shader(unsigned int shader_object_id, const char** shader_source_string,
                                GLenum shader_type);
 static bool load_shader(const std::string& fname, std::string& buffer);
 
-int main()
+int main(int argc, char* argv[])
 {
-    GLFWwindow* window;
-
-    // Initialize GLFW.
-    if (!glfwInit())
-        return -1;
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
     constexpr int width{ 800 };
     constexpr int height{ 600 };
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(width, height, "Learn OpenGL", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window!" << std::endl;
-        glfwTerminate();
+    // Create a window (or a headless offscreen context, see util/context.hpp)
+    // and its OpenGL context.
+    util::Context context(argc, argv, width, height);
+    if (context.error)
         return -1;
-    }
-
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLAD.
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
-    {
-        std::cout << "Failed to Initialize GLAD\n";
-        glfwTerminate();
-        return -1;
-    }
-
-    glViewport(0, 0, width, height);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
 
     // Setup shaders and program.
     std::string vert_shader;
@@ -61,7 +35,6 @@ int main()
     if (!add_compile_shader(vertex_shader, &vertex_shader_source, GL_VERTEX_SHADER))
     {
         // Compile failed. add_compile_shader will output the error.
-        glfwTerminate();
         return 1;
     }
 
@@ -73,7 +46,6 @@ int main()
     if (!add_compile_shader(fragment_shader, &fragment_shader_source, GL_FRAGMENT_SHADER))
     {
         // Compile failed. add_compile_shader will output the error.
-        glfwTerminate();
         return 1;
     }
 
@@ -93,7 +65,6 @@ int main()
         std::cerr << "[ERROR] Program link failed!\n" << info_log << '\n';
         glDeleteShader(vertex_shader);
         glDeleteShader(fragment_shader);
-        glfwTerminate();
         return 1;
     }
 
@@ -142,10 +113,10 @@ int main()
     glCullFace(GL_BACK); // cull back face
     glFrontFace(GL_CCW); // GL_CW for clock-wise
 
-    while (!glfwWindowShouldClose(window))
+    while (!context.should_close())
     {
         // input
-        process_input(window);
+        process_input(context);
 
         // rendering commands here...
         // set clear color (state setter)
@@ -153,11 +124,11 @@ int main()
         // Clear the color buffer using the clear-color state set above.
         glClear(GL_COLOR_BUFFER_BIT);
 
-        glUseProgram(shader_program);
-        glBindVertexArray(vao);
+        util::gl_state().use_program(shader_program);
+        util::gl_state().bind_vertex_array(vao);
 
         // update uniform variable with time varying color.
-        double time_value = glfwGetTime();
+        double time_value = context.time();
         // make sure value varies between [0.0, 1.0].
         float green_value = static_cast<float>(std::sin(time_value) / 2.0 + 0.5);
         // Query for the location of the my_color uniform.
@@ -174,33 +145,25 @@ int main()
         // No need to unbind it every time.
         // glBindVertexArray(0);
 
-        // poll and process events
-        glfwPollEvents();
-        // swap buffers
-        glfwSwapBuffers(window);
+        // swap buffers and poll events
+        context.end_frame();
     }
 
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &points_vbo);
     glDeleteProgram(shader_program);
 
-    glfwTerminate();
     return 0;
 }
 
-void framebuffer_resize_callback(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height);
-}
-
 // We call this in the main loop.
-void process_input(GLFWwindow* window)
+void process_input(util::Context& context)
 {
     // Returns the last reported state of a keyboard key for the specified
     // window.
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (context.key_pressed(GLFW_KEY_ESCAPE))
     {
-        glfwSetWindowShouldClose(window, true);
+        context.close();
     }
 }
 
@@ -3,56 +3,29 @@
 // GLFW (include after glad)
 #include <GLFW/glfw3.h>
 
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+
 #include <iostream>
 
 #include <util/shader.hpp>
 
-static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
-static void process_input(GLFWwindow* window);
+static void process_input(util::Context& context);
 
-int main()
+int main(int argc, char* argv[])
 {
-    GLFWwindow* window;
-
-    // Initialize GLFW.
-    if (!glfwInit())
-        return -1;
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
     constexpr int width{ 800 };
     constexpr int height{ 600 };
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(width, height, "Learn OpenGL", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window!" << std::endl;
-        glfwTerminate();
+    // Create a window (or a headless offscreen context, see util/context.hpp)
+    // and its OpenGL context.
+    util::Context context(argc, argv, width, height);
+    if (context.error)
         return -1;
-    }
-
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLAD.
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
-    {
-        std::cout << "Failed to Initialize GLAD\n";
-        glfwTerminate();
-        return -1;
-    }
-
-    glViewport(0, 0, width, height);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
 
     // Setup shaders and program.
     util::Shader shader_program("shaders/vertex.vert", "shaders/fragment.frag");
     if (shader_program.error)
     {
-        glfwTerminate();
         return 1;
     }
 
@@ -100,10 +73,10 @@ int main()
     glCullFace(GL_BACK); // cull back face
     glFrontFace(GL_CW); // GL_CCW for clock-wise
 
-    while (!glfwWindowShouldClose(window))
+    while (!context.should_close())
     {
         // input
-        process_input(window);
+        process_input(context);
 
         // rendering commands here...
         // set clear color (state setter)
@@ -112,37 +85,29 @@ int main()
         glClear(GL_COLOR_BUFFER_BIT);
 
         shader_program.use();
-        glBindVertexArray(vao);
+        util::gl_state().bind_vertex_array(vao);
 
         glDrawArrays(GL_TRIANGLES, 0, 3);
         // No need to unbind it every time.
         // glBindVertexArray(0);
 
-        // poll and process events
-        glfwPollEvents();
-        // swap buffers
-        glfwSwapBuffers(window);
+        // swap buffers and poll events
+        context.end_frame();
     }
 
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &vbo);
 
-    glfwTerminate();
     return 0;
 }
 
-void framebuffer_resize_callback(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height);
-}
-
 // We call this in the main loop.
-void process_input(GLFWwindow* window)
+void process_input(util::Context& context)
 {
     // Returns the last reported state of a keyboard key for the specified
     // window.
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (context.key_pressed(GLFW_KEY_ESCAPE))
     {
-        glfwSetWindowShouldClose(window, true);
+        context.close();
     }
 }
@@ -3,56 +3,32 @@
 // GLFW (include after glad)
 #include <GLFW/glfw3.h>
 
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+
 #include <iostream>
 
 #include <util/shader.hpp>
 
-static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
-static void process_input(GLFWwindow* window);
+static void process_input(util::Context& context);
 
-int main()
+int main(int argc, char* argv[])
 {
-    GLFWwindow* window;
-
-    // Initialize GLFW.
-    if (!glfwInit())
-        return -1;
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
     constexpr int width{ 800 };
     constexpr int height{ 600 };
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(width, height, "Learn OpenGL", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window!" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLAD.
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
-    {
-        std::cout << "Failed to Initialize GLAD\n";
-        glfwTerminate();
+    // Create a window (or a headless offscreen context, see util/context.hpp)
+    // and its OpenGL context.
+    util::Context context(argc, argv, width, height);
+    if (context.error)
         return -1;
-    }
 
-    glViewport(0, 0, width, height);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+    util::Uniform1f x_offset_uniform("x_offset", 0.0f);
 
     // Setup shaders and program.
-    util::Shader shader_program("shaders/vertex.vert", "shaders/fragment.frag");
+    util::Shader shader_program("shaders/vertex.vert", "shaders/fragment.frag",
+                                { &x_offset_uniform });
     if (shader_program.error)
     {
-        glfwTerminate();
         return 1;
     }
 
@@ -104,10 +80,10 @@ int main()
     float sign = 1.0;
     float step = 0.01;
 
-    while (!glfwWindowShouldClose(window))
+    while (!context.should_close())
     {
         // input
-        process_input(window);
+        process_input(context);
 
         // rendering commands here...
         // set clear color (state setter)
@@ -116,8 +92,8 @@ int main()
         glClear(GL_COLOR_BUFFER_BIT);
 
         shader_program.use();
-        glBindVertexArray(vao);
-        shader_program.set_float("x_offset", x_offset);
+        util::gl_state().bind_vertex_array(vao);
+        x_offset_uniform.set(x_offset);
 
         glDrawArrays(GL_TRIANGLES, 0, 3);
         // Animate the triangle by moving it between the walls: x = -1.0 and x
@@ -129,31 +105,23 @@ int main()
 
         x_offset += (sign * step);
 
-        // poll and process events
-        glfwPollEvents();
-        // swap buffers
-        glfwSwapBuffers(window);
+        // swap buffers and poll events
+        context.end_frame();
     }
 
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &vbo);
 
-    glfwTerminate();
     return 0;
 }
 
-void framebuffer_resize_callback(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height);
-}
-
 // We call this in the main loop.
-void process_input(GLFWwindow* window)
+void process_input(util::Context& context)
 {
     // Returns the last reported state of a keyboard key for the specified
     // window.
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (context.key_pressed(GLFW_KEY_ESCAPE))
     {
-        glfwSetWindowShouldClose(window, true);
+        context.close();
     }
 }
@@ -3,58 +3,30 @@
 // GLFW (include after glad)
 #include <GLFW/glfw3.h>
 
-#include <stb_image.h>
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+#include <util/texture_loader.hpp>
 
 #include <iostream>
 
 #include <util/shader.hpp>
 
-static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
-static void process_input(GLFWwindow* window);
+static void process_input(util::Context& context);
 
-int main()
+int main(int argc, char* argv[])
 {
-    GLFWwindow* window;
-
-    // Initialize GLFW.
-    if (!glfwInit())
-        return -1;
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
     constexpr int width{ 800 };
     constexpr int height{ 600 };
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(width, height, "Learn OpenGL", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window!" << std::endl;
-        glfwTerminate();
+    // Create a window (or a headless offscreen context, see util/context.hpp)
+    // and its OpenGL context.
+    util::Context context(argc, argv, width, height);
+    if (context.error)
         return -1;
-    }
-
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLAD.
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
-    {
-        std::cout << "Failed to Initialize GLAD\n";
-        glfwTerminate();
-        return -1;
-    }
-
-    glViewport(0, 0, width, height);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
 
     // Setup shaders and program.
     util::Shader shader_program("shaders/vertex.vert", "shaders/fragment.frag");
     if (shader_program.error)
     {
-        glfwTerminate();
         return 1;
     }
 
@@ -127,37 +99,22 @@ int main()
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
 
-    // load and create a texture.
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    // set the texture wrapping parameters.
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // GL_REPEAT is the default.
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // set texture filtering parameters.
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load image, create texture, generate mipmaps.
-    int tex_width, tex_height, num_channels;
-    unsigned char* data
-        = stbi_load("resources/textures/container.jpg", &tex_width, &tex_height, &num_channels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex_width, tex_height, 0, GL_RGB, GL_UNSIGNED_BYTE,
-                     data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
-    {
-        std::cerr << "[ERROR] Failed to load the texture!\n";
-    }
-    stbi_image_free(data);
+    // load and create the texture. The image is decoded on a worker thread
+    // while the rest is set up and uploaded by poll() in the render loop; until
+    // then the texture shows a grey placeholder texel.
+    util::TextureLoader texture_loader;
+    util::TextureOptions texture_options;
+    texture_options.min_filter = GL_LINEAR_MIPMAP_LINEAR;
+    // keep the image upside down, as stored.
+    texture_options.flip_vertically = false;
+    const util::TextureHandle texture
+        = texture_loader.load("resources/textures/container.jpg", texture_options);
 
     // Optional: Unbind VAO and VBO.
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    util::gl_state().bind_texture(0, GL_TEXTURE_2D, 0);
 
     // Little optimization to skip the other side of the triangle.
     // We are drawing the triangle in counter clockwise dir.
@@ -165,10 +122,14 @@ int main()
     glCullFace(GL_BACK); // cull back face
     glFrontFace(GL_CCW); // GL_CW for clock-wise
 
-    while (!glfwWindowShouldClose(window))
+    // Headless runs render only a few frames, which should show the image.
+    if (context.headless())
+        texture_loader.finish();
+
+    while (!context.should_close())
     {
         // input
-        process_input(window);
+        process_input(context);
 
         // rendering commands here...
         // set clear color (state setter)
@@ -176,43 +137,37 @@ int main()
         // Clear the color buffer using the clear-color state set above.
         glClear(GL_COLOR_BUFFER_BIT);
 
+        // upload the images decoded since the last frame.
+        texture_loader.poll();
+
         // bind texture.
-        glBindTexture(GL_TEXTURE_2D, texture);
+        util::gl_state().bind_texture(0, GL_TEXTURE_2D, texture.id());
 
         shader_program.use();
-        glBindVertexArray(vao);
+        util::gl_state().bind_vertex_array(vao);
 
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
         // No need to unbind it every time.
         // glBindVertexArray(0);
 
-        // poll and process events
-        glfwPollEvents();
-        // swap buffers
-        glfwSwapBuffers(window);
+        // swap buffers and poll events
+        context.end_frame();
     }
 
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &vbo);
     glDeleteBuffers(1, &ebo);
-    glDeleteTextures(1, &texture);
 
-    glfwTerminate();
     return 0;
 }
 
-void framebuffer_resize_callback(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height);
-}
-
 // We call this in the main loop.
-void process_input(GLFWwindow* window)
+void process_input(util::Context& context)
 {
     // Returns the last reported state of a keyboard key for the specified
     // window.
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (context.key_pressed(GLFW_KEY_ESCAPE))
     {
-        glfwSetWindowShouldClose(window, true);
+        context.close();
     }
 }
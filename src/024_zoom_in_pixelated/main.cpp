@@ -3,58 +3,30 @@
 // GLFW (include after glad)
 #include <GLFW/glfw3.h>
 
-#include <stb_image.h>
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+#include <util/texture_loader.hpp>
 
 #include <iostream>
 
 #include <util/shader.hpp>
 
-static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
-static void process_input(GLFWwindow* window);
+static void process_input(util::Context& context);
 
-int main()
+int main(int argc, char* argv[])
 {
-    GLFWwindow* window;
-
-    // Initialize GLFW.
-    if (!glfwInit())
-        return -1;
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
     constexpr int width{ 800 };
     constexpr int height{ 600 };
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(width, height, "Learn OpenGL", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window!" << std::endl;
-        glfwTerminate();
+    // Create a window (or a headless offscreen context, see util/context.hpp)
+    // and its OpenGL context.
+    util::Context context(argc, argv, width, height);
+    if (context.error)
         return -1;
-    }
-
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLAD.
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
-    {
-        std::cout << "Failed to Initialize GLAD\n";
-        glfwTerminate();
-        return -1;
-    }
-
-    glViewport(0, 0, width, height);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
 
     // Setup shaders and program.
     util::Shader shader_program("shaders/vertex.vert", "shaders/fragment.frag");
     if (shader_program.error)
     {
-        glfwTerminate();
         return 1;
     }
 
@@ -129,53 +101,26 @@ int main()
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
 
-    // load and create a texture.
-    unsigned int texture[2];
-    glGenTextures(2, texture);
-    const char* images[2]
-        = { "resources/textures/container.jpg", "resources/textures/awesomeface.png" };
-
-    // OpenGL expects the 0.0 coordinate on the y-axis to be on the bottom side
-    // of the image, but images usually have 0.0 at the top of the y-axis.
-    stbi_set_flip_vertically_on_load(
-        true); // tell stb_image.h to flip loaded textures on the y-axis.
-    for (int i = 0; i < 2; ++i)
-    {
-        // activate the texture unit first before binding texture.
-        // Texture units are needed for using multiple textures at once.
-        glActiveTexture(GL_TEXTURE0 + i);
-        glBindTexture(GL_TEXTURE_2D, texture[i]);
-        // set the texture wrapping parameters.
-        int wrap_opt = (i == 0 ? GL_CLAMP_TO_EDGE : GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_opt); // GL_REPEAT is the default.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_opt);
-        // set texture filtering parameters.
-        // set texture filtering to nearest neighbor to clearly see the texels/pixels.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        // load image, create texture, generate mipmaps.
-        int tex_width, tex_height, num_channels;
-        unsigned char* data = stbi_load(images[i], &tex_width, &tex_height, &num_channels, 0);
-        if (data)
-        {
-            // note that the second image has transparency and thus an alpha channel, so make sure to tell OpenGL the data type is of GL_RGBA.
-            unsigned int image_pixel_fmt = (i == 0 ? GL_RGB : GL_RGBA);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex_width, tex_height, 0, image_pixel_fmt,
-                         GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-        }
-        else
-        {
-            std::cerr << "[ERROR] Failed to load the texture " << images[i] << '\n';
-        }
-        stbi_image_free(data);
-    }
+    // load and create the textures. The images are decoded on worker threads
+    // while the rest is set up and uploaded by poll() in the render loop; until
+    // then the textures show a grey placeholder texel.
+    util::TextureLoader texture_loader;
+    // set texture filtering to nearest neighbor to clearly see the texels/pixels.
+    util::TextureOptions pixelated;
+    pixelated.min_filter = GL_NEAREST;
+    pixelated.mag_filter = GL_NEAREST;
+    util::TextureOptions clamped = pixelated;
+    clamped.wrap = GL_CLAMP_TO_EDGE;
+    const util::TextureHandle texture[2] = {
+        texture_loader.load("resources/textures/container.jpg", clamped),
+        texture_loader.load("resources/textures/awesomeface.png", pixelated),
+    };
 
     // Optional: Unbind VAO and VBO.
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    util::gl_state().bind_texture(0, GL_TEXTURE_2D, 0);
 
     // Little optimization to skip the other side of the triangle.
     // We are drawing the triangle in counter clockwise dir.
@@ -188,10 +133,14 @@ int main()
     shader_program.set_int("texture0", 0);
     shader_program.set_int("texture1", 1);
 
-    while (!glfwWindowShouldClose(window))
+    // Headless runs render only a few frames, which should show the images.
+    if (context.headless())
+        texture_loader.finish();
+
+    while (!context.should_close())
     {
         // input
-        process_input(window);
+        process_input(context);
 
         // rendering commands here...
         // set clear color (state setter)
@@ -199,47 +148,40 @@ int main()
         // Clear the color buffer using the clear-color state set above.
         glClear(GL_COLOR_BUFFER_BIT);
 
+        // upload the images decoded since the last frame.
+        texture_loader.poll();
+
         // bind textures on corresponding texture units.
         for (int i = 0; i < 2; ++i)
         {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, texture[i]);
+            util::gl_state().bind_texture(i, GL_TEXTURE_2D, texture[i].id());
         }
 
         shader_program.use();
-        glBindVertexArray(vao);
+        util::gl_state().bind_vertex_array(vao);
 
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
         // No need to unbind it every time.
         // glBindVertexArray(0);
 
-        // poll and process events
-        glfwPollEvents();
-        // swap buffers
-        glfwSwapBuffers(window);
+        // swap buffers and poll events
+        context.end_frame();
     }
 
     glDeleteVertexArrays(1, &vao);
     glDeleteBuffers(1, &vbo);
     glDeleteBuffers(1, &ebo);
-    glDeleteTextures(2, texture);
 
-    glfwTerminate();
     return 0;
 }
 
-void framebuffer_resize_callback(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height);
-}
-
 // We call this in the main loop.
-void process_input(GLFWwindow* window)
+void process_input(util::Context& context)
 {
     // Returns the last reported state of a keyboard key for the specified
     // window.
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (context.key_pressed(GLFW_KEY_ESCAPE))
     {
-        glfwSetWindowShouldClose(window, true);
+        context.close();
     }
 }
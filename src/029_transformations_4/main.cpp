@@ -1,20 +1,41 @@
+// Draws a Sierpinski triangle made of textured triangles.
+//
+// By default every triangle is a separate draw call with its own transform
+// uniform, which is 3^depth draw calls for the smallest level alone. With
+// --instanced the centers and scales of all triangles are generated once and
+// drawn with a single glDrawArraysInstanced call.
+//
+// Options (besides those of util::Context):
+//   --depth N     recursion depth, 4 by default.
+//   --instanced   use the instanced path.
+//   --no-alpha-test  show translucent texels as they are instead of the
+//                 background color (the shader variant without ALPHA_TEST).
+//   --bench       time both paths at increasing depths (headless unless
+//                 --window is given) and exit.
+
+#include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <glad/glad.h>
 // GLFW (include after glad)
 #include <GLFW/glfw3.h>
 
-#include <stb_image.h>
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+#include <util/texture_loader.hpp>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <cstdio>
 #include <iostream>
+#include <vector>
 
-#include <util/shader.hpp>
+#include <util/shader_variants.hpp>
 
-static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
-static void process_input(GLFWwindow* window);
+static void process_input(util::Context& context);
 
 struct Point
 {
@@ -23,53 +44,65 @@ struct Point
 };
 const float root3 = std::sqrt(3.0f);
 
-static Point next_center(float minx, float maxx, float miny);
-static void draw_triangles(float scale, const Point& center, const unsigned int vao,
-                           util::Shader& shader_program);
-
-int main()
+// Attributes of one triangle of the instanced path: translation and uniform scale.
+struct Instance
 {
-    GLFWwindow* window;
-
-    // Initialize GLFW.
-    if (!glfwInit())
-        return -1;
+    float x;
+    float y;
+    float scale;
+};
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+struct Options
+{
+    int depth = 4; // the recursion used to stop at scale 1/16.
+    bool instanced = false;
+    bool alpha_test = true;
+    bool bench = false;
+};
 
+static Options parse_options(int argc, char* argv[]);
+static Point next_center(float minx, float maxx, float miny);
+static void sub_centers(float scale, const Point& center, Point (&sub)[3]);
+static void draw_triangles(float scale, const Point& center, int depth, const unsigned int vao,
+                           util::Shader& shader_program, util::UniformHandle transform);
+static void collect_triangles(float scale, const Point& center, int depth,
+                              std::vector<Instance>& instances);
+static void run_benchmark(util::Context& context, int max_depth, const Point& center,
+                          GLuint vao, util::Shader& shader_program,
+                          util::UniformHandle transform, GLuint instanced_vao,
+                          GLuint instance_vbo, util::Shader& instanced_program);
+
+int main(int argc, char* argv[])
+{
     constexpr int width{ 800 };
     constexpr int height{ 600 };
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(width, height, "Learn OpenGL", NULL, NULL);
-    if (!window)
+    const Options options = parse_options(argc, argv);
+    // Create a window (or a headless offscreen context, see util/context.hpp)
+    // and its OpenGL context.
+    util::ContextOptions context_options(width, height);
+    if (options.bench)
     {
-        std::cout << "Failed to create GLFW window!" << std::endl;
-        glfwTerminate();
-        return -1;
+        context_options.backend = util::Backend::headless;
     }
+    util::Context context(context_options.parse(argc, argv));
+    if (context.error)
+        return -1;
 
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLAD.
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
+    // Setup shaders and program: two variants of the same sources, with and
+    // without INSTANCED. Both are compiled together, so a driver with
+    // parallel shader compilation builds them at the same time.
+    util::ShaderVariants textured("shaders/vertex.vert", "shaders/fragment.frag");
+    util::ShaderDefines defines;
+    if (options.alpha_test)
     {
-        std::cout << "Failed to Initialize GLAD\n";
-        glfwTerminate();
-        return -1;
+        defines.define("ALPHA_TEST");
     }
-
-    glViewport(0, 0, width, height);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
-
-    // Setup shaders and program.
-    util::Shader shader_program("shaders/vertex.vert", "shaders/fragment.frag");
-    if (shader_program.error)
+    util::ProgramBatch programs;
+    util::Shader& shader_program = textured.get(defines, &programs);
+    util::Shader& instanced_program =
+        textured.get(util::ShaderDefines(defines).define("INSTANCED"), &programs);
+    if (!programs.finish())
     {
-        glfwTerminate();
         return 1;
     }
 
@@ -128,50 +161,44 @@ int main()
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
 
-    // load and create a texture.
-    unsigned int texture;
-    glGenTextures(1, &texture);
-    const char* images[2]
-        = { "resources/textures/container.jpg", "resources/textures/awesomeface.png" };
+    // The instanced path gets its own VAO: the same vertices plus one
+    // Instance per triangle, advanced once per instance (divisor 1).
+    std::vector<Instance> instances;
+    collect_triangles(1.0f, center, options.depth, instances);
 
-    // OpenGL expects the 0.0 coordinate on the y-axis to be on the bottom side
-    // of the image, but images usually have 0.0 at the top of the y-axis.
-    stbi_set_flip_vertically_on_load(
-        true); // tell stb_image.h to flip loaded textures on the y-axis.
-    {
-        // activate the texture unit first before binding texture.
-        // Texture units are needed for using multiple textures at once.
-        glActiveTexture(GL_TEXTURE0 + 0);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        // set the texture wrapping parameters.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S,
-                        GL_CLAMP_TO_BORDER); // GL_REPEAT is the default.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, glm::value_ptr(bgcolor));
-        // set texture filtering parameters.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // load image, create texture, generate mipmaps.
-        int tex_width, tex_height, num_channels;
-        unsigned char* data = stbi_load(images[1], &tex_width, &tex_height, &num_channels, 0);
-        if (data)
-        {
-            // note that the second image has transparency and thus an alpha channel, so make sure to tell OpenGL the data type is of GL_RGBA.
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex_width, tex_height, 0, GL_RGBA,
-                         GL_UNSIGNED_BYTE, data);
-            glGenerateMipmap(GL_TEXTURE_2D);
-        }
-        else
-        {
-            std::cerr << "[ERROR] Failed to load the texture " << images[1] << '\n';
-        }
-        stbi_image_free(data);
-    }
+    GLuint instanced_vao;
+    glGenVertexArrays(1, &instanced_vao);
+    glBindVertexArray(instanced_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0 /* offset */);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    GLuint instance_vbo{};
+    glGenBuffers(1, &instance_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(),
+                 GL_STATIC_DRAW);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)0);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    // load and create the texture. The image is decoded on a worker thread
+    // while the rest is set up and uploaded by poll() in the render loop; until
+    // then the texture shows a grey placeholder texel.
+    util::TextureLoader texture_loader;
+    util::TextureOptions texture_options;
+    texture_options.wrap = GL_CLAMP_TO_BORDER;
+    const util::TextureHandle texture
+        = texture_loader.load("resources/textures/awesomeface.png", texture_options);
+    util::gl_state().bind_texture(0, GL_TEXTURE_2D, texture.id());
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, glm::value_ptr(bgcolor));
 
     // Optional: Unbind VAO and VBO.
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    util::gl_state().bind_texture(0, GL_TEXTURE_2D, 0);
 
     // Little optimization to skip the other side of the triangle.
     // We are drawing the triangle in counter clockwise dir.
@@ -183,11 +210,28 @@ int main()
     shader_program.use(); // don't forget to activate/use the shader before setting uniforms!
     shader_program.set_int("texture0", 0);
     shader_program.set_vec4("bgcolor", bgcolor);
+    // Resolve the per-triangle uniform once instead of by name for every draw.
+    const util::UniformHandle transform = shader_program.uniform("transform");
+    instanced_program.use();
+    instanced_program.set_int("texture0", 0);
+    instanced_program.set_vec4("bgcolor", bgcolor);
+
+    // Headless runs render only a few frames, which should show the image.
+    if (context.headless())
+        texture_loader.finish();
+
+    if (options.bench)
+    {
+        util::gl_state().bind_texture(0, GL_TEXTURE_2D, texture.id());
+        run_benchmark(context, options.depth, center, vao, shader_program, transform,
+                      instanced_vao, instance_vbo, instanced_program);
+        context.close();
+    }
 
-    while (!glfwWindowShouldClose(window))
+    while (!context.should_close())
     {
         // input
-        process_input(window);
+        process_input(context);
 
         // rendering commands here...
         // set clear color (state setter)
@@ -195,74 +239,209 @@ int main()
         // Clear the color buffer using the clear-color state set above.
         glClear(GL_COLOR_BUFFER_BIT);
 
+        // upload the images decoded since the last frame.
+        texture_loader.poll();
+
         // bind textures on corresponding texture units.
         {
-            glActiveTexture(GL_TEXTURE0 + 0);
-            glBindTexture(GL_TEXTURE_2D, texture);
+            util::gl_state().bind_texture(0, GL_TEXTURE_2D, texture.id());
         }
 
-        draw_triangles(1.0f, center, vao, shader_program);
+        if (options.instanced)
+        {
+            instanced_program.use();
+            util::gl_state().bind_vertex_array(instanced_vao);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 3, static_cast<GLsizei>(instances.size()));
+        }
+        else
+        {
+            draw_triangles(1.0f, center, options.depth, vao, shader_program, transform);
+        }
 
-        // swap buffers
-        glfwSwapBuffers(window);
-        // poll and process events
-        glfwPollEvents();
+        // swap buffers and poll events
+        context.end_frame();
     }
 
     glDeleteVertexArrays(1, &vao);
+    glDeleteVertexArrays(1, &instanced_vao);
     glDeleteBuffers(1, &vbo);
-    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &instance_vbo);
 
-    glfwTerminate();
     return 0;
 }
 
+Options parse_options(int argc, char* argv[])
+{
+    Options options;
+    for (int ii = 1; ii < argc; ++ii)
+    {
+        if (std::strcmp(argv[ii], "--instanced") == 0)
+        {
+            options.instanced = true;
+        }
+        else if (std::strcmp(argv[ii], "--no-alpha-test") == 0)
+        {
+            options.alpha_test = false;
+        }
+        else if (std::strcmp(argv[ii], "--bench") == 0)
+        {
+            options.bench = true;
+        }
+        else if (std::strcmp(argv[ii], "--depth") == 0 && ii + 1 < argc)
+        {
+            options.depth = std::atoi(argv[++ii]);
+        }
+    }
+    if (options.bench && options.depth == Options{}.depth)
+    {
+        options.depth = 12;
+    }
+    return options;
+}
+
 Point next_center(float minx, float maxx, float miny)
 {
     float scale = maxx - minx;
     return Point{ minx + 0.5f * scale, miny + 0.5f * scale / root3 };
 }
 
-void draw_triangles(float scale, const Point& center, const unsigned int vao,
-                    util::Shader& shader_program)
+// Centers of the upper, left and right sub-triangles (of half the scale).
+void sub_centers(float scale, const Point& center, Point (&sub)[3])
+{
+    sub[0] = Point{ center.x, center.y + scale / root3 };
+    sub[1] = Point{ center.x - scale * 0.5f, center.y - scale / (2.0f * root3) };
+    sub[2] = Point{ center.x + scale * 0.5f, center.y - scale / (2.0f * root3) };
+}
+
+void draw_triangles(float scale, const Point& center, int depth, const unsigned int vao,
+                    util::Shader& shader_program, util::UniformHandle transform)
 {
     shader_program.use();
     // create transformations.
     glm::mat4 trans{ 1.0f }; // make sure to initialize matrix to identity matrix first.
     trans = glm::translate(trans, glm::vec3(center.x, center.y, 0.0f));
     trans = glm::scale(trans, glm::vec3(scale, scale, 1.0f));
-    shader_program.set_matrix4f("transform", trans);
+    shader_program.set_matrix4f(transform, trans);
 
-    glBindVertexArray(vao);
+    util::gl_state().bind_vertex_array(vao);
     glDrawArrays(GL_TRIANGLES, 0, 3);
 
-    if (scale <= 1.0f / 16.0)
+    if (depth <= 0)
     {
         return;
     }
 
-    // Upper
-    draw_triangles(scale * 0.5, Point{ center.x, center.y + scale / root3 }, vao, shader_program);
-    // Left
-    draw_triangles(scale * 0.5, Point{ center.x - scale * 0.5f, center.y - scale / (2.0f * root3) },
-                   vao, shader_program);
-    // Right
-    draw_triangles(scale * 0.5, Point{ center.x + scale * 0.5f, center.y - scale / (2.0f * root3) },
-                   vao, shader_program);
+    // Upper, left and right.
+    Point sub[3];
+    sub_centers(scale, center, sub);
+    for (const Point& sub_center: sub)
+    {
+        draw_triangles(scale * 0.5f, sub_center, depth - 1, vao, shader_program, transform);
+    }
 }
 
-void framebuffer_resize_callback(GLFWwindow* window, int width, int height)
+// Appends the triangles in the order draw_triangles() draws them, so the
+// overlapping edges come out the same.
+void collect_triangles(float scale, const Point& center, int depth,
+                       std::vector<Instance>& instances)
 {
-    glViewport(0, 0, width, height);
+    if (instances.empty())
+    {
+        // 3^0 + 3^1 + ... + 3^depth triangles.
+        size_t count = 0;
+        size_t level_count = 1;
+        for (int level = 0; level <= depth; ++level, level_count *= 3)
+        {
+            count += level_count;
+        }
+        instances.reserve(count);
+    }
+
+    instances.push_back(Instance{ center.x, center.y, scale });
+    if (depth <= 0)
+    {
+        return;
+    }
+
+    Point sub[3];
+    sub_centers(scale, center, sub);
+    for (const Point& sub_center: sub)
+    {
+        collect_triangles(scale * 0.5f, sub_center, depth - 1, instances);
+    }
+}
+
+// Average milliseconds per frame of draw, waiting for the GPU every frame.
+template <typename Draw> static double time_frames(util::Context& context, Draw&& draw)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr double min_seconds = 0.3;
+    constexpr int max_frames = 200;
+
+    // Warm up: first use of a program or buffer can be much slower.
+    draw();
+    glFinish();
+
+    int frames = 0;
+    const auto start = clock::now();
+    double elapsed = 0.0;
+    while (frames < max_frames && elapsed < min_seconds)
+    {
+        glClear(GL_COLOR_BUFFER_BIT);
+        draw();
+        glFinish();
+        context.end_frame();
+        ++frames;
+        elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    }
+    return elapsed * 1e3 / frames;
+}
+
+void run_benchmark(util::Context& context, int max_depth, const Point& center, GLuint vao,
+                   util::Shader& shader_program, util::UniformHandle transform,
+                   GLuint instanced_vao, GLuint instance_vbo, util::Shader& instanced_program)
+{
+    // One draw call per triangle gets too slow to be worth waiting for beyond this.
+    constexpr int max_per_draw_depth = 10;
+
+    std::printf("%5s %10s %16s %16s %10s\n", "depth", "triangles", "per draw ms", "instanced ms",
+                "speedup");
+    std::vector<Instance> instances;
+    for (int depth = 0; depth <= max_depth; depth += 2)
+    {
+        instances.clear();
+        collect_triangles(1.0f, center, depth, instances);
+        const GLsizei count = static_cast<GLsizei>(instances.size());
+        util::gl_state().bind_buffer(GL_ARRAY_BUFFER, instance_vbo);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(),
+                     GL_STATIC_DRAW);
+
+        const double instanced_ms = time_frames(context, [&]() {
+            instanced_program.use();
+            util::gl_state().bind_vertex_array(instanced_vao);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 3, count);
+        });
+
+        if (depth > max_per_draw_depth)
+        {
+            std::printf("%5d %10d %16s %16.3f %10s\n", depth, count, "-", instanced_ms, "-");
+            continue;
+        }
+        const double per_draw_ms = time_frames(context, [&]() {
+            draw_triangles(1.0f, center, depth, vao, shader_program, transform);
+        });
+        std::printf("%5d %10d %16.3f %16.3f %9.1fx\n", depth, count, per_draw_ms, instanced_ms,
+                    per_draw_ms / instanced_ms);
+    }
 }
 
 // We call this in the main loop.
-void process_input(GLFWwindow* window)
+void process_input(util::Context& context)
 {
     // Returns the last reported state of a keyboard key for the specified
     // window.
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (context.key_pressed(GLFW_KEY_ESCAPE))
     {
-        glfwSetWindowShouldClose(window, true);
+        context.close();
     }
 }
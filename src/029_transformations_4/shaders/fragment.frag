@@ -1,14 +1,23 @@
 #version 330 core
 
+// Permutations (see util::ShaderVariants):
+//   ALPHA_TEST  texels that are not fully opaque show bgcolor.
+
 in vec2 out_tex_coord; // interpolated tex coordinates from vertex shader.
 
 out vec4 frag_color;
 
 uniform sampler2D texture0;
+#ifdef ALPHA_TEST
 uniform vec4 bgcolor;
+#endif
 
 void main()
 {
     vec4 color = texture(texture0, out_tex_coord);
-    frag_color = color.w < 1.0f ? bgcolor : color; 
+#ifdef ALPHA_TEST
+    frag_color = color.w < 1.0f ? bgcolor : color;
+#else
+    frag_color = color;
+#endif
 }
@@ -1,14 +1,27 @@
 #version 330 core
 
+// Permutations (see util::ShaderVariants):
+//   INSTANCED  each instance is a triangle with its own center and scale
+//              instead of a transform uniform per draw call.
+
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec2 tex_coord;
+#ifdef INSTANCED
+// Per instance: xy is the center and z the scale of the triangle.
+layout (location = 2) in vec3 instance;
+#else
+uniform mat4 transform;
+#endif
 
 out vec2 out_tex_coord;
 
-uniform mat4 transform;
-
 void main()
 {
+#ifdef INSTANCED
+    // Same as transform, translate(center) * scale(scale, scale, 1).
+    gl_Position = vec4(pos.xy * instance.z + instance.xy, pos.z, 1.0);
+#else
     gl_Position = transform * vec4(pos, 1.0);
+#endif
     out_tex_coord = tex_coord;
 }
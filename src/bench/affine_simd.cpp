@@ -0,0 +1,285 @@
+// Micro benchmark of util::Affine3f against the Mat4x4f products it replaces:
+// composing world transformations, and the view projection matrix times the
+// world transformation of many instances. Every instruction set is checked
+// against the scalar code, and the Affine3f results against the Mat4x4f ones.
+//
+// The AVX2 kernels use fused multiply-add, so their results can differ from the
+// scalar ones in the last bit or two.
+
+#include <util/3dtypes.hpp>
+#include <util/random.hpp>
+#include <util/simd.hpp>
+
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t num_transforms = 4096;
+// Rotations, scales in [0.5, 2] and translations in [-10, 10], so products
+// have elements up to a few hundred.
+constexpr float max_abs_diff = 1e-3f;
+
+float random_signed() { return util::random_float() * 2.0f - 1.0f; }
+
+util::Affine3f random_affine()
+{
+    util::Affine3f scale, rotation, translation;
+    scale.init_scale_transform(0.5f + 1.5f * util::random_float(),
+                               0.5f + 1.5f * util::random_float(),
+                               0.5f + 1.5f * util::random_float());
+    rotation.init_rotate_transform(util::random_float() * 360.0f,
+                                   util::random_float() * 360.0f,
+                                   util::random_float() * 360.0f);
+    translation.init_translation_transform(10.0f * random_signed(), 10.0f * random_signed(),
+                                           10.0f * random_signed());
+    return translation * rotation * scale;
+}
+
+struct Inputs
+{
+    util::Affine3f lhs;
+    util::Mat4x4f mat_lhs;
+    util::Mat4x4f view_projection;
+    std::vector<util::Affine3f> affines;
+    std::vector<util::Mat4x4f> mats;
+};
+
+struct Outputs
+{
+    std::vector<util::Affine3f> products;
+    std::vector<util::Mat4x4f> projected;
+};
+
+void compute(const Inputs& in, Outputs& out)
+{
+    out.products.resize(num_transforms);
+    out.projected.resize(num_transforms);
+
+    util::multiply_batch(in.lhs, in.affines.data(), out.products.data(), num_transforms);
+    util::multiply_batch(in.view_projection, in.affines.data(), out.projected.data(),
+                         num_transforms);
+}
+
+bool compare(const char* what, const float* ref, const float* res, size_t count)
+{
+    float max_diff = 0.0f;
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        max_diff = std::max(max_diff, std::fabs(ref[ii] - res[ii]));
+    }
+    const bool ok = max_diff <= max_abs_diff;
+    std::cout << "  " << what << ": max abs diff = " << max_diff
+              << (ok ? "" : "  <-- MISMATCH") << '\n';
+    return ok;
+}
+
+bool verify(const char* isa, const Outputs& ref, const Outputs& res)
+{
+    std::cout << "Verifying " << isa << " against scalar:\n";
+    bool ok = compare("multiply_batch(Affine3f)", &ref.products[0].mat[0][0],
+                      &res.products[0].mat[0][0], num_transforms * 12);
+    ok &= compare("multiply_batch(Mat4x4f, Affine3f)", &ref.projected[0].mat[0][0],
+                  &res.projected[0].mat[0][0], num_transforms * 16);
+    return ok;
+}
+
+// The Affine3f results against the Mat4x4f ones they stand for.
+bool verify_against_matrices(const Inputs& in, const Outputs& out)
+{
+    std::cout << "Verifying Affine3f against Mat4x4f:\n";
+    std::vector<util::Mat4x4f> expected(num_transforms);
+    std::vector<util::Mat4x4f> result(num_transforms);
+
+    for (size_t ii = 0; ii < num_transforms; ++ii)
+    {
+        expected[ii] = in.mat_lhs * in.mats[ii];
+        result[ii] = out.products[ii].to_matrix();
+    }
+    bool ok = compare("Affine3f product", &expected[0].mat[0][0], &result[0].mat[0][0],
+                      num_transforms * 16);
+
+    util::multiply_batch(in.view_projection, in.mats.data(), expected.data(), num_transforms);
+    ok &= compare("Mat4x4f * Affine3f", &expected[0].mat[0][0], &out.projected[0].mat[0][0],
+                  num_transforms * 16);
+
+    // Both inverses against the identity; the rigid one on the rotation and
+    // translation part only.
+    const util::Affine3f identity(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+                                  1.0f, 0.0f);
+    std::vector<util::Affine3f> expected_identity(num_transforms, identity);
+    std::vector<util::Affine3f> inverse(num_transforms);
+    for (size_t ii = 0; ii < num_transforms; ++ii)
+    {
+        inverse[ii] = in.affines[ii] * in.affines[ii].inverse();
+    }
+    ok &= compare("inverse", &expected_identity[0].mat[0][0], &inverse[0].mat[0][0],
+                  num_transforms * 12);
+
+    for (size_t ii = 0; ii < num_transforms; ++ii)
+    {
+        util::Affine3f rigid;
+        rigid.init_rotate_transform(30.0f * ii, 7.0f * ii, 11.0f * ii);
+        rigid.mat[0][3] = random_signed();
+        rigid.mat[1][3] = random_signed();
+        rigid.mat[2][3] = random_signed();
+        inverse[ii] = rigid.inverse_rigid() * rigid;
+    }
+    ok &= compare("inverse_rigid", &expected_identity[0].mat[0][0], &inverse[0].mat[0][0],
+                  num_transforms * 12);
+
+    // Points and vectors against the 4x4 transform of (p, 1) and (v, 0).
+    const util::Affine3f& aa = in.affines[0];
+    const util::Mat4x4f mm = aa.to_matrix();
+    float max_diff = 0.0f;
+    for (size_t ii = 0; ii < num_transforms; ++ii)
+    {
+        const util::Vec3f p(random_signed(), random_signed(), random_signed());
+        const util::Vec4f homogeneous[2] = { util::Vec4f(p, 1.0f), util::Vec4f(p, 0.0f) };
+        util::Vec4f points[2];
+        util::transform_points(mm, homogeneous, points, 2);
+        const util::Vec3f tp = aa.transform_point(p);
+        const util::Vec3f tv = aa.transform_vector(p);
+        max_diff = std::max({ max_diff, std::fabs(tp.x - points[0].x),
+                              std::fabs(tp.y - points[0].y), std::fabs(tp.z - points[0].z),
+                              std::fabs(tv.x - points[1].x), std::fabs(tv.y - points[1].y),
+                              std::fabs(tv.z - points[1].z) });
+    }
+    std::cout << "  transform_point/vector: max abs diff = " << max_diff
+              << (max_diff <= max_abs_diff ? "" : "  <-- MISMATCH") << '\n';
+    ok &= max_diff <= max_abs_diff;
+    return ok;
+}
+
+void run_benchmarks(const char* isa, const Inputs& in, Outputs& out)
+{
+    const std::string prefix = std::string("BM_") + isa + "/";
+    const std::string suffix = "/" + std::to_string(num_transforms);
+    std::vector<util::Mat4x4f> matrices(num_transforms);
+
+    bench::run((prefix + "compose_Mat4x4f" + suffix).c_str(),
+               [&]() {
+                   util::multiply_batch(in.mat_lhs, in.mats.data(), matrices.data(),
+                                        num_transforms);
+                   bench::do_not_optimize(matrices);
+               },
+               num_transforms);
+
+    bench::run((prefix + "compose_Affine3f" + suffix).c_str(),
+               [&]() {
+                   util::multiply_batch(in.lhs, in.affines.data(), out.products.data(),
+                                        num_transforms);
+                   bench::do_not_optimize(out.products);
+               },
+               num_transforms);
+
+    bench::run((prefix + "project_Mat4x4f" + suffix).c_str(),
+               [&]() {
+                   util::multiply_batch(in.view_projection, in.mats.data(), matrices.data(),
+                                        num_transforms);
+                   bench::do_not_optimize(matrices);
+               },
+               num_transforms);
+
+    bench::run((prefix + "project_Affine3f" + suffix).c_str(),
+               [&]() {
+                   util::multiply_batch(in.view_projection, in.affines.data(),
+                                        out.projected.data(), num_transforms);
+                   bench::do_not_optimize(out.projected);
+               },
+               num_transforms);
+
+    bench::run((prefix + "inverse" + suffix).c_str(),
+               [&]() {
+                   for (size_t ii = 0; ii < num_transforms; ++ii)
+                   {
+                       out.products[ii] = in.affines[ii].inverse();
+                   }
+                   bench::do_not_optimize(out.products);
+               },
+               num_transforms);
+
+    bench::run((prefix + "inverse_rigid" + suffix).c_str(),
+               [&]() {
+                   for (size_t ii = 0; ii < num_transforms; ++ii)
+                   {
+                       out.products[ii] = in.affines[ii].inverse_rigid();
+                   }
+                   bench::do_not_optimize(out.products);
+               },
+               num_transforms);
+}
+
+}
+
+int main()
+{
+    // Same inputs on every run.
+    util::seed_random(1);
+
+    Inputs in;
+    in.lhs = random_affine();
+    in.mat_lhs = in.lhs.to_matrix();
+    // A perspective projection with the camera a bit back.
+    const util::Mat4x4f perspective(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.333f, 0.0f, 0.0f, 0.0f, 0.0f,
+                                    1.222f, -2.222f, 0.0f, 0.0f, 1.0f, 0.0f);
+    util::Mat4x4f camera;
+    camera.init_translation_transform(0.0f, -1.0f, 5.0f);
+    in.view_projection = perspective * camera;
+    in.affines.resize(num_transforms);
+    in.mats.resize(num_transforms);
+    for (size_t ii = 0; ii < num_transforms; ++ii)
+    {
+        in.affines[ii] = random_affine();
+        in.mats[ii] = in.affines[ii].to_matrix();
+    }
+    std::cout << "sizeof(Affine3f) = " << sizeof(util::Affine3f)
+              << ", sizeof(Mat4x4f) = " << sizeof(util::Mat4x4f) << "\n";
+
+    const util::simd::Isa best = util::simd::detect();
+    std::cout << "Best available instruction set: " << util::simd::name(best) << "\n";
+
+    Outputs reference;
+    util::simd::set_active(util::simd::Isa::scalar);
+    compute(in, reference);
+    bool ok = verify_against_matrices(in, reference);
+    std::cout << '\n';
+
+    const util::simd::Isa isas[] = { util::simd::Isa::scalar, util::simd::Isa::sse,
+                                     util::simd::Isa::avx2 };
+    for (util::simd::Isa isa: isas)
+    {
+        util::simd::set_active(isa);
+        if (util::simd::active() != isa)
+        {
+            std::cout << "Skipping " << util::simd::name(isa) << " (not available)\n";
+            continue;
+        }
+
+        Outputs out;
+        compute(in, out);
+        if (isa != util::simd::Isa::scalar)
+        {
+            ok &= verify(util::simd::name(isa), reference, out);
+        }
+
+        std::cout << '\n';
+        bench::print_header();
+        run_benchmarks(util::simd::name(isa), in, out);
+        std::cout << '\n';
+    }
+
+    util::simd::set_active(best);
+    if (!ok)
+    {
+        std::cerr << "[ERROR] Affine3f results differ from the reference!\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+// Minimal Google Benchmark style runner shared by the programs in src/bench.
+// Each benchmark body is run in batches of doubling size until it has run for
+// at least min_seconds and the time per iteration of the last batch is reported.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+
+namespace bench
+{
+
+struct Result
+{
+    double ns_per_iter;
+    size_t iterations;
+};
+
+/// Prevents the compiler from optimizing away the computation of value.
+template <typename T> inline void do_not_optimize(T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+inline void print_header()
+{
+    std::printf("%-48s %14s %12s %16s\n", "Benchmark", "Time", "Iterations", "Items/s");
+    for (int ii = 0; ii < 93; ++ii)
+    {
+        std::putchar('-');
+    }
+    std::putchar('\n');
+}
+
+/// Runs fn repeatedly and prints one result row. items_per_iter is the number
+/// of items (matrices, points, files, ...) processed by a single call of fn.
+template <typename Fn>
+Result run(const char* name, Fn&& fn, size_t items_per_iter = 1, double min_seconds = 0.5)
+{
+    using clock = std::chrono::steady_clock;
+    size_t iterations = 1;
+    double elapsed_ns = 0.0;
+    while (true)
+    {
+        const auto start = clock::now();
+        for (size_t ii = 0; ii < iterations; ++ii)
+        {
+            fn();
+        }
+        elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        if (elapsed_ns >= min_seconds * 1e9 || iterations >= (size_t{ 1 } << 40))
+        {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    const double ns_per_iter = elapsed_ns / static_cast<double>(iterations);
+    const double items_per_second = items_per_iter * 1e9 / ns_per_iter;
+    std::printf("%-48s %11.1f ns %12zu %16.4g\n", name, ns_per_iter, iterations, items_per_second);
+    return Result{ ns_per_iter, iterations };
+}
+
+}
@@ -0,0 +1,244 @@
+// Micro benchmark of reading whole files the ways this repository has: the
+// istreambuf_iterator copy Shader used for its sources, an ifstream rdbuf()
+// into an ostringstream, fread() into a buffer of the file size and
+// util::MappedFile. Every way is followed by the same checksum pass over the
+// bytes, since a mapping only reads a page when it is first touched.
+//
+// Runs on many small files, like shader sources, and on a few large ones,
+// like textures, written to .file_bench/ in the working directory and
+// removed afterwards. They stay in the page cache, so this measures the
+// copies and system calls rather than the disk.
+//
+// Then read() into a buffer and mmap() are compared on their own over a range
+// of file sizes: MappedFile reads files below min_mapped_size
+// (src/util/mapped_file.cpp) and maps the rest, and that threshold is where
+// mapping starts to win here.
+
+#include <util/mapped_file.hpp>
+#include <util/shader_source.hpp>
+
+#include "bench.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+const fs::path bench_dir = ".file_bench";
+
+constexpr size_t num_small = 1000;
+constexpr size_t small_size = 2 * 1024;
+constexpr size_t num_large = 4;
+constexpr size_t large_size = 16 * 1024 * 1024;
+// Files per size of the read()/mmap() comparison.
+constexpr size_t num_sized = 64;
+constexpr size_t sizes[] = { 1024,       4 * 1024,   8 * 1024,   16 * 1024,
+                             64 * 1024, 256 * 1024, 1024 * 1024 };
+
+uint64_t checksum(std::string_view data)
+{
+    uint64_t sum = 0;
+    for (char cc: data)
+        sum += static_cast<unsigned char>(cc);
+    return sum;
+}
+
+// Files of GLSL-looking lines, so the preprocessor has lines to scan.
+std::vector<std::string> write_files(const std::string& prefix, size_t count, size_t size)
+{
+    std::string contents = "#version 330 core\n";
+    for (size_t line = 0; contents.size() < size; ++line)
+        contents += "    vec4 v" + std::to_string(line) + " = texture(tex, uv) * color;\n";
+    contents.resize(size);
+    contents.back() = '\n';
+
+    std::vector<std::string> paths;
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        const std::string path = (bench_dir / (prefix + std::to_string(ii) + ".glsl")).string();
+        std::ofstream(path, std::ios::binary) << contents;
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+uint64_t read_istreambuf_iterator(const std::string& path)
+{
+    std::ifstream fin(path);
+    const std::string contents((std::istreambuf_iterator<char>(fin)),
+                               std::istreambuf_iterator<char>());
+    return checksum(contents);
+}
+
+uint64_t read_rdbuf(const std::string& path)
+{
+    std::ifstream fin(path, std::ios::binary);
+    std::ostringstream contents;
+    contents << fin.rdbuf();
+    return checksum(contents.str());
+}
+
+uint64_t read_fread(const std::string& path)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return 0;
+    std::fseek(file, 0, SEEK_END);
+    std::string contents(static_cast<size_t>(std::ftell(file)), '\0');
+    std::fseek(file, 0, SEEK_SET);
+    const size_t got = std::fread(contents.data(), 1, contents.size(), file);
+    std::fclose(file);
+    return checksum(std::string_view(contents).substr(0, got));
+}
+
+uint64_t read_mapped(const std::string& path)
+{
+    const util::MappedFile file(path);
+    return checksum(file.view());
+}
+
+// The two ways MappedFile reads a file, without its size threshold.
+uint64_t read_posix(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+        return 0;
+    std::vector<char> buffer(static_cast<size_t>(info.st_size));
+    size_t got = 0;
+    while (got < buffer.size())
+    {
+        const ssize_t nn = read(fd, buffer.data() + got, buffer.size() - got);
+        if (nn <= 0)
+            break;
+        got += static_cast<size_t>(nn);
+    }
+    close(fd);
+    return checksum(std::string_view(buffer.data(), got));
+}
+
+uint64_t read_mmap(const std::string& path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0)
+        return 0;
+    const size_t size = static_cast<size_t>(info.st_size);
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return 0;
+    madvise(addr, size, MADV_SEQUENTIAL);
+    const uint64_t sum = checksum(std::string_view(static_cast<const char*>(addr), size));
+    munmap(addr, size);
+    return sum;
+}
+
+template <typename Read>
+void run(const char* name, const std::vector<std::string>& paths, Read read, uint64_t expected,
+         bool& ok)
+{
+    uint64_t sum = 0;
+    for (const std::string& path: paths)
+        sum += read(path);
+    if (sum != expected)
+    {
+        std::cout << "  " << name << " read different bytes  <-- MISMATCH\n";
+        ok = false;
+    }
+
+    bench::run(
+        name,
+        [&]() {
+            uint64_t total = 0;
+            for (const std::string& path: paths)
+                total += read(path);
+            bench::do_not_optimize(total);
+        },
+        paths.size());
+}
+
+void run_all(const std::string& set, const std::vector<std::string>& paths, bool& ok)
+{
+    uint64_t expected = 0;
+    for (const std::string& path: paths)
+        expected += read_fread(path);
+
+    run(("BM_istreambuf_iterator" + set).c_str(), paths, read_istreambuf_iterator, expected, ok);
+    run(("BM_rdbuf_ostringstream" + set).c_str(), paths, read_rdbuf, expected, ok);
+    run(("BM_fread" + set).c_str(), paths, read_fread, expected, ok);
+    run(("BM_MappedFile" + set).c_str(), paths, read_mapped, expected, ok);
+}
+
+}
+
+int main()
+{
+    std::error_code ec;
+    fs::create_directories(bench_dir, ec);
+    if (ec)
+    {
+        std::cerr << "[ERROR] Cannot create " << bench_dir << '\n';
+        return 1;
+    }
+    const std::vector<std::string> small = write_files("small", num_small, small_size);
+    const std::vector<std::string> large = write_files("large", num_large, large_size);
+
+    std::cout << num_small << " small files of " << small_size << " bytes, " << num_large
+              << " large files of " << large_size / (1024 * 1024) << " MB. Items are files.\n\n";
+    bench::print_header();
+
+    bool ok = true;
+    run_all("/small", small, ok);
+    run_all("/large", large, ok);
+
+    for (size_t size: sizes)
+    {
+        const std::string set = "/" + std::to_string(size / 1024) + "KB";
+        const std::vector<std::string> paths =
+            write_files("sized" + set.substr(1), num_sized, size);
+        uint64_t expected = 0;
+        for (const std::string& path: paths)
+            expected += read_fread(path);
+        run(("BM_read" + set).c_str(), paths, read_posix, expected, ok);
+        run(("BM_mmap" + set).c_str(), paths, read_mmap, expected, ok);
+    }
+
+    // What Shader does with each source: the preprocessor maps the file and
+    // hands out views of it.
+    util::ShaderSource source;
+    bench::run(
+        "BM_preprocess_shader/small",
+        [&]() {
+            for (const std::string& path: small)
+            {
+                util::preprocess_shader(path, {}, source);
+                bench::do_not_optimize(source);
+            }
+        },
+        small.size());
+
+    fs::remove_all(bench_dir, ec);
+    if (!ok)
+    {
+        std::cerr << "[ERROR] The ways of reading a file disagree!\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,193 @@
+// Benchmark of util::cull: frustum culling of 10k, 100k and 1M objects
+// scattered around a camera, as axis aligned boxes and as spheres, with the
+// scalar, SSE and AVX2 kernels and with the partitioned mode on 1 to N
+// threads. Checks that every kernel finds the objects the scalar one does.
+//
+// The SIMD kernels may round differently (fused multiply-add), so an object
+// touching a plane within rounding could flip; such differences are reported
+// but only more than a handful counts as a mismatch.
+
+#include <util/3dtypes.hpp>
+#include <util/frustum.hpp>
+#include <util/random.hpp>
+#include <util/simd.hpp>
+#include <util/thread_pool.hpp>
+
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t counts[] = { 10000, 100000, 1000000 };
+// Objects are spread over a cube of this half size around the camera.
+constexpr float scene_size = 100.0f;
+constexpr size_t max_differences = 4;
+
+struct Scene
+{
+    util::BoxBounds boxes;
+    util::SphereBounds spheres;
+};
+
+float random_signed() { return util::random_float() * 2.0f - 1.0f; }
+
+Scene make_scene(size_t count)
+{
+    Scene scene;
+    scene.boxes.reserve(count);
+    scene.spheres.reserve(count);
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        const util::Vec3f center(scene_size * random_signed(), scene_size * random_signed(),
+                                 scene_size * random_signed());
+        const util::Vec3f extent(0.5f + 1.5f * util::random_float(),
+                                 0.5f + 1.5f * util::random_float(),
+                                 0.5f + 1.5f * util::random_float());
+        util::Vec3f min = center;
+        min -= extent;
+        util::Vec3f max = center;
+        max += extent;
+        scene.boxes.add(min, max);
+        scene.spheres.add(center, std::sqrt(extent.dot(extent)));
+    }
+    return scene;
+}
+
+// Camera at the origin looking down -z and turned a bit, with a 60 degree
+// vertical field of view, 16:9, near 0.1 and far 100.
+util::Mat4x4f make_view_projection()
+{
+    const float near_z = 0.1f;
+    const float far_z = 100.0f;
+    const float aspect = 16.0f / 9.0f;
+    const float focal = 1.0f / std::tan(util::to_radian(30.0f));
+    const util::Mat4x4f projection(focal / aspect, 0.0f, 0.0f, 0.0f,
+                                   0.0f, focal, 0.0f, 0.0f,
+                                   0.0f, 0.0f, (far_z + near_z) / (near_z - far_z),
+                                   2.0f * far_z * near_z / (near_z - far_z),
+                                   0.0f, 0.0f, -1.0f, 0.0f);
+    util::Mat4x4f view;
+    view.init_rotate_transform(10.0f, 25.0f, 0.0f);
+    return projection * view;
+}
+
+// Indices in exactly one of the sorted lists.
+size_t count_differences(const std::vector<uint32_t>& aa, const std::vector<uint32_t>& bb)
+{
+    std::vector<uint32_t> differences;
+    std::set_symmetric_difference(aa.begin(), aa.end(), bb.begin(), bb.end(),
+                                  std::back_inserter(differences));
+    return differences.size();
+}
+
+bool check(const std::string& what, const std::vector<uint32_t>& reference,
+           const std::vector<uint32_t>& visible)
+{
+    const size_t differences = count_differences(reference, visible);
+    if (differences == 0)
+        return true;
+    const bool ok = differences <= max_differences;
+    std::cout << "  " << what << ": " << differences << " objects differ from scalar"
+              << (ok ? " (on a plane)" : "  <-- MISMATCH") << '\n';
+    return ok;
+}
+
+void report(const bench::Result& result, size_t count)
+{
+    std::cout << "    " << count * 1e6 / result.ns_per_iter << " objects/ms\n";
+}
+
+}
+
+int main()
+{
+    // Same scene on every run.
+    util::seed_random(1);
+    const util::Frustum frustum(make_view_projection());
+    const unsigned hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    const util::simd::Isa best = util::simd::detect();
+    std::cout << "Best available instruction set: " << util::simd::name(best) << "\n";
+    std::cout << "Hardware threads: " << hardware_threads << "\n\n";
+    bench::print_header();
+
+    bool ok = true;
+    const util::simd::Isa isas[] = { util::simd::Isa::scalar, util::simd::Isa::sse,
+                                     util::simd::Isa::avx2 };
+    for (size_t count: counts)
+    {
+        const Scene scene = make_scene(count);
+        const std::string suffix = "/" + std::to_string(count);
+        std::vector<uint32_t> box_reference, sphere_reference, visible;
+
+        util::simd::set_active(util::simd::Isa::scalar);
+        util::cull(frustum, scene.boxes, box_reference);
+        util::cull(frustum, scene.spheres, sphere_reference);
+        std::cout << count << " objects: " << box_reference.size() << " boxes and "
+                  << sphere_reference.size() << " spheres visible\n";
+
+        for (util::simd::Isa isa: isas)
+        {
+            util::simd::set_active(isa);
+            if (util::simd::active() != isa)
+                continue;
+            const std::string prefix = std::string("BM_") + util::simd::name(isa);
+
+            util::cull(frustum, scene.boxes, visible);
+            ok &= check(prefix + "_boxes", box_reference, visible);
+            report(bench::run((prefix + "_boxes" + suffix).c_str(),
+                              [&]() {
+                                  util::cull(frustum, scene.boxes, visible);
+                                  bench::do_not_optimize(visible);
+                              },
+                              count),
+                   count);
+
+            util::cull(frustum, scene.spheres, visible);
+            ok &= check(prefix + "_spheres", sphere_reference, visible);
+            report(bench::run((prefix + "_spheres" + suffix).c_str(),
+                              [&]() {
+                                  util::cull(frustum, scene.spheres, visible);
+                                  bench::do_not_optimize(visible);
+                              },
+                              count),
+                   count);
+        }
+
+        // Thread scaling of the partitioned mode with the best kernels: the
+        // calling thread takes a range too, so a pool of threads - 1.
+        util::simd::set_active(best);
+        for (unsigned threads = 2; threads <= std::max(2u, hardware_threads); threads *= 2)
+        {
+            util::ThreadPool pool(threads - 1);
+            const std::string name = std::string("BM_") + util::simd::name(best) + "_boxes_"
+                                   + std::to_string(threads) + "_threads" + suffix;
+            util::cull(frustum, scene.boxes, visible, pool);
+            ok &= check(name, box_reference, visible);
+            report(bench::run(name.c_str(),
+                              [&]() {
+                                  util::cull(frustum, scene.boxes, visible, pool);
+                                  bench::do_not_optimize(visible);
+                              },
+                              count),
+                   count);
+        }
+        std::cout << '\n';
+    }
+
+    if (!ok)
+    {
+        std::cerr << "[ERROR] The culling kernels disagree\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,226 @@
+// Micro benchmark of the util::Mat4x4f kernels: compares the scalar reference
+// implementation against the SSE and AVX2 code paths and checks that all of them
+// produce (nearly) bitwise identical results.
+//
+// The AVX2 kernels use fused multiply-add, so their results can differ from the
+// scalar ones in the last bit or two. transform_points(Vec3f) is the exception
+// and must match exactly: SoftRasterizer renders the same image with every
+// instruction set only as long as its vertices transform to the same bits.
+
+#include <util/3dtypes.hpp>
+#include <util/random.hpp>
+#include <util/simd.hpp>
+
+#include "bench.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t num_mats = 4096;
+constexpr size_t num_points = 65536;
+// Inputs are in [-1, 1], so every result is a sum of at most 4 products of
+// magnitude <= 1 and an absolute tolerance is meaningful.
+constexpr float max_abs_diff = 1e-5f;
+
+float random_signed() { return util::random_float() * 2.0f - 1.0f; }
+
+util::Mat4x4f random_matrix()
+{
+    util::Mat4x4f mm;
+    for (int ii = 0; ii < 4; ++ii)
+    {
+        for (int jj = 0; jj < 4; ++jj)
+        {
+            mm.mat[ii][jj] = random_signed();
+        }
+    }
+    return mm;
+}
+
+int32_t ulp_distance(float a, float b)
+{
+    int32_t ia, ib;
+    std::memcpy(&ia, &a, sizeof(float));
+    std::memcpy(&ib, &b, sizeof(float));
+    // Map to a monotonic integer line so the difference counts representable floats.
+    ia = (ia < 0) ? INT32_MIN - ia : ia;
+    ib = (ib < 0) ? INT32_MIN - ib : ib;
+    return std::abs(ia - ib);
+}
+
+struct Outputs
+{
+    std::vector<util::Mat4x4f> products;
+    std::vector<util::Mat4x4f> batch;
+    std::vector<util::Vec4f> points3;
+    std::vector<util::Vec4f> points4;
+};
+
+struct Inputs
+{
+    util::Mat4x4f lhs;
+    std::vector<util::Mat4x4f> mats;
+    std::vector<util::Vec3f> points3;
+    std::vector<util::Vec4f> points4;
+};
+
+void compute(const Inputs& in, Outputs& out)
+{
+    out.products.resize(num_mats);
+    out.batch.resize(num_mats);
+    out.points3.resize(num_points);
+    out.points4.resize(num_points);
+
+    for (size_t ii = 0; ii < num_mats; ++ii)
+    {
+        out.products[ii] = in.lhs * in.mats[ii];
+    }
+    util::multiply_batch(in.lhs, in.mats.data(), out.batch.data(), num_mats);
+    util::transform_points(in.lhs, in.points3.data(), out.points3.data(), num_points);
+    util::transform_points(in.lhs, in.points4.data(), out.points4.data(), num_points);
+}
+
+bool compare(const char* what, const float* ref, const float* res, size_t count,
+             float tolerance = max_abs_diff)
+{
+    int32_t max_ulps = 0;
+    float max_diff = 0.0f;
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        max_ulps = std::max(max_ulps, ulp_distance(ref[ii], res[ii]));
+        max_diff = std::max(max_diff, std::fabs(ref[ii] - res[ii]));
+    }
+    const bool ok = max_diff <= tolerance;
+    std::cout << "  " << what << ": max ulp distance = " << max_ulps
+              << ", max abs diff = " << max_diff << (ok ? "" : "  <-- MISMATCH") << '\n';
+    return ok;
+}
+
+bool verify(const char* isa, const Outputs& ref, const Outputs& res)
+{
+    std::cout << "Verifying " << isa << " against scalar:\n";
+    bool ok = compare("operator*", &ref.products[0].mat[0][0], &res.products[0].mat[0][0],
+                      num_mats * 16);
+    ok &= compare("multiply_batch", &ref.batch[0].mat[0][0], &res.batch[0].mat[0][0],
+                  num_mats * 16);
+    ok &= compare("transform_points(Vec3f)", &ref.points3[0].x, &res.points3[0].x, num_points * 4,
+                  0.0f);
+    ok &= compare("transform_points(Vec4f)", &ref.points4[0].x, &res.points4[0].x, num_points * 4);
+    return ok;
+}
+
+void run_benchmarks(const char* isa, const Inputs& in, Outputs& out)
+{
+    const std::string prefix = std::string("BM_") + isa + "/";
+
+    util::Mat4x4f res;
+    size_t idx = 0;
+    bench::run((prefix + "operator*").c_str(), [&]() {
+        res = in.lhs * in.mats[idx];
+        idx = (idx + 1) % num_mats;
+        bench::do_not_optimize(res);
+    });
+
+    bench::run((prefix + "operator*_loop/" + std::to_string(num_mats)).c_str(),
+               [&]() {
+                   for (size_t ii = 0; ii < num_mats; ++ii)
+                   {
+                       out.products[ii] = in.lhs * in.mats[ii];
+                   }
+                   bench::do_not_optimize(out.products);
+               },
+               num_mats);
+
+    bench::run((prefix + "multiply_batch/" + std::to_string(num_mats)).c_str(),
+               [&]() {
+                   util::multiply_batch(in.lhs, in.mats.data(), out.batch.data(), num_mats);
+                   bench::do_not_optimize(out.batch);
+               },
+               num_mats);
+
+    bench::run((prefix + "transform_points_vec3/" + std::to_string(num_points)).c_str(),
+               [&]() {
+                   util::transform_points(in.lhs, in.points3.data(), out.points3.data(),
+                                          num_points);
+                   bench::do_not_optimize(out.points3);
+               },
+               num_points);
+
+    bench::run((prefix + "transform_points_vec4/" + std::to_string(num_points)).c_str(),
+               [&]() {
+                   util::transform_points(in.lhs, in.points4.data(), out.points4.data(),
+                                          num_points);
+                   bench::do_not_optimize(out.points4);
+               },
+               num_points);
+}
+
+}
+
+int main()
+{
+    // Same inputs on every run.
+    util::seed_random(1);
+
+    Inputs in;
+    in.lhs = random_matrix();
+    in.mats.resize(num_mats);
+    for (auto& mm: in.mats)
+    {
+        mm = random_matrix();
+    }
+    in.points3.resize(num_points);
+    in.points4.resize(num_points);
+    for (size_t ii = 0; ii < num_points; ++ii)
+    {
+        in.points3[ii] = util::Vec3f(random_signed(), random_signed(), random_signed());
+        in.points4[ii] = util::Vec4f(in.points3[ii], random_signed());
+    }
+
+    const util::simd::Isa best = util::simd::detect();
+    std::cout << "Best available instruction set: " << util::simd::name(best) << "\n";
+
+    Outputs reference;
+    util::simd::set_active(util::simd::Isa::scalar);
+    compute(in, reference);
+
+    bool ok = true;
+    const util::simd::Isa isas[] = { util::simd::Isa::scalar, util::simd::Isa::sse,
+                                     util::simd::Isa::avx2 };
+    for (util::simd::Isa isa: isas)
+    {
+        util::simd::set_active(isa);
+        if (util::simd::active() != isa)
+        {
+            std::cout << "Skipping " << util::simd::name(isa) << " (not available)\n";
+            continue;
+        }
+
+        Outputs out;
+        compute(in, out);
+        if (isa != util::simd::Isa::scalar)
+        {
+            ok &= verify(util::simd::name(isa), reference, out);
+        }
+
+        std::cout << '\n';
+        bench::print_header();
+        run_benchmarks(util::simd::name(isa), in, out);
+        std::cout << '\n';
+    }
+
+    util::simd::set_active(best);
+    if (!ok)
+    {
+        std::cerr << "[ERROR] SIMD results differ from the scalar reference!\n";
+        return 1;
+    }
+    return 0;
+}
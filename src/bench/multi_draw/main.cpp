@@ -0,0 +1,243 @@
+// Benchmark of drawing many small meshes: N cubes from one util::MeshPool,
+// drawn two ways:
+//   - naive: per cube, glUniform* for its world matrix and color and a
+//            glDrawElementsBaseVertex, like the samples draw their meshes.
+//   - mdi:   util::MultiDrawBatch: the commands and per-cube data are built
+//            on the CPU every frame and issued with one
+//            glMultiDrawElementsIndirect, the shader fetching the data from
+//            a shader storage buffer.
+// For each cube count (default 10k, 25k, 50k and 100k, or --counts a,b,...)
+// it reports the CPU time to submit a frame and the time until the frame is
+// done (glFinish), and checks that both ways render the same image.
+//
+// Runs headless in a GL 4.3 context (llvmpipe has it); --frames N sets the
+// frames averaged per measurement.
+
+#include <glad/glad.h>
+
+#include <util/3dtypes.hpp>
+#include <util/context.hpp>
+#include <util/gl_ext.hpp>
+#include <util/mesh.hpp>
+#include <util/multi_draw_batch.hpp>
+#include <util/shader.hpp>
+#include <util/uniform_block.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+// std430 layout of CubeData in shaders/multi_draw.vert.
+struct CubeData
+{
+    util::std140::mat4 world;
+    util::std140::vec4 color;
+};
+
+struct Cube
+{
+    util::Mat4x4f world;
+    util::Vec4f color;
+};
+
+struct Timings
+{
+    double submit_ms = 0.0;
+    double frame_ms = 0.0;
+};
+
+static std::vector<Cube> make_cubes(size_t count);
+static std::vector<size_t> parse_counts(const char* list);
+
+static double ms_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    util::ContextOptions options(512, 512);
+    options.backend = util::Backend::headless;
+    options.gl_major = 4;
+    options.gl_minor = 3;
+    util::Context context(options.parse(argc, argv));
+    if (context.error)
+        return -1;
+
+    std::vector<size_t> counts = { 10000, 25000, 50000, 100000 };
+    int frames = 10;
+    for (int ii = 1; ii + 1 < argc; ++ii)
+    {
+        if (std::strcmp(argv[ii], "--counts") == 0)
+            counts = parse_counts(argv[++ii]);
+        else if (std::strcmp(argv[ii], "--frames") == 0)
+            frames = std::max(1, std::atoi(argv[++ii]));
+    }
+
+    std::printf("GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+    if (!util::gl_ext::multi_draw_indirect_supported())
+    {
+        std::fprintf(stderr, "[ERROR] The context has no multi-draw indirect\n");
+        return 1;
+    }
+
+    util::Shader naive_shader("shaders/naive.vert", "shaders/fragment.frag");
+    util::Shader mdi_shader("shaders/multi_draw.vert", "shaders/fragment.frag");
+    if (naive_shader.error || mdi_shader.error)
+        return 1;
+    const GLint world_location = glGetUniformLocation(naive_shader.ID, "world");
+    const GLint color_location = glGetUniformLocation(naive_shader.ID, "color");
+
+    // clang-format off
+    const util::Vec3f vertices[] = {
+        { -0.5f, -0.5f, -0.5f }, { 0.5f, -0.5f, -0.5f },
+        { 0.5f, 0.5f, -0.5f }, { -0.5f, 0.5f, -0.5f },
+        { -0.5f, -0.5f, 0.5f }, { 0.5f, -0.5f, 0.5f },
+        { 0.5f, 0.5f, 0.5f }, { -0.5f, 0.5f, 0.5f },
+    };
+    const uint16_t indices[] = {
+        0, 2, 1, 0, 3, 2, // back
+        4, 5, 6, 4, 6, 7, // front
+        0, 4, 7, 0, 7, 3, // left
+        1, 2, 6, 1, 6, 5, // right
+        0, 1, 5, 0, 5, 4, // bottom
+        3, 7, 6, 3, 6, 2, // top
+    };
+    // clang-format on
+    util::MeshPool<util::VertexFormat<util::Vec3f>> pool(64, 1024);
+    util::SubMesh cube_mesh;
+    if (!pool.add(std::span<const util::Vec3f>(vertices), std::span<const uint16_t>(indices),
+                  cube_mesh))
+        return 1;
+    util::MultiDrawBatch<CubeData> batch(pool, 1);
+    if (batch.error)
+        return 1;
+
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+    std::printf("\n%8s %-6s %12s %12s %14s %10s\n", "cubes", "mode", "submit ms", "frame ms",
+                "cubes/s", "draw calls");
+    bool same_images = true;
+    for (size_t count: counts)
+    {
+        const std::vector<Cube> cubes = make_cubes(count);
+        std::vector<unsigned char> images[2];
+
+        for (int mode = 0; mode < 2; ++mode)
+        {
+            const bool mdi = mode == 1;
+            size_t draw_calls = 0;
+            Timings total;
+            // One more frame than measured: the first one warms up the driver.
+            for (int frame = 0; frame <= frames; ++frame)
+            {
+                glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                glFinish();
+
+                const auto start = bench_clock::now();
+                if (mdi)
+                {
+                    batch.clear();
+                    for (const Cube& cube: cubes)
+                        batch.add(cube_mesh, CubeData{ cube.world, cube.color });
+                    mdi_shader.use();
+                    batch.draw();
+                    draw_calls = batch.draw_calls();
+                }
+                else
+                {
+                    naive_shader.use();
+                    pool.bind();
+                    for (const Cube& cube: cubes)
+                    {
+                        glUniformMatrix4fv(world_location, 1, GL_TRUE, &cube.world.mat[0][0]);
+                        glUniform4f(color_location, cube.color.x, cube.color.y, cube.color.z,
+                                    cube.color.w);
+                        pool.draw(cube_mesh);
+                    }
+                    draw_calls = cubes.size();
+                }
+                const double submit_ms = ms_since(start);
+                glFinish();
+                const double frame_ms = ms_since(start);
+                if (frame > 0)
+                {
+                    total.submit_ms += submit_ms;
+                    total.frame_ms += frame_ms;
+                }
+            }
+
+            const double submit_ms = total.submit_ms / frames;
+            const double frame_ms = total.frame_ms / frames;
+            std::printf("%8zu %-6s %12.2f %12.2f %14.4g %10zu\n", count, mdi ? "mdi" : "naive",
+                        submit_ms, frame_ms, count * 1000.0 / frame_ms, draw_calls);
+
+            images[mode].resize(static_cast<size_t>(context.width()) * context.height() * 4);
+            glReadPixels(0, 0, context.width(), context.height(), GL_RGBA, GL_UNSIGNED_BYTE,
+                         images[mode].data());
+        }
+        if (images[0] != images[1])
+        {
+            std::printf("  naive and mdi images differ  <-- MISMATCH\n");
+            same_images = false;
+        }
+    }
+
+    if (glGetError() != GL_NO_ERROR || !same_images)
+    {
+        std::fprintf(stderr, "[ERROR] The ways of drawing disagree or GL reported an error\n");
+        return 1;
+    }
+    return 0;
+}
+
+// A square grid of small cubes covering clip space, each turned a bit
+// differently and in its own color.
+std::vector<Cube> make_cubes(size_t count)
+{
+    const size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    const float cell = 2.0f / static_cast<float>(side);
+    std::vector<Cube> cubes(count);
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        const size_t row = ii / side;
+        const size_t column = ii % side;
+        util::Mat4x4f scale, rotate, translate;
+        scale.init_scale_transform(0.5f * cell);
+        rotate.init_rotate_transform(30.0f + static_cast<float>(ii % 7) * 5.0f,
+                                     40.0f + static_cast<float>(ii % 11) * 3.0f, 0.0f);
+        translate.init_translation_transform(-1.0f + (static_cast<float>(column) + 0.5f) * cell,
+                                             -1.0f + (static_cast<float>(row) + 0.5f) * cell,
+                                             0.0f);
+        cubes[ii].world = translate * rotate * scale;
+        cubes[ii].color = util::Vec4f(static_cast<float>(column) / static_cast<float>(side),
+                                      static_cast<float>(row) / static_cast<float>(side),
+                                      0.5f + 0.5f * static_cast<float>(ii % 3) / 2.0f, 1.0f);
+    }
+    return cubes;
+}
+
+std::vector<size_t> parse_counts(const char* list)
+{
+    std::vector<size_t> counts;
+    for (const char* pos = list; *pos;)
+    {
+        char* end = nullptr;
+        const long value = std::strtol(pos, &end, 10);
+        if (end == pos)
+            break;
+        if (value > 0)
+            counts.push_back(static_cast<size_t>(value));
+        pos = *end == ',' ? end + 1 : end;
+    }
+    return counts;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec4 vertex_color;
+
+out vec4 frag_color;
+
+void main()
+{
+    // Shade the faces differently so that the cubes read as cubes.
+    float facing = 0.6 + 0.4 * abs(normalize(cross(dFdx(gl_FragCoord.xyz),
+                                                   dFdy(gl_FragCoord.xyz))).z);
+    frag_color = vec4(vertex_color.rgb * facing, vertex_color.a);
+}
@@ -0,0 +1,24 @@
+#version 430 core
+
+layout (location = 0) in vec3 pos;
+// Index of the draw, see util::MultiDrawBatch.
+layout (location = 1) in uint draw_id;
+
+struct CubeData
+{
+    mat4 world;
+    vec4 color;
+};
+
+layout (std430, row_major, binding = 0) readonly buffer Draws
+{
+    CubeData draws[];
+};
+
+out vec4 vertex_color;
+
+void main()
+{
+    gl_Position = draws[draw_id].world * vec4(pos, 1.0);
+    vertex_color = draws[draw_id].color;
+}
@@ -0,0 +1,15 @@
+#version 330 core
+
+layout (location = 0) in vec3 pos;
+
+// Uploaded row major (transposed) from util::Mat4x4f.
+uniform mat4 world;
+uniform vec4 color;
+
+out vec4 vertex_color;
+
+void main()
+{
+    gl_Position = world * vec4(pos, 1.0);
+    vertex_color = color;
+}
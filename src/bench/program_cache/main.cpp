@@ -0,0 +1,185 @@
+// Startup benchmark for the program binary cache (util/program_cache.hpp).
+//
+// Builds the shader program of every sample (copied to shaders/<sample>/ at
+// build time) four ways and reports the time taken:
+//   - no cache: compile and link from GLSL, one program after the other.
+//   - batch:    compile and link from GLSL with a util::ProgramBatch, which
+//               issues all programs before checking any of them, so drivers
+//               with parallel shader compilation overlap them.
+//   - cold:     the cache is empty, so programs are compiled, linked and stored.
+//   - warm:     every program is created from its cached binary.
+// The per program times of the last batch round are printed at the end.
+//
+// Mesa only exposes program binaries while its own shader cache is enabled, so
+// instead of disabling that cache it is pointed at a private directory which is
+// wiped before every uncached and cold round; otherwise it would turn those
+// into warm ones. The benchmark runs headless by default (pass --window to use a
+// hidden GLFW window instead), so on a machine without GPU it measures Mesa
+// llvmpipe.
+
+#include <glad/glad.h>
+
+#include <util/context.hpp>
+#include <util/program_cache.hpp>
+#include <util/shader.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct ProgramSources
+{
+    std::string vertex_path;
+    std::string fragment_path;
+};
+
+static std::vector<ProgramSources> find_programs(const fs::path& root);
+static double build_all(const std::vector<ProgramSources>& programs, bool& ok,
+                        util::ProgramBatch* batch = nullptr);
+static void clear_driver_cache();
+
+static const char* const driver_cache_dir = ".program_cache_bench_mesa";
+
+int main(int argc, char* argv[])
+{
+    constexpr int rounds = 5;
+
+    // Must be set before the driver is loaded.
+    setenv("MESA_SHADER_CACHE_DIR", driver_cache_dir, 1);
+    clear_driver_cache();
+
+    util::ContextOptions options(64, 64);
+    options.backend = util::Backend::headless;
+    util::Context context(options.parse(argc, argv));
+    if (context.error)
+        return -1;
+
+    std::cout << "GL_RENDERER: " << glGetString(GL_RENDERER) << '\n'
+              << "GL_VERSION:  " << glGetString(GL_VERSION) << '\n'
+              << "Parallel shader compile: "
+              << (util::Shader::parallel_compile_supported() ? "yes" : "no") << '\n';
+
+    util::program_cache::set_enabled(true);
+    if (!util::program_cache::enabled())
+    {
+        std::cout << "[ERROR] The driver does not support program binaries.\n";
+        return 1;
+    }
+
+    const std::vector<ProgramSources> programs = find_programs("shaders");
+    std::cout << "Programs per round: " << programs.size() << "\n\n";
+
+    std::vector<double> no_cache, batched, cold, warm;
+    std::unique_ptr<util::ProgramBatch> last_batch;
+    bool ok = true;
+    for (int round = 0; round < rounds; ++round)
+    {
+        util::program_cache::set_enabled(false);
+        clear_driver_cache();
+        no_cache.push_back(build_all(programs, ok));
+
+        clear_driver_cache();
+        last_batch = std::make_unique<util::ProgramBatch>();
+        batched.push_back(build_all(programs, ok, last_batch.get()));
+
+        util::program_cache::set_enabled(true);
+        util::program_cache::clear();
+        clear_driver_cache();
+        cold.push_back(build_all(programs, ok));
+        warm.push_back(build_all(programs, ok));
+    }
+
+    auto report = [](const char* name, std::vector<double>& times) {
+        std::sort(times.begin(), times.end());
+        double sum = 0.0;
+        for (double tt: times)
+            sum += tt;
+        std::cout << name << " avg " << sum / times.size() << " ms, min " << times.front()
+                  << " ms, max " << times.back() << " ms\n";
+    };
+    report("no cache:", no_cache);
+    report("batch:   ", batched);
+    report("cold:    ", cold);
+    report("warm:    ", warm);
+
+    const util::program_cache::Stats& stats = util::program_cache::stats();
+    std::cout << "\nCache hits " << stats.hits << ", misses " << stats.misses << ", rejected "
+              << stats.rejected << ", stored " << stats.stored << "\n\n";
+
+    std::cout << "Last batch round:\n";
+    std::cout.flush();
+    last_batch->print_report();
+
+    return ok ? 0 : 1;
+}
+
+std::vector<ProgramSources> find_programs(const fs::path& root)
+{
+    std::vector<ProgramSources> programs;
+    for (const auto& entry: fs::directory_iterator(root))
+    {
+        const fs::path vert = entry.path() / "vertex.vert";
+        const fs::path frag = entry.path() / "fragment.frag";
+        if (fs::exists(vert) && fs::exists(frag))
+        {
+            programs.push_back({ vert.string(), frag.string() });
+        }
+    }
+    std::sort(programs.begin(), programs.end(),
+              [](const auto& a, const auto& b) { return a.vertex_path < b.vertex_path; });
+    return programs;
+}
+
+// Returns the wall time in milliseconds to build all programs, with batch if
+// it is not null.
+double build_all(const std::vector<ProgramSources>& programs, bool& ok, util::ProgramBatch* batch)
+{
+    using clock = std::chrono::steady_clock;
+    std::vector<std::unique_ptr<util::Shader>> shaders;
+    shaders.reserve(programs.size());
+
+    const auto start = clock::now();
+    for (const ProgramSources& pp: programs)
+    {
+        if (batch)
+        {
+            shaders.push_back(std::make_unique<util::Shader>(pp.vertex_path.c_str(),
+                                                             pp.fragment_path.c_str(), *batch));
+            continue;
+        }
+        shaders.push_back(
+            std::make_unique<util::Shader>(pp.vertex_path.c_str(), pp.fragment_path.c_str()));
+        ok &= !shaders.back()->error;
+    }
+    if (batch)
+    {
+        ok &= batch->finish();
+    }
+    // Compilation may be deferred by the driver until the program is used.
+    for (auto& shader: shaders)
+        shader->use();
+    glFinish();
+
+    return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+}
+
+// Removes the files only: Mesa turns its cache off for the rest of the
+// process if a directory it created disappears.
+void clear_driver_cache()
+{
+    std::error_code ec;
+    for (const auto& entry: fs::recursive_directory_iterator(driver_cache_dir, ec))
+    {
+        if (entry.is_regular_file())
+        {
+            fs::remove(entry.path(), ec);
+        }
+    }
+}
@@ -0,0 +1,322 @@
+// Micro benchmark of util::Quatf and util::DualQuatf against the matrix
+// path they replace: composing rotations with Mat4x4f products versus
+// quaternion products, building the matrices, and interpolating. Every
+// instruction set is checked against the scalar code, and the quaternion
+// results against the matrices of Mat4x4f::init_rotate_transform_*.
+//
+// The AVX2 kernels use fused multiply-add, so their results can differ from the
+// scalar ones in the last bit or two.
+
+#include <util/3dtypes.hpp>
+#include <util/random.hpp>
+#include <util/simd.hpp>
+
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t num_quats = 4096;
+// Unit quaternions and rotation matrices have elements in [-1, 1]; the
+// translations are in [-10, 10], hence a relative check for those.
+constexpr float max_abs_diff = 1e-5f;
+
+float random_signed() { return util::random_float() * 2.0f - 1.0f; }
+
+float random_angle() { return util::random_float() * 360.0f; }
+
+util::Quatf random_quat()
+{
+    util::Vec3f axis(random_signed(), random_signed(), random_signed());
+    if (axis.length() < 1e-3f)
+        axis = util::Vec3f(0.0f, 0.0f, 1.0f);
+    axis.normalize();
+    return util::Quatf::from_axis_angle(axis, util::to_radian(random_angle()));
+}
+
+struct Inputs
+{
+    util::Quatf lhs;
+    util::DualQuatf dual_lhs;
+    util::Mat4x4f mat_lhs;
+    // Euler angles in degrees, three per rotation.
+    std::vector<float> angles;
+    std::vector<util::Quatf> quats;
+    std::vector<util::Quatf> targets;
+    std::vector<util::DualQuatf> duals;
+    std::vector<util::Mat4x4f> mats;
+};
+
+struct Outputs
+{
+    std::vector<util::Quatf> products;
+    std::vector<util::Quatf> nlerped;
+    std::vector<util::DualQuatf> dual_products;
+    std::vector<util::Mat4x4f> matrices;
+    std::vector<util::Mat4x4f> dual_matrices;
+};
+
+void compute(const Inputs& in, Outputs& out)
+{
+    out.products.resize(num_quats);
+    out.nlerped.resize(num_quats);
+    out.dual_products.resize(num_quats);
+    out.matrices.resize(num_quats);
+    out.dual_matrices.resize(num_quats);
+
+    util::multiply_batch(in.lhs, in.quats.data(), out.products.data(), num_quats);
+    util::nlerp_batch(in.quats.data(), in.targets.data(), 0.3f, out.nlerped.data(), num_quats);
+    util::multiply_batch(in.dual_lhs, in.duals.data(), out.dual_products.data(), num_quats);
+    util::to_matrix_batch(in.quats.data(), out.matrices.data(), num_quats);
+    util::to_matrix_batch(in.duals.data(), out.dual_matrices.data(), num_quats);
+}
+
+bool compare(const char* what, const float* ref, const float* res, size_t count,
+             float tolerance = max_abs_diff)
+{
+    float max_diff = 0.0f;
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        max_diff = std::max(max_diff, std::fabs(ref[ii] - res[ii]));
+    }
+    const bool ok = max_diff <= tolerance;
+    std::cout << "  " << what << ": max abs diff = " << max_diff
+              << (ok ? "" : "  <-- MISMATCH") << '\n';
+    return ok;
+}
+
+bool verify(const char* isa, const Outputs& ref, const Outputs& res)
+{
+    std::cout << "Verifying " << isa << " against scalar:\n";
+    bool ok = compare("multiply_batch(Quatf)", &ref.products[0].x, &res.products[0].x,
+                      num_quats * 4);
+    ok &= compare("nlerp_batch", &ref.nlerped[0].x, &res.nlerped[0].x, num_quats * 4);
+    ok &= compare("multiply_batch(DualQuatf)", &ref.dual_products[0].real.x,
+                  &res.dual_products[0].real.x, num_quats * 8, 10 * max_abs_diff);
+    ok &= compare("to_matrix_batch(Quatf)", &ref.matrices[0].mat[0][0],
+                  &res.matrices[0].mat[0][0], num_quats * 16);
+    ok &= compare("to_matrix_batch(DualQuatf)", &ref.dual_matrices[0].mat[0][0],
+                  &res.dual_matrices[0].mat[0][0], num_quats * 16, 10 * max_abs_diff);
+    return ok;
+}
+
+// The quaternion results against the matrix ones they stand for.
+bool verify_against_matrices(const Inputs& in)
+{
+    std::cout << "Verifying quaternions against matrices:\n";
+    std::vector<util::Mat4x4f> expected(num_quats);
+    std::vector<util::Mat4x4f> result(num_quats);
+
+    // init_rotate_transform() against the product of the per axis matrices.
+    for (size_t ii = 0; ii < num_quats; ++ii)
+    {
+        const float* aa = &in.angles[ii * 3];
+        util::Mat4x4f rx, ry, rz;
+        rx.init_rotate_transform_x(util::to_radian(aa[0]));
+        ry.init_rotate_transform_y(util::to_radian(aa[1]));
+        rz.init_rotate_transform_z(util::to_radian(aa[2]));
+        expected[ii] = rz * ry * rx;
+        result[ii].init_rotate_transform(aa[0], aa[1], aa[2]);
+    }
+    bool ok = compare("init_rotate_transform", &expected[0].mat[0][0], &result[0].mat[0][0],
+                      num_quats * 16);
+
+    // Composing, then converting, against converting, then multiplying.
+    const util::Mat4x4f lhs_matrix = in.lhs.to_matrix();
+    for (size_t ii = 0; ii < num_quats; ++ii)
+    {
+        expected[ii] = lhs_matrix * in.quats[ii].to_matrix();
+        result[ii] = (in.lhs * in.quats[ii]).to_matrix();
+    }
+    ok &= compare("Quatf product", &expected[0].mat[0][0], &result[0].mat[0][0],
+                  num_quats * 16);
+
+    // Rigid transformations against translation * rotation.
+    for (size_t ii = 0; ii < num_quats; ++ii)
+    {
+        const util::Vec3f t = in.duals[ii].translation();
+        util::Mat4x4f translation;
+        translation.init_translation_transform(t.x, t.y, t.z);
+        expected[ii] = translation * in.duals[ii].rotation().to_matrix();
+        result[ii] = in.duals[ii].to_matrix();
+    }
+    ok &= compare("DualQuatf matrix", &expected[0].mat[0][0], &result[0].mat[0][0],
+                  num_quats * 16, 10 * max_abs_diff);
+
+    const util::Mat4x4f dual_lhs_matrix = in.dual_lhs.to_matrix();
+    for (size_t ii = 0; ii < num_quats; ++ii)
+    {
+        expected[ii] = dual_lhs_matrix * in.duals[ii].to_matrix();
+        result[ii] = (in.dual_lhs * in.duals[ii]).to_matrix();
+    }
+    ok &= compare("DualQuatf product", &expected[0].mat[0][0], &result[0].mat[0][0],
+                  num_quats * 16, 10 * max_abs_diff);
+    return ok;
+}
+
+void run_benchmarks(const char* isa, const Inputs& in, Outputs& out)
+{
+    const std::string prefix = std::string("BM_") + isa + "/";
+    const std::string suffix = "/" + std::to_string(num_quats);
+
+    // What a rotation from Euler angles used to cost: three matrices and two
+    // products.
+    bench::run((prefix + "rotation_matrix_products" + suffix).c_str(),
+               [&]() {
+                   for (size_t ii = 0; ii < num_quats; ++ii)
+                   {
+                       const float* aa = &in.angles[ii * 3];
+                       util::Mat4x4f rx, ry, rz;
+                       rx.init_rotate_transform_x(util::to_radian(aa[0]));
+                       ry.init_rotate_transform_y(util::to_radian(aa[1]));
+                       rz.init_rotate_transform_z(util::to_radian(aa[2]));
+                       out.matrices[ii] = rz * ry * rx;
+                   }
+                   bench::do_not_optimize(out.matrices);
+               },
+               num_quats);
+
+    bench::run((prefix + "init_rotate_transform" + suffix).c_str(),
+               [&]() {
+                   for (size_t ii = 0; ii < num_quats; ++ii)
+                   {
+                       const float* aa = &in.angles[ii * 3];
+                       out.matrices[ii].init_rotate_transform(aa[0], aa[1], aa[2]);
+                   }
+                   bench::do_not_optimize(out.matrices);
+               },
+               num_quats);
+
+    bench::run((prefix + "compose_Mat4x4f" + suffix).c_str(),
+               [&]() {
+                   util::multiply_batch(in.mat_lhs, in.mats.data(), out.matrices.data(),
+                                        num_quats);
+                   bench::do_not_optimize(out.matrices);
+               },
+               num_quats);
+
+    bench::run((prefix + "compose_Quatf" + suffix).c_str(),
+               [&]() {
+                   util::multiply_batch(in.lhs, in.quats.data(), out.products.data(), num_quats);
+                   bench::do_not_optimize(out.products);
+               },
+               num_quats);
+
+    bench::run((prefix + "compose_DualQuatf" + suffix).c_str(),
+               [&]() {
+                   util::multiply_batch(in.dual_lhs, in.duals.data(), out.dual_products.data(),
+                                        num_quats);
+                   bench::do_not_optimize(out.dual_products);
+               },
+               num_quats);
+
+    bench::run((prefix + "nlerp_batch" + suffix).c_str(),
+               [&]() {
+                   util::nlerp_batch(in.quats.data(), in.targets.data(), 0.3f,
+                                     out.nlerped.data(), num_quats);
+                   bench::do_not_optimize(out.nlerped);
+               },
+               num_quats);
+
+    bench::run((prefix + "slerp" + suffix).c_str(),
+               [&]() {
+                   for (size_t ii = 0; ii < num_quats; ++ii)
+                   {
+                       out.nlerped[ii] = util::slerp(in.quats[ii], in.targets[ii], 0.3f);
+                   }
+                   bench::do_not_optimize(out.nlerped);
+               },
+               num_quats);
+
+    bench::run((prefix + "to_matrix_batch_Quatf" + suffix).c_str(),
+               [&]() {
+                   util::to_matrix_batch(in.quats.data(), out.matrices.data(), num_quats);
+                   bench::do_not_optimize(out.matrices);
+               },
+               num_quats);
+
+    bench::run((prefix + "to_matrix_batch_DualQuatf" + suffix).c_str(),
+               [&]() {
+                   util::to_matrix_batch(in.duals.data(), out.dual_matrices.data(), num_quats);
+                   bench::do_not_optimize(out.dual_matrices);
+               },
+               num_quats);
+}
+
+}
+
+int main()
+{
+    // Same inputs on every run.
+    util::seed_random(1);
+
+    Inputs in;
+    in.lhs = random_quat();
+    in.dual_lhs = util::DualQuatf(random_quat(), util::Vec3f(1.0f, -2.0f, 3.0f));
+    in.mat_lhs = in.lhs.to_matrix();
+    in.angles.resize(num_quats * 3);
+    for (float& angle: in.angles)
+    {
+        angle = random_angle();
+    }
+    in.quats.resize(num_quats);
+    in.targets.resize(num_quats);
+    in.duals.resize(num_quats);
+    in.mats.resize(num_quats);
+    for (size_t ii = 0; ii < num_quats; ++ii)
+    {
+        in.quats[ii] = random_quat();
+        in.targets[ii] = random_quat();
+        in.duals[ii] = util::DualQuatf(
+            random_quat(),
+            util::Vec3f(10.0f * random_signed(), 10.0f * random_signed(), 10.0f * random_signed()));
+        in.mats[ii] = in.quats[ii].to_matrix();
+    }
+
+    const util::simd::Isa best = util::simd::detect();
+    std::cout << "Best available instruction set: " << util::simd::name(best) << "\n";
+
+    Outputs reference;
+    util::simd::set_active(util::simd::Isa::scalar);
+    compute(in, reference);
+    bool ok = verify_against_matrices(in);
+    std::cout << '\n';
+
+    const util::simd::Isa isas[] = { util::simd::Isa::scalar, util::simd::Isa::sse,
+                                     util::simd::Isa::avx2 };
+    for (util::simd::Isa isa: isas)
+    {
+        util::simd::set_active(isa);
+        if (util::simd::active() != isa)
+        {
+            std::cout << "Skipping " << util::simd::name(isa) << " (not available)\n";
+            continue;
+        }
+
+        Outputs out;
+        compute(in, out);
+        if (isa != util::simd::Isa::scalar)
+        {
+            ok &= verify(util::simd::name(isa), reference, out);
+        }
+
+        std::cout << '\n';
+        bench::print_header();
+        run_benchmarks(util::simd::name(isa), in, out);
+        std::cout << '\n';
+    }
+
+    util::simd::set_active(best);
+    if (!ok)
+    {
+        std::cerr << "[ERROR] Quaternion results differ from the reference!\n";
+        return 1;
+    }
+    return 0;
+}
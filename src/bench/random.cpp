@@ -0,0 +1,119 @@
+// Micro benchmark of the random number generators (util/random.hpp): the
+// std::mt19937 + std::uniform_real_distribution pair random_float() used to
+// wrap, random_float() itself and fill_uniform() with every instruction set.
+// Also checks that fill_uniform() gives the same numbers on every instruction
+// set and for the same seed.
+
+#include <util/3dtypes.hpp>
+#include <util/random.hpp>
+#include <util/simd.hpp>
+
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+constexpr size_t num_floats = 1 << 16;
+constexpr uint64_t seed = 42;
+
+std::vector<float> fill_seeded(size_t count)
+{
+    std::vector<float> out(count);
+    util::seed_random(seed);
+    util::fill_uniform(out);
+    return out;
+}
+
+bool same(const std::vector<float>& a, const std::vector<float>& b)
+{
+    return std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+}
+
+int main()
+{
+    const util::simd::Isa best = util::simd::detect();
+    std::cout << "Best available instruction set: " << util::simd::name(best) << "\n\n";
+
+    // Odd length to cover the partial last block.
+    const size_t check_count = num_floats + 5;
+    util::simd::set_active(util::simd::Isa::scalar);
+    const std::vector<float> reference = fill_seeded(check_count);
+
+    bool ok = true;
+    float lo = 1.0f, hi = 0.0f;
+    for (float ff: reference)
+    {
+        lo = std::min(lo, ff);
+        hi = std::max(hi, ff);
+    }
+    ok &= lo >= 0.0f && hi < 1.0f;
+    std::cout << "Range of " << check_count << " floats: [" << lo << ", " << hi << "]\n";
+
+    bench::print_header();
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<> unirand(0.0, 1.0);
+    float single = 0.0f;
+    bench::run("BM_mt19937_uniform_real_distribution", [&]() {
+        single = static_cast<float>(unirand(gen));
+        bench::do_not_optimize(single);
+    });
+
+    util::seed_random(seed);
+    bench::run("BM_random_float", [&]() {
+        single = util::random_float();
+        bench::do_not_optimize(single);
+    });
+
+    std::vector<float> out(num_floats);
+    const std::string size = "/" + std::to_string(num_floats);
+    bench::run(("BM_mt19937_loop" + size).c_str(),
+               [&]() {
+                   for (float& ff: out)
+                       ff = static_cast<float>(unirand(gen));
+                   bench::do_not_optimize(out);
+               },
+               num_floats);
+
+    const util::simd::Isa isas[] = { util::simd::Isa::scalar, util::simd::Isa::sse,
+                                     util::simd::Isa::avx2 };
+    for (util::simd::Isa isa: isas)
+    {
+        util::simd::set_active(isa);
+        if (util::simd::active() != isa)
+        {
+            std::cout << "Skipping " << util::simd::name(isa) << " (not available)\n";
+            continue;
+        }
+        if (!same(reference, fill_seeded(check_count)))
+        {
+            std::cout << "  fill_uniform differs on " << util::simd::name(isa)
+                      << "  <-- MISMATCH\n";
+            ok = false;
+        }
+
+        bench::run(("BM_fill_uniform_" + std::string(util::simd::name(isa)) + size).c_str(),
+                   [&]() {
+                       util::fill_uniform(out);
+                       bench::do_not_optimize(out);
+                   },
+                   num_floats);
+    }
+
+    util::simd::set_active(best);
+    if (!ok)
+    {
+        std::cerr << "[ERROR] fill_uniform is not reproducible across instruction sets!\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,482 @@
+// Runs samples headlessly, checks their last frame against reference images
+// and their frame times against a baseline report:
+//
+//     sample_harness --build build --references resources/golden
+//         014_shader_vectors 020_texture ...
+//
+// Each sample runs from its build directory, build/<name>/main, with
+// --headless --frames N --capture=FILE --profile=FILE.json (see
+// util/context.hpp), which reads the last frame back through a pixel pack
+// buffer and writes the FrameProfiler summary. The capture is compared with
+// <references>/<name>.ppm: a pixel differs when a channel is off by more than
+// --tolerance, and the sample fails when more than --max-differing of its
+// pixels do. The frame times fail when their average, CPU or GPU, is more
+// than --max-slowdown above the one of the same sample in the baseline, by
+// default <references>/baseline.json. A sample also fails when its profile
+// reports uniform location lookups after the first frame (see
+// Context::lookups_after_first_frame()): frames should set uniforms through
+// locations resolved up front.
+//
+// Samples run with UTIL_RANDOM_SEED=1 (see util/random.hpp), both when
+// checking and with --update, so the ones that draw their vertex colors from
+// util::random_float() render the same on every run and match their
+// references.
+//
+// Captures, logs, profiles and report.json, which has the same format as the
+// baseline, go to --output. --update writes the captures and the report as
+// the new references and baseline instead of checking them. A sample without
+// a reference image or a baseline entry fails, unless --allow-missing reports
+// it as skipped instead. The exit code is 1 when a sample crashed, timed out,
+// did not match, got slower or had nothing to be checked against.
+
+#include <util/image.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+// The UTIL_RANDOM_SEED of every sample run.
+constexpr const char* sample_seed = "1";
+
+struct Options
+{
+    fs::path build = ".";
+    fs::path references;
+    fs::path output = "sample_report";
+    fs::path baseline;
+    long frames = 120;
+    int tolerance = 8;
+    double max_differing = 0.001;
+    double max_slowdown = 0.2;
+    double timeout_s = 120.0;
+    bool update = false;
+    // Skip the checks that have no reference or baseline entry instead of
+    // failing the sample.
+    bool allow_missing = false;
+    std::vector<std::string> samples;
+};
+
+// Milliseconds, as in FrameProfiler::write_json().
+struct Summary
+{
+    size_t count = 0;
+    double min = 0.0;
+    double avg = 0.0;
+    double p99 = 0.0;
+};
+
+struct Result
+{
+    std::string name;
+    // "ok", "failed" (non-zero exit), "crashed" or "timeout".
+    std::string run = "ok";
+    int exit_code = 0;
+    // "match", "mismatch", "missing" (no reference), "unreadable" (reference
+    // that cannot be read), "updated" or "none" (no capture).
+    std::string image = "none";
+    util::ImageDiff diff;
+    Summary cpu;
+    Summary gpu;
+    // Average over the baseline's, 0 without a baseline.
+    double cpu_ratio = 0.0;
+    double gpu_ratio = 0.0;
+    bool slower = false;
+    // Uniform location lookups after the first frame, from the profile.
+    size_t lookups = 0;
+    // No baseline entry to compare the frame times with.
+    bool no_baseline = false;
+    // Options::allow_missing.
+    bool missing_allowed = false;
+
+    bool missing() const { return image == "missing" || no_baseline; }
+
+    bool passed() const
+    {
+        return run == "ok" && (image == "match" || image == "updated" || image == "missing")
+            && !slower && lookups == 0 && (missing_allowed || !missing());
+    }
+
+    // Passed without its image or frame times checked.
+    bool skipped() const { return passed() && missing(); }
+};
+
+void usage()
+{
+    std::cout << "usage: sample_harness [--build DIR] [--references DIR] [--output DIR]\n"
+                 "                      [--baseline FILE] [--frames N] [--tolerance N]\n"
+                 "                      [--max-differing FRACTION] [--max-slowdown FRACTION]\n"
+                 "                      [--timeout SECONDS] [--update] [--allow-missing]\n"
+                 "                      SAMPLE...\n";
+}
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+    for (int ii = 1; ii < argc; ++ii)
+    {
+        const std::string arg = argv[ii];
+        const bool has_value = ii + 1 < argc;
+        if (arg == "--update")
+            options.update = true;
+        else if (arg == "--allow-missing")
+            options.allow_missing = true;
+        else if (arg == "--build" && has_value)
+            options.build = argv[++ii];
+        else if (arg == "--references" && has_value)
+            options.references = argv[++ii];
+        else if (arg == "--output" && has_value)
+            options.output = argv[++ii];
+        else if (arg == "--baseline" && has_value)
+            options.baseline = argv[++ii];
+        else if (arg == "--frames" && has_value)
+            options.frames = std::strtol(argv[++ii], nullptr, 10);
+        else if (arg == "--tolerance" && has_value)
+            options.tolerance = std::atoi(argv[++ii]);
+        else if (arg == "--max-differing" && has_value)
+            options.max_differing = std::strtod(argv[++ii], nullptr);
+        else if (arg == "--max-slowdown" && has_value)
+            options.max_slowdown = std::strtod(argv[++ii], nullptr);
+        else if (arg == "--timeout" && has_value)
+            options.timeout_s = std::strtod(argv[++ii], nullptr);
+        else if (arg.starts_with("--"))
+            return false;
+        else
+            options.samples.push_back(arg);
+    }
+    if (options.update && options.references.empty())
+        return false;
+    if (options.baseline.empty() && !options.references.empty())
+        options.baseline = options.references / "baseline.json";
+    return !options.samples.empty() && options.frames > 0;
+}
+
+std::string read_file(const fs::path& path)
+{
+    std::ifstream fin(path);
+    std::ostringstream contents;
+    contents << fin.rdbuf();
+    return contents.str();
+}
+
+double number_after(const std::string& text, size_t from, const char* key, size_t end)
+{
+    const size_t pos = text.find(key, from);
+    if (pos == std::string::npos || pos >= end)
+        return 0.0;
+    return std::strtod(text.c_str() + pos + std::strlen(key), nullptr);
+}
+
+// Reads the summary under key ("cpu_ms" or "gpu_ms") of the entry that
+// starts at from and ends before end. Only the JSON this repository writes is
+// understood: FrameProfiler::write_json() and the reports below.
+Summary read_summary(const std::string& text, size_t from, size_t end, const char* key)
+{
+    Summary summary;
+    const size_t pos = text.find(key, from);
+    if (pos == std::string::npos || pos >= end)
+        return summary;
+    const size_t close = std::min(end, text.find('}', pos));
+    summary.count = static_cast<size_t>(number_after(text, pos, "\"count\": ", close));
+    summary.min = number_after(text, pos, "\"min\": ", close);
+    summary.avg = number_after(text, pos, "\"avg\": ", close);
+    summary.p99 = number_after(text, pos, "\"p99\": ", close);
+    return summary;
+}
+
+// The entry named name: its first and one past its last character.
+bool find_entry(const std::string& text, const std::string& name, size_t& begin, size_t& end)
+{
+    begin = text.find("{ \"name\": \"" + name + "\"");
+    if (begin == std::string::npos)
+        return false;
+    end = text.find('\n', begin);
+    if (end == std::string::npos)
+        end = text.size();
+    return true;
+}
+
+// Runs the sample from its directory with its output in log. Returns its
+// exit code, or sets run to why it has none.
+int run_sample(const fs::path& directory, const std::vector<std::string>& args,
+               const fs::path& log, double timeout_s, std::string& run)
+{
+    const pid_t pid = fork();
+    if (pid < 0)
+    {
+        std::perror("[ERROR] fork");
+        run = "failed";
+        return -1;
+    }
+    if (pid == 0)
+    {
+        const int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0)
+        {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        if (chdir(directory.c_str()) != 0)
+            _exit(127);
+        setenv("UTIL_RANDOM_SEED", sample_seed, 1);
+        std::vector<char*> argv;
+        for (const std::string& arg: args)
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    using clock = std::chrono::steady_clock;
+    const auto deadline = clock::now() + std::chrono::duration<double>(timeout_s);
+    int status = 0;
+    while (waitpid(pid, &status, WNOHANG) == 0)
+    {
+        if (clock::now() > deadline)
+        {
+            kill(pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            run = "timeout";
+            return -1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (WIFSIGNALED(status))
+    {
+        run = "crashed";
+        return -WTERMSIG(status);
+    }
+    const int code = WEXITSTATUS(status);
+    if (code != 0)
+        run = "failed";
+    return code;
+}
+
+void check_image(const Options& options, const fs::path& capture, Result& result)
+{
+    util::Image image;
+    if (!fs::exists(capture) || !util::read_ppm(capture.string(), image))
+        return;
+
+    const fs::path reference_path = options.references / (result.name + ".ppm");
+    if (options.update)
+    {
+        std::error_code ec;
+        fs::create_directories(options.references, ec);
+        fs::copy_file(capture, reference_path, fs::copy_options::overwrite_existing, ec);
+        if (ec)
+        {
+            std::cerr << "[ERROR] Cannot update " << reference_path << ": " << ec.message()
+                      << '\n';
+            return;
+        }
+        result.image = "updated";
+        return;
+    }
+
+    if (!fs::exists(reference_path))
+    {
+        result.image = "missing";
+        return;
+    }
+    util::Image reference;
+    if (!util::read_ppm(reference_path.string(), reference))
+    {
+        result.image = "unreadable";
+        return;
+    }
+    result.diff = util::compare_images(image, reference, options.tolerance);
+    result.image = result.diff.matches(options.max_differing) ? "match" : "mismatch";
+}
+
+void check_times(const Options& options, const std::string& baseline, Result& result)
+{
+    size_t begin, end;
+    if (options.update)
+        return;
+    if (baseline.empty() || !find_entry(baseline, result.name, begin, end))
+    {
+        result.no_baseline = true;
+        return;
+    }
+
+    const Summary cpu = read_summary(baseline, begin, end, "\"cpu_ms\"");
+    const Summary gpu = read_summary(baseline, begin, end, "\"gpu_ms\"");
+    if (cpu.count && result.cpu.count && cpu.avg > 0.0)
+        result.cpu_ratio = result.cpu.avg / cpu.avg;
+    if (gpu.count && result.gpu.count && gpu.avg > 0.0)
+        result.gpu_ratio = result.gpu.avg / gpu.avg;
+    result.slower = result.cpu_ratio > 1.0 + options.max_slowdown
+                 || result.gpu_ratio > 1.0 + options.max_slowdown;
+}
+
+Result run_one(const Options& options, const std::string& baseline, const std::string& name)
+{
+    Result result;
+    result.name = name;
+    result.missing_allowed = options.allow_missing;
+    const fs::path output = fs::absolute(options.output);
+    const fs::path capture = output / (name + ".ppm");
+    const fs::path profile = output / (name + ".json");
+    std::error_code ec;
+    fs::remove(capture, ec);
+    fs::remove(profile, ec);
+
+    const std::vector<std::string> args = {
+        "./main",
+        "--headless",
+        "--frames",
+        std::to_string(options.frames),
+        "--capture=" + capture.string(),
+        "--profile=" + profile.string(),
+    };
+    result.exit_code = run_sample(options.build / name, args, output / (name + ".log"),
+                                  options.timeout_s, result.run);
+    if (result.run != "ok")
+        return result;
+
+    check_image(options, capture, result);
+    const std::string profile_text = read_file(profile);
+    size_t begin, end;
+    if (find_entry(profile_text, "frame", begin, end))
+    {
+        result.cpu = read_summary(profile_text, begin, end, "\"cpu_ms\"");
+        result.gpu = read_summary(profile_text, begin, end, "\"gpu_ms\"");
+    }
+    result.lookups = static_cast<size_t>(number_after(
+        profile_text, 0, "\"uniform_lookups_after_first_frame\": ", profile_text.size()));
+    check_times(options, baseline, result);
+    return result;
+}
+
+void write_summary(std::ostream& out, const Summary& summary)
+{
+    out << "{ \"count\": " << summary.count << ", \"min\": " << summary.min
+        << ", \"avg\": " << summary.avg << ", \"p99\": " << summary.p99 << " }";
+}
+
+// One line per sample, which is what find_entry() relies on.
+bool write_report(const fs::path& path, const Options& options, const std::vector<Result>& results)
+{
+    std::ofstream fout(path);
+    fout << "{\n  \"frames\": " << options.frames << ",\n  \"tolerance\": " << options.tolerance
+         << ",\n  \"max_differing\": " << options.max_differing
+         << ",\n  \"max_slowdown\": " << options.max_slowdown << ",\n  \"samples\": [\n";
+    for (size_t ii = 0; ii < results.size(); ++ii)
+    {
+        const Result& rr = results[ii];
+        fout << "    { \"name\": \"" << rr.name << "\", \"passed\": "
+             << (rr.passed() ? "true" : "false")
+             << ", \"skipped\": " << (rr.skipped() ? "true" : "false")
+             << ", \"baseline\": " << (rr.no_baseline ? "false" : "true")
+             << ", \"run\": \"" << rr.run
+             << "\", \"exit_code\": " << rr.exit_code << ", \"image\": \"" << rr.image
+             << "\", \"differing\": " << rr.diff.differing
+             << ", \"max_difference\": " << rr.diff.max_difference << ", \"rms\": " << rr.diff.rms
+             << ", \"cpu_ms\": ";
+        write_summary(fout, rr.cpu);
+        fout << ", \"gpu_ms\": ";
+        write_summary(fout, rr.gpu);
+        fout << ", \"lookups_after_first_frame\": " << rr.lookups
+             << ", \"cpu_ratio\": " << rr.cpu_ratio << ", \"gpu_ratio\": " << rr.gpu_ratio
+             << " }" << (ii + 1 < results.size() ? "," : "") << '\n';
+    }
+    fout << "  ]\n}\n";
+    if (!fout)
+    {
+        std::cerr << "[ERROR] Cannot write the report to " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+void print_result(const Result& rr)
+{
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-32s %-4s %-8s %-9s %9.3f %9.3f %7.2f %7.2f",
+                  rr.name.c_str(), rr.skipped() ? "skip" : rr.passed() ? "ok" : "FAIL",
+                  rr.run.c_str(), rr.image.c_str(),
+                  rr.cpu.avg, rr.gpu.avg, rr.cpu_ratio, rr.gpu_ratio);
+    std::cout << line;
+    if (rr.image == "match" || rr.image == "mismatch")
+        std::cout << "  " << rr.diff.differing << " px differ, max " << rr.diff.max_difference;
+    if (rr.lookups)
+        std::cout << "  " << rr.lookups << " uniform lookups after the first frame";
+    std::cout << '\n';
+}
+
+} // end of anonymous namespace
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options))
+    {
+        usage();
+        return 2;
+    }
+    std::error_code ec;
+    fs::create_directories(options.output, ec);
+    if (ec)
+    {
+        std::cerr << "[ERROR] Cannot create " << options.output << ": " << ec.message() << '\n';
+        return 2;
+    }
+    const std::string baseline = fs::exists(options.baseline) ? read_file(options.baseline) : "";
+    if (baseline.empty() && !options.update)
+        std::cout << "No baseline at " << options.baseline << '\n';
+
+    std::cout << "Sample                           Pass Run      Image       CPU ms    GPU ms"
+                 "  CPU x   GPU x\n";
+    std::vector<Result> results;
+    bool passed = true;
+    size_t missing = 0;
+    for (const std::string& name: options.samples)
+    {
+        results.push_back(run_one(options, baseline, name));
+        print_result(results.back());
+        passed &= results.back().passed();
+        missing += results.back().missing();
+    }
+    if (missing)
+        std::cout << missing << " of " << results.size()
+                  << " samples have no reference image or baseline entry in "
+                  << options.references.string() << ": record them with --update"
+                  << (options.allow_missing ? "" : " or pass --allow-missing") << '\n';
+
+    const fs::path report = options.output / "report.json";
+    if (!write_report(report, options, results))
+        return 1;
+    std::cout << "Report written to " << report.string() << '\n';
+    if (options.update && !options.references.empty())
+    {
+        fs::copy_file(report, options.baseline, fs::copy_options::overwrite_existing, ec);
+        if (ec)
+        {
+            std::cerr << "[ERROR] Cannot update " << options.baseline << ": " << ec.message()
+                      << '\n';
+            return 1;
+        }
+        std::cout << "References and baseline updated in " << options.references.string()
+                  << '\n';
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,341 @@
+// Benchmark of util::SoftRasterizer on the data of two samples:
+//
+// - cubes: the ColoredVertex cube of ogldev/013_camera_transformation with
+//   its camera and projection, drawn N times at random places with back-face
+//   culling (glFrontFace(GL_CW)) and, unlike the sample, the depth test.
+// - quads: the textured quad of 020_texture, drawn N times at random places
+//   and sizes, texture * color with culling of the clockwise faces. The
+//   texture is a generated 512x512 checker instead of container.jpg, which
+//   would need stb_image.
+//
+// Reports triangles per second (Items/s) with the scalar, SSE and AVX2
+// kernels on one thread, then the scaling of the best kernels over 2 to N
+// threads. Every image must be identical to the one of the scalar kernels on
+// one thread, whatever the kernels and the number of threads.
+
+#include <util/3dtypes.hpp>
+#include <util/random.hpp>
+#include <util/simd.hpp>
+#include <util/soft_raster.hpp>
+#include <util/thread_pool.hpp>
+
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+using Raster = util::SoftRasterizer;
+
+struct ColoredVertex
+{
+    float x, y, z;
+    // Random, like ColoredVertex::set() in the sample.
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+};
+
+struct Object
+{
+    util::Mat4x4f transform;
+};
+
+struct Scene
+{
+    const char* name;
+    int width;
+    int height;
+    Raster::VertexLayout layout;
+    Raster::DrawState state;
+    const void* vertices;
+    size_t vertex_count;
+    std::span<const uint16_t> indices16;
+    std::span<const uint32_t> indices32;
+    std::vector<Object> objects;
+    size_t triangles_per_object;
+};
+
+// 013_camera_transformation.
+ColoredVertex cube_vertices[8] = {
+    { -0.5f, -0.5f, 0.5f }, { -0.5f, 0.5f, 0.5f },  { -0.5f, -0.5f, -0.5f }, { -0.5f, 0.5f, -0.5f },
+    { 0.5f, -0.5f, 0.5f },  { 0.5f, 0.5f, 0.5f },   { 0.5f, -0.5f, -0.5f },  { 0.5f, 0.5f, -0.5f },
+};
+const uint16_t cube_indices[36] = {
+    1, 2, 0, 3, 6, 2, 7, 4, 6, 5, 0, 4, 6, 0, 2, 3, 5, 7,
+    1, 3, 2, 3, 7, 6, 7, 5, 4, 5, 1, 0, 6, 4, 0, 3, 1, 5,
+};
+
+// 020_texture: position, color, texture coordinates.
+const float quad_vertices[] = {
+    -0.5f, 0.5f,  0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f, //
+    -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, //
+    0.5f,  -0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, //
+    0.5f,  0.5f,  0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, //
+};
+const uint32_t quad_indices[] = { 0, 1, 2, 0, 2, 3 };
+
+util::Mat4x4f translation(float x, float y, float z)
+{
+    util::Mat4x4f mat;
+    mat.init_translation_transform(x, y, z);
+    return mat;
+}
+
+util::Mat4x4f scale(float s)
+{
+    util::Mat4x4f mat;
+    mat.init_scale_transform(s);
+    return mat;
+}
+
+// The camera and perspective projection of 013_camera_transformation.
+util::Mat4x4f cube_view_projection(float aspect)
+{
+    const util::Mat4x4f camera = translation(0.0f, 0.9f, 0.0f);
+    const float d = 1.0f / std::tan(util::to_radian(45.0f));
+    const float near_z = 1.0f;
+    const float far_z = 10.0f;
+    const float z_range = near_z - far_z;
+    const util::Mat4x4f perspective(d / aspect, 0.0f, 0.0f, 0.0f,
+                                    0.0f, d, 0.0f, 0.0f,
+                                    0.0f, 0.0f, (-far_z - near_z) / z_range,
+                                    2.0f * far_z * near_z / z_range,
+                                    0.0f, 0.0f, 1.0f, 0.0f);
+    return perspective * camera;
+}
+
+Scene make_cubes(size_t count)
+{
+    for (ColoredVertex& vertex: cube_vertices)
+    {
+        vertex.r = util::random_float();
+        vertex.g = util::random_float();
+        vertex.b = util::random_float();
+    }
+
+    Scene scene{};
+    scene.name = "cubes";
+    scene.width = 1200;
+    scene.height = 900;
+    scene.layout.stride = sizeof(ColoredVertex);
+    scene.layout.color = offsetof(ColoredVertex, r);
+    scene.state.cull_face = Raster::CullFace::back;
+    scene.state.front_face = Raster::FrontFace::cw;
+    scene.state.depth_test = true;
+    scene.vertices = cube_vertices;
+    scene.vertex_count = std::size(cube_vertices);
+    scene.indices16 = cube_indices;
+    scene.triangles_per_object = std::size(cube_indices) / 3;
+
+    const float aspect = static_cast<float>(scene.width) / scene.height;
+    const util::Mat4x4f view_projection = cube_view_projection(aspect);
+    // Smaller cubes for more of them, so that the covered area stays similar.
+    const float size = 2.0f / std::sqrt(static_cast<float>(count));
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        const float z = 2.0f + 7.0f * util::random_float();
+        util::Mat4x4f rotation;
+        rotation.init_rotate_transform(360.0f * util::random_float(),
+                                       360.0f * util::random_float(), 0.0f);
+        const util::Mat4x4f world
+            = translation((util::random_float() * 2.0f - 1.0f) * z * aspect,
+                          (util::random_float() * 2.0f - 1.0f) * z - 0.9f, z)
+            * rotation * scale(size * (0.5f + util::random_float()));
+        scene.objects.push_back({ view_projection * world });
+    }
+    return scene;
+}
+
+Scene make_quads(size_t count, const util::SoftTexture& texture)
+{
+    Scene scene{};
+    scene.name = "quads";
+    scene.width = 800;
+    scene.height = 600;
+    scene.layout.stride = 8 * sizeof(float);
+    scene.layout.color = 3 * sizeof(float);
+    scene.layout.tex_coord = 6 * sizeof(float);
+    scene.state.cull_face = Raster::CullFace::back;
+    scene.state.front_face = Raster::FrontFace::ccw;
+    scene.state.texture = &texture;
+    scene.vertices = quad_vertices;
+    scene.vertex_count = std::size(quad_vertices) / 8;
+    scene.indices32 = quad_indices;
+    scene.triangles_per_object = std::size(quad_indices) / 3;
+
+    const float size = 4.0f / std::sqrt(static_cast<float>(count));
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        util::Mat4x4f rotation;
+        rotation.init_rotate_transform_z(360.0f * util::random_float());
+        const util::Mat4x4f world
+            = translation(util::random_float() * 2.0f - 1.0f, util::random_float() * 2.0f - 1.0f,
+                          0.0f)
+            * rotation * scale(size * (0.5f + util::random_float()));
+        scene.objects.push_back({ world });
+    }
+    return scene;
+}
+
+util::SoftTexture make_texture()
+{
+    util::SoftTexture texture;
+    texture.width = 512;
+    texture.height = 512;
+    texture.texels.resize(512 * 512 * 4);
+    for (int y = 0; y < 512; ++y)
+    {
+        for (int x = 0; x < 512; ++x)
+        {
+            uint8_t* texel = &texture.texels[(y * 512 + x) * 4];
+            const bool dark = ((x / 64) + (y / 64)) % 2;
+            texel[0] = static_cast<uint8_t>(dark ? 90 : 200);
+            texel[1] = static_cast<uint8_t>(dark ? 60 : 150 + x / 8);
+            texel[2] = static_cast<uint8_t>(dark ? 30 : 60 + y / 8);
+            texel[3] = 255;
+        }
+    }
+    return texture;
+}
+
+void render(Raster& raster, const Scene& scene)
+{
+    raster.clear(0.2f, 0.3f, 0.3f, 1.0f);
+    Raster::DrawState state = scene.state;
+    for (const Object& object: scene.objects)
+    {
+        state.transform = object.transform;
+        if (!scene.indices16.empty())
+            raster.draw(state, scene.layout, scene.vertices, scene.vertex_count, scene.indices16);
+        else
+            raster.draw(state, scene.layout, scene.vertices, scene.vertex_count, scene.indices32);
+    }
+    raster.finish();
+}
+
+std::vector<uint8_t> image_of(const Raster& raster)
+{
+    const uint8_t* pixels = raster.pixels();
+    return { pixels, pixels + static_cast<size_t>(raster.width()) * raster.height() * 4 };
+}
+
+size_t count_differences(const std::vector<uint8_t>& aa, const std::vector<uint8_t>& bb)
+{
+    size_t differences = 0;
+    for (size_t ii = 0; ii < aa.size(); ii += 4)
+    {
+        if (std::memcmp(&aa[ii], &bb[ii], 4) != 0)
+            ++differences;
+    }
+    return differences;
+}
+
+bool check(const std::string& what, const std::vector<uint8_t>& reference,
+           const std::vector<uint8_t>& image)
+{
+    const size_t differences = count_differences(reference, image);
+    if (differences == 0)
+        return true;
+    std::cout << "  " << what << ": " << differences << " pixels differ  <-- MISMATCH\n";
+    return false;
+}
+
+bench::Result run(const std::string& name, Raster& raster, const Scene& scene)
+{
+    const size_t triangles = scene.objects.size() * scene.triangles_per_object;
+    return bench::run(name.c_str(), [&]() { render(raster, scene); }, triangles);
+}
+
+bool run_scene(const Scene& scene, unsigned hardware_threads)
+{
+    const std::string suffix = "/" + std::to_string(scene.objects.size());
+    bool ok = true;
+
+    Raster reference_raster(scene.width, scene.height);
+    util::simd::set_active(util::simd::Isa::scalar);
+    render(reference_raster, scene);
+    const std::vector<uint8_t> reference = image_of(reference_raster);
+    const Raster::Stats& stats = reference_raster.stats();
+    std::cout << scene.name << suffix << ": " << stats.triangles << " triangles, "
+              << stats.culled << " culled, " << stats.clipped << " clipped, "
+              << stats.rasterized << " rasterized, " << stats.fragments << " fragments\n";
+
+    // The single threaded runs of the best instruction set are the baseline
+    // of the threaded ones.
+    const util::simd::Isa best = util::simd::detect();
+    std::vector<uint8_t> single_image;
+    double single_ns = 0.0;
+    for (util::simd::Isa isa: { util::simd::Isa::scalar, util::simd::Isa::sse,
+                                util::simd::Isa::avx2 })
+    {
+        util::simd::set_active(isa);
+        if (util::simd::active() != isa)
+            continue;
+        Raster raster(scene.width, scene.height);
+        const std::string name
+            = std::string("BM_") + scene.name + "_" + util::simd::name(isa) + "_1_thread" + suffix;
+        render(raster, scene);
+        std::vector<uint8_t> image = image_of(raster);
+        ok &= check(name, reference, image);
+        const double ns = run(name, raster, scene).ns_per_iter;
+        if (isa == best)
+        {
+            single_image = std::move(image);
+            single_ns = ns;
+        }
+    }
+
+    // The calling thread rasterizes too, so a pool of threads - 1.
+    util::simd::set_active(best);
+    for (unsigned threads = 2; threads <= std::max(2u, hardware_threads); threads *= 2)
+    {
+        util::ThreadPool pool(threads - 1);
+        Raster raster(scene.width, scene.height, &pool);
+        const std::string name = std::string("BM_") + scene.name + "_" + util::simd::name(best)
+                               + "_" + std::to_string(threads) + "_threads" + suffix;
+        render(raster, scene);
+        ok &= check(name, single_image, image_of(raster));
+        const double ns = run(name, raster, scene).ns_per_iter;
+        std::cout << "    " << single_ns / ns << "x of 1 thread, "
+                  << raster.stats().tiles_stolen << " tiles stolen\n";
+    }
+    std::cout << '\n';
+    return ok;
+}
+
+}
+
+int main()
+{
+    // Same scenes on every run.
+    util::seed_random(1);
+    const unsigned hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::cout << "Best available instruction set: " << util::simd::name(util::simd::detect())
+              << "\n";
+    std::cout << "Hardware threads: " << hardware_threads << "\n\n";
+    bench::print_header();
+
+    bool ok = true;
+    const util::SoftTexture texture = make_texture();
+    for (size_t count: { 1000, 10000, 100000 })
+        ok &= run_scene(make_cubes(count), hardware_threads);
+    for (size_t count: { 100, 1000, 10000 })
+        ok &= run_scene(make_quads(count, texture), hardware_threads);
+
+    if (!ok)
+    {
+        std::cerr << "[ERROR] The rasterizer kernels disagree\n";
+        return 1;
+    }
+    return 0;
+}
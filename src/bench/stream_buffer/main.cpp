@@ -0,0 +1,283 @@
+// Benchmark of streaming vertex data written anew every frame: N particles
+// moved on the CPU and drawn as points, their vertices uploaded five ways:
+//   - buffer_data: glBufferData with the data, reallocating every frame.
+//   - sub_data:    glBufferSubData into the same storage, which has to wait
+//                  until the previous frame has been drawn from it.
+//   - orphan:      util::StreamBuffer without buffer storage: the storage is
+//                  orphaned and mapped unsynchronized.
+//   - persist1:    util::StreamBuffer mapped persistently with one region, so
+//                  every frame waits for the previous one (stalls).
+//   - persist3:    util::StreamBuffer mapped persistently with three regions.
+// Frames are not waited for, the CPU may run ahead of the GPU as it would in
+// an application. For each particle count (default 100k, 500k and 1M, or
+// --counts a,b,...) it reports the time per frame and the fence stalls, and
+// checks that all ways render the same image.
+//
+// Runs headless in a GL 4.4 context (llvmpipe has it); without buffer
+// storage the persistent ways are skipped. --frames N sets the frames
+// measured per way.
+
+#include <glad/glad.h>
+
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+#include <util/shader.hpp>
+#include <util/stream_buffer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <vector>
+
+using bench_clock = std::chrono::steady_clock;
+
+struct Vertex
+{
+    float x;
+    float y;
+    uint32_t color;
+};
+
+struct Particle
+{
+    float x;
+    float y;
+    float dx;
+    float dy;
+};
+
+enum class Mode
+{
+    buffer_data,
+    sub_data,
+    orphan,
+    persist1,
+    persist3,
+};
+
+static const char* const mode_names[] = { "buffer_data", "sub_data", "orphan", "persist1",
+                                          "persist3" };
+
+static std::vector<Particle> make_particles(size_t count);
+static void move_particles(std::vector<Particle>& particles, std::vector<Vertex>& vertices);
+static std::vector<size_t> parse_counts(const char* list);
+
+static double ms_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+static void point_attributes(size_t offset)
+{
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                          reinterpret_cast<const void*>(offset));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex),
+                          reinterpret_cast<const void*>(offset + offsetof(Vertex, color)));
+}
+
+int main(int argc, char* argv[])
+{
+    util::ContextOptions options(512, 512);
+    options.backend = util::Backend::headless;
+    options.gl_major = 4;
+    options.gl_minor = 4;
+    util::Context context(options.parse(argc, argv));
+    if (context.error)
+        return -1;
+
+    std::vector<size_t> counts = { 100000, 500000, 1000000 };
+    int frames = 30;
+    for (int ii = 1; ii + 1 < argc; ++ii)
+    {
+        if (std::strcmp(argv[ii], "--counts") == 0)
+            counts = parse_counts(argv[++ii]);
+        else if (std::strcmp(argv[ii], "--frames") == 0)
+            frames = std::max(1, std::atoi(argv[++ii]));
+    }
+
+    std::printf("GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+    util::Shader shader("shaders/particle.vert", "shaders/particle.frag");
+    if (shader.error)
+        return 1;
+
+    GLuint vao = 0;
+    glGenVertexArrays(1, &vao);
+    util::gl_state().bind_vertex_array(vao);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    shader.use();
+
+    std::printf("\n%8s %-12s %10s %14s %8s %10s\n", "points", "mode", "frame ms", "points/s",
+                "stalls", "stall ms");
+    bool same_images = true;
+    for (size_t count: counts)
+    {
+        const size_t frame_bytes = count * sizeof(Vertex);
+        std::vector<unsigned char> reference;
+
+        for (size_t mode_index = 0; mode_index < std::size(mode_names); ++mode_index)
+        {
+            const Mode mode = static_cast<Mode>(mode_index);
+            const bool streamed = mode >= Mode::orphan;
+            const int regions = mode == Mode::persist1 ? 1 : 3;
+            std::optional<util::StreamBuffer> stream;
+            GLuint buffer = 0;
+            if (streamed)
+            {
+                stream.emplace(GL_ARRAY_BUFFER, frame_bytes, regions, mode != Mode::orphan);
+                if (stream->error)
+                    return 1;
+                if ((mode != Mode::orphan) != stream->persistent())
+                {
+                    std::printf("%8zu %-12s (no buffer storage)\n", count, mode_names[mode_index]);
+                    continue;
+                }
+            }
+            else
+            {
+                glGenBuffers(1, &buffer);
+                util::gl_state().bind_buffer(GL_ARRAY_BUFFER, buffer);
+                glBufferData(GL_ARRAY_BUFFER, frame_bytes, nullptr, GL_DYNAMIC_DRAW);
+            }
+
+            std::vector<Particle> particles = make_particles(count);
+            std::vector<Vertex> vertices(count);
+            glFinish();
+
+            // One more frame than measured: the first one warms up the driver.
+            bench_clock::time_point start;
+            for (int frame = 0; frame <= frames; ++frame)
+            {
+                if (frame == 1)
+                {
+                    glFinish();
+                    start = bench_clock::now();
+                }
+                move_particles(particles, vertices);
+                glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT);
+
+                size_t offset = 0;
+                switch (mode)
+                {
+                case Mode::buffer_data:
+                    util::gl_state().bind_buffer(GL_ARRAY_BUFFER, buffer);
+                    glBufferData(GL_ARRAY_BUFFER, frame_bytes, vertices.data(), GL_DYNAMIC_DRAW);
+                    break;
+                case Mode::sub_data:
+                    util::gl_state().bind_buffer(GL_ARRAY_BUFFER, buffer);
+                    glBufferSubData(GL_ARRAY_BUFFER, 0, frame_bytes, vertices.data());
+                    break;
+                default:
+                {
+                    util::StreamBuffer::Slice slice = stream->allocate(frame_bytes);
+                    if (!slice.data)
+                        return 1;
+                    std::memcpy(slice.data, vertices.data(), frame_bytes);
+                    stream->flush();
+                    offset = slice.offset;
+                    util::gl_state().bind_buffer(GL_ARRAY_BUFFER, stream->id());
+                    break;
+                }
+                }
+                point_attributes(offset);
+                glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+                if (stream)
+                    stream->end_frame();
+            }
+            glFinish();
+            const double frame_ms = ms_since(start) / frames;
+
+            const util::StreamBuffer::Stats stats = stream ? stream->stats()
+                                                           : util::StreamBuffer::Stats{};
+            std::printf("%8zu %-12s %10.2f %14.4g %8zu %10.2f\n", count, mode_names[mode_index],
+                        frame_ms, count * 1000.0 / frame_ms, stats.stalls, stats.stall_ms);
+
+            std::vector<unsigned char> image(static_cast<size_t>(context.width())
+                                             * context.height() * 4);
+            glReadPixels(0, 0, context.width(), context.height(), GL_RGBA, GL_UNSIGNED_BYTE,
+                         image.data());
+            if (reference.empty())
+                reference = std::move(image);
+            else if (image != reference)
+            {
+                std::printf("  %s image differs  <-- MISMATCH\n", mode_names[mode_index]);
+                same_images = false;
+            }
+            if (buffer)
+            {
+                util::gl_state().forget_buffer(buffer);
+                glDeleteBuffers(1, &buffer);
+            }
+        }
+    }
+
+    if (glGetError() != GL_NO_ERROR || !same_images)
+    {
+        std::fprintf(stderr, "[ERROR] The ways of uploading disagree or GL reported an error\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Particles spread over clip space, each drifting in its own direction.
+std::vector<Particle> make_particles(size_t count)
+{
+    std::vector<Particle> particles(count);
+    uint32_t state = 12345;
+    const auto next = [&state] {
+        state = state * 1664525u + 1013904223u;
+        return static_cast<float>(state >> 8) / static_cast<float>(1u << 24) * 2.0f - 1.0f;
+    };
+    for (Particle& particle: particles)
+    {
+        particle.x = next();
+        particle.y = next();
+        particle.dx = 0.01f * next();
+        particle.dy = 0.01f * next();
+    }
+    return particles;
+}
+
+// Moves every particle one step, bouncing off the edges of clip space, and
+// writes its vertex, colored by direction.
+void move_particles(std::vector<Particle>& particles, std::vector<Vertex>& vertices)
+{
+    for (size_t ii = 0; ii < particles.size(); ++ii)
+    {
+        Particle& particle = particles[ii];
+        particle.x += particle.dx;
+        particle.y += particle.dy;
+        if (std::fabs(particle.x) > 1.0f)
+            particle.dx = -particle.dx;
+        if (std::fabs(particle.y) > 1.0f)
+            particle.dy = -particle.dy;
+        const uint32_t red = particle.dx > 0.0f ? 255u : 64u;
+        const uint32_t green = particle.dy > 0.0f ? 255u : 64u;
+        vertices[ii] = Vertex{ particle.x, particle.y, red | green << 8 | 128u << 16 | 255u << 24 };
+    }
+}
+
+std::vector<size_t> parse_counts(const char* list)
+{
+    std::vector<size_t> counts;
+    for (const char* pos = list; *pos;)
+    {
+        char* end = nullptr;
+        const long value = std::strtol(pos, &end, 10);
+        if (end == pos)
+            break;
+        if (value > 0)
+            counts.push_back(static_cast<size_t>(value));
+        pos = *end == ',' ? end + 1 : end;
+    }
+    return counts;
+}
@@ -0,0 +1,291 @@
+// Startup benchmark for the asynchronous texture loader (util/texture_loader.hpp).
+//
+// Loads a set of images and draws one textured quad per image, two ways:
+//   - sync:  stbi_load, glTexImage2D and glGenerateMipmap for every image on
+//            the render thread, then the first frame, like the samples did.
+//   - async: util::TextureLoader::load() for every image and the first frame
+//            right away (with placeholders); later frames poll() the uploads.
+// and reports the time to the first frame, the time until every texture is
+// ready and, for async, the longest frame while textures were streaming in.
+//
+// Two image sets are measured: the sample textures (container.jpg and
+// awesomeface.png) and --count synthetic RGB images of --size squared pixels
+// (default 200 of 1024x1024). The synthetic ones are written as binary PPM,
+// since no image encoder is vendored, so their decode is mostly I/O and
+// copying. Files are read once before timing, so all rounds hit the page
+// cache. Runs headless by default (--window for a GLFW window).
+
+#include <glad/glad.h>
+
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+#include <util/shader.hpp>
+#include <util/texture_loader.hpp>
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+using bench_clock = std::chrono::steady_clock;
+
+struct Timings
+{
+    double first_frame_ms = 0.0;
+    double all_ready_ms = 0.0;
+    double longest_frame_ms = 0.0;
+    long frames = 0;
+};
+
+static std::vector<std::string> write_synthetic_images(const fs::path& dir, int count, int size);
+static void warm_page_cache(const std::vector<std::string>& paths);
+static Timings load_sync(util::Context& context, const std::vector<std::string>& paths,
+                         util::Shader& shader);
+static Timings load_async(util::Context& context, const std::vector<std::string>& paths,
+                          util::Shader& shader, size_t threads);
+static void draw_frame(util::Context& context, const std::vector<GLuint>& textures,
+                       util::Shader& shader);
+static void report(const std::vector<Timings>& rounds, bool streaming);
+
+static double ms_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+static const char* const synthetic_dir = ".texture_bench";
+
+int main(int argc, char* argv[])
+{
+    constexpr int rounds = 3;
+
+    util::ContextOptions options(256, 256);
+    options.backend = util::Backend::headless;
+    util::Context context(options.parse(argc, argv));
+    if (context.error)
+        return -1;
+
+    int count = 200;
+    int size = 1024;
+    size_t threads = 0;
+    for (int ii = 1; ii + 1 < argc; ++ii)
+    {
+        if (std::strcmp(argv[ii], "--count") == 0)
+            count = std::max(1, std::atoi(argv[++ii]));
+        else if (std::strcmp(argv[ii], "--size") == 0)
+            size = std::max(1, std::atoi(argv[++ii]));
+        else if (std::strcmp(argv[ii], "--threads") == 0)
+            threads = static_cast<size_t>(std::max(0, std::atoi(argv[++ii])));
+    }
+
+    std::printf("GL_RENDERER: %s\n", glGetString(GL_RENDERER));
+    std::printf("Hardware threads: %u\n\n", std::thread::hardware_concurrency());
+
+    util::Shader shader("shaders/quad.vert", "shaders/quad.frag");
+    if (shader.error)
+        return 1;
+    shader.use();
+    shader.set_int("texture0", 0);
+    // Core profiles draw nothing without a vertex array, even an empty one.
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    util::gl_state().bind_vertex_array(vao);
+
+    struct ImageSet
+    {
+        const char* name;
+        std::vector<std::string> paths;
+    };
+    const ImageSet sets[] = {
+        { "samples",
+          { "resources/textures/container.jpg", "resources/textures/awesomeface.png" } },
+        { "synthetic", write_synthetic_images(synthetic_dir, count, size) },
+    };
+
+    std::printf("%-10s %-6s %8s %16s %16s %18s\n", "set", "mode", "images", "first frame ms",
+                "all ready ms", "longest frame ms");
+    for (const ImageSet& set: sets)
+    {
+        warm_page_cache(set.paths);
+        std::vector<Timings> sync, async;
+        for (int round = 0; round < rounds; ++round)
+        {
+            sync.push_back(load_sync(context, set.paths, shader));
+            async.push_back(load_async(context, set.paths, shader, threads));
+        }
+        std::printf("%-10s %-6s %8zu", set.name, "sync", set.paths.size());
+        report(sync, false);
+        std::printf("%-10s %-6s %8zu", set.name, "async", set.paths.size());
+        report(async, true);
+    }
+
+    glDeleteVertexArrays(1, &vao);
+    std::error_code ec;
+    fs::remove_all(synthetic_dir, ec);
+    return 0;
+}
+
+// Writes count size x size binary PPM images with different gradients.
+std::vector<std::string> write_synthetic_images(const fs::path& dir, int count, int size)
+{
+    fs::create_directories(dir);
+    std::vector<std::string> paths;
+    std::vector<unsigned char> pixels(static_cast<size_t>(size) * size * 3);
+    for (int ii = 0; ii < count; ++ii)
+    {
+        for (int yy = 0; yy < size; ++yy)
+        {
+            for (int xx = 0; xx < size; ++xx)
+            {
+                unsigned char* px = &pixels[(static_cast<size_t>(yy) * size + xx) * 3];
+                px[0] = static_cast<unsigned char>(xx + ii);
+                px[1] = static_cast<unsigned char>(yy * 3 + ii);
+                px[2] = static_cast<unsigned char>((xx ^ yy) + ii * 7);
+            }
+        }
+        const fs::path path = dir / ("image_" + std::to_string(ii) + ".ppm");
+        std::ofstream fout(path, std::ios::binary);
+        fout << "P6\n" << size << ' ' << size << "\n255\n";
+        fout.write(reinterpret_cast<const char*>(pixels.data()),
+                   static_cast<std::streamsize>(pixels.size()));
+        paths.push_back(path.string());
+    }
+    return paths;
+}
+
+void warm_page_cache(const std::vector<std::string>& paths)
+{
+    std::vector<char> buffer(size_t{ 1 } << 20);
+    for (const std::string& path: paths)
+    {
+        std::ifstream fin(path, std::ios::binary);
+        while (fin.read(buffer.data(), static_cast<std::streamsize>(buffer.size())))
+        {
+        }
+    }
+}
+
+Timings load_sync(util::Context& context, const std::vector<std::string>& paths,
+                  util::Shader& shader)
+{
+    Timings timings;
+    const auto start = bench_clock::now();
+
+    std::vector<GLuint> textures(paths.size());
+    glGenTextures(static_cast<GLsizei>(textures.size()), textures.data());
+    stbi_set_flip_vertically_on_load(true);
+    for (size_t ii = 0; ii < paths.size(); ++ii)
+    {
+        util::gl_state().bind_texture(0, GL_TEXTURE_2D, textures[ii]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        int width, height, channels;
+        unsigned char* data = stbi_load(paths[ii].c_str(), &width, &height, &channels, 0);
+        if (data)
+        {
+            const GLenum format = channels == 4 ? GL_RGBA : GL_RGB;
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(format), width, height, 0, format,
+                         GL_UNSIGNED_BYTE, data);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+        stbi_image_free(data);
+    }
+    // util::TextureLoader flips the images itself.
+    stbi_set_flip_vertically_on_load(false);
+
+    draw_frame(context, textures, shader);
+    glFinish();
+    timings.first_frame_ms = timings.all_ready_ms = ms_since(start);
+    timings.longest_frame_ms = timings.first_frame_ms;
+    timings.frames = 1;
+
+    for (GLuint texture: textures)
+        util::gl_state().forget_texture(texture);
+    glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+    return timings;
+}
+
+Timings load_async(util::Context& context, const std::vector<std::string>& paths,
+                   util::Shader& shader, size_t threads)
+{
+    Timings timings;
+    const auto start = bench_clock::now();
+
+    util::TextureLoader loader(threads);
+    std::vector<util::TextureHandle> handles;
+    std::vector<GLuint> textures;
+    for (const std::string& path: paths)
+    {
+        handles.push_back(loader.load(path));
+        textures.push_back(handles.back().id());
+    }
+
+    // The first frame shows the placeholders; keep drawing until the last
+    // texture is in and one more frame has shown it.
+    bool all_ready = false;
+    while (!all_ready)
+    {
+        const auto frame_start = bench_clock::now();
+        loader.poll();
+        all_ready = loader.pending() == 0;
+        draw_frame(context, textures, shader);
+        glFinish();
+        timings.longest_frame_ms = std::max(timings.longest_frame_ms, ms_since(frame_start));
+        if (timings.frames++ == 0)
+            timings.first_frame_ms = ms_since(start);
+        if (all_ready)
+            timings.all_ready_ms = ms_since(start);
+        else // like a vsynced loop, rather than spinning on poll().
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return timings;
+}
+
+// One quad per texture in a square grid.
+void draw_frame(util::Context& context, const std::vector<GLuint>& textures,
+                util::Shader& shader)
+{
+    static const util::UniformHandle rect = shader.uniform("rect");
+    const int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(textures.size()))));
+    const float cell = 2.0f / static_cast<float>(columns);
+
+    glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    shader.use();
+    for (size_t ii = 0; ii < textures.size(); ++ii)
+    {
+        const int column = static_cast<int>(ii) % columns;
+        const int row = static_cast<int>(ii) / columns;
+        shader.set_vec4(rect, glm::vec4(-1.0f + column * cell, -1.0f + row * cell, cell, cell));
+        util::gl_state().bind_texture(0, GL_TEXTURE_2D, textures[ii]);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    context.end_frame();
+}
+
+// Prints the best of the rounds for each column.
+void report(const std::vector<Timings>& rounds, bool streaming)
+{
+    Timings best = rounds.front();
+    for (const Timings& tt: rounds)
+    {
+        best.first_frame_ms = std::min(best.first_frame_ms, tt.first_frame_ms);
+        best.all_ready_ms = std::min(best.all_ready_ms, tt.all_ready_ms);
+        best.longest_frame_ms = std::min(best.longest_frame_ms, tt.longest_frame_ms);
+    }
+    std::printf(" %16.2f %16.2f", best.first_frame_ms, best.all_ready_ms);
+    if (streaming)
+        std::printf(" %18.2f\n", best.longest_frame_ms);
+    else
+        std::printf(" %18s\n", "-");
+}
@@ -0,0 +1,15 @@
+#version 330 core
+
+// A quad covering rect (x, y, width, height in clip space), made from the
+// vertex index so that no vertex buffer is needed.
+
+out vec2 out_tex_coord;
+
+uniform vec4 rect;
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position = vec4(rect.xy + corner * rect.zw, 0.0, 1.0);
+    out_tex_coord = corner;
+}
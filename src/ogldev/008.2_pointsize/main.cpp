@@ -4,59 +4,29 @@
 // GLFW (include after glad)
 #include <GLFW/glfw3.h>
 
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+#include <util/mesh.hpp>
+
 #include <iostream>
 
 #include <util/shader.hpp>
 
-static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
-static void process_input(GLFWwindow* window);
+static void process_input(util::Context& context);
 static void create_buffers(GLuint& vao);
 
-struct Buffers
-{
-    GLuint vao;
-    GLuint vbo;
-    Buffers(const float* vertices, size_t num_verts);
-    ~Buffers();
-};
+// Each vertex is a position followed by a color.
+using ColoredFormat = util::VertexFormat<util::Vec3f, util::Vec3f>;
 
-int main()
+int main(int argc, char* argv[])
 {
-    GLFWwindow* window;
-
-    // Initialize GLFW.
-    if (!glfwInit())
-        return -1;
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
     constexpr int width{ 800 };
     constexpr int height{ 800 };
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(width, height, "Learn OpenGL", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window!" << std::endl;
-        glfwTerminate();
+    // Create a window (or a headless offscreen context, see util/context.hpp)
+    // and its OpenGL context.
+    util::Context context(argc, argv, width, height);
+    if (context.error)
         return -1;
-    }
-
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLAD.
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
-    {
-        std::cout << "Failed to Initialize GLAD\n";
-        glfwTerminate();
-        return -1;
-    }
-
-    glViewport(0, 0, width, height);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
 
     util::Matrix4f combined_mat("combined_mat");
 
@@ -64,7 +34,6 @@ int main()
     util::Shader shader_program("shaders/vertex.vert", "shaders/fragment.frag", { &combined_mat });
     if (shader_program.error)
     {
-        glfwTerminate();
         return 1;
     }
 
@@ -82,7 +51,7 @@ int main()
     // clang-format on
 
     {
-        Buffers bufs(vertices, 3);
+        const util::Mesh<ColoredFormat> mesh(vertices, 3);
 
         // Little optimization to skip the other side of the triangle.
         // We are drawing the triangle in counter-clockwise dir.
@@ -104,10 +73,10 @@ int main()
             for (int jj = 0; jj < 4; ++jj)
                 mat[ii][jj] = (ii == jj) ? 1.0f : 0.0f;
 
-        while (!glfwWindowShouldClose(window))
+        while (!context.should_close())
         {
             // input
-            process_input(window);
+            process_input(context);
 
             // rendering commands here...
             // set clear color (state setter)
@@ -117,80 +86,31 @@ int main()
 
             shader_program.use();
 
-            glBindVertexArray(bufs.vao);
-
             combined_mat.set();
 
             // draw just the three vertices with set point size.
-            glDrawArrays(GL_POINTS, 0, 3);
+            mesh.draw(GL_POINTS);
 
             // draw the primitive (triangle).
-            glDrawArrays(GL_TRIANGLES, 0, 3);
+            mesh.draw(GL_TRIANGLES);
             // No need to unbind it every time.
             // glBindVertexArray(0);
 
-            // poll and process events
-            glfwPollEvents();
-            // swap buffers
-            glfwSwapBuffers(window);
+            // swap buffers and poll events
+            context.end_frame();
         }
     }
 
-    glfwTerminate();
     return 0;
 }
 
-void framebuffer_resize_callback(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height);
-}
-
 // We call this in the main loop.
-void process_input(GLFWwindow* window)
+void process_input(util::Context& context)
 {
     // Returns the last reported state of a keyboard key for the specified
     // window.
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (context.key_pressed(GLFW_KEY_ESCAPE))
     {
-        glfwSetWindowShouldClose(window, true);
+        context.close();
     }
 }
-
-Buffers::Buffers(const float* vertices, size_t num_verts)
-{
-    constexpr size_t vert_dims = 3; // x, y, z or r, b, g
-    constexpr size_t attributes = 2; // pos + colors.
-
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * (num_verts * vert_dims * attributes), vertices,
-                 GL_STATIC_DRAW);
-
-    glGenVertexArrays(1, &vao);
-    // Bind vertex array object.
-    glBindVertexArray(vao);
-    // Bind the vbo and tell VAO its memory layouts.
-    // 1. Vertex positions:
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    // configure attrib-pointer #0 to the positions part of the vertex buffer.
-    glVertexAttribPointer(0, vert_dims, GL_FLOAT, GL_FALSE,
-                          (vert_dims * attributes) * sizeof(float), (void*)0 /* offset */);
-    // configure attrib-pointer #1 to the color part of the vertex buffer.
-    glVertexAttribPointer(1, vert_dims, GL_FLOAT, GL_FALSE,
-                          (vert_dims * attributes) * sizeof(float),
-                          (void*)(vert_dims * sizeof(float)));
-
-    // Attributes are disabled by default. We need to explicitly enable them too.
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-
-    // Optional: Unbind VAO and VBO.
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-}
-
-Buffers::~Buffers()
-{
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &vbo);
-}
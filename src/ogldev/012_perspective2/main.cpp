@@ -7,17 +7,17 @@
 // GLFW (include after glad)
 #include <GLFW/glfw3.h>
 
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+#include <util/mesh.hpp>
+
 #include <iostream>
-#include <random>
+#include <span>
 
+#include <util/3dtypes.hpp>
 #include <util/shader.hpp>
 
-static std::random_device rd; // Will be used to obtain a seed for the random number engine
-static std::mt19937 gen(rd()); // Standard mersenne_twister_engine seeded with rd()
-static std::uniform_real_distribution<> unirand(0.0, 1.0);
-
-static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
-static void process_input(GLFWwindow* window);
+static void process_input(util::Context& context);
 static void create_buffers(GLuint& vao);
 
 struct ColoredVertex
@@ -34,9 +34,9 @@ struct ColoredVertex
         x = x_;
         y = y_;
         z = 0.0f;
-        r = static_cast<float>(unirand(gen));
-        g = static_cast<float>(unirand(gen));
-        b = static_cast<float>(unirand(gen));
+        r = util::random_float();
+        g = util::random_float();
+        b = util::random_float();
     }
 
     void set(float x_, float y_, float z_)
@@ -44,21 +44,14 @@ struct ColoredVertex
         x = x_;
         y = y_;
         z = z_;
-        r = static_cast<float>(unirand(gen));
-        g = static_cast<float>(unirand(gen));
-        b = static_cast<float>(unirand(gen));
+        r = util::random_float();
+        g = util::random_float();
+        b = util::random_float();
     }
 };
 
-struct Buffers
-{
-    GLuint vao;
-    GLuint vbo;
-    GLuint ibo;
-    Buffers(const ColoredVertex* vertices, const uint16_t* indices, size_t num_verts,
-            size_t num_indices);
-    ~Buffers();
-};
+// Vertex format of ColoredVertex: position and color.
+using ColoredFormat = util::VertexFormat<util::Vec3f, util::Vec3f>;
 
 struct FrameContext
 {
@@ -70,7 +63,7 @@ struct FrameContext
     util::Matrix4f& total_transform;
 };
 
-void display_frame(GLFWwindow* window, Buffers& bufs, size_t num_indices,
+void display_frame(util::Context& context, const util::Mesh<ColoredFormat>& mesh,
                    util::Shader& shader_program, FrameContext& ctxt)
 {
     float& angle = ctxt.angle;
@@ -80,7 +73,7 @@ void display_frame(GLFWwindow* window, Buffers& bufs, size_t num_indices,
     util::Mat4x4f& rotation = ctxt.rotation;
     util::Matrix4f& total_transform = ctxt.total_transform;
     // input
-    process_input(window);
+    process_input(context);
 
     // rendering commands here...
     // set clear color (state setter)
@@ -107,57 +100,22 @@ void display_frame(GLFWwindow* window, Buffers& bufs, size_t num_indices,
     // calculate the final transformation.
     total_transform.set(perspective * translation * rotation);
 
-    glBindVertexArray(bufs.vao);
-
-    glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, 0);
+    mesh.draw();
     // No need to unbind it every time.
     // glBindVertexArray(0);
-
-    // poll and process events
-    glfwPollEvents();
-    // swap buffers
-    glfwSwapBuffers(window);
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-    GLFWwindow* window;
-
-    // Initialize GLFW.
-    if (!glfwInit())
-        return -1;
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
     constexpr int width{ 400 };
     constexpr int height{ 900 };
 
     float ar = static_cast<float>(width) / height;
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(width, height, "Learn OpenGL", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window!" << std::endl;
-        glfwTerminate();
+    // Create a window (or a headless offscreen context, see util/context.hpp)
+    // and its OpenGL context.
+    util::Context context(argc, argv, width, height);
+    if (context.error)
         return -1;
-    }
-
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLAD.
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
-    {
-        std::cout << "Failed to Initialize GLAD\n";
-        glfwTerminate();
-        return -1;
-    }
-
-    glViewport(0, 0, width, height);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
 
     util::Matrix4f trans_tot("trans_tot");
 
@@ -165,7 +123,6 @@ int main()
     util::Shader shader_program("shaders/vertex.vert", "shaders/fragment.frag", { &trans_tot });
     if (shader_program.error)
     {
-        glfwTerminate();
         return 1;
     }
 
@@ -234,7 +191,8 @@ int main()
             1,
             5,
         };
-        Buffers bufs(vertices, indices, num_verts, num_indices);
+        const util::Mesh<ColoredFormat> mesh{ std::span<const ColoredVertex>(vertices),
+                                              std::span<const uint16_t>(indices) };
 
         // Little optimization to skip the other side of the triangle.
         // We are drawing the triangle in counter-clockwise dir.
@@ -291,68 +249,27 @@ int main()
 
         FrameContext ctxt{ angle, delta, perspective, translation, rot, trans_tot };
 
-        while (!glfwWindowShouldClose(window))
+        while (!context.should_close())
         {
-            display_frame(window, bufs, num_indices, shader_program, ctxt);
+            {
+                util::ProfileScope scope(context.profiler(), "display_frame");
+                display_frame(context, mesh, shader_program, ctxt);
+            }
+            // swap buffers and poll events
+            context.end_frame();
         }
     }
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
     return 0;
 }
 
-void framebuffer_resize_callback(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height);
-}
-
 // We call this in the main loop.
-void process_input(GLFWwindow* window)
+void process_input(util::Context& context)
 {
     // Returns the last reported state of a keyboard key for the specified
     // window.
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (context.key_pressed(GLFW_KEY_ESCAPE))
     {
-        glfwSetWindowShouldClose(window, true);
+        context.close();
     }
 }
-
-Buffers::Buffers(const ColoredVertex* vertices, const uint16_t* indices, size_t num_verts,
-                 size_t num_indices)
-{
-    glGenVertexArrays(1, &vao);
-    // Bind vertex array object.
-    glBindVertexArray(vao);
-
-    // Bind the vbo and tell VAO its memory layouts.
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(ColoredVertex) * num_verts, vertices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    // configure attrib-pointer #0 to the positions part of the vertex buffer.
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0 /* offset */);
-    // configure attrib-pointer #1 to the color part of the vertex buffer.
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    // Attributes are disabled by default. We need to explicitly enable them too.
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-
-    glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * num_indices, indices, GL_STATIC_DRAW);
-
-    // Optional: Unbind VAO, VBO and IBO.
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-}
-
-Buffers::~Buffers()
-{
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &vbo);
-    glDeleteBuffers(1, &ibo);
-}
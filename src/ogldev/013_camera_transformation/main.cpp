@@ -11,18 +11,22 @@
 
 #include "util/3dtypes.hpp"
 #include "util/uniforms.hpp"
-#include <cmath>
 #include <cstdint>
 #include <glad/glad.h>
 // GLFW (include after glad)
 #include <GLFW/glfw3.h>
 
+#include <util/context.hpp>
+#include <util/gl_state.hpp>
+#include <util/mesh.hpp>
+#include <util/uniform_block.hpp>
+
 #include <iostream>
+#include <span>
 
 #include <util/shader.hpp>
 
-static void framebuffer_resize_callback(GLFWwindow* window, int width, int height);
-static void process_input(GLFWwindow* window);
+static void process_input(util::Context& context);
 static void create_buffers(GLuint& vao);
 
 struct ColoredVertex
@@ -53,45 +57,38 @@ struct ColoredVertex
 private:
     void set_rgb()
     {
-        r = static_cast<float>(util::random_float());
-        g = static_cast<float>(util::random_float());
-        b = static_cast<float>(util::random_float());
+        r = util::random_float();
+        g = util::random_float();
+        b = util::random_float();
     }
 };
 
-struct Buffers
+// Vertex format of ColoredVertex: position and color.
+using ColoredFormat = util::VertexFormat<util::Vec3f, util::Vec3f>;
+
+// C++ mirror of the Camera uniform block in shaders/vertex.vert.
+struct CameraBlock
 {
-    GLuint vao;
-    GLuint vbo;
-    GLuint ibo;
-    Buffers(const ColoredVertex* vertices, const uint16_t* indices, size_t num_verts,
-            size_t num_indices);
-    ~Buffers();
+    util::std140::mat4 view_projection;
 };
+UTIL_STD140_OFFSET(CameraBlock, view_projection, 0);
 
 struct FrameContext
 {
     float& angle;
     float& delta;
-    util::Mat4x4f& perspective;
-    util::Mat4x4f& camera; // camera or view transformation.
-    util::Mat4x4f& translation;
-    util::Mat4x4f& rotation;
-    util::Matrix4f& WVP; // world view projection transformation (combined).
+    const util::Vec3f& position; // of the cube.
+    util::Matrix4f& world; // world transformation.
 };
 
-void display_frame(GLFWwindow* window, Buffers& bufs, size_t num_indices,
+void display_frame(util::Context& context, const util::Mesh<ColoredFormat>& mesh,
                    util::Shader& shader_program, FrameContext& ctxt)
 {
     float& angle = ctxt.angle;
     float& delta = ctxt.delta;
-    util::Mat4x4f& perspective = ctxt.perspective;
-    util::Mat4x4f& camera = ctxt.camera;
-    util::Mat4x4f& translation = ctxt.translation;
-    util::Mat4x4f& rotation = ctxt.rotation;
-    util::Matrix4f& WVP = ctxt.WVP;
+    util::Matrix4f& world = ctxt.world;
     // input
-    process_input(window);
+    process_input(context);
 
     // rendering commands here...
     // set clear color (state setter)
@@ -107,77 +104,44 @@ void display_frame(GLFWwindow* window, Buffers& bufs, size_t num_indices,
     }
     angle += delta;
 
-    float (&rmat)[4][4] = rotation.mat;
-    float (&tmat)[4][4] = translation.mat;
-
-    // rotation animation.
-    rmat[0][0] = std::cos(angle);
-    rmat[0][2] = -std::sin(angle);
-    rmat[2][0] = std::sin(angle);
-    rmat[2][2] = std::cos(angle);
-    // calculate the final transformation.
-    // translation * rotation is the world transformation.
-    WVP.set(perspective * camera * translation * rotation);
+    // rotation animation: a turn about the y axis, clockwise seen from above
+    // like Mat4x4f::init_rotate_transform_y(), then the translation, both in
+    // one rigid transformation that converts to a matrix without a product.
+    const util::Quatf rotation =
+        util::Quatf::from_axis_angle(util::Vec3f(0.0f, 1.0f, 0.0f), -angle);
+    // The view projection part is in the uniform buffer since setup; only
+    // the world transformation (translation * rotation) changes per frame.
+    world.set(util::DualQuatf(rotation, ctxt.position).to_matrix());
 
-    glBindVertexArray(bufs.vao);
-
-    glDrawElements(GL_TRIANGLES, num_indices, GL_UNSIGNED_SHORT, 0);
+    mesh.draw();
     // No need to unbind it every time.
     // glBindVertexArray(0);
-
-    // poll and process events
-    glfwPollEvents();
-    // swap buffers
-    glfwSwapBuffers(window);
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-    GLFWwindow* window;
-
-    // Initialize GLFW.
-    if (!glfwInit())
-        return -1;
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
     constexpr int width{ 1200 };
     constexpr int height{ 900 };
 
-    float ar = static_cast<float>(width) / height;
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(width, height, "Learn OpenGL", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Failed to create GLFW window!" << std::endl;
-        glfwTerminate();
+    constexpr float ar = static_cast<float>(width) / height;
+    // Create a window (or a headless offscreen context, see util/context.hpp)
+    // and its OpenGL context.
+    util::Context context(argc, argv, width, height);
+    if (context.error)
         return -1;
-    }
 
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
+    util::Matrix4f world("world");
 
-    // Initialize GLAD.
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
+    // Setup shaders and program.
+    util::Shader shader_program("shaders/vertex.vert", "shaders/fragment.frag", { &world });
+    if (shader_program.error)
     {
-        std::cout << "Failed to Initialize GLAD\n";
-        glfwTerminate();
-        return -1;
+        return 1;
     }
 
-    glViewport(0, 0, width, height);
-
-    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
-
-    util::Matrix4f WVP("wvp");
-
-    // Setup shaders and program.
-    util::Shader shader_program("shaders/vertex.vert", "shaders/fragment.frag", { &WVP });
-    if (shader_program.error)
+    util::UniformBlock<CameraBlock> camera_block("Camera", 0);
+    if (camera_block.error || !camera_block.attach(shader_program.ID))
     {
-        glfwTerminate();
         return 1;
     }
 
@@ -246,7 +210,8 @@ int main()
             1,
             5,
         };
-        Buffers bufs(vertices, indices, num_verts, num_indices);
+        const util::Mesh<ColoredFormat> mesh{ std::span<const ColoredVertex>(vertices),
+                                              std::span<const uint16_t>(indices) };
 
         // Little optimization to skip the other side of the triangle.
         // We are drawing the triangle in counter-clockwise dir.
@@ -254,23 +219,12 @@ int main()
         glCullFace(GL_BACK); // cull back face
         glFrontFace(GL_CW); // GL_CW for clock-wise
 
-        util::Mat4x4f rot;
-        util::Mat4x4f translation;
-        float (&rmat)[4][4] = rot.mat;
-        float (&tmat)[4][4] = translation.mat;
         float angle = 0.0f;
         float delta = 0.03f;
-        for (int ii = 0; ii < 4; ++ii)
-        {
-            for (int jj = 0; jj < 4; ++jj)
-            {
-                tmat[ii][jj] = rmat[ii][jj] = (ii == jj) ? 1.0f : 0.0f;
-            }
-        }
 
         // translate the cube a bit away from the origin in the z-direction so
         // it is fully in the view frustum.
-        tmat[2][3] = 2.0f;
+        const util::Vec3f position(0.0f, 0.0f, 2.0f);
 
         // Camera transformation:
         // Camera uses a U, V, N model.
@@ -285,13 +239,13 @@ int main()
         // float camera_pos[3] = { 0.0f, 0.9f, 0.0f }; 
 
         // camera moves down(y axis) so now we can see the cube's bottom side.
-        float camera_pos[3] = { 0.0f, -0.9f, 0.0f }; 
+        constexpr float camera_pos[3] = { 0.0f, -0.9f, 0.0f };
 
         // These have to be normalized.
-        float camera_U[3] = { 1.0f, 0.0f, 0.0f };
-        float camera_V[3] = { 0.0f, 1.0f, 0.0f };
-        float camera_N[3] = { 0.0f, 0.0f, 1.0f };
-        util::Mat4x4f camera_translation{
+        constexpr float camera_U[3] = { 1.0f, 0.0f, 0.0f };
+        constexpr float camera_V[3] = { 0.0f, 1.0f, 0.0f };
+        constexpr float camera_N[3] = { 0.0f, 0.0f, 1.0f };
+        constexpr util::Mat4x4f camera_translation{
 
             // row 0
             1.0f, 0.0f, 0.0f, -camera_pos[0],
@@ -302,8 +256,8 @@ int main()
             // row 3
             0.0f, 0.0f, 0.0f, 1.0f
         };
-        util::Mat4x4f camera_rotation{
-            
+        constexpr util::Mat4x4f camera_rotation{
+
             // row 0
             camera_U[0], camera_U[1], camera_U[2], 0.0f,
             // row 1
@@ -314,24 +268,24 @@ int main()
             0.0f, 0.0f, 0.0f, 1.0f
         };
 
-        util::Mat4x4f camera_transformation = camera_rotation * camera_translation;
+        constexpr util::Mat4x4f camera_transformation = camera_rotation * camera_translation;
 
         // Perspective projection matrix.
 
         // same FOV is used for the vertical FOV and horizontal FOV.
-        float FOV = 90.0f; // in degrees.
-        float tanHalfFOV = std::tan(FOV * M_PI / 360.0);
+        constexpr float FOV = 90.0f; // in degrees.
+        constexpr float tanHalfFOV = util::constexpr_tan(util::to_radian(FOV / 2.0f));
         // Assumes the near clip-plane is at z = 1.0;
-        float d = 1 / tanHalfFOV;
+        constexpr float d = 1 / tanHalfFOV;
 
         // Change near_z and far_z to see the clipping.
-        const float near_z = 1.0f;
-        const float far_z = 10.0f;
-        const float z_range = near_z - far_z;
-        const float A = (-far_z - near_z) / z_range;
-        const float B = 2.0 * far_z * near_z / z_range;
+        constexpr float near_z = 1.0f;
+        constexpr float far_z = 10.0f;
+        constexpr float z_range = near_z - far_z;
+        constexpr float A = (-far_z - near_z) / z_range;
+        constexpr float B = 2.0 * far_z * near_z / z_range;
 
-        util::Mat4x4f perspective{
+        constexpr util::Mat4x4f perspective{
             // row 0
             d / ar, // here we adjust based on aspect ratio.
             0.0f,
@@ -354,70 +308,39 @@ int main()
             0.0f,
         };
 
-        FrameContext ctxt{ angle, delta, perspective, camera_transformation, translation, rot, WVP };
+        // Nothing above depends on run time values, so the whole chain folds
+        // to this one matrix in read-only data.
+        static constexpr util::Mat4x4f view_projection = perspective * camera_transformation;
+        static_assert(view_projection.mat[1][3] == d * 0.9f && view_projection.mat[3][2] == 1.0f);
+
+        // It never changes either, so it is uploaded once here and shared by
+        // all frames.
+        camera_block.data.view_projection = view_projection;
+        camera_block.upload();
+
+        FrameContext ctxt{ angle, delta, position, world };
 
-        while (!glfwWindowShouldClose(window))
+        while (!context.should_close())
         {
-            display_frame(window, bufs, num_indices, shader_program, ctxt);
+            {
+                util::ProfileScope scope(context.profiler(), "display_frame");
+                display_frame(context, mesh, shader_program, ctxt);
+            }
+            // swap buffers and poll events
+            context.end_frame();
         }
     }
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
     return 0;
 }
 
-void framebuffer_resize_callback(GLFWwindow* window, int width, int height)
-{
-    glViewport(0, 0, width, height);
-}
-
 // We call this in the main loop.
-void process_input(GLFWwindow* window)
+void process_input(util::Context& context)
 {
     // Returns the last reported state of a keyboard key for the specified
     // window.
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (context.key_pressed(GLFW_KEY_ESCAPE))
     {
-        glfwSetWindowShouldClose(window, true);
+        context.close();
     }
 }
-
-Buffers::Buffers(const ColoredVertex* vertices, const uint16_t* indices, size_t num_verts,
-                 size_t num_indices)
-{
-    glGenVertexArrays(1, &vao);
-    // Bind vertex array object.
-    glBindVertexArray(vao);
-
-    // Bind the vbo and tell VAO its memory layouts.
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(ColoredVertex) * num_verts, vertices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    // configure attrib-pointer #0 to the positions part of the vertex buffer.
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0 /* offset */);
-    // configure attrib-pointer #1 to the color part of the vertex buffer.
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-
-    // Attributes are disabled by default. We need to explicitly enable them too.
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-
-    glGenBuffers(1, &ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * num_indices, indices, GL_STATIC_DRAW);
-
-    // Optional: Unbind VAO, VBO and IBO.
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-}
-
-Buffers::~Buffers()
-{
-    glDeleteVertexArrays(1, &vao);
-    glDeleteBuffers(1, &vbo);
-    glDeleteBuffers(1, &ibo);
-}
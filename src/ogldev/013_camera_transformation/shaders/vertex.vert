@@ -3,12 +3,20 @@
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 vertex_color;
 
-uniform mat4 wvp;
+// Shared by every program drawing from this camera and by all frames: the
+// camera does not move, so it is uploaded once at setup (util::UniformBlock).
+// row_major matches util::Mat4x4f.
+layout (std140, row_major) uniform Camera
+{
+    mat4 view_projection;
+};
+
+uniform mat4 world;
 
 out vec3 out_color;
 
 void main()
 {
-    gl_Position = wvp * vec4(pos, 1.0);
+    gl_Position = view_projection * world * vec4(pos, 1.0);
     out_color = vertex_color;
 }
@@ -1,50 +1,21 @@
 #include <util/3dtypes.hpp>
 #include <cassert>
-#include <random>
 
 namespace util
 {
 
-namespace
-{
-std::random_device rd; // Will be used to obtain a seed for the random number engine
-std::mt19937 gen(rd()); // Standard mersenne_twister_engine seeded with rd()
-std::uniform_real_distribution<> unirand(0.0, 1.0);
-}
-
-float random_float() { return unirand(gen); }
-
-Vec3f Vec3f::cross(const Vec3f& v) const
-{
-    const float _x = y * v.z - z * v.y;
-    const float _y = z * v.x - x * v.z;
-    const float _z = x * v.y - y * v.x;
-
-    return Vec3f(_x, _y, _z);
-}
-
-Vec3f& Vec3f::normalize()
-{
-    float len = length();
+// random_float() lives in random.cpp with the other generators.
 
-    assert(len != 0);
-
-    x /= len;
-    y /= len;
-    z /= len;
-
-    return *this;
-}
+// Vec3f, Mat4x4f and Quatf are constexpr and defined in the header; the
+// static_asserts at the end of this file check them at compile time.
 
-Mat4x4f::Mat4x4f(
+Affine3f::Affine3f(
     // row 0
     float a00, float a01, float a02, float a03,
     // row 1
     float a10, float a11, float a12, float a13,
     // row 2
-    float a20, float a21, float a22, float a23,
-    // row 3
-    float a30, float a31, float a32, float a33)
+    float a20, float a21, float a22, float a23)
 {
     mat[0][0] = a00;
     mat[0][1] = a01;
@@ -60,185 +31,280 @@ Mat4x4f::Mat4x4f(
     mat[2][1] = a21;
     mat[2][2] = a22;
     mat[2][3] = a23;
-
-    mat[3][0] = a30;
-    mat[3][1] = a31;
-    mat[3][2] = a32;
-    mat[3][3] = a33;
 }
 
-Mat4x4f Mat4x4f::operator*(const Mat4x4f& other) const
+Affine3f::Affine3f(const Mat4x4f& mat_)
 {
-    Mat4x4f res;
-    for (int ii = 0; ii < 4; ++ii)
+    assert(mat_.mat[3][0] == 0.0f && mat_.mat[3][1] == 0.0f && mat_.mat[3][2] == 0.0f
+           && mat_.mat[3][3] == 1.0f);
+
+    for (short ii = 0; ii < 3; ++ii)
     {
-        for (int jj = 0; jj < 4; ++jj)
+        for (short jj = 0; jj < 4; ++jj)
         {
-            float dot = 0.0f;
-            for (int kk = 0; kk < 4; ++kk)
-            {
-                dot += mat[ii][kk] * other.mat[kk][jj];
-            }
-            res.mat[ii][jj] = dot;
+            mat[ii][jj] = mat_.mat[ii][jj];
         }
     }
+}
+
+// Affine3f::operator* and the product with a Mat4x4f live in simd.cpp.
 
+Affine3f Affine3f::inverse() const
+{
+    const affine3f_t& m = mat;
+    // Cofactors of the upper left 3x3, transposed.
+    const float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    const float c01 = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+    const float c02 = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+    const float c10 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    const float c11 = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+    const float c12 = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+    const float c20 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    const float c21 = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+    const float c22 = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+    const float det = m[0][0] * c00 + m[0][1] * c10 + m[0][2] * c20;
+
+    assert(det != 0);
+
+    const float inv = 1.0f / det;
+    Affine3f res(c00 * inv, c01 * inv, c02 * inv, 0.0f, c10 * inv, c11 * inv, c12 * inv, 0.0f,
+                 c20 * inv, c21 * inv, c22 * inv, 0.0f);
+    // -inverse(R) * t
+    const Vec3f t = res.transform_vector(Vec3f(m[0][3], m[1][3], m[2][3]));
+    res.mat[0][3] = -t.x;
+    res.mat[1][3] = -t.y;
+    res.mat[2][3] = -t.z;
     return res;
 }
 
-void Mat4x4f::init_scale_transform(float scale_x, float scale_y, float scale_z)
+Affine3f Affine3f::inverse_rigid() const
 {
-    float scales[3]{ scale_x, scale_y, scale_z };
-    init_scale_transform(scales);
+    const affine3f_t& m = mat;
+    // -transpose(R) * t
+    const float tx = -(m[0][0] * m[0][3] + m[1][0] * m[1][3] + m[2][0] * m[2][3]);
+    const float ty = -(m[0][1] * m[0][3] + m[1][1] * m[1][3] + m[2][1] * m[2][3]);
+    const float tz = -(m[0][2] * m[0][3] + m[1][2] * m[1][3] + m[2][2] * m[2][3]);
+    return Affine3f(m[0][0], m[1][0], m[2][0], tx, m[0][1], m[1][1], m[2][1], ty, m[0][2],
+                    m[1][2], m[2][2], tz);
 }
 
-void Mat4x4f::init_scale_transform(float scale)
+Mat4x4f Affine3f::to_matrix() const
 {
-    float scales[3]{ scale, scale, scale };
-    init_scale_transform(scales);
+    return Mat4x4f(
+        // row 0
+        mat[0][0], mat[0][1], mat[0][2], mat[0][3],
+        // row 1
+        mat[1][0], mat[1][1], mat[1][2], mat[1][3],
+        // row 2
+        mat[2][0], mat[2][1], mat[2][2], mat[2][3],
+        // row 3
+        0.0f, 0.0f, 0.0f, 1.0f);
 }
 
-void Mat4x4f::init_scale_transform(float scales[3])
+void Affine3f::init_scale_transform(float scale_x, float scale_y, float scale_z)
 {
-    for (short ii = 0; ii < 4; ++ii)
-    {
-        for (short jj = 0; jj < 4; ++jj)
-        {
-            if (ii == jj)
-            {
-                mat[ii][ii] = (ii < 3) ? scales[ii] : 1.0f;
-            }
-            else
-            {
-                mat[ii][jj] = 0.0f;
-            }
-        }
-    }
+    *this = Affine3f(scale_x, 0.0f, 0.0f, 0.0f, 0.0f, scale_y, 0.0f, 0.0f, 0.0f, 0.0f, scale_z,
+                     0.0f);
 }
 
-namespace
-{
+void Affine3f::init_scale_transform(float scale) { init_scale_transform(scale, scale, scale); }
 
-void fill_deg_rotations(Mat4x4f& rx, Mat4x4f& ry, Mat4x4f& rz, float x, float y, float z)
+void Affine3f::init_rotate_transform(float rotate_x, float rotate_y, float rotate_z)
 {
-    x = to_radian(x);
-    y = to_radian(y);
-    z = to_radian(z);
-
-    rx.init_rotate_transform_x(x);
-    ry.init_rotate_transform_y(y);
-    rz.init_rotate_transform_z(z);
+    Mat4x4f rotation;
+    rotation.init_rotate_transform(rotate_x, rotate_y, rotate_z);
+    *this = Affine3f(rotation);
 }
 
-} // end of anonymous namespace
-
-void Mat4x4f::init_rotate_transform(float rotate_x, float rotate_y, float rotate_z)
+void Affine3f::init_translation_transform(float x, float y, float z)
 {
-    Mat4x4f rx, ry, rz;
-    fill_deg_rotations(rx, ry, rz, rotate_x, rotate_y, rotate_z);
-
-    *this = rz * ry * rx;
+    *this = Affine3f(1.0f, 0.0f, 0.0f, x, 0.0f, 1.0f, 0.0f, y, 0.0f, 0.0f, 1.0f, z);
 }
 
-void Mat4x4f::init_rotate_transform_zyx(float rotate_x, float rotate_y, float rotate_z)
+Quatf slerp(const Quatf& a, const Quatf& b, float t)
 {
-    Mat4x4f rx, ry, rz;
+    float cos_theta = a.dot(b);
+    const float sign = cos_theta < 0.0f ? -1.0f : 1.0f;
+    cos_theta *= sign;
+    // Nearly the same rotation: sin(theta) is too small to divide by.
+    if (cos_theta > 0.9995f)
+    {
+        return nlerp(a, b, t);
+    }
 
-    fill_deg_rotations(rx, ry, rz, rotate_x, rotate_y, rotate_z);
+    const float theta = acosf(cos_theta);
+    const float sin_theta = sinf(theta);
+    const float wa = sinf((1.0f - t) * theta) / sin_theta;
+    const float wb = sign * sinf(t * theta) / sin_theta;
+    return Quatf(wa * a.x + wb * b.x, wa * a.y + wb * b.y, wa * a.z + wb * b.z,
+                 wa * a.w + wb * b.w);
+}
 
-    *this = rx * ry * rz;
+Quatf nlerp(const Quatf& a, const Quatf& b, float t)
+{
+    const float sign = a.dot(b) < 0.0f ? -1.0f : 1.0f;
+    Quatf res(a.x + t * (sign * b.x - a.x), a.y + t * (sign * b.y - a.y),
+              a.z + t * (sign * b.z - a.z), a.w + t * (sign * b.w - a.w));
+    return res.normalize();
 }
 
-void Mat4x4f::init_rotate_transform_x(float x)
+DualQuatf::DualQuatf(const Quatf& rotation, const Vec3f& translation)
+    : real{ rotation }
 {
-    mat[0][0] = 1.0f;
-    mat[0][1] = 0.0f;
-    mat[0][2] = 0.0f;
-    mat[0][3] = 0.0f;
+    // dual = (translation, 0) * real / 2
+    const Quatf t(translation.x * 0.5f, translation.y * 0.5f, translation.z * 0.5f, 0.0f);
+    dual = t * real;
+}
 
-    mat[1][0] = 0.0f;
-    mat[1][1] = cosf(x);
-    mat[1][2] = sinf(x);
-    mat[1][3] = 0.0f;
+DualQuatf DualQuatf::operator*(const DualQuatf& r) const
+{
+    DualQuatf res;
+    res.real = real * r.real;
+    const Quatf a = real * r.dual;
+    const Quatf b = dual * r.real;
+    res.dual = Quatf(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w);
+    return res;
+}
 
-    mat[2][0] = 0.0f;
-    mat[2][1] = -sinf(x);
-    mat[2][2] = cosf(x);
-    mat[2][3] = 0.0f;
+Vec3f DualQuatf::translation() const
+{
+    // 2 * dual * conjugate(real)
+    const Quatf t = dual * real.conjugate();
+    return Vec3f(t.x + t.x, t.y + t.y, t.z + t.z);
+}
 
-    mat[3][0] = 0.0f;
-    mat[3][1] = 0.0f;
-    mat[3][2] = 0.0f;
-    mat[3][3] = 1.0f;
+Vec3f DualQuatf::transform_point(const Vec3f& p) const
+{
+    Vec3f res = real.rotate(p);
+    res += translation();
+    return res;
 }
 
-void Mat4x4f::init_rotate_transform_y(float y)
+DualQuatf& DualQuatf::normalize()
 {
-    mat[0][0] = cosf(y);
-    mat[0][1] = 0.0f;
-    mat[0][2] = -sinf(y);
-    mat[0][3] = 0.0f;
+    const float len = real.length();
 
-    mat[1][0] = 0.0f;
-    mat[1][1] = 1.0f;
-    mat[1][2] = 0.0f;
-    mat[1][3] = 0.0f;
+    assert(len != 0);
 
-    mat[2][0] = sinf(y);
-    mat[2][1] = 0.0f;
-    mat[2][2] = cosf(y);
-    mat[2][3] = 0.0f;
+    const float inv = 1.0f / len;
+    real = Quatf(real.x * inv, real.y * inv, real.z * inv, real.w * inv);
+    dual = Quatf(dual.x * inv, dual.y * inv, dual.z * inv, dual.w * inv);
+    // Keep dual orthogonal to real, which a unit dual quaternion has.
+    const float d = real.dot(dual);
+    dual = Quatf(dual.x - real.x * d, dual.y - real.y * d, dual.z - real.z * d,
+                 dual.w - real.w * d);
+    return *this;
+}
 
-    mat[3][0] = 0.0f;
-    mat[3][1] = 0.0f;
-    mat[3][2] = 0.0f;
-    mat[3][3] = 1.0f;
+Mat4x4f DualQuatf::to_matrix() const
+{
+    Mat4x4f res = real.to_matrix();
+    const Vec3f t = translation();
+    res.mat[0][3] = t.x;
+    res.mat[1][3] = t.y;
+    res.mat[2][3] = t.z;
+    return res;
 }
 
-void Mat4x4f::init_rotate_transform_z(float z)
+DualQuatf nlerp(const DualQuatf& a, const DualQuatf& b, float t)
 {
-    mat[0][0] = cosf(z);
-    mat[0][1] = sinf(z);
-    mat[0][2] = 0.0f;
-    mat[0][3] = 0.0f;
+    const float sign = a.real.dot(b.real) < 0.0f ? -1.0f : 1.0f;
+    const auto lerp = [sign, t](const Quatf& qa, const Quatf& qb) {
+        return Quatf(qa.x + t * (sign * qb.x - qa.x), qa.y + t * (sign * qb.y - qa.y),
+                     qa.z + t * (sign * qb.z - qa.z), qa.w + t * (sign * qb.w - qa.w));
+    };
+    DualQuatf res;
+    res.real = lerp(a.real, b.real);
+    res.dual = lerp(a.dual, b.dual);
+    return res.normalize();
+}
 
-    mat[1][0] = -sinf(z);
-    mat[1][1] = cosf(z);
-    mat[1][2] = 0.0f;
-    mat[1][3] = 0.0f;
+// Compile time checks of the constexpr math: the trigonometry against known
+// values and folded transformations against their results worked out by hand.
+namespace
+{
 
-    mat[2][0] = 0.0f;
-    mat[2][1] = 0.0f;
-    mat[2][2] = 1.0f;
-    mat[2][3] = 0.0f;
+constexpr bool near(float a, float b, float eps = 1e-6f) { return a - b <= eps && b - a <= eps; }
 
-    mat[3][0] = 0.0f;
-    mat[3][1] = 0.0f;
-    mat[3][2] = 0.0f;
-    mat[3][3] = 1.0f;
+constexpr bool near(const Mat4x4f& a, const Mat4x4f& b, float eps = 1e-6f)
+{
+    for (int ii = 0; ii < 4; ++ii)
+    {
+        for (int jj = 0; jj < 4; ++jj)
+        {
+            if (!near(a.mat[ii][jj], b.mat[ii][jj], eps))
+                return false;
+        }
+    }
+    return true;
 }
 
-void Mat4x4f::init_translation_transform(float x, float y, float z)
+constexpr Mat4x4f translation(float x, float y, float z)
 {
-    mat[0][0] = 1.0f;
-    mat[0][1] = 0.0f;
-    mat[0][2] = 0.0f;
-    mat[0][3] = x;
+    Mat4x4f res;
+    res.init_translation_transform(x, y, z);
+    return res;
+}
 
-    mat[1][0] = 0.0f;
-    mat[1][1] = 1.0f;
-    mat[1][2] = 0.0f;
-    mat[1][3] = y;
+constexpr Mat4x4f scale(float x, float y, float z)
+{
+    Mat4x4f res;
+    res.init_scale_transform(x, y, z);
+    return res;
+}
 
-    mat[2][0] = 0.0f;
-    mat[2][1] = 0.0f;
-    mat[2][2] = 1.0f;
-    mat[2][3] = z;
+constexpr Mat4x4f rotation_y(float angle)
+{
+    Mat4x4f res;
+    res.init_rotate_transform_y(angle);
+    return res;
+}
 
-    mat[3][0] = 0.0f;
-    mat[3][1] = 0.0f;
-    mat[3][2] = 0.0f;
-    mat[3][3] = 1.0f;
+constexpr Mat4x4f rotation(float rotate_x, float rotate_y, float rotate_z)
+{
+    Mat4x4f res;
+    res.init_rotate_transform(rotate_x, rotate_y, rotate_z);
+    return res;
 }
 
+constexpr float pi = std::numbers::pi_v<float>;
+
+static_assert(constexpr_sin(0.0f) == 0.0f && constexpr_cos(0.0f) == 1.0f);
+static_assert(near(constexpr_sin(pi / 6.0f), 0.5f) && near(constexpr_cos(pi / 3.0f), 0.5f));
+static_assert(near(constexpr_sin(-3.0f * pi / 4.0f), -0.70710678f));
+static_assert(near(constexpr_cos(5.0f * pi), -1.0f) && near(constexpr_sin(5.0f * pi), 0.0f));
+static_assert(near(constexpr_sin(2.0f), 0.90929743f) && near(constexpr_cos(2.0f), -0.41614684f));
+static_assert(near(constexpr_tan(pi / 4.0f), 1.0f) && near(constexpr_tan(1.0f), 1.55740772f));
+static_assert(constexpr_sqrt(16.0f) == 4.0f && constexpr_sqrt(0.0f) == 0.0f);
+static_assert(near(constexpr_sqrt(2.0f), 1.41421356f) && near(constexpr_sqrt(1e-4f), 1e-2f));
+
+static_assert(Vec3f(1.0f, 0.0f, 0.0f).cross(Vec3f(0.0f, 1.0f, 0.0f)) == Vec3f(0.0f, 0.0f, 1.0f));
+static_assert(Vec3f(3.0f, 4.0f, 0.0f).length() == 5.0f);
+static_assert(Vec3f(3.0f, 4.0f, 0.0f).normalize() == Vec3f(0.6f, 0.8f, 0.0f));
+
+// Scaling, then translating.
+static_assert(near(translation(1.0f, 2.0f, 3.0f) * scale(2.0f, 3.0f, 4.0f),
+                   Mat4x4f(2.0f, 0.0f, 0.0f, 1.0f, 0.0f, 3.0f, 0.0f, 2.0f, 0.0f, 0.0f, 4.0f, 3.0f,
+                           0.0f, 0.0f, 0.0f, 1.0f)));
+
+// A quarter turn about y, clockwise seen from above: x goes to z.
+static_assert(near(rotation_y(pi / 2.0f),
+                   Mat4x4f(0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f,
+                           0.0f, 0.0f, 0.0f, 1.0f)));
+static_assert(near(rotation(0.0f, 90.0f, 0.0f), rotation_y(pi / 2.0f)));
+static_assert(near(rotation(0.0f, 30.0f, 0.0f) * rotation(0.0f, 60.0f, 0.0f),
+                   rotation(0.0f, 90.0f, 0.0f)));
+static_assert(near(Quatf::from_axis_angle(Vec3f(0.0f, 1.0f, 0.0f), -0.5f).to_matrix(),
+                   rotation_y(0.5f)));
+
+// A projection (d = 1, aspect ratio 4:3, z in [1, 10]) of a camera at
+// (0, -0.9, 0), as in ogldev/013: one fixed matrix.
+static_assert(near(Mat4x4f(0.75f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f,
+                           11.0f / 9.0f, -20.0f / 9.0f, 0.0f, 0.0f, 1.0f, 0.0f)
+                       * translation(0.0f, 0.9f, 0.0f),
+                   Mat4x4f(0.75f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.9f, 0.0f, 0.0f,
+                           11.0f / 9.0f, -20.0f / 9.0f, 0.0f, 0.0f, 1.0f, 0.0f)));
+
+} // end of anonymous namespace
+
 }
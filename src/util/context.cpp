@@ -0,0 +1,493 @@
+#include <util/context.hpp>
+#include <util/gl_ext.hpp>
+#include <util/gl_state.hpp>
+#include <util/render_queue.hpp>
+#include <util/uniforms.hpp>
+
+// GLFW (include after glad)
+#include <GLFW/glfw3.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace util
+{
+
+namespace
+{
+
+bool env_flag(const char* name)
+{
+    const char* env = std::getenv(name);
+    return env && *env && std::strcmp(env, "0") != 0;
+}
+
+} // end of anonymous namespace
+
+ContextOptions& ContextOptions::parse(int argc, char* argv[])
+{
+    if (env_flag("UTIL_HEADLESS"))
+    {
+        backend = Backend::headless;
+    }
+    if (const char* env = std::getenv("UTIL_FRAMES"))
+    {
+        frames = std::strtol(env, nullptr, 10);
+    }
+    if (env_flag("UTIL_PROFILE"))
+    {
+        profile = true;
+        if (std::strcmp(std::getenv("UTIL_PROFILE"), "1") != 0)
+        {
+            profile_output = std::getenv("UTIL_PROFILE");
+        }
+    }
+    if (env_flag("UTIL_WATCH_SHADERS"))
+    {
+        watch_shaders = true;
+    }
+    if (const char* env = std::getenv("UTIL_CAPTURE"))
+    {
+        capture_output = env;
+    }
+
+    for (int ii = 1; ii < argc; ++ii)
+    {
+        const std::string arg = argv[ii];
+        if (arg == "--headless")
+        {
+            backend = Backend::headless;
+        }
+        else if (arg == "--window")
+        {
+            backend = Backend::window;
+        }
+        else if (arg == "--frames" && ii + 1 < argc)
+        {
+            frames = std::strtol(argv[++ii], nullptr, 10);
+        }
+        else if (arg.starts_with("--frames="))
+        {
+            frames = std::strtol(arg.c_str() + 9, nullptr, 10);
+        }
+        else if (arg == "--profile")
+        {
+            profile = true;
+        }
+        else if (arg.starts_with("--profile="))
+        {
+            profile = true;
+            profile_output = arg.substr(10);
+        }
+        else if (arg == "--watch-shaders")
+        {
+            watch_shaders = true;
+        }
+        else if (arg.starts_with("--capture="))
+        {
+            capture_output = arg.substr(10);
+        }
+    }
+    return *this;
+}
+
+Context::Context(const ContextOptions& options)
+    : error{ true }
+{
+    frames_to_render = options.frames;
+    if (options.backend == Backend::headless)
+    {
+        if (frames_to_render <= 0)
+        {
+            frames_to_render = ContextOptions::default_headless_frames;
+        }
+        error = !init_headless(options);
+    }
+    else
+    {
+        error = !init_window(options);
+    }
+
+    if (error)
+    {
+        return;
+    }
+
+    glViewport(0, 0, fb_width, fb_height);
+    // A new context starts from the default state, not from what a previous one had.
+    gl_state().invalidate();
+
+    if (options.profile)
+    {
+        frame_profiler = std::make_unique<FrameProfiler>();
+        profile_output = options.profile_output;
+    }
+
+    if (options.watch_shaders)
+    {
+        watcher = std::make_unique<ShaderWatcher>();
+        if (!watcher->error())
+        {
+            ShaderWatcher::set_active(watcher.get());
+        }
+    }
+
+    if (!options.capture_output.empty())
+    {
+        capture = std::make_unique<FrameCapture>(fb_width, fb_height);
+        capture_output = options.capture_output;
+    }
+}
+
+Context::Context(int argc, char* argv[], int width, int height)
+    : Context(ContextOptions(width, height).parse(argc, argv))
+{
+}
+
+Context::~Context()
+{
+    if (watcher)
+    {
+        ShaderWatcher::set_active(nullptr);
+        watcher.reset();
+    }
+
+    // Both own GL objects, so they go while the context is current.
+    if (capture)
+    {
+        write_capture();
+        capture.reset();
+    }
+    if (frame_profiler)
+    {
+        report_profile();
+        frame_profiler.reset();
+    }
+    // Locations are looked up while setting up and drawing the first frame;
+    // a fixed number of frames rendered headless is where a later lookup
+    // (a uniform set by name every frame) gets caught.
+    if (!window && frames_to_render > 1 && frame_count > 1 && lookups_after_first_frame())
+    {
+        std::cerr << "[ERROR] " << lookups_after_first_frame()
+                  << " uniform location lookups after the first frame\n";
+    }
+
+    if (egl_context)
+    {
+        if (fbo)
+        {
+            glDeleteFramebuffers(1, &fbo);
+            glDeleteRenderbuffers(1, &color_rb);
+            glDeleteRenderbuffers(1, &depth_rb);
+        }
+        eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(egl_display, egl_context);
+    }
+    if (egl_display)
+    {
+        eglTerminate(egl_display);
+        return;
+    }
+
+    // Window backend (or a failed attempt at creating one).
+    if (window)
+    {
+        glfwDestroyWindow(window);
+    }
+    glfwTerminate();
+}
+
+bool Context::init_window(const ContextOptions& options)
+{
+    // Initialize GLFW.
+    if (!glfwInit())
+    {
+        std::cout << "Failed to initialize GLFW!" << std::endl;
+        return false;
+    }
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, options.gl_major);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, options.gl_minor);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    // Create a windowed mode window and its OpenGL context
+    window = glfwCreateWindow(options.width, options.height, options.title, NULL, NULL);
+    if (!window)
+    {
+        std::cout << "Failed to create GLFW window!" << std::endl;
+        return false;
+    }
+
+    // Make the window's context current
+    glfwMakeContextCurrent(window);
+
+    // Initialize GLAD.
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))
+    {
+        std::cout << "Failed to Initialize GLAD\n";
+        return false;
+    }
+    gl_ext::load(reinterpret_cast<GLADloadproc>(glfwGetProcAddress));
+
+    fb_width = options.width;
+    fb_height = options.height;
+    glfwSetWindowUserPointer(window, this);
+    glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+    return true;
+}
+
+bool Context::init_headless(const ContextOptions& options)
+{
+    // Prefer Mesa's surfaceless platform: it needs no X11/Wayland display and
+    // no DRM device, so it also works on machines with neither.
+    EGLDisplay display = EGL_NO_DISPLAY;
+    auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (get_platform_display)
+    {
+        display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (display == EGL_NO_DISPLAY)
+    {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint egl_major, egl_minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &egl_major, &egl_minor))
+    {
+        std::cout << "Failed to initialize EGL!" << std::endl;
+        return false;
+    }
+    egl_display = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cout << "EGL does not support desktop OpenGL!" << std::endl;
+        return false;
+    }
+
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, options.gl_major,
+        EGL_CONTEXT_MINOR_VERSION, options.gl_minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE,
+    };
+
+    // EGL_KHR_no_config_context first, as surfaceless contexts never need a
+    // config. Otherwise pick any config that can do desktop GL.
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT,
+                                          context_attribs);
+    if (context == EGL_NO_CONTEXT)
+    {
+        const EGLint config_attribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE,
+        };
+        EGLConfig config;
+        EGLint num_configs = 0;
+        if (eglChooseConfig(display, config_attribs, &config, 1, &num_configs) && num_configs > 0)
+        {
+            context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+        }
+    }
+    if (context == EGL_NO_CONTEXT)
+    {
+        std::cout << "Failed to create a headless OpenGL " << options.gl_major << '.'
+                  << options.gl_minor << " context!" << std::endl;
+        return false;
+    }
+    egl_context = context;
+
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        std::cout << "Failed to make the headless context current!" << std::endl;
+        return false;
+    }
+
+    // Initialize GLAD.
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress)))
+    {
+        std::cout << "Failed to Initialize GLAD\n";
+        return false;
+    }
+    gl_ext::load(reinterpret_cast<GLADloadproc>(eglGetProcAddress));
+
+    fb_width = options.width;
+    fb_height = options.height;
+    return init_framebuffer();
+}
+
+bool Context::init_framebuffer()
+{
+    glGenRenderbuffers(1, &color_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, color_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, fb_width, fb_height);
+
+    glGenRenderbuffers(1, &depth_rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, depth_rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, fb_width, fb_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rb);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER,
+                              depth_rb);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Offscreen framebuffer is incomplete!" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Context::should_close()
+{
+    if (close_requested)
+    {
+        return true;
+    }
+    if (frames_to_render > 0 && frame_count >= frames_to_render)
+    {
+        return true;
+    }
+    if (window && glfwWindowShouldClose(window))
+    {
+        return true;
+    }
+
+    if (frame_profiler)
+    {
+        frame_profiler->begin_frame();
+    }
+    if (watcher)
+    {
+        watcher->poll();
+    }
+    return false;
+}
+
+void Context::end_frame()
+{
+    // Before presenting, as that leaves the back buffer undefined.
+    if (capture && (frames_to_render <= 0 || frame_count + 1 == frames_to_render))
+    {
+        ProfileScope scope(profiler(), "capture");
+        capture->read(fbo, frame_count);
+        capture->poll();
+    }
+
+    ++frame_count;
+    if (frame_count == 1)
+    {
+        first_frame_lookups = UniformTable::driver_queries();
+    }
+    {
+        ProfileScope scope(profiler(), "present");
+        if (window)
+        {
+            // swap buffers
+            glfwSwapBuffers(window);
+            // poll and process events
+            glfwPollEvents();
+        }
+        else
+        {
+            // Nothing to present; just make sure the frame gets submitted.
+            glFlush();
+        }
+    }
+
+    if (frame_profiler)
+    {
+        frame_profiler->end_frame();
+    }
+}
+
+void Context::report_profile()
+{
+    frame_profiler->finish();
+    frame_profiler->print_summary();
+    const GLState::Stats& state_stats = gl_state().stats();
+    std::cout << "GL state calls: " << state_stats.issued << " issued, " << state_stats.elided
+              << " elided\n";
+    const Uniform::Stats& uniform_stats = Uniform::stats();
+    std::cout << "Uniform uploads: " << uniform_stats.issued << " issued, "
+              << uniform_stats.elided << " elided\n";
+    std::cout << "Uniform location lookups: " << first_frame_lookups
+              << " up to the first frame, " << lookups_after_first_frame() << " after\n";
+    if (const size_t flushes = RenderQueue::total_flushes())
+    {
+        // Per flush, usually once a frame.
+        const RenderQueue::Stats& queue_stats = RenderQueue::total_stats();
+        const double nn = static_cast<double>(flushes);
+        std::cout << "Render queue per flush: " << queue_stats.packets / nn << " packets, "
+                  << queue_stats.draw_calls / nn << " draw calls, "
+                  << queue_stats.state_changes / nn << " state changes, "
+                  << queue_stats.uniform_uploads / nn << " uniform uploads, "
+                  << queue_stats.sort_ms / nn << " ms sorting\n";
+    }
+    if (profile_output.empty())
+    {
+        return;
+    }
+
+    const bool json = profile_output.ends_with(".json");
+    // The lookups for tools like sample_harness, which fails a sample that
+    // has any after the first frame.
+    const bool written =
+        json ? frame_profiler->write_json(
+                   profile_output,
+                   { { "uniform_lookups_first_frame", first_frame_lookups },
+                     { "uniform_lookups_after_first_frame", lookups_after_first_frame() } })
+             : frame_profiler->write_csv(profile_output);
+    if (written)
+    {
+        std::cout << "Profile written to " << profile_output << '\n';
+    }
+}
+
+void Context::write_capture()
+{
+    capture->finish();
+    if (capture->image().empty())
+    {
+        std::cerr << "[ERROR] No frame was captured for " << capture_output << '\n';
+        return;
+    }
+    if (write_ppm(capture_output, capture->image()))
+    {
+        std::cout << "Frame " << capture->image_frame() << " written to " << capture_output
+                  << '\n';
+    }
+}
+
+bool Context::key_pressed(int key) const
+{
+    return window && glfwGetKey(window, key) == GLFW_PRESS;
+}
+
+double Context::time() const
+{
+    if (window)
+    {
+        return glfwGetTime();
+    }
+    return static_cast<double>(frame_count) / 60.0;
+}
+
+// static
+void Context::framebuffer_resize_callback(GLFWwindow* window, int width, int height)
+{
+    Context* context = static_cast<Context*>(glfwGetWindowUserPointer(window));
+    context->fb_width = width;
+    context->fb_height = height;
+    glViewport(0, 0, width, height);
+}
+
+}
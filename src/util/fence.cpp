@@ -0,0 +1,22 @@
+#include <util/fence.hpp>
+
+namespace util
+{
+
+namespace
+{
+
+constexpr GLuint64 second_ns = 1000000000;
+
+} // end of anonymous namespace
+
+GLenum wait_fence(GLsync fence)
+{
+    // A second per call, as drivers may cap the timeout of one.
+    GLenum status = GL_TIMEOUT_EXPIRED;
+    for (int ii = 0; ii < max_fence_wait_s && status == GL_TIMEOUT_EXPIRED; ++ii)
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, second_ns);
+    return status;
+}
+
+}
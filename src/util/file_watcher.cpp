@@ -0,0 +1,112 @@
+#include <util/file_watcher.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace util
+{
+
+#ifdef __linux__
+
+FileWatcher::FileWatcher()
+    : error{ true }
+{
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        std::cerr << "[ERROR] inotify_init1 failed: " << std::strerror(errno) << '\n';
+        return;
+    }
+    error = false;
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (fd >= 0)
+        close(fd);
+}
+
+bool FileWatcher::add(const std::string& path)
+{
+    if (error)
+        return false;
+
+    const std::string file = normalize(path);
+    const std::filesystem::path parent = std::filesystem::path(file).parent_path();
+    const std::string dir = parent.empty() ? std::string(".") : parent.string();
+
+    // Watching a directory again returns its existing descriptor.
+    const int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0)
+    {
+        std::cerr << "[ERROR] Cannot watch " << dir << ": " << std::strerror(errno) << '\n';
+        return false;
+    }
+    directories[wd] = dir;
+    files.insert(file);
+    return true;
+}
+
+std::vector<std::string> FileWatcher::changed()
+{
+    std::vector<std::string> result;
+    if (error)
+        return result;
+
+    alignas(inotify_event) char buffer[4096];
+    for (;;)
+    {
+        const ssize_t len = read(fd, buffer, sizeof(buffer));
+        if (len <= 0)
+            break; // EAGAIN: no more events.
+
+        for (ssize_t offset = 0; offset < len;)
+        {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            const auto dir = directories.find(event->wd);
+            if (dir == directories.end() || event->len == 0)
+                continue;
+            const std::string file = normalize(dir->second + '/' + event->name);
+            if (files.contains(file) && std::find(result.begin(), result.end(), file) == result.end())
+                result.push_back(file);
+        }
+    }
+    return result;
+}
+
+#else // __linux__
+
+FileWatcher::FileWatcher()
+    : error{ true }
+{
+    std::cerr << "[ERROR] FileWatcher needs inotify (Linux)\n";
+}
+
+FileWatcher::~FileWatcher() {}
+
+bool FileWatcher::add(const std::string&) { return false; }
+
+std::vector<std::string> FileWatcher::changed() { return {}; }
+
+#endif // __linux__
+
+// static
+std::string FileWatcher::normalize(const std::string& path)
+{
+    std::string normal = std::filesystem::path(path).lexically_normal().string();
+    if (normal.starts_with("./"))
+        normal.erase(0, 2);
+    return normal;
+}
+
+}
@@ -0,0 +1,141 @@
+#include <util/frame_capture.hpp>
+#include <util/fence.hpp>
+#include <util/gl_state.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace util
+{
+
+FrameCapture::FrameCapture(int width_, int height_, int buffers_)
+    : error{ true }
+    , width{ width_ }
+    , height{ height_ }
+    , num_buffers{ std::clamp(buffers_, 1, max_buffers) }
+{
+    if (width <= 0 || height <= 0)
+    {
+        std::cerr << "[ERROR] Cannot capture frames of " << width << 'x' << height << '\n';
+        return;
+    }
+
+    const GLsizeiptr bytes = static_cast<GLsizeiptr>(width) * height * 4;
+    glGenBuffers(num_buffers, buffers);
+    for (int ii = 0; ii < num_buffers; ++ii)
+    {
+        gl_state().bind_buffer(GL_PIXEL_PACK_BUFFER, buffers[ii]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+    }
+    gl_state().bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+    error = false;
+}
+
+FrameCapture::~FrameCapture()
+{
+    for (Pending& pp: pending)
+    {
+        if (pp.fence)
+            glDeleteSync(pp.fence);
+    }
+    for (int ii = 0; ii < num_buffers; ++ii)
+        gl_state().forget_buffer(buffers[ii]);
+    glDeleteBuffers(num_buffers, buffers);
+}
+
+void FrameCapture::read(GLuint framebuffer, long frame)
+{
+    if (error)
+        return;
+
+    // The oldest read has to be done before its buffer is reused.
+    if (pending[next].fence)
+    {
+        if (!collect(next, false))
+        {
+            ++capture_stats.stalls;
+            collect(next, true);
+        }
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    if (framebuffer == 0)
+        glReadBuffer(GL_BACK);
+    gl_state().bind_buffer(GL_PIXEL_PACK_BUFFER, buffers[next]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    gl_state().bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pending[next].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pending[next].frame = frame;
+    next = (next + 1) % num_buffers;
+    ++capture_stats.reads;
+}
+
+void FrameCapture::poll()
+{
+    // Oldest first, stopping at the first one still in flight.
+    for (int nn = 0; nn < num_buffers; ++nn)
+    {
+        const int ii = (next + nn) % num_buffers;
+        if (pending[ii].fence && !collect(ii, false))
+            return;
+    }
+}
+
+void FrameCapture::finish()
+{
+    for (int nn = 0; nn < num_buffers; ++nn)
+    {
+        const int ii = (next + nn) % num_buffers;
+        if (pending[ii].fence)
+            collect(ii, true);
+    }
+}
+
+bool FrameCapture::collect(int ii, bool wait)
+{
+    Pending& pp = pending[ii];
+    GLenum status = glClientWaitSync(pp.fence, 0, 0);
+    if (wait && status == GL_TIMEOUT_EXPIRED)
+        status = wait_fence(pp.fence);
+    if (!wait && status == GL_TIMEOUT_EXPIRED)
+        return false;
+    glDeleteSync(pp.fence);
+    pp.fence = nullptr;
+    if (status == GL_WAIT_FAILED)
+    {
+        std::cerr << "[ERROR] Waiting for a frame capture fence failed\n";
+        return true;
+    }
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        std::cerr << "[ERROR] Frame " << pp.frame << " was not read back after "
+                  << max_fence_wait_s << " s, dropping its capture\n";
+        return true;
+    }
+
+    const size_t bytes = static_cast<size_t>(width) * height * 4;
+    gl_state().bind_buffer(GL_PIXEL_PACK_BUFFER, buffers[ii]);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                                          static_cast<GLsizeiptr>(bytes), GL_MAP_READ_BIT);
+    if (mapped)
+    {
+        latest.width = width;
+        latest.height = height;
+        latest.pixels.resize(bytes);
+        std::memcpy(latest.pixels.data(), mapped, bytes);
+        latest_frame = pp.frame;
+        ++capture_stats.completed;
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+    {
+        std::cerr << "[ERROR] Could not map a frame capture buffer\n";
+    }
+    gl_state().bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+    return true;
+}
+
+}
@@ -0,0 +1,484 @@
+#include <util/frustum.hpp>
+#include <util/simd.hpp>
+#include <util/thread_pool.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#if !defined(UTIL_SIMD_DISABLED) && (defined(__x86_64__) || defined(__i386__))
+#define UTIL_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace util
+{
+
+namespace
+{
+
+// The kernels cull the objects [begin, end) into out and return how many are
+// visible. out needs room for end - begin + 8 indices: the AVX2 kernel
+// always stores 8 and advances by the visible ones.
+using BoxKernel = size_t (*)(const Frustum& frustum, const BoxBounds& boxes, size_t begin,
+                             size_t end, uint32_t* out);
+using SphereKernel = size_t (*)(const Frustum& frustum, const SphereBounds& spheres,
+                                size_t begin, size_t end, uint32_t* out);
+
+constexpr size_t out_slack = 8;
+
+// Ranges of the partitioned mode are at least this long, shorter ones cost
+// more to hand to a worker than to cull.
+constexpr size_t min_range = 16384;
+
+// Scalar reference kernels.
+
+size_t boxes_scalar(const Frustum& frustum, const BoxBounds& boxes, size_t begin, size_t end,
+                    uint32_t* out)
+{
+    size_t count = 0;
+    for (size_t ii = begin; ii < end; ++ii)
+    {
+        bool inside = true;
+        for (const Plane& plane: frustum.planes)
+        {
+            const float distance = plane.a * boxes.center_x[ii] + plane.b * boxes.center_y[ii]
+                                 + plane.c * boxes.center_z[ii] + plane.d;
+            const float radius = std::fabs(plane.a) * boxes.extent_x[ii]
+                               + std::fabs(plane.b) * boxes.extent_y[ii]
+                               + std::fabs(plane.c) * boxes.extent_z[ii];
+            inside = inside && distance >= -radius;
+        }
+        if (inside)
+            out[count++] = static_cast<uint32_t>(ii);
+    }
+    return count;
+}
+
+size_t spheres_scalar(const Frustum& frustum, const SphereBounds& spheres, size_t begin,
+                      size_t end, uint32_t* out)
+{
+    size_t count = 0;
+    for (size_t ii = begin; ii < end; ++ii)
+    {
+        bool inside = true;
+        for (const Plane& plane: frustum.planes)
+        {
+            const float distance = plane.a * spheres.center_x[ii] + plane.b * spheres.center_y[ii]
+                                 + plane.c * spheres.center_z[ii] + plane.d;
+            inside = inside && distance >= -spheres.radius[ii];
+        }
+        if (inside)
+            out[count++] = static_cast<uint32_t>(ii);
+    }
+    return count;
+}
+
+#ifdef UTIL_SIMD_X86
+
+// SSE kernels, 4 objects per iteration.
+
+struct SsePlanes
+{
+    __m128 a[6], b[6], c[6], d[6];
+    __m128 abs_a[6], abs_b[6], abs_c[6];
+
+    explicit SsePlanes(const Frustum& frustum)
+    {
+        for (int pp = 0; pp < 6; ++pp)
+        {
+            const Plane& plane = frustum.planes[pp];
+            a[pp] = _mm_set1_ps(plane.a);
+            b[pp] = _mm_set1_ps(plane.b);
+            c[pp] = _mm_set1_ps(plane.c);
+            d[pp] = _mm_set1_ps(plane.d);
+            abs_a[pp] = _mm_set1_ps(std::fabs(plane.a));
+            abs_b[pp] = _mm_set1_ps(std::fabs(plane.b));
+            abs_c[pp] = _mm_set1_ps(std::fabs(plane.c));
+        }
+    }
+};
+
+// Writes the indices base + lane of the lanes set in mask.
+inline size_t write_lanes(unsigned mask, size_t base, uint32_t* out)
+{
+    size_t count = 0;
+    while (mask)
+    {
+        out[count++] = static_cast<uint32_t>(base + __builtin_ctz(mask));
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+size_t boxes_sse(const Frustum& frustum, const BoxBounds& boxes, size_t begin, size_t end,
+                 uint32_t* out)
+{
+    const SsePlanes planes(frustum);
+    size_t count = 0;
+    size_t ii = begin;
+    for (; ii + 4 <= end; ii += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(&boxes.center_x[ii]);
+        const __m128 cy = _mm_loadu_ps(&boxes.center_y[ii]);
+        const __m128 cz = _mm_loadu_ps(&boxes.center_z[ii]);
+        const __m128 ex = _mm_loadu_ps(&boxes.extent_x[ii]);
+        const __m128 ey = _mm_loadu_ps(&boxes.extent_y[ii]);
+        const __m128 ez = _mm_loadu_ps(&boxes.extent_z[ii]);
+        __m128 outside = _mm_setzero_ps();
+        for (int pp = 0; pp < 6; ++pp)
+        {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(planes.a[pp], cx), planes.d[pp]);
+            distance = _mm_add_ps(distance, _mm_mul_ps(planes.b[pp], cy));
+            distance = _mm_add_ps(distance, _mm_mul_ps(planes.c[pp], cz));
+            __m128 radius = _mm_mul_ps(planes.abs_a[pp], ex);
+            radius = _mm_add_ps(radius, _mm_mul_ps(planes.abs_b[pp], ey));
+            radius = _mm_add_ps(radius, _mm_mul_ps(planes.abs_c[pp], ez));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius),
+                                                      _mm_setzero_ps()));
+        }
+        count += write_lanes(~_mm_movemask_ps(outside) & 0xf, ii, out + count);
+    }
+    return count + boxes_scalar(frustum, boxes, ii, end, out + count);
+}
+
+size_t spheres_sse(const Frustum& frustum, const SphereBounds& spheres, size_t begin,
+                   size_t end, uint32_t* out)
+{
+    const SsePlanes planes(frustum);
+    size_t count = 0;
+    size_t ii = begin;
+    for (; ii + 4 <= end; ii += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(&spheres.center_x[ii]);
+        const __m128 cy = _mm_loadu_ps(&spheres.center_y[ii]);
+        const __m128 cz = _mm_loadu_ps(&spheres.center_z[ii]);
+        const __m128 radius = _mm_loadu_ps(&spheres.radius[ii]);
+        __m128 outside = _mm_setzero_ps();
+        for (int pp = 0; pp < 6; ++pp)
+        {
+            __m128 distance = _mm_add_ps(_mm_mul_ps(planes.a[pp], cx), planes.d[pp]);
+            distance = _mm_add_ps(distance, _mm_mul_ps(planes.b[pp], cy));
+            distance = _mm_add_ps(distance, _mm_mul_ps(planes.c[pp], cz));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius),
+                                                      _mm_setzero_ps()));
+        }
+        count += write_lanes(~_mm_movemask_ps(outside) & 0xf, ii, out + count);
+    }
+    return count + spheres_scalar(frustum, spheres, ii, end, out + count);
+}
+
+// AVX2 + FMA kernels, 8 objects per iteration. The indices of the visible
+// ones are packed to the front of a register with one permute, whose
+// control comes from a table indexed by the visibility mask.
+
+#define UTIL_AVX2 __attribute__((target("avx2,fma")))
+
+using PackTable = std::array<std::array<uint32_t, 8>, 256>;
+
+constexpr PackTable make_pack_table()
+{
+    PackTable table{};
+    for (unsigned mask = 0; mask < 256; ++mask)
+    {
+        unsigned count = 0;
+        for (unsigned lane = 0; lane < 8; ++lane)
+        {
+            if (mask & (1u << lane))
+                table[mask][count++] = lane;
+        }
+    }
+    return table;
+}
+
+alignas(32) constexpr PackTable pack_table = make_pack_table();
+
+struct Avx2Planes
+{
+    __m256 a[6], b[6], c[6], d[6];
+    __m256 abs_a[6], abs_b[6], abs_c[6];
+
+    UTIL_AVX2 explicit Avx2Planes(const Frustum& frustum)
+    {
+        for (int pp = 0; pp < 6; ++pp)
+        {
+            const Plane& plane = frustum.planes[pp];
+            a[pp] = _mm256_set1_ps(plane.a);
+            b[pp] = _mm256_set1_ps(plane.b);
+            c[pp] = _mm256_set1_ps(plane.c);
+            d[pp] = _mm256_set1_ps(plane.d);
+            abs_a[pp] = _mm256_set1_ps(std::fabs(plane.a));
+            abs_b[pp] = _mm256_set1_ps(std::fabs(plane.b));
+            abs_c[pp] = _mm256_set1_ps(std::fabs(plane.c));
+        }
+    }
+};
+
+// Stores the indices base + lane of the lanes set in mask at out, packed.
+UTIL_AVX2 inline size_t pack_lanes(unsigned mask, size_t base, uint32_t* out)
+{
+    const __m256i lanes = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(base)),
+                                           _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    const __m256i control =
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(pack_table[mask].data()));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                        _mm256_permutevar8x32_epi32(lanes, control));
+    return static_cast<size_t>(__builtin_popcount(mask));
+}
+
+UTIL_AVX2 size_t boxes_avx2(const Frustum& frustum, const BoxBounds& boxes, size_t begin,
+                            size_t end, uint32_t* out)
+{
+    const Avx2Planes planes(frustum);
+    size_t count = 0;
+    size_t ii = begin;
+    for (; ii + 8 <= end; ii += 8)
+    {
+        const __m256 cx = _mm256_loadu_ps(&boxes.center_x[ii]);
+        const __m256 cy = _mm256_loadu_ps(&boxes.center_y[ii]);
+        const __m256 cz = _mm256_loadu_ps(&boxes.center_z[ii]);
+        const __m256 ex = _mm256_loadu_ps(&boxes.extent_x[ii]);
+        const __m256 ey = _mm256_loadu_ps(&boxes.extent_y[ii]);
+        const __m256 ez = _mm256_loadu_ps(&boxes.extent_z[ii]);
+        __m256 outside = _mm256_setzero_ps();
+        for (int pp = 0; pp < 6; ++pp)
+        {
+            __m256 distance = _mm256_fmadd_ps(planes.a[pp], cx, planes.d[pp]);
+            distance = _mm256_fmadd_ps(planes.b[pp], cy, distance);
+            distance = _mm256_fmadd_ps(planes.c[pp], cz, distance);
+            // distance + |normal| . extent < 0
+            distance = _mm256_fmadd_ps(planes.abs_a[pp], ex, distance);
+            distance = _mm256_fmadd_ps(planes.abs_b[pp], ey, distance);
+            distance = _mm256_fmadd_ps(planes.abs_c[pp], ez, distance);
+            outside = _mm256_or_ps(outside,
+                                   _mm256_cmp_ps(distance, _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        count += pack_lanes(~_mm256_movemask_ps(outside) & 0xff, ii, out + count);
+    }
+    return count + boxes_scalar(frustum, boxes, ii, end, out + count);
+}
+
+UTIL_AVX2 size_t spheres_avx2(const Frustum& frustum, const SphereBounds& spheres,
+                              size_t begin, size_t end, uint32_t* out)
+{
+    const Avx2Planes planes(frustum);
+    size_t count = 0;
+    size_t ii = begin;
+    for (; ii + 8 <= end; ii += 8)
+    {
+        const __m256 cx = _mm256_loadu_ps(&spheres.center_x[ii]);
+        const __m256 cy = _mm256_loadu_ps(&spheres.center_y[ii]);
+        const __m256 cz = _mm256_loadu_ps(&spheres.center_z[ii]);
+        const __m256 radius = _mm256_loadu_ps(&spheres.radius[ii]);
+        __m256 outside = _mm256_setzero_ps();
+        for (int pp = 0; pp < 6; ++pp)
+        {
+            __m256 distance = _mm256_fmadd_ps(planes.a[pp], cx, planes.d[pp]);
+            distance = _mm256_fmadd_ps(planes.b[pp], cy, distance);
+            distance = _mm256_fmadd_ps(planes.c[pp], cz, distance);
+            outside = _mm256_or_ps(outside,
+                                   _mm256_cmp_ps(_mm256_add_ps(distance, radius),
+                                                 _mm256_setzero_ps(), _CMP_LT_OQ));
+        }
+        count += pack_lanes(~_mm256_movemask_ps(outside) & 0xff, ii, out + count);
+    }
+    return count + spheres_scalar(frustum, spheres, ii, end, out + count);
+}
+
+#undef UTIL_AVX2
+
+#endif // UTIL_SIMD_X86
+
+BoxKernel box_kernel()
+{
+    switch (simd::active())
+    {
+#ifdef UTIL_SIMD_X86
+        case simd::Isa::avx2:
+            return boxes_avx2;
+        case simd::Isa::sse:
+            return boxes_sse;
+#endif
+        default:
+            return boxes_scalar;
+    }
+}
+
+SphereKernel sphere_kernel()
+{
+    switch (simd::active())
+    {
+#ifdef UTIL_SIMD_X86
+        case simd::Isa::avx2:
+            return spheres_avx2;
+        case simd::Isa::sse:
+            return spheres_sse;
+#endif
+        default:
+            return spheres_scalar;
+    }
+}
+
+template <typename Bounds, typename Kernel>
+size_t cull_serial(const Frustum& frustum, const Bounds& bounds, std::vector<uint32_t>& visible,
+                   Kernel kernel)
+{
+    visible.resize(bounds.size() + out_slack);
+    const size_t count = kernel(frustum, bounds, 0, bounds.size(), visible.data());
+    visible.resize(count);
+    return count;
+}
+
+// Range kk of the partitioned mode writes from its begin + kk * out_slack,
+// so that the slack of one range does not overlap the next.
+template <typename Bounds, typename Kernel>
+size_t cull_partitioned(const Frustum& frustum, const Bounds& bounds,
+                        std::vector<uint32_t>& visible, ThreadPool& pool, Kernel kernel)
+{
+    const size_t size = bounds.size();
+    const size_t max_ranges = std::max<size_t>(1, (size + min_range - 1) / min_range);
+    // The calling thread takes a range too.
+    const size_t num_ranges = std::min(pool.size() + 1, max_ranges);
+    if (num_ranges == 1)
+        return cull_serial(frustum, bounds, visible, kernel);
+
+    // Multiples of 8, so that only the last range has a scalar tail.
+    const size_t range = ((size + num_ranges - 1) / num_ranges + 7) & ~size_t{ 7 };
+    visible.resize(size + num_ranges * out_slack);
+    std::vector<size_t> counts(num_ranges);
+    uint32_t* out = visible.data();
+    const auto run_range = [&, out](size_t kk) {
+        const size_t begin = std::min(size, kk * range);
+        const size_t end = std::min(size, begin + range);
+        counts[kk] = kernel(frustum, bounds, begin, end, out + begin + kk * out_slack);
+    };
+    TaskGroup group(pool);
+    for (size_t kk = 0; kk + 1 < num_ranges; ++kk)
+        group.submit([&run_range, kk] { run_range(kk); });
+    run_range(num_ranges - 1);
+    group.wait();
+
+    size_t count = counts[0];
+    for (size_t kk = 1; kk < num_ranges; ++kk)
+    {
+        const size_t begin = std::min(size, kk * range);
+        std::memmove(out + count, out + begin + kk * out_slack, counts[kk] * sizeof(uint32_t));
+        count += counts[kk];
+    }
+    visible.resize(count);
+    return count;
+}
+
+} // end of anonymous namespace
+
+Frustum::Frustum(const Mat4x4f& view_projection)
+{
+    // Gribb and Hartmann: a point p is inside when -w <= x, y, z <= w for
+    // (x, y, z, w) = M p, that is when (row3 +- row_i) . p >= 0.
+    const mat4x4f_t& m = view_projection.mat;
+    for (int side = 0; side < 6; ++side)
+    {
+        const int row = side / 2;
+        const float sign = (side % 2 == 0) ? 1.0f : -1.0f;
+        Plane& plane = planes[side];
+        plane.a = m[3][0] + sign * m[row][0];
+        plane.b = m[3][1] + sign * m[row][1];
+        plane.c = m[3][2] + sign * m[row][2];
+        plane.d = m[3][3] + sign * m[row][3];
+        const float length =
+            std::sqrt(plane.a * plane.a + plane.b * plane.b + plane.c * plane.c);
+        if (length > 0.0f)
+        {
+            plane.a /= length;
+            plane.b /= length;
+            plane.c /= length;
+            plane.d /= length;
+        }
+    }
+}
+
+bool Frustum::intersects_sphere(const Vec3f& center, float radius) const
+{
+    return std::all_of(std::begin(planes), std::end(planes),
+                       [&](const Plane& plane) { return plane.distance(center) >= -radius; });
+}
+
+bool Frustum::intersects_box(const Vec3f& min, const Vec3f& max) const
+{
+    const Vec3f center(0.5f * (min.x + max.x), 0.5f * (min.y + max.y), 0.5f * (min.z + max.z));
+    const Vec3f extent(0.5f * (max.x - min.x), 0.5f * (max.y - min.y), 0.5f * (max.z - min.z));
+    return std::all_of(std::begin(planes), std::end(planes), [&](const Plane& plane) {
+        const float radius = std::fabs(plane.a) * extent.x + std::fabs(plane.b) * extent.y
+                           + std::fabs(plane.c) * extent.z;
+        return plane.distance(center) >= -radius;
+    });
+}
+
+void BoxBounds::add(const Vec3f& min, const Vec3f& max)
+{
+    center_x.push_back(0.5f * (min.x + max.x));
+    center_y.push_back(0.5f * (min.y + max.y));
+    center_z.push_back(0.5f * (min.z + max.z));
+    extent_x.push_back(0.5f * (max.x - min.x));
+    extent_y.push_back(0.5f * (max.y - min.y));
+    extent_z.push_back(0.5f * (max.z - min.z));
+}
+
+void BoxBounds::reserve(size_t count)
+{
+    for (std::vector<float>* array:
+         { &center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z })
+        array->reserve(count);
+}
+
+void BoxBounds::clear()
+{
+    for (std::vector<float>* array:
+         { &center_x, &center_y, &center_z, &extent_x, &extent_y, &extent_z })
+        array->clear();
+}
+
+void SphereBounds::add(const Vec3f& center, float radius_)
+{
+    center_x.push_back(center.x);
+    center_y.push_back(center.y);
+    center_z.push_back(center.z);
+    radius.push_back(radius_);
+}
+
+void SphereBounds::reserve(size_t count)
+{
+    for (std::vector<float>* array: { &center_x, &center_y, &center_z, &radius })
+        array->reserve(count);
+}
+
+void SphereBounds::clear()
+{
+    for (std::vector<float>* array: { &center_x, &center_y, &center_z, &radius })
+        array->clear();
+}
+
+size_t cull(const Frustum& frustum, const BoxBounds& boxes, std::vector<uint32_t>& visible)
+{
+    return cull_serial(frustum, boxes, visible, box_kernel());
+}
+
+size_t cull(const Frustum& frustum, const SphereBounds& spheres, std::vector<uint32_t>& visible)
+{
+    return cull_serial(frustum, spheres, visible, sphere_kernel());
+}
+
+size_t cull(const Frustum& frustum, const BoxBounds& boxes, std::vector<uint32_t>& visible,
+            ThreadPool& pool)
+{
+    return cull_partitioned(frustum, boxes, visible, pool, box_kernel());
+}
+
+size_t cull(const Frustum& frustum, const SphereBounds& spheres, std::vector<uint32_t>& visible,
+            ThreadPool& pool)
+{
+    return cull_partitioned(frustum, spheres, visible, pool, sphere_kernel());
+}
+
+}
@@ -0,0 +1,67 @@
+#include <util/gl_ext.hpp>
+
+#include <cstring>
+
+namespace util
+{
+
+namespace gl_ext
+{
+
+MultiDrawElementsIndirect multi_draw_elements_indirect = nullptr;
+MultiDrawArraysIndirect multi_draw_arrays_indirect = nullptr;
+BufferStorage buffer_storage = nullptr;
+
+namespace
+{
+
+bool version_at_least(GLint want_major, GLint want_minor)
+{
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return major > want_major || (major == want_major && minor >= want_minor);
+}
+
+} // end of anonymous namespace
+
+void load(GLADloadproc get_proc)
+{
+    multi_draw_elements_indirect =
+        reinterpret_cast<MultiDrawElementsIndirect>(get_proc("glMultiDrawElementsIndirect"));
+    multi_draw_arrays_indirect =
+        reinterpret_cast<MultiDrawArraysIndirect>(get_proc("glMultiDrawArraysIndirect"));
+    buffer_storage = reinterpret_cast<BufferStorage>(get_proc("glBufferStorage"));
+    if (!buffer_storage)
+        buffer_storage = reinterpret_cast<BufferStorage>(get_proc("glBufferStorageARB"));
+}
+
+bool multi_draw_indirect_supported()
+{
+    return version_at_least(4, 3) && multi_draw_elements_indirect && multi_draw_arrays_indirect;
+}
+
+bool buffer_storage_supported()
+{
+    return buffer_storage && (version_at_least(4, 4) || has_extension("GL_ARB_buffer_storage"));
+}
+
+bool has_extension(const char* name)
+{
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (GLint ii = 0; ii < num_extensions; ++ii)
+    {
+        const char* ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, ii));
+        if (ext && std::strcmp(ext, name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+}
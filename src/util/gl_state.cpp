@@ -0,0 +1,232 @@
+#include <util/gl_state.hpp>
+#include <util/gl_ext.hpp>
+
+namespace util
+{
+
+// static
+int GLState::buffer_target_index(GLenum target)
+{
+    switch (target)
+    {
+        case GL_ARRAY_BUFFER: return 0;
+        case GL_ELEMENT_ARRAY_BUFFER: return 1;
+        case GL_UNIFORM_BUFFER: return 2;
+        case GL_PIXEL_PACK_BUFFER: return 3;
+        case GL_PIXEL_UNPACK_BUFFER: return 4;
+        case GL_COPY_READ_BUFFER: return 5;
+        case GL_COPY_WRITE_BUFFER: return 6;
+        case GL_DRAW_INDIRECT_BUFFER: return 7;
+        default: return -1;
+    }
+}
+
+// static
+int GLState::texture_target_index(GLenum target)
+{
+    switch (target)
+    {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_1D: return 1;
+        case GL_TEXTURE_3D: return 2;
+        case GL_TEXTURE_CUBE_MAP: return 3;
+        case GL_TEXTURE_1D_ARRAY: return 4;
+        case GL_TEXTURE_2D_ARRAY: return 5;
+        case GL_TEXTURE_RECTANGLE: return 6;
+        case GL_TEXTURE_BUFFER: return 7;
+        case GL_TEXTURE_2D_MULTISAMPLE: return 8;
+        default: return -1;
+    }
+}
+
+// static
+int GLState::capability_index(GLenum capability)
+{
+    switch (capability)
+    {
+        case GL_CULL_FACE: return 0;
+        case GL_BLEND: return 1;
+        case GL_DEPTH_TEST: return 2;
+        case GL_STENCIL_TEST: return 3;
+        case GL_SCISSOR_TEST: return 4;
+        case GL_PROGRAM_POINT_SIZE: return 5;
+        default: return -1;
+    }
+}
+
+void GLState::use_program(GLuint program_)
+{
+    if (change(program, program_))
+        glUseProgram(program_);
+}
+
+void GLState::bind_vertex_array(GLuint vao)
+{
+    if (change(vertex_array, vao))
+    {
+        glBindVertexArray(vao);
+        buffers[buffer_target_index(GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+    }
+}
+
+void GLState::bind_buffer(GLenum target, GLuint buffer)
+{
+    const int index = buffer_target_index(target);
+    if (index < 0)
+    {
+        ++call_stats.issued;
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (change(buffers[index], buffer))
+        glBindBuffer(target, buffer);
+}
+
+void GLState::bind_buffer_base(GLenum target, GLuint index, GLuint buffer)
+{
+    ++call_stats.issued;
+    glBindBufferBase(target, index, buffer);
+    const int generic = buffer_target_index(target);
+    if (generic >= 0)
+        buffers[generic] = buffer;
+}
+
+void GLState::active_texture(GLuint unit)
+{
+    if (change(active_unit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::bind_texture(GLuint unit, GLenum target, GLuint texture)
+{
+    const int index = texture_target_index(target);
+    if (unit >= max_texture_units || index < 0)
+    {
+        active_texture(unit);
+        ++call_stats.issued;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (textures[unit][index] == texture)
+    {
+        ++call_stats.elided;
+        return;
+    }
+    active_texture(unit);
+    change(textures[unit][index], texture);
+    glBindTexture(target, texture);
+}
+
+void GLState::set_enabled(GLenum capability, bool enabled)
+{
+    const int index = capability_index(capability);
+    if (index >= 0 && !change(capabilities[index], GLuint{ enabled }))
+        return;
+    if (index < 0)
+        ++call_stats.issued;
+
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void GLState::cull_face(GLenum face)
+{
+    if (change(cull_face_mode, face))
+        glCullFace(face);
+}
+
+void GLState::front_face(GLenum mode)
+{
+    if (change(front_face_mode, mode))
+        glFrontFace(mode);
+}
+
+void GLState::blend_func(GLenum src, GLenum dst)
+{
+    if (blend_src == src && blend_dst == dst)
+    {
+        ++call_stats.elided;
+        return;
+    }
+    blend_src = src;
+    blend_dst = dst;
+    ++call_stats.issued;
+    glBlendFunc(src, dst);
+}
+
+void GLState::depth_func(GLenum func)
+{
+    if (change(depth_func_value, func))
+        glDepthFunc(func);
+}
+
+void GLState::depth_mask(bool enabled)
+{
+    if (change(depth_mask_value, GLuint{ enabled }))
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void GLState::forget_program(GLuint program_)
+{
+    if (program == program_)
+        program = unknown;
+}
+
+void GLState::forget_vertex_array(GLuint vao)
+{
+    if (vertex_array == vao)
+        vertex_array = unknown;
+}
+
+void GLState::forget_buffer(GLuint buffer)
+{
+    for (GLuint& bound: buffers)
+    {
+        if (bound == buffer)
+            bound = unknown;
+    }
+}
+
+void GLState::forget_texture(GLuint texture)
+{
+    for (auto& unit: textures)
+    {
+        for (GLuint& bound: unit)
+        {
+            if (bound == texture)
+                bound = unknown;
+        }
+    }
+}
+
+void GLState::invalidate()
+{
+    program = unknown;
+    vertex_array = unknown;
+    for (GLuint& bound: buffers)
+        bound = unknown;
+    active_unit = unknown;
+    for (auto& unit: textures)
+    {
+        for (GLuint& bound: unit)
+            bound = unknown;
+    }
+    for (GLuint& cap: capabilities)
+        cap = unknown;
+    cull_face_mode = unknown;
+    front_face_mode = unknown;
+    blend_src = unknown;
+    blend_dst = unknown;
+    depth_func_value = unknown;
+    depth_mask_value = unknown;
+}
+
+GLState& gl_state()
+{
+    static GLState state;
+    return state;
+}
+
+}
@@ -0,0 +1,147 @@
+#include <util/image.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace util
+{
+
+namespace
+{
+
+// Reads a header field of a PPM file, skipping whitespace and comments.
+bool read_field(std::istream& in, long& value)
+{
+    for (int cc = in.peek(); cc != EOF; cc = in.peek())
+    {
+        if (cc == '#')
+        {
+            in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        else if (std::isspace(cc))
+        {
+            in.get();
+        }
+        else
+        {
+            break;
+        }
+    }
+    return static_cast<bool>(in >> value);
+}
+
+} // end of anonymous namespace
+
+bool write_ppm(const std::string& path, const Image& image)
+{
+    std::ofstream fout(path, std::ios::binary);
+    if (!fout)
+    {
+        std::cerr << "[ERROR] Cannot write image to " << path << '\n';
+        return false;
+    }
+
+    fout << "P6\n" << image.width << ' ' << image.height << "\n255\n";
+    std::vector<char> row(static_cast<size_t>(image.width) * 3);
+    for (int yy = image.height - 1; yy >= 0; --yy)
+    {
+        const uint8_t* src = &image.pixels[static_cast<size_t>(yy) * image.width * 4];
+        for (int xx = 0; xx < image.width; ++xx)
+        {
+            row[xx * 3 + 0] = static_cast<char>(src[xx * 4 + 0]);
+            row[xx * 3 + 1] = static_cast<char>(src[xx * 4 + 1]);
+            row[xx * 3 + 2] = static_cast<char>(src[xx * 4 + 2]);
+        }
+        fout.write(row.data(), static_cast<std::streamsize>(row.size()));
+    }
+    if (!fout)
+    {
+        std::cerr << "[ERROR] Cannot write image to " << path << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool read_ppm(const std::string& path, Image& image)
+{
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin)
+    {
+        std::cerr << "[ERROR] Cannot read image " << path << '\n';
+        return false;
+    }
+
+    char magic[2] = {};
+    long width = 0;
+    long height = 0;
+    long max_value = 0;
+    fin.read(magic, 2);
+    if (magic[0] != 'P' || magic[1] != '6' || !read_field(fin, width) || !read_field(fin, height)
+        || !read_field(fin, max_value) || width <= 0 || height <= 0 || width > 65536
+        || height > 65536 || max_value != 255)
+    {
+        std::cerr << "[ERROR] " << path << " is not an 8-bit binary PPM image\n";
+        return false;
+    }
+    // One whitespace character ends the header.
+    fin.get();
+
+    image.width = static_cast<int>(width);
+    image.height = static_cast<int>(height);
+    image.pixels.assign(static_cast<size_t>(width) * height * 4, 255);
+    std::vector<char> row(static_cast<size_t>(width) * 3);
+    for (long yy = height - 1; yy >= 0; --yy)
+    {
+        if (!fin.read(row.data(), static_cast<std::streamsize>(row.size())))
+        {
+            std::cerr << "[ERROR] " << path << " is truncated\n";
+            image = Image{};
+            return false;
+        }
+        uint8_t* dst = &image.pixels[static_cast<size_t>(yy) * width * 4];
+        for (long xx = 0; xx < width; ++xx)
+        {
+            dst[xx * 4 + 0] = static_cast<uint8_t>(row[xx * 3 + 0]);
+            dst[xx * 4 + 1] = static_cast<uint8_t>(row[xx * 3 + 1]);
+            dst[xx * 4 + 2] = static_cast<uint8_t>(row[xx * 3 + 2]);
+        }
+    }
+    return true;
+}
+
+ImageDiff compare_images(const Image& image, const Image& reference, int tolerance)
+{
+    ImageDiff diff;
+    if (image.width != reference.width || image.height != reference.height
+        || image.pixels.size() != reference.pixels.size())
+    {
+        diff.size_mismatch = true;
+        return diff;
+    }
+
+    diff.pixels = static_cast<size_t>(image.width) * image.height;
+    double sum_squares = 0.0;
+    for (size_t ii = 0; ii < diff.pixels; ++ii)
+    {
+        int pixel_max = 0;
+        for (size_t cc = 0; cc < 3; ++cc)
+        {
+            const int delta = std::abs(image.pixels[ii * 4 + cc] - reference.pixels[ii * 4 + cc]);
+            pixel_max = std::max(pixel_max, delta);
+            sum_squares += delta * delta;
+        }
+        diff.max_difference = std::max(diff.max_difference, pixel_max);
+        if (pixel_max > tolerance)
+            ++diff.differing;
+    }
+    if (diff.pixels)
+        diff.rms = std::sqrt(sum_squares / static_cast<double>(diff.pixels * 3));
+    return diff;
+}
+
+}
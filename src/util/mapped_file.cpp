@@ -0,0 +1,190 @@
+#include <util/mapped_file.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define UTIL_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace util
+{
+
+MappedFile::MappedFile()
+    : error{ false }
+{
+}
+
+#ifdef UTIL_HAVE_MMAP
+
+namespace
+{
+
+int madvise_flag(MappedFile::Advice advice)
+{
+    switch (advice)
+    {
+    case MappedFile::Advice::sequential:
+        return MADV_SEQUENTIAL;
+    case MappedFile::Advice::random:
+        return MADV_RANDOM;
+    case MappedFile::Advice::willneed:
+        return MADV_WILLNEED;
+    case MappedFile::Advice::normal:
+        break;
+    }
+    return MADV_NORMAL;
+}
+
+// Below this size setting up the mapping and taking its page faults costs
+// more than copying the bytes: BM_read and BM_mmap of src/bench/file_loading.cpp
+// cross between 8 and 16 KB on Linux with the files in the page cache.
+constexpr size_t min_mapped_size = 16 * 1024;
+
+} // end of anonymous namespace
+
+MappedFile::MappedFile(const std::string& path, Advice advice)
+    : error{ true }
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        std::cerr << "[ERROR] Cannot open " << path << ": " << std::strerror(errno) << '\n';
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        std::cerr << "[ERROR] Cannot stat " << path << ": " << std::strerror(errno) << '\n';
+        close(fd);
+        return;
+    }
+
+    const size_t file_size = static_cast<size_t>(info.st_size);
+    if (file_size > 0 && file_size < min_mapped_size)
+    {
+        unsigned char* buffer = new unsigned char[file_size];
+        size_t got = 0;
+        while (got < file_size)
+        {
+            const ssize_t nn = read(fd, buffer + got, file_size - got);
+            if (nn < 0 && errno == EINTR)
+                continue;
+            if (nn <= 0)
+                break;
+            got += static_cast<size_t>(nn);
+        }
+        if (got < file_size)
+        {
+            std::cerr << "[ERROR] Cannot read " << path << '\n';
+            delete[] buffer;
+            close(fd);
+            return;
+        }
+        bytes = buffer;
+        length = file_size;
+        owned = true;
+    }
+    // mmap() rejects a length of 0.
+    else if (file_size > 0)
+    {
+        void* addr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            std::cerr << "[ERROR] Cannot map " << path << ": " << std::strerror(errno) << '\n';
+            close(fd);
+            return;
+        }
+        // Only a hint, failing is harmless.
+        if (advice != Advice::normal)
+            madvise(addr, file_size, madvise_flag(advice));
+        bytes = static_cast<const unsigned char*>(addr);
+        length = file_size;
+    }
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+    error = false;
+}
+
+void MappedFile::release()
+{
+    if (bytes && owned)
+        delete[] bytes;
+    else if (bytes)
+        munmap(const_cast<unsigned char*>(bytes), length);
+    bytes = nullptr;
+    length = 0;
+    owned = false;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path, Advice)
+    : error{ true }
+{
+    std::ifstream fin(path, std::ios::binary | std::ios::ate);
+    if (!fin)
+    {
+        std::cerr << "[ERROR] Cannot open " << path << '\n';
+        return;
+    }
+    const size_t file_size = static_cast<size_t>(fin.tellg());
+    fin.seekg(0);
+    if (file_size > 0)
+    {
+        unsigned char* buffer = new unsigned char[file_size];
+        if (!fin.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(file_size)))
+        {
+            std::cerr << "[ERROR] Cannot read " << path << '\n';
+            delete[] buffer;
+            return;
+        }
+        bytes = buffer;
+        length = file_size;
+        owned = true;
+    }
+    error = false;
+}
+
+void MappedFile::release()
+{
+    delete[] bytes;
+    bytes = nullptr;
+    length = 0;
+    owned = false;
+}
+
+#endif
+
+MappedFile::~MappedFile() { release(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : error{ other.error }
+    , bytes{ std::exchange(other.bytes, nullptr) }
+    , length{ std::exchange(other.length, 0) }
+    , owned{ std::exchange(other.owned, false) }
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        error = other.error;
+        bytes = std::exchange(other.bytes, nullptr);
+        length = std::exchange(other.length, 0);
+        owned = std::exchange(other.owned, false);
+    }
+    return *this;
+}
+
+}
@@ -0,0 +1,215 @@
+#include <util/mesh.hpp>
+#include <util/gl_state.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace util
+{
+
+namespace
+{
+
+// Indices as they go into the index buffer: 32 bit indices are narrowed to
+// 16 bit when they all fit, halving the index memory and bandwidth.
+struct PackedIndices
+{
+    std::vector<uint16_t> narrowed;
+    const void* data = nullptr;
+    size_t count = 0;
+    GLenum type = 0;
+
+    explicit PackedIndices(const IndexData& indices)
+        : data{ indices.data }
+        , count{ indices.count }
+        , type{ indices.count ? indices.type : 0 }
+    {
+        if (type != GL_UNSIGNED_INT)
+        {
+            return;
+        }
+        const auto* wide = static_cast<const uint32_t*>(indices.data);
+        if (*std::max_element(wide, wide + count) > UINT16_MAX)
+        {
+            return;
+        }
+        narrowed.assign(wide, wide + count);
+        data = narrowed.data();
+        type = GL_UNSIGNED_SHORT;
+    }
+
+    size_t index_size() const { return type == GL_UNSIGNED_SHORT ? 2 : 4; }
+    size_t bytes() const { return count * index_size(); }
+};
+
+} // end of anonymous namespace
+
+void MeshBase::create(const void* vertices, size_t vertex_count, GLsizei stride,
+                      const IndexData& indices, void (*setup_attributes)())
+{
+    const PackedIndices packed(indices);
+    num_vertices = vertex_count;
+    num_indices = packed.count;
+    indices_type = packed.type;
+
+    glGenVertexArrays(1, &vao);
+    gl_state().bind_vertex_array(vao);
+
+    glGenBuffers(1, &vbo);
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertex_count * stride, vertices, GL_STATIC_DRAW);
+    setup_attributes();
+
+    if (packed.count)
+    {
+        glGenBuffers(1, &ibo);
+        gl_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, packed.bytes(), packed.data, GL_STATIC_DRAW);
+    }
+}
+
+MeshBase::MeshBase(MeshBase&& other) noexcept
+    : vao{ std::exchange(other.vao, 0) }
+    , vbo{ std::exchange(other.vbo, 0) }
+    , ibo{ std::exchange(other.ibo, 0) }
+    , num_vertices{ std::exchange(other.num_vertices, 0) }
+    , num_indices{ std::exchange(other.num_indices, 0) }
+    , indices_type{ std::exchange(other.indices_type, 0) }
+{
+}
+
+MeshBase& MeshBase::operator=(MeshBase&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        vao = std::exchange(other.vao, 0);
+        vbo = std::exchange(other.vbo, 0);
+        ibo = std::exchange(other.ibo, 0);
+        num_vertices = std::exchange(other.num_vertices, 0);
+        num_indices = std::exchange(other.num_indices, 0);
+        indices_type = std::exchange(other.indices_type, 0);
+    }
+    return *this;
+}
+
+MeshBase::~MeshBase() { release(); }
+
+void MeshBase::release()
+{
+    if (vao)
+    {
+        gl_state().forget_vertex_array(vao);
+        glDeleteVertexArrays(1, &vao);
+    }
+    for (GLuint* buffer: { &vbo, &ibo })
+    {
+        if (*buffer)
+        {
+            gl_state().forget_buffer(*buffer);
+            glDeleteBuffers(1, buffer);
+        }
+    }
+    vao = vbo = ibo = 0;
+}
+
+void MeshBase::bind() const { gl_state().bind_vertex_array(vao); }
+
+void MeshBase::draw(GLenum mode) const
+{
+    bind();
+    if (num_indices)
+    {
+        glDrawElements(mode, static_cast<GLsizei>(num_indices), indices_type, nullptr);
+    }
+    else
+    {
+        glDrawArrays(mode, 0, static_cast<GLsizei>(num_vertices));
+    }
+}
+
+MeshPoolBase::MeshPoolBase(size_t max_vertices, size_t index_bytes, GLsizei stride,
+                           void (*setup_attributes)())
+    : vertex_stride{ stride }
+    , vertex_capacity{ max_vertices }
+    , index_capacity{ index_bytes }
+{
+    glGenVertexArrays(1, &vao);
+    gl_state().bind_vertex_array(vao);
+
+    glGenBuffers(1, &vbo);
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, max_vertices * stride, nullptr, GL_STATIC_DRAW);
+    setup_attributes();
+
+    glGenBuffers(1, &ibo);
+    gl_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, nullptr, GL_STATIC_DRAW);
+}
+
+MeshPoolBase::~MeshPoolBase()
+{
+    gl_state().forget_vertex_array(vao);
+    gl_state().forget_buffer(vbo);
+    gl_state().forget_buffer(ibo);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &ibo);
+}
+
+bool MeshPoolBase::add(const void* vertices, size_t vertex_count, const IndexData& indices,
+                       SubMesh& mesh)
+{
+    const PackedIndices packed(indices);
+    // Keep every mesh's indices aligned for either index type.
+    const size_t index_offset = (index_end + 3) & ~size_t{ 3 };
+    if (vertex_end + vertex_count > vertex_capacity
+        || index_offset + packed.bytes() > index_capacity)
+    {
+        std::cerr << "[ERROR] Mesh pool is full\n";
+        return false;
+    }
+
+    // Uploading rebinds the pool's buffers; the vertex array keeps the index buffer.
+    gl_state().bind_vertex_array(vao);
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, vertex_end * vertex_stride, vertex_count * vertex_stride,
+                    vertices);
+    if (packed.count)
+    {
+        gl_state().bind_buffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, index_offset, packed.bytes(), packed.data);
+    }
+
+    mesh.base_vertex = static_cast<GLint>(vertex_end);
+    mesh.vertex_count = vertex_count;
+    mesh.index_offset = index_offset;
+    mesh.index_count = packed.count;
+    mesh.index_type = packed.type;
+
+    vertex_end += vertex_count;
+    if (packed.count)
+    {
+        index_end = index_offset + packed.bytes();
+    }
+    return true;
+}
+
+void MeshPoolBase::bind() const { gl_state().bind_vertex_array(vao); }
+
+void MeshPoolBase::draw(const SubMesh& mesh, GLenum mode) const
+{
+    if (mesh.index_count)
+    {
+        glDrawElementsBaseVertex(mode, static_cast<GLsizei>(mesh.index_count), mesh.index_type,
+                                 reinterpret_cast<const void*>(mesh.index_offset),
+                                 mesh.base_vertex);
+    }
+    else
+    {
+        glDrawArrays(mode, mesh.base_vertex, static_cast<GLsizei>(mesh.vertex_count));
+    }
+}
+
+}
@@ -0,0 +1,143 @@
+#include <util/multi_draw_batch.hpp>
+#include <util/gl_ext.hpp>
+#include <util/gl_state.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+namespace util
+{
+
+MultiDrawBatchBase::MultiDrawBatchBase(const MeshPoolBase& pool_, GLuint draw_id_location_,
+                                       GLuint storage_binding_, size_t data_size_)
+    : error{ true }
+    , pool{ pool_ }
+    , draw_id_location{ draw_id_location_ }
+    , storage_binding{ storage_binding_ }
+    , data_size{ data_size_ }
+{
+    if (!gl_ext::multi_draw_indirect_supported())
+    {
+        std::cerr << "[ERROR] Multi-draw indirect needs an OpenGL 4.3 context\n";
+        return;
+    }
+
+    glGenBuffers(1, &indirect_buffer);
+    glGenBuffers(1, &storage_buffer);
+    glGenBuffers(1, &draw_id_buffer);
+
+    // The draw id attribute advances once per instance and every command
+    // draws one instance starting at its base instance, so it reads the
+    // index of the draw.
+    gl_state().bind_vertex_array(pool.vertex_array());
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, draw_id_buffer);
+    glVertexAttribIPointer(draw_id_location, 1, GL_UNSIGNED_INT, 0, nullptr);
+    glVertexAttribDivisor(draw_id_location, 1);
+    glEnableVertexAttribArray(draw_id_location);
+    reserve_draw_ids(1024);
+    error = false;
+}
+
+MultiDrawBatchBase::~MultiDrawBatchBase()
+{
+    for (GLuint buffer: { indirect_buffer, storage_buffer, draw_id_buffer })
+    {
+        if (buffer)
+        {
+            gl_state().forget_buffer(buffer);
+            glDeleteBuffers(1, &buffer);
+        }
+    }
+}
+
+void MultiDrawBatchBase::clear()
+{
+    commands16.clear();
+    commands32.clear();
+    array_commands.clear();
+    draw_data.clear();
+    num_draws = 0;
+}
+
+void MultiDrawBatchBase::add(const SubMesh& mesh, const void* data)
+{
+    const GLuint draw_id = static_cast<GLuint>(num_draws++);
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    draw_data.insert(draw_data.end(), bytes, bytes + data_size);
+
+    if (!mesh.index_count)
+    {
+        array_commands.push_back(ArraysCommand{ static_cast<GLuint>(mesh.vertex_count), 1,
+                                                static_cast<GLuint>(mesh.base_vertex), draw_id });
+        return;
+    }
+    // The pool aligns the indices of every mesh to 4 bytes, so the offset is
+    // a whole number of indices of either width.
+    const bool narrow = mesh.index_type == GL_UNSIGNED_SHORT;
+    const size_t index_size = narrow ? sizeof(uint16_t) : sizeof(uint32_t);
+    (narrow ? commands16 : commands32)
+        .push_back(ElementsCommand{ static_cast<GLuint>(mesh.index_count), 1,
+                                    static_cast<GLuint>(mesh.index_offset / index_size),
+                                    mesh.base_vertex, draw_id });
+}
+
+void MultiDrawBatchBase::reserve_draw_ids(size_t count)
+{
+    if (count <= draw_id_capacity)
+        return;
+    draw_id_capacity = std::max(count, 2 * draw_id_capacity);
+    std::vector<GLuint> ids(draw_id_capacity);
+    std::iota(ids.begin(), ids.end(), 0u);
+    gl_state().bind_buffer(GL_ARRAY_BUFFER, draw_id_buffer);
+    glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), ids.data(), GL_STATIC_DRAW);
+}
+
+void MultiDrawBatchBase::draw(GLenum mode)
+{
+    last_draw_calls = 0;
+    if (error || num_draws == 0)
+        return;
+    reserve_draw_ids(num_draws);
+
+    // Replaced every frame: glBufferData orphans the old storage, so the
+    // upload does not wait for the draws of the previous frame.
+    gl_state().bind_buffer(GL_SHADER_STORAGE_BUFFER, storage_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, draw_data.size(), draw_data.data(), GL_STREAM_DRAW);
+    gl_state().bind_buffer_base(GL_SHADER_STORAGE_BUFFER, storage_binding, storage_buffer);
+
+    const size_t elements_bytes = sizeof(ElementsCommand);
+    const size_t offset32 = commands16.size() * elements_bytes;
+    const size_t offset_arrays = offset32 + commands32.size() * elements_bytes;
+    const size_t total = offset_arrays + array_commands.size() * sizeof(ArraysCommand);
+    gl_state().bind_buffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, offset32, commands16.data());
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, offset32, offset_arrays - offset32,
+                    commands32.data());
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, offset_arrays, total - offset_arrays,
+                    array_commands.data());
+
+    pool.bind();
+    if (!commands16.empty())
+    {
+        gl_ext::multi_draw_elements_indirect(mode, GL_UNSIGNED_SHORT, nullptr,
+                                             static_cast<GLsizei>(commands16.size()), 0);
+        ++last_draw_calls;
+    }
+    if (!commands32.empty())
+    {
+        gl_ext::multi_draw_elements_indirect(mode, GL_UNSIGNED_INT,
+                                             reinterpret_cast<const void*>(offset32),
+                                             static_cast<GLsizei>(commands32.size()), 0);
+        ++last_draw_calls;
+    }
+    if (!array_commands.empty())
+    {
+        gl_ext::multi_draw_arrays_indirect(mode, reinterpret_cast<const void*>(offset_arrays),
+                                           static_cast<GLsizei>(array_commands.size()), 0);
+        ++last_draw_calls;
+    }
+}
+
+}
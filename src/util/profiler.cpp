@@ -0,0 +1,344 @@
+#include <util/profiler.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace util
+{
+
+namespace
+{
+
+constexpr float no_sample = std::numeric_limits<float>::quiet_NaN();
+
+void accumulate(float& dst, double ms)
+{
+    dst = std::isnan(dst) ? static_cast<float>(ms) : dst + static_cast<float>(ms);
+}
+
+FrameProfiler::Summary summarize(const std::vector<float>& ring)
+{
+    std::vector<float> samples;
+    samples.reserve(ring.size());
+    for (float ss: ring)
+    {
+        if (!std::isnan(ss))
+            samples.push_back(ss);
+    }
+
+    FrameProfiler::Summary summary;
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (float ss: samples)
+        sum += ss;
+    const size_t p99_index
+        = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(samples.size()))) - 1;
+
+    summary.count = samples.size();
+    summary.min = samples.front();
+    summary.avg = sum / static_cast<double>(samples.size());
+    summary.p99 = samples[p99_index];
+    return summary;
+}
+
+void write_json_summary(std::ostream& out, const FrameProfiler::Summary& summary)
+{
+    out << "{ \"count\": " << summary.count << ", \"min\": " << summary.min
+        << ", \"avg\": " << summary.avg << ", \"p99\": " << summary.p99 << " }";
+}
+
+std::string json_escape(const char* str)
+{
+    std::string escaped;
+    for (; *str; ++str)
+    {
+        if (*str == '"' || *str == '\\')
+            escaped.push_back('\\');
+        escaped.push_back(*str);
+    }
+    return escaped;
+}
+
+} // end of anonymous namespace
+
+FrameProfiler::FrameProfiler(bool gpu_timing, size_t history_size)
+    : gpu_enabled{ gpu_timing }
+    , history{ std::max(history_size, gpu_latency + 1) }
+{
+    if (gpu_enabled)
+    {
+        // Timer queries are core since GL 3.3, but the counter may still be
+        // unimplemented (0 bits).
+        GLint bits = 0;
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+        gpu_enabled = bits > 0;
+    }
+    series_index("frame");
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    for (GpuFrame& gf: gpu_frames)
+    {
+        if (!gf.timestamps.empty())
+            glDeleteQueries(static_cast<GLsizei>(gf.timestamps.size()), gf.timestamps.data());
+    }
+}
+
+size_t FrameProfiler::series_index(const char* name)
+{
+    for (size_t ii = 0; ii < series.size(); ++ii)
+    {
+        if (series[ii].name == name || std::strcmp(series[ii].name, name) == 0)
+            return ii;
+    }
+    series.push_back({ name, std::vector<float>(history, no_sample),
+                       std::vector<float>(history, no_sample) });
+    return series.size() - 1;
+}
+
+void FrameProfiler::begin_frame()
+{
+    if (in_frame)
+        end_frame();
+
+    const uint64_t frame = frame_number++;
+    for (Series& ss: series)
+    {
+        ss.cpu[slot(frame)] = no_sample;
+        ss.gpu[slot(frame)] = no_sample;
+    }
+
+    if (gpu_enabled)
+    {
+        collect_gpu();
+
+        GpuFrame& gf = gpu_frames[frame % gpu_latency];
+        if (gf.pending)
+        {
+            // Still not available after gpu_latency frames; rather than
+            // waiting for it, give the sample up and reuse the queries.
+            ++dropped;
+        }
+        gf.frame = frame;
+        gf.pending = false;
+        gf.timestamps_used = 0;
+        gf.scopes.clear();
+        current_gpu = &gf;
+        gf.frame_begin = next_timestamp();
+        glQueryCounter(gf.frame_begin, GL_TIMESTAMP);
+    }
+
+    in_frame = true;
+    frame_start = clock::now();
+}
+
+void FrameProfiler::end_frame()
+{
+    if (!in_frame)
+        return;
+
+    add_cpu(0, frame_start);
+    if (current_gpu)
+    {
+        const GLuint frame_end = next_timestamp();
+        glQueryCounter(frame_end, GL_TIMESTAMP);
+        current_gpu->scopes.push_back({ 0, current_gpu->frame_begin, frame_end });
+        current_gpu->pending = true;
+        current_gpu = nullptr;
+    }
+    in_frame = false;
+}
+
+void FrameProfiler::add_cpu(size_t index, clock::time_point start)
+{
+    const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    accumulate(series[index].cpu[slot(frame_number - 1)], ms);
+}
+
+GLuint FrameProfiler::next_timestamp()
+{
+    GpuFrame& gf = *current_gpu;
+    if (gf.timestamps_used == gf.timestamps.size())
+    {
+        // Grow in chunks to keep glGenQueries out of the steady state.
+        const size_t grow = std::max<size_t>(8, gf.timestamps.size());
+        gf.timestamps.resize(gf.timestamps.size() + grow);
+        glGenQueries(static_cast<GLsizei>(grow), gf.timestamps.data() + gf.timestamps_used);
+    }
+    return gf.timestamps[gf.timestamps_used++];
+}
+
+void FrameProfiler::collect_gpu()
+{
+    for (GpuFrame& gf: gpu_frames)
+    {
+        if (gf.pending && read_gpu(gf, false))
+            gf.pending = false;
+    }
+}
+
+void FrameProfiler::finish()
+{
+    end_frame();
+    for (GpuFrame& gf: gpu_frames)
+    {
+        if (gf.pending && read_gpu(gf, true))
+            gf.pending = false;
+    }
+}
+
+bool FrameProfiler::read_gpu(GpuFrame& gf, bool wait)
+{
+    // The frame end is the last query of the frame, so once it is available
+    // all of them are. GL_QUERY_RESULT itself waits for the result.
+    if (!wait)
+    {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(gf.scopes.back().end_query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+    }
+
+    const size_t row = slot(gf.frame);
+    for (const GpuScope& scope: gf.scopes)
+    {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(scope.begin_query, GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(scope.end_query, GL_QUERY_RESULT, &end);
+        accumulate(series[scope.series].gpu[row], static_cast<double>(end - begin) * 1e-6);
+    }
+    return true;
+}
+
+std::vector<FrameProfiler::SeriesSummary> FrameProfiler::summaries() const
+{
+    std::vector<SeriesSummary> result;
+    result.reserve(series.size());
+    for (const Series& ss: series)
+    {
+        result.push_back({ ss.name, summarize(ss.cpu), summarize(ss.gpu) });
+    }
+    return result;
+}
+
+void FrameProfiler::print_summary() const
+{
+    std::printf("Profile of %llu frames (ms, statistics over the last %zu)\n",
+                static_cast<unsigned long long>(frames()), history);
+    std::printf("%-16s %9s %9s %9s   %9s %9s %9s\n", "scope", "cpu min", "cpu avg", "cpu p99",
+                "gpu min", "gpu avg", "gpu p99");
+    for (const SeriesSummary& ss: summaries())
+    {
+        std::printf("%-16s %9.3f %9.3f %9.3f", ss.name.c_str(), ss.cpu.min, ss.cpu.avg,
+                    ss.cpu.p99);
+        if (ss.gpu.count)
+            std::printf("   %9.3f %9.3f %9.3f\n", ss.gpu.min, ss.gpu.avg, ss.gpu.p99);
+        else
+            std::printf("   %9s %9s %9s\n", "-", "-", "-");
+    }
+    if (dropped)
+        std::printf("GPU samples dropped: %zu\n", dropped);
+}
+
+bool FrameProfiler::write_csv(const std::string& path) const
+{
+    std::ofstream fout(path);
+    if (!fout)
+    {
+        std::cerr << "[ERROR] Cannot write profile to " << path << '\n';
+        return false;
+    }
+
+    fout << "frame";
+    for (const Series& ss: series)
+        fout << ',' << ss.name << "_cpu_ms," << ss.name << "_gpu_ms";
+    fout << '\n';
+
+    const uint64_t last = frames();
+    const uint64_t first = (last > history) ? last - history : 0;
+    for (uint64_t frame = first; frame < last; ++frame)
+    {
+        fout << frame;
+        for (const Series& ss: series)
+        {
+            fout << ',';
+            if (!std::isnan(ss.cpu[slot(frame)]))
+                fout << ss.cpu[slot(frame)];
+            fout << ',';
+            if (!std::isnan(ss.gpu[slot(frame)]))
+                fout << ss.gpu[slot(frame)];
+        }
+        fout << '\n';
+    }
+    return static_cast<bool>(fout);
+}
+
+bool FrameProfiler::write_json(const std::string& path, const Counters& counters) const
+{
+    std::ofstream fout(path);
+    if (!fout)
+    {
+        std::cerr << "[ERROR] Cannot write profile to " << path << '\n';
+        return false;
+    }
+
+    fout << "{\n  \"frames\": " << frames() << ",\n  \"history\": " << history
+         << ",\n  \"gpu_timing\": " << (gpu_enabled ? "true" : "false")
+         << ",\n  \"gpu_dropped\": " << dropped;
+    for (const auto& [name, count]: counters)
+        fout << ",\n  \"" << json_escape(name.c_str()) << "\": " << count;
+    fout << ",\n  \"series\": [\n";
+    const std::vector<SeriesSummary> all = summaries();
+    for (size_t ii = 0; ii < all.size(); ++ii)
+    {
+        fout << "    { \"name\": \"" << json_escape(all[ii].name.c_str()) << "\", \"cpu_ms\": ";
+        write_json_summary(fout, all[ii].cpu);
+        fout << ", \"gpu_ms\": ";
+        write_json_summary(fout, all[ii].gpu);
+        fout << " }" << (ii + 1 < all.size() ? "," : "") << '\n';
+    }
+    fout << "  ]\n}\n";
+    return static_cast<bool>(fout);
+}
+
+ProfileScope::ProfileScope(FrameProfiler* profiler_, const char* name)
+    : profiler{ (profiler_ && profiler_->in_frame) ? profiler_ : nullptr }
+{
+    if (!profiler)
+        return;
+
+    frame = profiler->frame_number;
+    series = profiler->series_index(name);
+    if (profiler->current_gpu)
+    {
+        begin_query = profiler->next_timestamp();
+        glQueryCounter(begin_query, GL_TIMESTAMP);
+    }
+    start = FrameProfiler::clock::now();
+}
+
+ProfileScope::~ProfileScope()
+{
+    // The frame may have ended inside the scope; then it is not recorded.
+    if (!profiler || !profiler->in_frame || profiler->frame_number != frame)
+        return;
+
+    profiler->add_cpu(series, start);
+    if (begin_query && profiler->current_gpu)
+    {
+        const GLuint end_query = profiler->next_timestamp();
+        glQueryCounter(end_query, GL_TIMESTAMP);
+        profiler->current_gpu->scopes.push_back({ series, begin_query, end_query });
+    }
+}
+
+}
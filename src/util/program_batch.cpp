@@ -0,0 +1,101 @@
+#include <util/program_batch.hpp>
+#include <util/shader.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace util
+{
+
+namespace
+{
+
+double ms_between(std::chrono::steady_clock::time_point from,
+                  std::chrono::steady_clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+}
+
+ProgramBatch::~ProgramBatch() { finish(); }
+
+void ProgramBatch::add(Shader& shader, clock::time_point start, bool issued)
+{
+    const clock::time_point now = clock::now();
+    Timing timing;
+    timing.vertex_path = shader.vertex_path();
+    timing.fragment_path = shader.fragment_path();
+    timing.issue_ms = ms_between(start, now);
+    program_timings.push_back(timing);
+    if (!issued)
+    {
+        all_ok = false;
+        return;
+    }
+    entries.push_back(Entry{ &shader, program_timings.size() - 1, now });
+    shader.batch = this;
+}
+
+void ProgramBatch::remove(Shader& shader)
+{
+    std::erase_if(entries, [&](const Entry& entry) { return entry.shader == &shader; });
+}
+
+bool ProgramBatch::poll()
+{
+    std::vector<Entry> done;
+    std::erase_if(entries, [&](const Entry& entry) {
+        if (!entry.shader->pending_ready())
+            return false;
+        done.push_back(entry);
+        return true;
+    });
+    for (const Entry& entry: done)
+    {
+        complete(entry);
+    }
+    return entries.empty();
+}
+
+bool ProgramBatch::finish()
+{
+    while (!poll())
+    {
+        // Nothing is done yet: wait for the oldest program, which the driver
+        // most likely finishes first.
+        const Entry entry = entries.front();
+        entries.erase(entries.begin());
+        complete(entry);
+    }
+    return all_ok;
+}
+
+void ProgramBatch::complete(const Entry& entry)
+{
+    const clock::time_point ready = clock::now();
+    Timing& timing = program_timings[entry.timing];
+    timing.ready_ms = ms_between(entry.issued, ready);
+    timing.ok = entry.shader->finish_build();
+    timing.finish_ms = ms_between(ready, clock::now());
+    all_ok &= timing.ok;
+}
+
+void ProgramBatch::print_report() const
+{
+    std::printf("%-50s %10s %10s %10s\n", "program (fragment shader)", "issue ms", "ready ms",
+                "finish ms");
+    double issue = 0.0, finish = 0.0, ready = 0.0;
+    for (const Timing& timing: program_timings)
+    {
+        std::printf("%-50s %10.2f %10.2f %10.2f%s\n", timing.fragment_path.c_str(),
+                    timing.issue_ms, timing.ready_ms, timing.finish_ms,
+                    timing.ok ? "" : "  FAILED");
+        issue += timing.issue_ms;
+        finish += timing.finish_ms;
+        ready = std::max(ready, timing.ready_ms);
+    }
+    std::printf("%-50s %10.2f %10.2f %10.2f\n", "total (ready: longest)", issue, ready, finish);
+}
+
+}
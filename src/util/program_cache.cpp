@@ -0,0 +1,222 @@
+#include <util/program_cache.hpp>
+#include <util/hash.hpp>
+#include <util/mapped_file.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace util
+{
+
+namespace program_cache
+{
+
+namespace
+{
+
+// Bump this when the file layout changes.
+constexpr uint32_t file_version = 1;
+constexpr char file_magic[4] = { 'G', 'L', 'P', 'B' };
+
+struct FileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t format;
+    uint32_t length;
+};
+
+Stats cache_stats;
+
+int enabled_override = -1; // -1: use the environment.
+
+bool env_enabled()
+{
+    const char* env = std::getenv("UTIL_PROGRAM_CACHE");
+    return !env || std::strcmp(env, "0") != 0;
+}
+
+const char* gl_string(GLenum name)
+{
+    const GLubyte* str = glGetString(name);
+    return str ? reinterpret_cast<const char*>(str) : "";
+}
+
+fs::path entry_path(uint64_t key)
+{
+    char fname[32];
+    std::snprintf(fname, sizeof(fname), "%016llx.bin", static_cast<unsigned long long>(key));
+    return fs::path(directory()) / fname;
+}
+
+} // end of anonymous namespace
+
+bool enabled()
+{
+    const bool on = (enabled_override < 0) ? env_enabled() : (enabled_override == 1);
+    if (!on)
+    {
+        return false;
+    }
+    GLint num_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    return num_formats > 0;
+}
+
+void set_enabled(bool on) { enabled_override = on ? 1 : 0; }
+
+const std::string& directory()
+{
+    static const std::string dir = []() {
+        const char* env = std::getenv("UTIL_PROGRAM_CACHE_DIR");
+        return std::string((env && *env) ? env : ".program_cache");
+    }();
+    return dir;
+}
+
+uint64_t key(std::string_view vertex_source, std::string_view fragment_source)
+{
+    return key(std::span(&vertex_source, 1), std::span(&fragment_source, 1));
+}
+
+uint64_t key(std::span<const std::string_view> vertex_pieces,
+             std::span<const std::string_view> fragment_pieces)
+{
+    // Lengths are mixed in so that moving text from one source to the other
+    // changes the key.
+    uint64_t hh = fnv1a(gl_string(GL_VENDOR));
+    hh = fnv1a(gl_string(GL_RENDERER), hh);
+    hh = fnv1a(gl_string(GL_VERSION), hh);
+    for (const std::span<const std::string_view> pieces: { vertex_pieces, fragment_pieces })
+    {
+        size_t size = 0;
+        for (std::string_view piece: pieces)
+            size += piece.size();
+        hh = fnv1a(std::to_string(size), hh);
+        for (std::string_view piece: pieces)
+            hh = fnv1a(piece, hh);
+    }
+    return hh;
+}
+
+GLuint load(uint64_t key)
+{
+    const fs::path path = entry_path(key);
+    std::error_code ec;
+    if (!fs::exists(path, ec))
+    {
+        ++cache_stats.misses;
+        return 0;
+    }
+
+    // The driver reads the binary straight from the mapped file.
+    const MappedFile file(path.string(), MappedFile::Advice::willneed);
+    FileHeader header{};
+    if (file.size() >= sizeof(header))
+        std::memcpy(&header, file.data(), sizeof(header));
+    const bool valid_file = file.size() >= sizeof(header)
+        && std::memcmp(header.magic, file_magic, sizeof(file_magic)) == 0
+        && header.version == file_version && header.key == key
+        && file.size() - sizeof(header) >= header.length;
+
+    if (valid_file)
+    {
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.format, file.data() + sizeof(header),
+                        static_cast<GLsizei>(header.length));
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (success)
+        {
+            ++cache_stats.hits;
+            return program;
+        }
+        glDeleteProgram(program);
+    }
+
+    // Truncated file or a binary the driver no longer accepts. Drop it so the
+    // freshly compiled program can take its place.
+    ++cache_stats.rejected;
+    ++cache_stats.misses;
+    fs::remove(path, ec);
+    return 0;
+}
+
+bool store(uint64_t key, GLuint program)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return false;
+    }
+
+    FileHeader header{};
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.version = file_version;
+    header.key = key;
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &header.format, binary.data());
+    header.length = static_cast<uint32_t>(written);
+
+    std::error_code ec;
+    fs::create_directories(directory(), ec);
+    if (ec)
+    {
+        std::cerr << "[WARN] Cannot create program cache directory " << directory() << '\n';
+        return false;
+    }
+
+    // Write to a temporary file and rename it, so a concurrently starting
+    // process never sees a partially written entry.
+    const fs::path path = entry_path(key);
+    fs::path tmp_path = path;
+    tmp_path += ".tmp";
+    {
+        std::ofstream fout(tmp_path, std::ios::binary | std::ios::trunc);
+        fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        fout.write(binary.data(), written);
+        if (!fout)
+        {
+            fout.close();
+            fs::remove(tmp_path, ec);
+            return false;
+        }
+    }
+    fs::rename(tmp_path, path, ec);
+    if (ec)
+    {
+        fs::remove(tmp_path, ec);
+        return false;
+    }
+
+    ++cache_stats.stored;
+    return true;
+}
+
+void clear()
+{
+    std::error_code ec;
+    for (const auto& entry: fs::directory_iterator(directory(), ec))
+    {
+        if (entry.path().extension() == ".bin")
+        {
+            fs::remove(entry.path(), ec);
+        }
+    }
+}
+
+const Stats& stats() { return cache_stats; }
+
+}
+
+}
@@ -0,0 +1,243 @@
+#include <util/random.hpp>
+#include <util/3dtypes.hpp>
+#include <util/simd.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <random>
+
+#if !defined(UTIL_SIMD_DISABLED) && (defined(__x86_64__) || defined(__i386__))
+#define UTIL_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace util
+{
+
+namespace
+{
+
+uint64_t splitmix64(uint64_t& state)
+{
+    uint64_t zz = (state += 0x9e3779b97f4a7c15ull);
+    zz = (zz ^ (zz >> 30)) * 0xbf58476d1ce4e5b9ull;
+    zz = (zz ^ (zz >> 27)) * 0x94d049bb133111ebull;
+    return zz ^ (zz >> 31);
+}
+
+// Batch seeds are offset so that lane 0 does not repeat the single generator
+// seeded with the same value.
+constexpr uint64_t batch_seed_offset = 0x6a09e667f3bcc909ull;
+
+using BatchState = uint32_t[4][XoshiroBatch::lanes];
+
+// Each kernel writes blocks * lanes floats and advances the state accordingly.
+
+void fill_scalar(BatchState& s, float* out, size_t blocks)
+{
+    for (size_t bb = 0; bb < blocks; ++bb, out += XoshiroBatch::lanes)
+    {
+        for (size_t ll = 0; ll < XoshiroBatch::lanes; ++ll)
+        {
+            const uint32_t result = s[0][ll] + s[3][ll];
+            const uint32_t t = s[1][ll] << 9;
+            s[2][ll] ^= s[0][ll];
+            s[3][ll] ^= s[1][ll];
+            s[1][ll] ^= s[2][ll];
+            s[0][ll] ^= s[3][ll];
+            s[2][ll] ^= t;
+            s[3][ll] = (s[3][ll] << 11) | (s[3][ll] >> 21);
+            out[ll] = static_cast<float>(result >> 8) * 0x1.0p-24f;
+        }
+    }
+}
+
+#ifdef UTIL_SIMD_X86
+
+// Lanes 0-3 and 4-7 in two registers per state word.
+void fill_sse(BatchState& s, float* out, size_t blocks)
+{
+    __m128i s0[2], s1[2], s2[2], s3[2];
+    for (int hh = 0; hh < 2; ++hh)
+    {
+        s0[hh] = _mm_load_si128(reinterpret_cast<const __m128i*>(&s[0][4 * hh]));
+        s1[hh] = _mm_load_si128(reinterpret_cast<const __m128i*>(&s[1][4 * hh]));
+        s2[hh] = _mm_load_si128(reinterpret_cast<const __m128i*>(&s[2][4 * hh]));
+        s3[hh] = _mm_load_si128(reinterpret_cast<const __m128i*>(&s[3][4 * hh]));
+    }
+
+    const __m128 scale = _mm_set1_ps(0x1.0p-24f);
+    for (size_t bb = 0; bb < blocks; ++bb, out += XoshiroBatch::lanes)
+    {
+        for (int hh = 0; hh < 2; ++hh)
+        {
+            const __m128i result = _mm_add_epi32(s0[hh], s3[hh]);
+            const __m128i t = _mm_slli_epi32(s1[hh], 9);
+            s2[hh] = _mm_xor_si128(s2[hh], s0[hh]);
+            s3[hh] = _mm_xor_si128(s3[hh], s1[hh]);
+            s1[hh] = _mm_xor_si128(s1[hh], s2[hh]);
+            s0[hh] = _mm_xor_si128(s0[hh], s3[hh]);
+            s2[hh] = _mm_xor_si128(s2[hh], t);
+            s3[hh] = _mm_or_si128(_mm_slli_epi32(s3[hh], 11), _mm_srli_epi32(s3[hh], 21));
+            // 24 bit values convert exactly, so this matches the scalar kernel.
+            const __m128 ff = _mm_cvtepi32_ps(_mm_srli_epi32(result, 8));
+            _mm_storeu_ps(out + 4 * hh, _mm_mul_ps(ff, scale));
+        }
+    }
+
+    for (int hh = 0; hh < 2; ++hh)
+    {
+        _mm_store_si128(reinterpret_cast<__m128i*>(&s[0][4 * hh]), s0[hh]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(&s[1][4 * hh]), s1[hh]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(&s[2][4 * hh]), s2[hh]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(&s[3][4 * hh]), s3[hh]);
+    }
+}
+
+// All eight lanes in one register per state word. Compiled for AVX2
+// regardless of the global compiler flags and only selected after a runtime
+// CPU check, like the matrix kernels in simd.cpp.
+__attribute__((target("avx2"))) void fill_avx2(BatchState& s, float* out, size_t blocks)
+{
+    __m256i s0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(s[0]));
+    __m256i s1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(s[1]));
+    __m256i s2 = _mm256_load_si256(reinterpret_cast<const __m256i*>(s[2]));
+    __m256i s3 = _mm256_load_si256(reinterpret_cast<const __m256i*>(s[3]));
+
+    const __m256 scale = _mm256_set1_ps(0x1.0p-24f);
+    for (size_t bb = 0; bb < blocks; ++bb, out += XoshiroBatch::lanes)
+    {
+        const __m256i result = _mm256_add_epi32(s0, s3);
+        const __m256i t = _mm256_slli_epi32(s1, 9);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = _mm256_or_si256(_mm256_slli_epi32(s3, 11), _mm256_srli_epi32(s3, 21));
+        const __m256 ff = _mm256_cvtepi32_ps(_mm256_srli_epi32(result, 8));
+        _mm256_storeu_ps(out, _mm256_mul_ps(ff, scale));
+    }
+
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s[0]), s0);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s[1]), s1);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s[2]), s2);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(s[3]), s3);
+}
+
+#endif // UTIL_SIMD_X86
+
+void fill_blocks(BatchState& s, float* out, size_t blocks)
+{
+    switch (simd::active())
+    {
+#ifdef UTIL_SIMD_X86
+        case simd::Isa::avx2:
+            fill_avx2(s, out, blocks);
+            return;
+        case simd::Isa::sse:
+            fill_sse(s, out, blocks);
+            return;
+#endif
+        default:
+            fill_scalar(s, out, blocks);
+            return;
+    }
+}
+
+uint64_t process_seed()
+{
+    static const uint64_t seed = [] {
+        if (const char* env = std::getenv("UTIL_RANDOM_SEED"))
+            return static_cast<uint64_t>(std::strtoull(env, nullptr, 0));
+        std::random_device rd;
+        return (static_cast<uint64_t>(rd()) << 32) | rd();
+    }();
+    return seed;
+}
+
+struct ThreadGenerators
+{
+    Xoshiro128 single;
+    XoshiroBatch batch;
+
+    explicit ThreadGenerators(uint64_t seed)
+        : single{ seed }
+        , batch{ seed }
+    {
+    }
+};
+
+ThreadGenerators& thread_generators()
+{
+    static std::atomic<uint64_t> threads_seeded{ 0 };
+    thread_local ThreadGenerators generators(
+        process_seed() + 0x9e3779b97f4a7c15ull * threads_seeded.fetch_add(1));
+    return generators;
+}
+
+} // end of anonymous namespace
+
+void Xoshiro128::seed(uint64_t seed)
+{
+    uint64_t state = seed;
+    const uint64_t lo = splitmix64(state);
+    const uint64_t hi = splitmix64(state);
+    s[0] = static_cast<uint32_t>(lo);
+    s[1] = static_cast<uint32_t>(lo >> 32);
+    s[2] = static_cast<uint32_t>(hi);
+    s[3] = static_cast<uint32_t>(hi >> 32);
+}
+
+void XoshiroBatch::seed(uint64_t seed)
+{
+    uint64_t state = seed + batch_seed_offset;
+    for (size_t ll = 0; ll < lanes; ++ll)
+    {
+        const uint64_t lo = splitmix64(state);
+        const uint64_t hi = splitmix64(state);
+        s[0][ll] = static_cast<uint32_t>(lo);
+        s[1][ll] = static_cast<uint32_t>(lo >> 32);
+        s[2][ll] = static_cast<uint32_t>(hi);
+        s[3][ll] = static_cast<uint32_t>(hi >> 32);
+    }
+}
+
+void XoshiroBatch::fill(std::span<float> out)
+{
+    const size_t blocks = out.size() / lanes;
+    fill_blocks(s, out.data(), blocks);
+
+    const size_t done = blocks * lanes;
+    if (done < out.size())
+    {
+        // The rest of the last block is dropped.
+        alignas(32) float tail[lanes];
+        fill_blocks(s, tail, 1);
+        std::copy_n(tail, out.size() - done, out.data() + done);
+    }
+}
+
+void seed_random(uint64_t seed)
+{
+    ThreadGenerators& generators = thread_generators();
+    generators.single.seed(seed);
+    generators.batch.seed(seed);
+}
+
+void fill_uniform(std::span<float> out) { thread_generators().batch.fill(out); }
+
+void fill_uniform(std::span<float> out, float lo, float hi)
+{
+    fill_uniform(out);
+    const float range = hi - lo;
+    for (float& ff: out)
+        ff = lo + ff * range;
+}
+
+Xoshiro128& thread_rng() { return thread_generators().single; }
+
+float random_float() { return thread_rng().next_float(); }
+
+}
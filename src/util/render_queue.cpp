@@ -0,0 +1,268 @@
+#include <util/render_queue.hpp>
+#include <util/gl_state.hpp>
+#include <util/hash.hpp>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string_view>
+
+namespace util
+{
+
+namespace
+{
+
+// Id of key among the ids handed out this frame. Ids beyond what the key has
+// room for share the last one, which only costs some grouping.
+template <typename Key> uint16_t small_id(std::unordered_map<Key, uint16_t>& ids, Key key)
+{
+    const size_t next = std::min<size_t>(ids.size(), 0xffff);
+    return ids.try_emplace(key, static_cast<uint16_t>(next)).first->second;
+}
+
+GLsizei index_size(GLenum type)
+{
+    switch (type)
+    {
+    case GL_UNSIGNED_BYTE:
+        return 1;
+    case GL_UNSIGNED_SHORT:
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+} // end of anonymous namespace
+
+RenderQueue::Stats RenderQueue::all_stats;
+size_t RenderQueue::num_flushes = 0;
+
+RenderQueue::Uniforms& RenderQueue::Uniforms::set_int(UniformHandle handle, int value)
+{
+    queue.add_uniform(handle, Kind::int1).int_value = value;
+    return *this;
+}
+
+RenderQueue::Uniforms& RenderQueue::Uniforms::set_float(UniformHandle handle, float value)
+{
+    queue.add_uniform(handle, Kind::float1).values[0] = value;
+    return *this;
+}
+
+RenderQueue::Uniforms& RenderQueue::Uniforms::set_vec4(UniformHandle handle,
+                                                       const glm::vec4& value)
+{
+    std::memcpy(queue.add_uniform(handle, Kind::vec4).values, glm::value_ptr(value),
+                4 * sizeof(float));
+    return *this;
+}
+
+RenderQueue::Uniforms& RenderQueue::Uniforms::set_matrix4f(UniformHandle handle,
+                                                           const glm::mat4& value)
+{
+    std::memcpy(queue.add_uniform(handle, Kind::mat4).values, glm::value_ptr(value),
+                16 * sizeof(float));
+    return *this;
+}
+
+RenderQueue::Uniforms& RenderQueue::submit(const Packet& packet)
+{
+    entries.push_back(Entry{ packet, static_cast<uint32_t>(uniform_values.size()), 0 });
+    return uniforms;
+}
+
+RenderQueue::UniformValue& RenderQueue::add_uniform(UniformHandle handle, Kind kind)
+{
+    ++entries.back().num_uniforms;
+    // Value-initialized, so unused bytes are zero and values compare bytewise.
+    UniformValue& value = uniform_values.emplace_back();
+    value.handle = handle;
+    value.kind = kind;
+    return value;
+}
+
+uint64_t RenderQueue::sort_key(const Packet& packet)
+{
+    const uint64_t program = small_id(program_ids, packet.shader ? packet.shader->ID : 0u);
+    uint64_t texture_hash =
+        fnv1a(std::string_view(reinterpret_cast<const char*>(packet.textures),
+                               sizeof(packet.textures)));
+    texture_hash = fnv1a(std::string_view(reinterpret_cast<const char*>(&packet.texture_target),
+                                          sizeof(packet.texture_target)),
+                         texture_hash);
+    const uint64_t textures = small_id(texture_ids, texture_hash);
+    const uint64_t vertex_array = small_id(vertex_array_ids, packet.vertex_array);
+    const uint64_t depth =
+        static_cast<uint64_t>(std::clamp(packet.depth, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    return program << 48 | textures << 32 | vertex_array << 16 | depth;
+}
+
+bool RenderQueue::same_state(const Entry& aa, const Entry& bb) const
+{
+    const Packet& pa = aa.packet;
+    const Packet& pb = bb.packet;
+    return pa.shader == pb.shader && pa.vertex_array == pb.vertex_array
+        && std::equal(std::begin(pa.textures), std::end(pa.textures), std::begin(pb.textures))
+        && pa.texture_target == pb.texture_target && pa.mode == pb.mode
+        && pa.index_type == pb.index_type;
+}
+
+bool RenderQueue::same_uniforms(const Entry& aa, const Entry& bb) const
+{
+    return aa.num_uniforms == bb.num_uniforms
+        && (aa.num_uniforms == 0
+            || std::memcmp(&uniform_values[aa.first_uniform], &uniform_values[bb.first_uniform],
+                           aa.num_uniforms * sizeof(UniformValue))
+                == 0);
+}
+
+void RenderQueue::bind_state(const Entry& entry)
+{
+    const Packet& packet = entry.packet;
+    packet.shader->use();
+    for (int unit = 0; unit < max_textures; ++unit)
+    {
+        if (packet.textures[unit])
+            gl_state().bind_texture(unit, packet.texture_target, packet.textures[unit]);
+    }
+    gl_state().bind_vertex_array(packet.vertex_array);
+}
+
+void RenderQueue::upload_uniforms(const Entry& entry, const Entry* previous)
+{
+    const Shader& shader = *entry.packet.shader;
+    for (uint32_t ii = 0; ii < entry.num_uniforms; ++ii)
+    {
+        const UniformValue& value = uniform_values[entry.first_uniform + ii];
+        // The previous draw with the same program may have left the value.
+        if (previous && previous->packet.shader == entry.packet.shader)
+        {
+            const UniformValue* begin = uniform_values.data() + previous->first_uniform;
+            const UniformValue* end = begin + previous->num_uniforms;
+            const UniformValue* same = std::find_if(begin, end, [&](const UniformValue& other) {
+                return other.handle.index == value.handle.index;
+            });
+            if (same != end && std::memcmp(same, &value, sizeof(value)) == 0)
+                continue;
+        }
+
+        ++frame_stats.uniform_uploads;
+        switch (value.kind)
+        {
+        case Kind::int1:
+            shader.set_int(value.handle, value.int_value);
+            break;
+        case Kind::float1:
+            shader.set_float(value.handle, value.values[0]);
+            break;
+        case Kind::vec4:
+            shader.set_vec4(value.handle, glm::make_vec4(value.values));
+            break;
+        case Kind::mat4:
+            shader.set_matrix4f(value.handle, glm::make_mat4(value.values));
+            break;
+        }
+    }
+}
+
+void RenderQueue::issue_merged(const Packet& packet)
+{
+    ++frame_stats.draw_calls;
+    if (packet.index_type)
+    {
+        if (merged_counts.size() == 1)
+            glDrawElements(packet.mode, merged_counts[0], packet.index_type, merged_offsets[0]);
+        else
+            glMultiDrawElements(packet.mode, merged_counts.data(), packet.index_type,
+                                merged_offsets.data(), static_cast<GLsizei>(merged_counts.size()));
+    }
+    else
+    {
+        if (merged_counts.size() == 1)
+            glDrawArrays(packet.mode, merged_firsts[0], merged_counts[0]);
+        else
+            glMultiDrawArrays(packet.mode, merged_firsts.data(), merged_counts.data(),
+                              static_cast<GLsizei>(merged_counts.size()));
+    }
+}
+
+void RenderQueue::add_range(const Packet& packet)
+{
+    // Contiguous with the previous range: extend it.
+    if (!merged_counts.empty() && merged_firsts.back() + merged_counts.back() == packet.first)
+    {
+        merged_counts.back() += packet.count;
+        return;
+    }
+    merged_firsts.push_back(packet.first);
+    merged_counts.push_back(packet.count);
+    const size_t offset = static_cast<size_t>(packet.first) * index_size(packet.index_type);
+    merged_offsets.push_back(reinterpret_cast<const void*>(offset));
+}
+
+void RenderQueue::flush()
+{
+    using clock = std::chrono::steady_clock;
+    frame_stats = Stats{};
+    frame_stats.packets = entries.size();
+
+    const auto sort_start = clock::now();
+    order.clear();
+    order.reserve(entries.size());
+    for (uint32_t ii = 0; ii < entries.size(); ++ii)
+        order.emplace_back(sort_key(entries[ii].packet), ii);
+    // Ties keep the order of submission.
+    std::sort(order.begin(), order.end());
+    frame_stats.sort_ms =
+        std::chrono::duration<double, std::milli>(clock::now() - sort_start).count();
+
+    const size_t state_calls = gl_state().stats().issued;
+    const Entry* previous = nullptr;
+    size_t ii = 0;
+    while (ii < order.size())
+    {
+        const Entry& entry = entries[order[ii++].second];
+        const Packet& packet = entry.packet;
+        if (!packet.shader || packet.shader->error || packet.count <= 0)
+            continue;
+
+        bind_state(entry);
+        upload_uniforms(entry, previous);
+
+        merged_counts.clear();
+        merged_offsets.clear();
+        merged_firsts.clear();
+        add_range(packet);
+        while (ii < order.size())
+        {
+            const Entry& next = entries[order[ii].second];
+            if (!same_state(entry, next) || !same_uniforms(entry, next))
+                break;
+            if (next.packet.count > 0)
+                add_range(next.packet);
+            ++ii;
+        }
+        issue_merged(packet);
+        previous = &entry;
+    }
+    frame_stats.state_changes = gl_state().stats().issued - state_calls;
+
+    all_stats.packets += frame_stats.packets;
+    all_stats.draw_calls += frame_stats.draw_calls;
+    all_stats.state_changes += frame_stats.state_changes;
+    all_stats.uniform_uploads += frame_stats.uniform_uploads;
+    all_stats.sort_ms += frame_stats.sort_ms;
+    ++num_flushes;
+
+    entries.clear();
+    uniform_values.clear();
+    program_ids.clear();
+    texture_ids.clear();
+    vertex_array_ids.clear();
+}
+
+}
@@ -1,64 +1,268 @@
 #include "util/uniforms.hpp"
 #include <util/shader.hpp>
+#include <util/program_cache.hpp>
+#include <util/gl_ext.hpp>
+#include <util/gl_state.hpp>
+#include <util/shader_watcher.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <vector>
 
+// GL_KHR_parallel_shader_compile, not in the GL 3.3 core headers.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 namespace util
 {
 
-Shader::Shader(const char* vertex_path, const char* fragment_path)
-    : ID{ 0 }
-    , error{ true }
+namespace
 {
-    GLuint vertex_shader;
-    if (!compile_shader(vertex_path, GL_VERTEX_SHADER, vertex_shader))
+
+// Passes the pieces of source as they are, so the driver reads the mapped
+// files instead of a copy of them.
+void set_shader_source(GLuint shader, const ShaderSource& source)
+{
+    std::vector<const GLchar*> strings;
+    std::vector<GLint> lengths;
+    strings.reserve(source.pieces.size());
+    lengths.reserve(source.pieces.size());
+    for (std::string_view piece: source.pieces)
     {
-        return;
+        strings.push_back(piece.data());
+        lengths.push_back(static_cast<GLint>(piece.size()));
     }
+    glShaderSource(shader, static_cast<GLsizei>(strings.size()), strings.data(), lengths.data());
+}
+
+// Sets the uniforms of program to, which must be in use, to the values of
+// the uniforms of the same name in program from. Uniforms from does not
+// have, or has with another type, keep their defaults.
+void copy_uniform_values(GLuint from, GLuint to)
+{
+    GLint num_uniforms = 0;
+    GLint max_name_len = 0;
+    glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &num_uniforms);
+    glGetProgramiv(to, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_len);
 
-    GLuint fragment_shader;
-    if (!compile_shader(fragment_path, GL_FRAGMENT_SHADER, fragment_shader))
+    std::string name(static_cast<size_t>(max_name_len), '\0');
+    for (GLint ii = 0; ii < num_uniforms; ++ii)
     {
-        return;
+        GLsizei len = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(to, static_cast<GLuint>(ii), max_name_len, &len, &size, &type,
+                           name.data());
+        std::string base(name.data(), static_cast<size_t>(len));
+        if (base.ends_with("[0]"))
+        {
+            base.resize(base.size() - 3);
+        }
+
+        for (GLint element = 0; element < size; ++element)
+        {
+            std::string element_name = base;
+            if (size > 1)
+            {
+                element_name += '[';
+                element_name += std::to_string(element);
+                element_name += ']';
+            }
+            const GLint src = UniformTable::query_location(from, element_name.c_str());
+            const GLint dst = UniformTable::query_location(to, element_name.c_str());
+            if (src == UniformTable::inactive || dst == UniformTable::inactive)
+            {
+                continue;
+            }
+
+            GLfloat ff[16];
+            GLint ii_values[4];
+            GLuint uu[4];
+            switch (type)
+            {
+                case GL_FLOAT:
+                    glGetUniformfv(from, src, ff);
+                    glUniform1fv(dst, 1, ff);
+                    break;
+                case GL_FLOAT_VEC2:
+                    glGetUniformfv(from, src, ff);
+                    glUniform2fv(dst, 1, ff);
+                    break;
+                case GL_FLOAT_VEC3:
+                    glGetUniformfv(from, src, ff);
+                    glUniform3fv(dst, 1, ff);
+                    break;
+                case GL_FLOAT_VEC4:
+                    glGetUniformfv(from, src, ff);
+                    glUniform4fv(dst, 1, ff);
+                    break;
+                // glGetUniformfv returns matrices column major.
+                case GL_FLOAT_MAT2:
+                    glGetUniformfv(from, src, ff);
+                    glUniformMatrix2fv(dst, 1, GL_FALSE, ff);
+                    break;
+                case GL_FLOAT_MAT3:
+                    glGetUniformfv(from, src, ff);
+                    glUniformMatrix3fv(dst, 1, GL_FALSE, ff);
+                    break;
+                case GL_FLOAT_MAT4:
+                    glGetUniformfv(from, src, ff);
+                    glUniformMatrix4fv(dst, 1, GL_FALSE, ff);
+                    break;
+                case GL_INT_VEC2:
+                case GL_BOOL_VEC2:
+                    glGetUniformiv(from, src, ii_values);
+                    glUniform2iv(dst, 1, ii_values);
+                    break;
+                case GL_INT_VEC3:
+                case GL_BOOL_VEC3:
+                    glGetUniformiv(from, src, ii_values);
+                    glUniform3iv(dst, 1, ii_values);
+                    break;
+                case GL_INT_VEC4:
+                case GL_BOOL_VEC4:
+                    glGetUniformiv(from, src, ii_values);
+                    glUniform4iv(dst, 1, ii_values);
+                    break;
+                case GL_UNSIGNED_INT:
+                    glGetUniformuiv(from, src, uu);
+                    glUniform1uiv(dst, 1, uu);
+                    break;
+                case GL_UNSIGNED_INT_VEC2:
+                    glGetUniformuiv(from, src, uu);
+                    glUniform2uiv(dst, 1, uu);
+                    break;
+                case GL_UNSIGNED_INT_VEC3:
+                    glGetUniformuiv(from, src, uu);
+                    glUniform3uiv(dst, 1, uu);
+                    break;
+                case GL_UNSIGNED_INT_VEC4:
+                    glGetUniformuiv(from, src, uu);
+                    glUniform4uiv(dst, 1, uu);
+                    break;
+                case GL_FLOAT_MAT2x3:
+                case GL_FLOAT_MAT2x4:
+                case GL_FLOAT_MAT3x2:
+                case GL_FLOAT_MAT3x4:
+                case GL_FLOAT_MAT4x2:
+                case GL_FLOAT_MAT4x3:
+                    // Not used by the samples.
+                    break;
+                default:
+                    // GL_INT, GL_BOOL and the sampler types.
+                    glGetUniformiv(from, src, ii_values);
+                    glUniform1iv(dst, 1, ii_values);
+                    break;
+            }
+        }
     }
+}
+
+// Binds the uniform blocks of program to to the binding points of the blocks
+// of the same name in program from. Bindings are program state set by
+// UniformBlock::attach(), so a new program would otherwise have every block
+// at binding point 0.
+void copy_uniform_block_bindings(GLuint from, GLuint to)
+{
+    GLint num_blocks = 0;
+    GLint max_name_len = 0;
+    glGetProgramiv(from, GL_ACTIVE_UNIFORM_BLOCKS, &num_blocks);
+    glGetProgramiv(from, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &max_name_len);
 
-    error = !build_program(vertex_shader, fragment_shader, nullptr);
+    std::string name(static_cast<size_t>(max_name_len), '\0');
+    for (GLint ii = 0; ii < num_blocks; ++ii)
+    {
+        const GLuint src = static_cast<GLuint>(ii);
+        glGetActiveUniformBlockName(from, src, max_name_len, nullptr, name.data());
+        const GLuint dst = glGetUniformBlockIndex(to, name.c_str());
+        if (dst == GL_INVALID_INDEX)
+        {
+            continue;
+        }
 
-    // Can delete the shaders now.
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
+        GLint binding = 0;
+        glGetActiveUniformBlockiv(from, src, GL_UNIFORM_BLOCK_BINDING, &binding);
+        glUniformBlockBinding(to, dst, static_cast<GLuint>(binding));
+    }
+}
+
+} // end of anonymous namespace
+
+Shader::Shader(const char* vertex_path, const char* fragment_path)
+    : Shader(vertex_path, fragment_path, ShaderDefines{}, {}, nullptr)
+{
 }
 
 Shader::Shader(const char* vertex_path, const char* fragment_path, const std::vector<Uniform*>& unifs)
+    : Shader(vertex_path, fragment_path, ShaderDefines{}, unifs, nullptr)
+{
+}
+
+Shader::Shader(const char* vertex_path, const char* fragment_path, const ShaderDefines& defines,
+               const std::vector<Uniform*>& unifs)
+    : Shader(vertex_path, fragment_path, defines, unifs, nullptr)
+{
+}
+
+Shader::Shader(const char* vertex_path, const char* fragment_path, ProgramBatch& batch)
+    : Shader(vertex_path, fragment_path, ShaderDefines{}, {}, &batch)
+{
+}
+
+Shader::Shader(const char* vertex_path, const char* fragment_path, const std::vector<Uniform*>& unifs,
+               ProgramBatch& batch)
+    : Shader(vertex_path, fragment_path, ShaderDefines{}, unifs, &batch)
+{
+}
+
+Shader::Shader(const char* vertex_path, const char* fragment_path, const ShaderDefines& defines,
+               ProgramBatch& batch)
+    : Shader(vertex_path, fragment_path, defines, {}, &batch)
+{
+}
+
+Shader::Shader(const char* vertex_path, const char* fragment_path, const ShaderDefines& defines,
+               const std::vector<Uniform*>& unifs, ProgramBatch* batch_)
     : ID{ 0 }
     , error{ true }
+    , vertex_file{ vertex_path }
+    , fragment_file{ fragment_path }
+    , permutation{ defines }
+    , uniform_objects{ unifs }
 {
-    GLuint vertex_shader;
-    if (!compile_shader(vertex_path, GL_VERTEX_SHADER, vertex_shader))
+    if (batch_)
     {
-        return;
+        const auto start = std::chrono::steady_clock::now();
+        batch_->add(*this, start, start_program());
     }
-
-    GLuint fragment_shader;
-    if (!compile_shader(fragment_path, GL_FRAGMENT_SHADER, fragment_shader))
+    else
     {
-        return;
+        error = !build();
+    }
+    // Also when the build failed: fixing the sources brings the shader back.
+    if (ShaderWatcher* watcher = ShaderWatcher::active())
+    {
+        watcher->add(*this);
     }
-
-    error = !build_program(vertex_shader, fragment_shader, &unifs);
-
-    // Can delete the shaders now.
-    glDeleteShader(vertex_shader);
-    glDeleteShader(fragment_shader);
 }
 
 Shader::~Shader()
 {
-    if (error)
+    if (batch)
+    {
+        batch->remove(*this);
+    }
+    if (ShaderWatcher* watcher = ShaderWatcher::active())
+    {
+        watcher->remove(*this);
+    }
+    discard_pending();
+    if (!ID)
         return;
+    gl_state().forget_program(ID);
     glDeleteProgram(ID);
 }
 
@@ -66,28 +270,28 @@ void Shader::use()
 {
     if (error)
         return;
-    glUseProgram(ID);
+    gl_state().use_program(ID);
 }
 
 void Shader::set_bool(const std::string& name, bool value) const
 {
     if (error)
         return;
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), static_cast<int>(value));
+    glUniform1i(location(name), static_cast<int>(value));
 }
 
 void Shader::set_int(const std::string& name, int value) const
 {
     if (error)
         return;
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(location(name), value);
 }
 
 void Shader::set_float(const std::string& name, float value) const
 {
     if (error)
         return;
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(location(name), value);
 }
 
 // Assumes the matrix is stored in column major layout.
@@ -95,105 +299,348 @@ void Shader::set_matrix4f(const std::string& name, const glm::mat4& mat4) const
 {
     if (error)
         return;
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat4));
+    glUniformMatrix4fv(location(name), 1, GL_FALSE, glm::value_ptr(mat4));
 }
 
 void Shader::set_vec4(const std::string& name, const glm::vec4& vec4) const
 {
     if (error)
         return;
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(vec4));
+    glUniform4fv(location(name), 1, glm::value_ptr(vec4));
 }
 
-// static
-bool Shader::load_shader(const std::string& fname, std::string& buffer)
+UniformHandle Shader::uniform(const std::string& name)
+{
+    handle_locations.push_back(error ? UniformTable::inactive : location(name));
+    handle_names.push_back(name);
+    return UniformHandle{ static_cast<int>(handle_locations.size() - 1) };
+}
+
+void Shader::set_bool(UniformHandle handle, bool value) const
+{
+    if (error)
+        return;
+    glUniform1i(location(handle), static_cast<int>(value));
+}
+
+void Shader::set_int(UniformHandle handle, int value) const
+{
+    if (error)
+        return;
+    glUniform1i(location(handle), value);
+}
+
+void Shader::set_float(UniformHandle handle, float value) const
+{
+    if (error)
+        return;
+    glUniform1f(location(handle), value);
+}
+
+// Assumes the matrix is stored in column major layout.
+void Shader::set_matrix4f(UniformHandle handle, const glm::mat4& mat4) const
+{
+    if (error)
+        return;
+    glUniformMatrix4fv(location(handle), 1, GL_FALSE, glm::value_ptr(mat4));
+}
+
+void Shader::set_vec4(UniformHandle handle, const glm::vec4& vec4) const
+{
+    if (error)
+        return;
+    glUniform4fv(location(handle), 1, glm::value_ptr(vec4));
+}
+
+GLint Shader::location(const std::string& name) const
+{
+    if (const GLint* loc = uniforms.find(name))
+    {
+        return *loc;
+    }
+
+    // Not reported by glGetActiveUniform (e.g. an element of an array other
+    // than the first one). Ask the driver once and remember the answer.
+    const GLint loc = UniformTable::query_location(ID, name.c_str());
+    uniforms.insert(name, loc);
+    return loc;
+}
+
+std::vector<std::string> Shader::source_files() const
+{
+    std::vector<std::string> files = vertex_files;
+    for (const std::string& file: fragment_files)
+    {
+        if (std::find(files.begin(), files.end(), file) == files.end())
+        {
+            files.push_back(file);
+        }
+    }
+    if (files.empty())
+    {
+        // Nothing was read yet.
+        files = { vertex_file, fragment_file };
+    }
+    return files;
+}
+
+bool Shader::build()
 {
-    std::ifstream fin(fname);
-    if (!fin)
+    if (!start_program())
     {
-        std::cerr << "[ERROR] Error opening shader file " << fname << '\n';
         return false;
     }
-    try
+    ID = finish_program();
+    if (!ID)
     {
-        fin.seekg(0, std::ios::end);
-        buffer.reserve(fin.tellg());
-        fin.seekg(0, std::ios::beg);
-        buffer.assign((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
-        fin.close();
+        return false;
     }
-    catch (std::ifstream::failure& e)
+    return init_program();
+}
+
+bool Shader::start_program()
+{
+    ShaderSource vertex;
+    ShaderSource fragment;
+    const bool read = preprocess_shader(vertex_file, permutation, vertex) &&
+                      preprocess_shader(fragment_file, permutation, fragment);
+    // Keep what was read even on failure, so a watcher sees new includes.
+    vertex_files = vertex.files;
+    fragment_files = fragment.files;
+    if (!read)
     {
-        std::cerr << "[ERROR] Error reading shader file " << fname << '\n';
         return false;
     }
+    // Warm start: skip compiling and linking if the driver accepts a cached binary.
+    const bool use_cache = program_cache::enabled();
+    if (use_cache)
+    {
+        pending.cache_key = program_cache::key(vertex.pieces, fragment.pieces);
+        pending.program = program_cache::load(pending.cache_key);
+        if (pending.program)
+        {
+            pending.from_cache = true;
+            return true;
+        }
+    }
+
+    // Compile and link without asking for the results, so that drivers with
+    // parallel shader compilation can work while we do something else.
+    pending.vertex_shader = glCreateShader(GL_VERTEX_SHADER);
+    set_shader_source(pending.vertex_shader, vertex);
+    glCompileShader(pending.vertex_shader);
+
+    pending.fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
+    set_shader_source(pending.fragment_shader, fragment);
+    glCompileShader(pending.fragment_shader);
+
+    pending.program = glCreateProgram();
+    glAttachShader(pending.program, pending.vertex_shader);
+    glAttachShader(pending.program, pending.fragment_shader);
+    if (use_cache)
+    {
+        // Needed for glGetProgramBinary() to return something the program cache can store.
+        glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(pending.program);
     return true;
 }
 
-// static
-bool Shader::compile_shader(const char* shader_path, GLenum shader_type, GLuint& shader_id)
+GLuint Shader::finish_program()
 {
-    std::string buffer;
-    if (!load_shader(shader_path, buffer))
+    if (pending.from_cache)
     {
-        return false;
+        const GLuint program = pending.program;
+        pending = PendingProgram{};
+        return program;
     }
-    const char* shader_source = buffer.c_str();
-    shader_id = glCreateShader(shader_type);
-    // second param is the number of strings passed.
-    glShaderSource(shader_id, 1, &shader_source, NULL);
-    glCompileShader(shader_id);
-    // Check for compile errors:
+
+    int success;
+    glGetProgramiv(pending.program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        // A failed compilation fails the link too; its log is the useful one.
+        report_compile_errors(pending.vertex_shader, GL_VERTEX_SHADER);
+        report_compile_errors(pending.fragment_shader, GL_FRAGMENT_SHADER);
+        char info_log[1024];
+        glGetProgramInfoLog(pending.program, sizeof(info_log), NULL, info_log);
+        std::cerr << "[ERROR] Program link failed!\n" << info_log << '\n';
+        discard_pending();
+        return 0;
+    }
+
+    const GLuint program = pending.program;
+    const uint64_t cache_key = pending.cache_key;
+    pending.program = 0;
+    // Can delete the shaders now.
+    discard_pending();
+
+    if (program_cache::enabled())
+    {
+        program_cache::store(cache_key, program);
+    }
+    return program;
+}
+
+void Shader::discard_pending()
+{
+    if (pending.program)
+        glDeleteProgram(pending.program);
+    if (pending.vertex_shader)
+        glDeleteShader(pending.vertex_shader);
+    if (pending.fragment_shader)
+        glDeleteShader(pending.fragment_shader);
+    pending = PendingProgram{};
+}
+
+void Shader::report_compile_errors(GLuint shader_id, GLenum shader_type) const
+{
     int success;
     glGetShaderiv(shader_id, GL_COMPILE_STATUS, &success);
     if (success)
     {
-        return true;
+        return;
     }
     char info_log[512];
-    // Compilation failed. Show the errors and bail out.
+    // Compilation failed. Show the errors.
     glGetShaderInfoLog(shader_id, sizeof(info_log), NULL, info_log);
+    const std::vector<std::string>& files =
+        shader_type == GL_VERTEX_SHADER ? vertex_files : fragment_files;
     std::cerr << "[ERROR] " << (shader_type == GL_VERTEX_SHADER ? "Vertex" : "Fragment")
-              << " Shader compilation failed:\n"
-              << info_log << '\n';
-    return false;
+              << " Shader compilation failed";
+    if (!permutation.empty())
+    {
+        std::cerr << " (" << permutation.key() << ')';
+    }
+    std::cerr << ":\n" << info_log << '\n';
+    // The source string numbers of the log.
+    for (size_t ii = 0; files.size() > 1 && ii < files.size(); ++ii)
+    {
+        std::cerr << "  source " << ii << ": " << files[ii] << '\n';
+    }
 }
 
-bool Shader::build_program(GLuint vertex_shader, GLuint fragment_shader, const std::vector<Uniform*>* unifs)
+bool Shader::init_program()
 {
+    uniforms.reflect(ID);
+    resolve_uniforms();
+
+#ifndef NDEBUG
+    // Validation checks the program against the current GL state, which at
+    // build time is rarely the state it is drawn with, and it waits for the
+    // link. So it only runs in debug builds, as a sanity check.
     char info_log[1024];
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex_shader);
-    glAttachShader(ID, fragment_shader);
-    glLinkProgram(ID);
     int success;
-    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    glValidateProgram(ID);
+    glGetProgramiv(ID, GL_VALIDATE_STATUS, &success);
     if (!success)
     {
         glGetProgramInfoLog(ID, sizeof(info_log), NULL, info_log);
-        std::cerr << "[ERROR] Program link failed!\n" << info_log << '\n';
+        std::cerr << "[ERROR] Program validation failed!\n" << info_log << '\n';
         return false;
     }
+#endif
 
-    if (unifs)
+    return true;
+}
+
+void Shader::resolve_uniforms()
+{
+    for (auto& uu: uniform_objects)
     {
-        for (auto& uu: *unifs)
-        {
-            uu->program = ID;
-            uu->location = glGetUniformLocation(ID, uu->name.c_str());
-        }
+        uu->program = ID;
+        uu->location = location(uu->name);
+        uu->invalidate();
     }
+    for (size_t ii = 0; ii < handle_names.size(); ++ii)
+    {
+        handle_locations[ii] = location(handle_names[ii]);
+    }
+}
 
-    glValidateProgram(ID);
-    glGetProgramiv(ID, GL_VALIDATE_STATUS, &success);
-    if (!success)
+bool Shader::begin_reload()
+{
+    discard_pending();
+    if (!start_program())
     {
-        glGetProgramInfoLog(ID, sizeof(info_log), NULL, info_log);
-        std::cerr << "[ERROR] Program validation failed!\n" << info_log << '\n';
+        std::cerr << "[ERROR] Keeping the previous program of " << vertex_file << " and "
+                  << fragment_file << '\n';
+        return false;
+    }
+    return true;
+}
+
+bool Shader::finish_build()
+{
+    batch = nullptr;
+    ID = finish_program();
+    error = !ID || !init_program();
+    return !error;
+}
+
+bool Shader::pending_ready() const
+{
+    if (!pending.program || pending.from_cache || !parallel_compile_supported())
+    {
+        return true;
+    }
+    GLint done = GL_FALSE;
+    glGetProgramiv(pending.program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+bool Shader::finish_reload()
+{
+    if (!pending.program)
+    {
+        return false;
+    }
+
+    const GLuint program = finish_program();
+    if (!program)
+    {
+        std::cerr << "[ERROR] Keeping the previous program of " << vertex_file << " and "
+                  << fragment_file << '\n';
+        return false;
+    }
+
+    const GLuint old_program = ID;
+    if (old_program)
+    {
+        copy_uniform_block_bindings(old_program, program);
+    }
+    UniformTable old_uniforms = uniforms;
+    ID = program;
+    if (!init_program())
+    {
+        std::cerr << "[ERROR] Keeping the previous program of " << vertex_file << " and "
+                  << fragment_file << '\n';
+        glDeleteProgram(program);
+        ID = old_program;
+        uniforms = std::move(old_uniforms);
+        resolve_uniforms();
         return false;
     }
 
+    if (old_program)
+    {
+        gl_state().use_program(ID);
+        copy_uniform_values(old_program, ID);
+        gl_state().forget_program(old_program);
+        glDeleteProgram(old_program);
+    }
+    error = false;
     return true;
 }
 
+bool Shader::reload() { return begin_reload() && finish_reload(); }
+
+// static
+bool Shader::parallel_compile_supported()
+{
+    static const bool supported = gl_ext::has_extension("GL_KHR_parallel_shader_compile")
+        || gl_ext::has_extension("GL_ARB_parallel_shader_compile");
+    return supported;
+}
+
 }
@@ -0,0 +1,208 @@
+#include <util/shader_source.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <string_view>
+
+namespace util
+{
+
+namespace
+{
+
+std::string_view trim_left(std::string_view line)
+{
+    const size_t start = line.find_first_not_of(" \t");
+    return start == std::string_view::npos ? std::string_view{} : line.substr(start);
+}
+
+// Returns the name of an #include "name" line, or an empty view.
+std::string_view include_name(std::string_view line)
+{
+    line = trim_left(line);
+    if (!line.starts_with('#'))
+        return {};
+    line = trim_left(line.substr(1));
+    if (!line.starts_with("include"))
+        return {};
+    line = trim_left(line.substr(7));
+    if (!line.starts_with('"'))
+        return {};
+    const size_t end = line.find('"', 1);
+    return end == std::string_view::npos ? std::string_view{} : line.substr(1, end - 1);
+}
+
+bool is_version(std::string_view line)
+{
+    line = trim_left(line);
+    return line.starts_with('#') && trim_left(line.substr(1)).starts_with("version");
+}
+
+class Preprocessor
+{
+public:
+    Preprocessor(const ShaderDefines& defines_, ShaderSource& out_)
+        : defines{ defines_ }
+        , out{ out_ }
+    {
+    }
+
+    bool expand(const std::string& path, const std::string& included_from, int included_at)
+    {
+        MappedFile file(path);
+        if (file.error)
+        {
+            if (!included_from.empty())
+                std::cerr << "[ERROR] " << included_from << ':' << included_at
+                          << ": cannot open included file " << path << '\n';
+            return false;
+        }
+        const std::string_view contents = file.view();
+        out.mappings.push_back(std::move(file));
+
+        const size_t index = out.files.size();
+        const size_t first_piece = out.pieces.size();
+        out.files.push_back(path);
+        if (index != 0)
+            set_line(1, index);
+        const std::filesystem::path dir = std::filesystem::path(path).parent_path();
+
+        // Lines are passed on as runs of the mapped file, cut only where the
+        // preprocessor replaces or adds a line.
+        size_t run_start = 0;
+        size_t pos = 0;
+        int line_number = 0;
+        while (pos < contents.size())
+        {
+            const size_t eol = contents.find('\n', pos);
+            const size_t next = eol == std::string_view::npos ? contents.size() : eol + 1;
+            const std::string_view line = contents.substr(pos, next - pos);
+            ++line_number;
+
+            const std::string_view name = include_name(line);
+            if (!name.empty())
+            {
+                add_run(contents.substr(run_start, pos - run_start));
+                run_start = next;
+                const std::string included =
+                    (dir / std::filesystem::path(name)).lexically_normal().string();
+                if (std::find(out.files.begin(), out.files.end(), included) == out.files.end())
+                {
+                    if (!expand(included, path, line_number))
+                        return false;
+                }
+                // Back in this file, at the line after the #include.
+                set_line(line_number + 1, index);
+            }
+            else if (index == 0 && !defines_added && !defines.empty() && is_version(line))
+            {
+                // Wherever the #version line is: comments and blank lines
+                // may come before it.
+                add_run(contents.substr(run_start, next - run_start));
+                run_start = next;
+                out.pieces.push_back(define_lines());
+                set_line(line_number + 1, 0);
+            }
+            pos = next;
+        }
+        add_run(contents.substr(run_start));
+
+        // Without a #version line the defines go first.
+        if (index == 0 && !defines_added && !defines.empty())
+        {
+            const std::string_view lines = define_lines();
+            const std::string_view line = out.generated.emplace_back("#line 1 0\n");
+            out.pieces.insert(out.pieces.begin() + static_cast<std::ptrdiff_t>(first_piece),
+                              { lines, line });
+        }
+        return true;
+    }
+
+private:
+    // The #define lines of the defines, generated once.
+    std::string_view define_lines()
+    {
+        std::string& lines = out.generated.emplace_back();
+        for (const auto& [name, value]: defines.entries())
+            lines += "#define " + name + ' ' + value + '\n';
+        defines_added = true;
+        return lines;
+    }
+
+    // Adds a run of whole lines of a file, ending it with a newline if the
+    // file does not, so that what follows starts on a line of its own.
+    void add_run(std::string_view run)
+    {
+        if (run.empty())
+            return;
+        out.pieces.push_back(run);
+        if (run.back() != '\n')
+            out.pieces.push_back("\n");
+    }
+
+    void set_line(int line, size_t index)
+    {
+        out.pieces.push_back(out.generated.emplace_back(
+            "#line " + std::to_string(line) + ' ' + std::to_string(index) + '\n'));
+    }
+
+    const ShaderDefines& defines;
+    ShaderSource& out;
+    bool defines_added = false;
+};
+
+} // end of anonymous namespace
+
+ShaderDefines::ShaderDefines(std::initializer_list<const char*> names)
+{
+    for (const char* name: names)
+        define(name);
+}
+
+ShaderDefines& ShaderDefines::define(const std::string& name, const std::string& value)
+{
+    values[name] = value;
+    return *this;
+}
+
+std::string ShaderDefines::key() const
+{
+    std::string key;
+    for (const auto& [name, value]: values)
+    {
+        if (!key.empty())
+            key += ';';
+        key += name;
+        key += '=';
+        key += value;
+    }
+    return key;
+}
+
+size_t ShaderSource::size() const
+{
+    size_t total = 0;
+    for (std::string_view piece: pieces)
+        total += piece.size();
+    return total;
+}
+
+std::string ShaderSource::text() const
+{
+    std::string result;
+    result.reserve(size());
+    for (std::string_view piece: pieces)
+        result.append(piece);
+    return result;
+}
+
+bool preprocess_shader(const std::string& path, const ShaderDefines& defines, ShaderSource& out)
+{
+    out = ShaderSource{};
+    Preprocessor preprocessor(defines, out);
+    return preprocessor.expand(std::filesystem::path(path).lexically_normal().string(),
+                               std::string(), 0);
+}
+
+}
@@ -0,0 +1,26 @@
+#include <util/shader_variants.hpp>
+
+namespace util
+{
+
+ShaderVariants::ShaderVariants(const char* vertex_path, const char* fragment_path)
+    : vertex_file{ vertex_path }
+    , fragment_file{ fragment_path }
+{
+}
+
+Shader& ShaderVariants::get(const ShaderDefines& defines, ProgramBatch* batch)
+{
+    std::unique_ptr<Shader>& variant = variants[defines.key()];
+    if (!variant)
+    {
+        if (batch)
+            variant = std::make_unique<Shader>(vertex_file.c_str(), fragment_file.c_str(), defines,
+                                               *batch);
+        else
+            variant = std::make_unique<Shader>(vertex_file.c_str(), fragment_file.c_str(), defines);
+    }
+    return *variant;
+}
+
+}
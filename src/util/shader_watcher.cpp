@@ -0,0 +1,114 @@
+#include <util/shader_watcher.hpp>
+#include <util/shader.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+namespace util
+{
+
+namespace
+{
+
+ShaderWatcher* active_watcher = nullptr;
+
+}
+
+// static
+ShaderWatcher* ShaderWatcher::active() { return active_watcher; }
+
+// static
+void ShaderWatcher::set_active(ShaderWatcher* watcher) { active_watcher = watcher; }
+
+void ShaderWatcher::add(Shader& shader)
+{
+    for (const std::string& file: shader.source_files())
+    {
+        files.add(file);
+    }
+    entries.push_back(Entry{ &shader, false, {} });
+}
+
+// static
+bool ShaderWatcher::uses(const Shader& shader, const std::string& file)
+{
+    for (const std::string& source: shader.source_files())
+    {
+        if (FileWatcher::normalize(source) == file)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ShaderWatcher::remove(Shader& shader)
+{
+    std::erase_if(entries, [&](const Entry& entry) { return entry.shader == &shader; });
+}
+
+void ShaderWatcher::poll()
+{
+    for (const std::string& file: files.changed())
+    {
+        std::error_code ec;
+        auto saved = std::filesystem::last_write_time(file, ec);
+        if (ec)
+        {
+            saved = std::chrono::file_clock::now();
+        }
+        for (Entry& entry: entries)
+        {
+            if (!uses(*entry.shader, file))
+            {
+                continue;
+            }
+            if (!entry.pending || saved < entry.saved)
+            {
+                entry.saved = saved;
+            }
+            // Starts over if a rebuild was already running.
+            entry.pending = entry.shader->begin_reload();
+            if (!entry.pending)
+            {
+                ++reload_stats.failures;
+            }
+        }
+    }
+
+    for (Entry& entry: entries)
+    {
+        if (!entry.pending || !entry.shader->reload_ready())
+        {
+            continue;
+        }
+        entry.pending = false;
+        // The sources may include other files now.
+        for (const std::string& source: entry.shader->source_files())
+        {
+            files.add(source);
+        }
+        if (!entry.shader->finish_reload())
+        {
+            ++reload_stats.failures;
+            continue;
+        }
+
+        const std::chrono::duration<double, std::milli> latency =
+            std::chrono::file_clock::now() - entry.saved;
+        ++reload_stats.reloads;
+        reload_stats.last_latency_ms = latency.count();
+        reload_stats.max_latency_ms = std::max(reload_stats.max_latency_ms, latency.count());
+        std::cout << "Reloaded " << entry.shader->vertex_path() << " + "
+                  << entry.shader->fragment_path();
+        if (!entry.shader->defines().empty())
+        {
+            std::cout << " (" << entry.shader->defines().key() << ')';
+        }
+        std::cout << " as program " << entry.shader->ID << ": " << latency.count()
+                  << " ms from save to swap\n";
+    }
+}
+
+}
@@ -0,0 +1,1145 @@
+#include <util/3dtypes.hpp>
+#include <util/simd.hpp>
+
+#if !defined(UTIL_SIMD_DISABLED) && (defined(__x86_64__) || defined(__i386__))
+#define UTIL_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// All matrices are row major, so the row ii of a product is the linear
+// combination of the rows of the right hand side matrix weighted by the
+// elements of row ii of the left hand side matrix:
+//
+//   res[ii] = a[ii][0] * b[0] + a[ii][1] * b[1] + a[ii][2] * b[2] + a[ii][3] * b[3]
+//
+// Similarly a transformed point is the linear combination of the columns of the
+// matrix weighted by the coordinates of the point. The SIMD kernels below are
+// built around these two identities.
+
+namespace util
+{
+
+namespace
+{
+
+struct Kernels
+{
+    void (*mul)(const Mat4x4f& a, const Mat4x4f& b, Mat4x4f& res);
+    void (*mul_batch)(const Mat4x4f& lhs, const Mat4x4f* rhs, Mat4x4f* out, size_t count);
+    void (*xform3)(const Mat4x4f& mat, const Vec3f* points, Vec4f* out, size_t count);
+    void (*xform4)(const Mat4x4f& mat, const Vec4f* points, Vec4f* out, size_t count);
+    void (*amul)(const Affine3f& a, const Affine3f& b, Affine3f& res);
+    void (*amul_batch)(const Affine3f& lhs, const Affine3f* rhs, Affine3f* out, size_t count);
+    void (*mamul)(const Mat4x4f& a, const Affine3f& b, Mat4x4f& res);
+    void (*mamul_batch)(const Mat4x4f& lhs, const Affine3f* rhs, Mat4x4f* out, size_t count);
+    void (*qmul_batch)(const Quatf& lhs, const Quatf* rhs, Quatf* out, size_t count);
+    void (*dqmul_batch)(const DualQuatf& lhs, const DualQuatf* rhs, DualQuatf* out, size_t count);
+    void (*nlerp_batch)(const Quatf* a, const Quatf* b, float t, Quatf* out, size_t count);
+    void (*qmatrix_batch)(const Quatf* quats, Mat4x4f* out, size_t count);
+    void (*dqmatrix_batch)(const DualQuatf* quats, Mat4x4f* out, size_t count);
+};
+
+// Scalar reference kernels.
+
+void mul_scalar(const Mat4x4f& a, const Mat4x4f& b, Mat4x4f& res)
+{
+    for (int ii = 0; ii < 4; ++ii)
+    {
+        for (int jj = 0; jj < 4; ++jj)
+        {
+            float dot = 0.0f;
+            for (int kk = 0; kk < 4; ++kk)
+            {
+                dot += a.mat[ii][kk] * b.mat[kk][jj];
+            }
+            res.mat[ii][jj] = dot;
+        }
+    }
+}
+
+void mul_batch_scalar(const Mat4x4f& lhs, const Mat4x4f* rhs, Mat4x4f* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        mul_scalar(lhs, rhs[ii], out[ii]);
+    }
+}
+
+void xform3_scalar(const Mat4x4f& mat, const Vec3f* points, Vec4f* out, size_t count)
+{
+    const mat4x4f_t& m = mat.mat;
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        const Vec3f& p = points[ii];
+        out[ii] = Vec4f(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                        m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                        m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3],
+                        m[3][0] * p.x + m[3][1] * p.y + m[3][2] * p.z + m[3][3]);
+    }
+}
+
+void xform4_scalar(const Mat4x4f& mat, const Vec4f* points, Vec4f* out, size_t count)
+{
+    const mat4x4f_t& m = mat.mat;
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        const Vec4f& p = points[ii];
+        out[ii] = Vec4f(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3] * p.w,
+                        m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3] * p.w,
+                        m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3] * p.w,
+                        m[3][0] * p.x + m[3][1] * p.y + m[3][2] * p.z + m[3][3] * p.w);
+    }
+}
+
+// The products with an Affine3f on the right are the 4x4 ones with its last
+// row (0, 0, 0, 1) spelled out: the last column gets a[ii][3] added and the
+// other columns nothing.
+
+void amul_scalar(const Affine3f& a, const Affine3f& b, Affine3f& res)
+{
+    for (int ii = 0; ii < 3; ++ii)
+    {
+        for (int jj = 0; jj < 4; ++jj)
+        {
+            float dot = 0.0f;
+            for (int kk = 0; kk < 3; ++kk)
+            {
+                dot += a.mat[ii][kk] * b.mat[kk][jj];
+            }
+            res.mat[ii][jj] = (jj == 3) ? dot + a.mat[ii][3] : dot;
+        }
+    }
+}
+
+void amul_batch_scalar(const Affine3f& lhs, const Affine3f* rhs, Affine3f* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        amul_scalar(lhs, rhs[ii], out[ii]);
+    }
+}
+
+void mamul_scalar(const Mat4x4f& a, const Affine3f& b, Mat4x4f& res)
+{
+    for (int ii = 0; ii < 4; ++ii)
+    {
+        for (int jj = 0; jj < 4; ++jj)
+        {
+            float dot = 0.0f;
+            for (int kk = 0; kk < 3; ++kk)
+            {
+                dot += a.mat[ii][kk] * b.mat[kk][jj];
+            }
+            res.mat[ii][jj] = (jj == 3) ? dot + a.mat[ii][3] : dot;
+        }
+    }
+}
+
+void mamul_batch_scalar(const Mat4x4f& lhs, const Affine3f* rhs, Mat4x4f* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        mamul_scalar(lhs, rhs[ii], out[ii]);
+    }
+}
+
+void qmul_batch_scalar(const Quatf& lhs, const Quatf* rhs, Quatf* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        out[ii] = lhs * rhs[ii];
+    }
+}
+
+void dqmul_batch_scalar(const DualQuatf& lhs, const DualQuatf* rhs, DualQuatf* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        out[ii] = lhs * rhs[ii];
+    }
+}
+
+void nlerp_batch_scalar(const Quatf* a, const Quatf* b, float t, Quatf* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        out[ii] = nlerp(a[ii], b[ii], t);
+    }
+}
+
+void qmatrix_batch_scalar(const Quatf* quats, Mat4x4f* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        out[ii] = quats[ii].to_matrix();
+    }
+}
+
+void dqmatrix_batch_scalar(const DualQuatf* quats, Mat4x4f* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        out[ii] = quats[ii].to_matrix();
+    }
+}
+
+constexpr Kernels scalar_kernels{ mul_scalar,          mul_batch_scalar,   xform3_scalar,
+                                  xform4_scalar,       amul_scalar,        amul_batch_scalar,
+                                  mamul_scalar,        mamul_batch_scalar, qmul_batch_scalar,
+                                  dqmul_batch_scalar,  nlerp_batch_scalar, qmatrix_batch_scalar,
+                                  dqmatrix_batch_scalar };
+
+#ifdef UTIL_SIMD_X86
+
+// SSE kernels (SSE2 is part of the x86-64 baseline so these need no target attribute).
+
+inline __m128 sse_row(const Mat4x4f& m, int row) { return _mm_loadu_ps(m.mat[row]); }
+
+inline __m128 sse_row(const Affine3f& m, int row) { return _mm_loadu_ps(m.mat[row]); }
+
+// res = a_row[0] * b0 + a_row[1] * b1 + a_row[2] * b2 + a_row[3] * b3
+inline __m128 sse_combine(__m128 a_row, __m128 b0, __m128 b1, __m128 b2, __m128 b3)
+{
+    __m128 res = _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, 0x00), b0);
+    res = _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, 0x55), b1));
+    res = _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, 0xAA), b2));
+    res = _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, 0xFF), b3));
+    return res;
+}
+
+void mul_sse(const Mat4x4f& a, const Mat4x4f& b, Mat4x4f& res)
+{
+    const __m128 b0 = sse_row(b, 0);
+    const __m128 b1 = sse_row(b, 1);
+    const __m128 b2 = sse_row(b, 2);
+    const __m128 b3 = sse_row(b, 3);
+
+    for (int ii = 0; ii < 4; ++ii)
+    {
+        _mm_storeu_ps(res.mat[ii], sse_combine(sse_row(a, ii), b0, b1, b2, b3));
+    }
+}
+
+void mul_batch_sse(const Mat4x4f& lhs, const Mat4x4f* rhs, Mat4x4f* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        mul_sse(lhs, rhs[ii], out[ii]);
+    }
+}
+
+struct SseColumns
+{
+    __m128 c0, c1, c2, c3;
+
+    explicit SseColumns(const Mat4x4f& mat)
+    {
+        c0 = sse_row(mat, 0);
+        c1 = sse_row(mat, 1);
+        c2 = sse_row(mat, 2);
+        c3 = sse_row(mat, 3);
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    }
+};
+
+void xform3_sse(const Mat4x4f& mat, const Vec3f* points, Vec4f* out, size_t count)
+{
+    const SseColumns cols(mat);
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        const Vec3f& p = points[ii];
+        __m128 res = _mm_mul_ps(cols.c0, _mm_set1_ps(p.x));
+        res = _mm_add_ps(res, _mm_mul_ps(cols.c1, _mm_set1_ps(p.y)));
+        res = _mm_add_ps(res, _mm_mul_ps(cols.c2, _mm_set1_ps(p.z)));
+        res = _mm_add_ps(res, cols.c3);
+        _mm_storeu_ps(&out[ii].x, res);
+    }
+}
+
+void xform4_sse(const Mat4x4f& mat, const Vec4f* points, Vec4f* out, size_t count)
+{
+    const SseColumns cols(mat);
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        const __m128 p = _mm_loadu_ps(&points[ii].x);
+        __m128 res = _mm_mul_ps(cols.c0, _mm_shuffle_ps(p, p, 0x00));
+        res = _mm_add_ps(res, _mm_mul_ps(cols.c1, _mm_shuffle_ps(p, p, 0x55)));
+        res = _mm_add_ps(res, _mm_mul_ps(cols.c2, _mm_shuffle_ps(p, p, 0xAA)));
+        res = _mm_add_ps(res, _mm_mul_ps(cols.c3, _mm_shuffle_ps(p, p, 0xFF)));
+        _mm_storeu_ps(&out[ii].x, res);
+    }
+}
+
+// Only the last element of a row.
+inline __m128 sse_last(__m128 row)
+{
+    return _mm_and_ps(row, _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1)));
+}
+
+// sse_combine() with b3 = (0, 0, 0, 1), for an Affine3f on the right.
+inline __m128 sse_combine_affine(__m128 a_row, __m128 b0, __m128 b1, __m128 b2)
+{
+    __m128 res = _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, 0x00), b0);
+    res = _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, 0x55), b1));
+    res = _mm_add_ps(res, _mm_mul_ps(_mm_shuffle_ps(a_row, a_row, 0xAA), b2));
+    return _mm_add_ps(res, sse_last(a_row));
+}
+
+void amul_sse(const Affine3f& a, const Affine3f& b, Affine3f& res)
+{
+    const __m128 b0 = sse_row(b, 0);
+    const __m128 b1 = sse_row(b, 1);
+    const __m128 b2 = sse_row(b, 2);
+
+    for (int ii = 0; ii < 3; ++ii)
+    {
+        _mm_storeu_ps(res.mat[ii], sse_combine_affine(sse_row(a, ii), b0, b1, b2));
+    }
+}
+
+void amul_batch_sse(const Affine3f& lhs, const Affine3f* rhs, Affine3f* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        amul_sse(lhs, rhs[ii], out[ii]);
+    }
+}
+
+void mamul_sse(const Mat4x4f& a, const Affine3f& b, Mat4x4f& res)
+{
+    const __m128 b0 = sse_row(b, 0);
+    const __m128 b1 = sse_row(b, 1);
+    const __m128 b2 = sse_row(b, 2);
+
+    for (int ii = 0; ii < 4; ++ii)
+    {
+        _mm_storeu_ps(res.mat[ii], sse_combine_affine(sse_row(a, ii), b0, b1, b2));
+    }
+}
+
+void mamul_batch_sse(const Mat4x4f& lhs, const Affine3f* rhs, Mat4x4f* out, size_t count)
+{
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        mamul_sse(lhs, rhs[ii], out[ii]);
+    }
+}
+
+// The quaternion kernels work on 4 quaternions at a time, transposed so that
+// each register holds one component of all of them. Their arithmetic follows
+// the scalar code in 3dtypes.cpp term by term.
+
+struct SseQuats
+{
+    __m128 x, y, z, w;
+};
+
+// Quaternions at p, p + stride, p + 2 * stride and p + 3 * stride floats.
+inline SseQuats sse_load_quats(const float* p, size_t stride)
+{
+    SseQuats q{ _mm_loadu_ps(p), _mm_loadu_ps(p + stride), _mm_loadu_ps(p + 2 * stride),
+                _mm_loadu_ps(p + 3 * stride) };
+    _MM_TRANSPOSE4_PS(q.x, q.y, q.z, q.w);
+    return q;
+}
+
+inline void sse_store_quats(SseQuats q, float* p, size_t stride)
+{
+    _MM_TRANSPOSE4_PS(q.x, q.y, q.z, q.w);
+    _mm_storeu_ps(p, q.x);
+    _mm_storeu_ps(p + stride, q.y);
+    _mm_storeu_ps(p + 2 * stride, q.z);
+    _mm_storeu_ps(p + 3 * stride, q.w);
+}
+
+inline SseQuats sse_set1_quat(const Quatf& q)
+{
+    return { _mm_set1_ps(q.x), _mm_set1_ps(q.y), _mm_set1_ps(q.z), _mm_set1_ps(q.w) };
+}
+
+inline SseQuats sse_quat_mul(const SseQuats& a, const SseQuats& b)
+{
+    SseQuats r;
+    r.x = _mm_mul_ps(a.w, b.x);
+    r.x = _mm_add_ps(r.x, _mm_mul_ps(a.x, b.w));
+    r.x = _mm_add_ps(r.x, _mm_mul_ps(a.y, b.z));
+    r.x = _mm_sub_ps(r.x, _mm_mul_ps(a.z, b.y));
+    r.y = _mm_mul_ps(a.w, b.y);
+    r.y = _mm_sub_ps(r.y, _mm_mul_ps(a.x, b.z));
+    r.y = _mm_add_ps(r.y, _mm_mul_ps(a.y, b.w));
+    r.y = _mm_add_ps(r.y, _mm_mul_ps(a.z, b.x));
+    r.z = _mm_mul_ps(a.w, b.z);
+    r.z = _mm_add_ps(r.z, _mm_mul_ps(a.x, b.y));
+    r.z = _mm_sub_ps(r.z, _mm_mul_ps(a.y, b.x));
+    r.z = _mm_add_ps(r.z, _mm_mul_ps(a.z, b.w));
+    r.w = _mm_mul_ps(a.w, b.w);
+    r.w = _mm_sub_ps(r.w, _mm_mul_ps(a.x, b.x));
+    r.w = _mm_sub_ps(r.w, _mm_mul_ps(a.y, b.y));
+    r.w = _mm_sub_ps(r.w, _mm_mul_ps(a.z, b.z));
+    return r;
+}
+
+inline __m128 sse_quat_dot(const SseQuats& a, const SseQuats& b)
+{
+    __m128 d = _mm_mul_ps(a.x, b.x);
+    d = _mm_add_ps(d, _mm_mul_ps(a.y, b.y));
+    d = _mm_add_ps(d, _mm_mul_ps(a.z, b.z));
+    return _mm_add_ps(d, _mm_mul_ps(a.w, b.w));
+}
+
+// The upper left 3x3 of Quatf::to_matrix() and a fourth column, stored as the
+// first three rows of 4 matrices; the last row is (0, 0, 0, 1).
+inline void sse_store_matrices(const SseQuats& q, __m128 c3x, __m128 c3y, __m128 c3z,
+                               Mat4x4f* out)
+{
+    const __m128 x2 = _mm_add_ps(q.x, q.x);
+    const __m128 y2 = _mm_add_ps(q.y, q.y);
+    const __m128 z2 = _mm_add_ps(q.z, q.z);
+    const __m128 xx = _mm_mul_ps(q.x, x2);
+    const __m128 yy = _mm_mul_ps(q.y, y2);
+    const __m128 zz = _mm_mul_ps(q.z, z2);
+    const __m128 xy = _mm_mul_ps(q.x, y2);
+    const __m128 xz = _mm_mul_ps(q.x, z2);
+    const __m128 yz = _mm_mul_ps(q.y, z2);
+    const __m128 wx = _mm_mul_ps(q.w, x2);
+    const __m128 wy = _mm_mul_ps(q.w, y2);
+    const __m128 wz = _mm_mul_ps(q.w, z2);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    __m128 rows[3][4] = {
+        { _mm_sub_ps(one, _mm_add_ps(yy, zz)), _mm_sub_ps(xy, wz), _mm_add_ps(xz, wy), c3x },
+        { _mm_add_ps(xy, wz), _mm_sub_ps(one, _mm_add_ps(xx, zz)), _mm_sub_ps(yz, wx), c3y },
+        { _mm_sub_ps(xz, wy), _mm_add_ps(yz, wx), _mm_sub_ps(one, _mm_add_ps(xx, yy)), c3z },
+    };
+    const __m128 last = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    for (int rr = 0; rr < 3; ++rr)
+    {
+        _MM_TRANSPOSE4_PS(rows[rr][0], rows[rr][1], rows[rr][2], rows[rr][3]);
+        for (int mm = 0; mm < 4; ++mm)
+        {
+            _mm_storeu_ps(out[mm].mat[rr], rows[rr][mm]);
+        }
+    }
+    for (int mm = 0; mm < 4; ++mm)
+    {
+        _mm_storeu_ps(out[mm].mat[3], last);
+    }
+}
+
+// 2 * dual * conjugate(real), as DualQuatf::translation().
+inline SseQuats sse_translation(const SseQuats& real, const SseQuats& dual)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const SseQuats conj{ _mm_xor_ps(real.x, sign), _mm_xor_ps(real.y, sign),
+                         _mm_xor_ps(real.z, sign), real.w };
+    SseQuats t = sse_quat_mul(dual, conj);
+    t.x = _mm_add_ps(t.x, t.x);
+    t.y = _mm_add_ps(t.y, t.y);
+    t.z = _mm_add_ps(t.z, t.z);
+    return t;
+}
+
+constexpr size_t quat_stride = sizeof(Quatf) / sizeof(float);
+constexpr size_t dual_stride = sizeof(DualQuatf) / sizeof(float);
+
+void qmul_batch_sse(const Quatf& lhs, const Quatf* rhs, Quatf* out, size_t count)
+{
+    const SseQuats a = sse_set1_quat(lhs);
+    size_t ii = 0;
+    for (; ii + 4 <= count; ii += 4)
+    {
+        const SseQuats b = sse_load_quats(&rhs[ii].x, quat_stride);
+        sse_store_quats(sse_quat_mul(a, b), &out[ii].x, quat_stride);
+    }
+    qmul_batch_scalar(lhs, rhs + ii, out + ii, count - ii);
+}
+
+void dqmul_batch_sse(const DualQuatf& lhs, const DualQuatf* rhs, DualQuatf* out, size_t count)
+{
+    const SseQuats a_real = sse_set1_quat(lhs.real);
+    const SseQuats a_dual = sse_set1_quat(lhs.dual);
+    size_t ii = 0;
+    for (; ii + 4 <= count; ii += 4)
+    {
+        const SseQuats b_real = sse_load_quats(&rhs[ii].real.x, dual_stride);
+        const SseQuats b_dual = sse_load_quats(&rhs[ii].dual.x, dual_stride);
+        const SseQuats p = sse_quat_mul(a_real, b_dual);
+        const SseQuats q = sse_quat_mul(a_dual, b_real);
+        const SseQuats dual{ _mm_add_ps(p.x, q.x), _mm_add_ps(p.y, q.y), _mm_add_ps(p.z, q.z),
+                             _mm_add_ps(p.w, q.w) };
+        sse_store_quats(sse_quat_mul(a_real, b_real), &out[ii].real.x, dual_stride);
+        sse_store_quats(dual, &out[ii].dual.x, dual_stride);
+    }
+    dqmul_batch_scalar(lhs, rhs + ii, out + ii, count - ii);
+}
+
+void nlerp_batch_sse(const Quatf* a, const Quatf* b, float t, Quatf* out, size_t count)
+{
+    const __m128 tt = _mm_set1_ps(t);
+    const __m128 sign_bit = _mm_set1_ps(-0.0f);
+    size_t ii = 0;
+    for (; ii + 4 <= count; ii += 4)
+    {
+        const SseQuats qa = sse_load_quats(&a[ii].x, quat_stride);
+        const SseQuats qb = sse_load_quats(&b[ii].x, quat_stride);
+        // Negates b where it is on the other side of a.
+        const __m128 sign =
+            _mm_and_ps(_mm_cmplt_ps(sse_quat_dot(qa, qb), _mm_setzero_ps()), sign_bit);
+        const auto lerp = [&](__m128 ca, __m128 cb) {
+            return _mm_add_ps(ca, _mm_mul_ps(tt, _mm_sub_ps(_mm_xor_ps(cb, sign), ca)));
+        };
+        SseQuats r{ lerp(qa.x, qb.x), lerp(qa.y, qb.y), lerp(qa.z, qb.z), lerp(qa.w, qb.w) };
+        const __m128 len = _mm_sqrt_ps(sse_quat_dot(r, r));
+        r.x = _mm_div_ps(r.x, len);
+        r.y = _mm_div_ps(r.y, len);
+        r.z = _mm_div_ps(r.z, len);
+        r.w = _mm_div_ps(r.w, len);
+        sse_store_quats(r, &out[ii].x, quat_stride);
+    }
+    nlerp_batch_scalar(a + ii, b + ii, t, out + ii, count - ii);
+}
+
+void qmatrix_batch_sse(const Quatf* quats, Mat4x4f* out, size_t count)
+{
+    const __m128 zero = _mm_setzero_ps();
+    size_t ii = 0;
+    for (; ii + 4 <= count; ii += 4)
+    {
+        sse_store_matrices(sse_load_quats(&quats[ii].x, quat_stride), zero, zero, zero, out + ii);
+    }
+    qmatrix_batch_scalar(quats + ii, out + ii, count - ii);
+}
+
+void dqmatrix_batch_sse(const DualQuatf* quats, Mat4x4f* out, size_t count)
+{
+    size_t ii = 0;
+    for (; ii + 4 <= count; ii += 4)
+    {
+        const SseQuats real = sse_load_quats(&quats[ii].real.x, dual_stride);
+        const SseQuats t = sse_translation(real, sse_load_quats(&quats[ii].dual.x, dual_stride));
+        sse_store_matrices(real, t.x, t.y, t.z, out + ii);
+    }
+    dqmatrix_batch_scalar(quats + ii, out + ii, count - ii);
+}
+
+constexpr Kernels sse_kernels{ mul_sse,         mul_batch_sse,    xform3_sse,
+                               xform4_sse,      amul_sse,         amul_batch_sse,
+                               mamul_sse,       mamul_batch_sse,  qmul_batch_sse,
+                               dqmul_batch_sse, nlerp_batch_sse,  qmatrix_batch_sse,
+                               dqmatrix_batch_sse };
+
+// AVX2 + FMA kernels. These work on two rows (or two matrices / points) per
+// 256 bit register. They are compiled for AVX2 regardless of the global
+// compiler flags and only selected after a runtime CPU check.
+
+#define UTIL_AVX2 __attribute__((target("avx2,fma")))
+
+UTIL_AVX2 inline __m256 avx_dup(__m128 v) { return _mm256_set_m128(v, v); }
+
+UTIL_AVX2 inline __m256 avx_pair(const float* lo, const float* hi)
+{
+    return _mm256_set_m128(_mm_loadu_ps(hi), _mm_loadu_ps(lo));
+}
+
+UTIL_AVX2 void mul_avx2(const Mat4x4f& a, const Mat4x4f& b, Mat4x4f& res)
+{
+    const __m256 b0 = avx_dup(sse_row(b, 0));
+    const __m256 b1 = avx_dup(sse_row(b, 1));
+    const __m256 b2 = avx_dup(sse_row(b, 2));
+    const __m256 b3 = avx_dup(sse_row(b, 3));
+
+    for (int ii = 0; ii < 4; ii += 2)
+    {
+        // rows ii and ii + 1 of a.
+        const __m256 a_rows = _mm256_loadu_ps(a.mat[ii]);
+        __m256 rows = _mm256_mul_ps(_mm256_shuffle_ps(a_rows, a_rows, 0x00), b0);
+        rows = _mm256_fmadd_ps(_mm256_shuffle_ps(a_rows, a_rows, 0x55), b1, rows);
+        rows = _mm256_fmadd_ps(_mm256_shuffle_ps(a_rows, a_rows, 0xAA), b2, rows);
+        rows = _mm256_fmadd_ps(_mm256_shuffle_ps(a_rows, a_rows, 0xFF), b3, rows);
+        _mm256_storeu_ps(res.mat[ii], rows);
+    }
+}
+
+UTIL_AVX2 void mul_batch_avx2(const Mat4x4f& lhs, const Mat4x4f* rhs, Mat4x4f* out, size_t count)
+{
+    // Two right hand side matrices per iteration: the low lane works on
+    // rhs[ii] and the high lane on rhs[ii + 1], so every element of lhs is
+    // broadcast to both lanes once, outside the loop.
+    __m256 l[4][4];
+    for (int rr = 0; rr < 4; ++rr)
+    {
+        for (int kk = 0; kk < 4; ++kk)
+        {
+            l[rr][kk] = _mm256_set1_ps(lhs.mat[rr][kk]);
+        }
+    }
+
+    size_t ii = 0;
+    for (; ii + 2 <= count; ii += 2)
+    {
+        const Mat4x4f& m0 = rhs[ii];
+        const Mat4x4f& m1 = rhs[ii + 1];
+        const __m256 b0 = avx_pair(m0.mat[0], m1.mat[0]);
+        const __m256 b1 = avx_pair(m0.mat[1], m1.mat[1]);
+        const __m256 b2 = avx_pair(m0.mat[2], m1.mat[2]);
+        const __m256 b3 = avx_pair(m0.mat[3], m1.mat[3]);
+
+        for (int rr = 0; rr < 4; ++rr)
+        {
+            __m256 row = _mm256_mul_ps(l[rr][0], b0);
+            row = _mm256_fmadd_ps(l[rr][1], b1, row);
+            row = _mm256_fmadd_ps(l[rr][2], b2, row);
+            row = _mm256_fmadd_ps(l[rr][3], b3, row);
+            _mm_storeu_ps(out[ii].mat[rr], _mm256_castps256_ps128(row));
+            _mm_storeu_ps(out[ii + 1].mat[rr], _mm256_extractf128_ps(row, 1));
+        }
+    }
+
+    if (ii < count)
+    {
+        mul_avx2(lhs, rhs[ii], out[ii]);
+    }
+}
+
+UTIL_AVX2 inline void avx_store_pair(float* lo, float* hi, __m256 v)
+{
+    _mm_storeu_ps(lo, _mm256_castps256_ps128(v));
+    _mm_storeu_ps(hi, _mm256_extractf128_ps(v, 1));
+}
+
+struct Avx2Columns
+{
+    __m256 c0, c1, c2, c3;
+
+    UTIL_AVX2 explicit Avx2Columns(const Mat4x4f& mat)
+    {
+        const SseColumns cols(mat);
+        c0 = avx_dup(cols.c0);
+        c1 = avx_dup(cols.c1);
+        c2 = avx_dup(cols.c2);
+        c3 = avx_dup(cols.c3);
+    }
+};
+
+UTIL_AVX2 inline __m256 avx_pair_set1(float lo, float hi)
+{
+    return _mm256_set_m128(_mm_set1_ps(hi), _mm_set1_ps(lo));
+}
+
+UTIL_AVX2 void xform3_avx2(const Mat4x4f& mat, const Vec3f* points, Vec4f* out, size_t count)
+{
+    const Avx2Columns cols(mat);
+    size_t ii = 0;
+    for (; ii + 2 <= count; ii += 2)
+    {
+        const Vec3f& p0 = points[ii];
+        const Vec3f& p1 = points[ii + 1];
+        // Products and sums in the order of the scalar and SSE kernels, without
+        // FMA, so that points transform to the same bits whatever the
+        // instruction set; SoftRasterizer relies on it.
+        __m256 res = _mm256_mul_ps(cols.c0, avx_pair_set1(p0.x, p1.x));
+        res = _mm256_add_ps(res, _mm256_mul_ps(cols.c1, avx_pair_set1(p0.y, p1.y)));
+        res = _mm256_add_ps(res, _mm256_mul_ps(cols.c2, avx_pair_set1(p0.z, p1.z)));
+        res = _mm256_add_ps(res, cols.c3);
+        _mm256_storeu_ps(&out[ii].x, res);
+    }
+
+    if (ii < count)
+    {
+        xform3_sse(mat, points + ii, out + ii, count - ii);
+    }
+}
+
+UTIL_AVX2 void xform4_avx2(const Mat4x4f& mat, const Vec4f* points, Vec4f* out, size_t count)
+{
+    const Avx2Columns cols(mat);
+    size_t ii = 0;
+    for (; ii + 2 <= count; ii += 2)
+    {
+        const __m256 p = _mm256_loadu_ps(&points[ii].x);
+        __m256 res = _mm256_mul_ps(cols.c0, _mm256_shuffle_ps(p, p, 0x00));
+        res = _mm256_fmadd_ps(cols.c1, _mm256_shuffle_ps(p, p, 0x55), res);
+        res = _mm256_fmadd_ps(cols.c2, _mm256_shuffle_ps(p, p, 0xAA), res);
+        res = _mm256_fmadd_ps(cols.c3, _mm256_shuffle_ps(p, p, 0xFF), res);
+        _mm256_storeu_ps(&out[ii].x, res);
+    }
+
+    if (ii < count)
+    {
+        xform4_sse(mat, points + ii, out + ii, count - ii);
+    }
+}
+
+// The rows of the products with an Affine3f on the right, the last row of
+// which is (0, 0, 0, 1) in both lanes.
+
+UTIL_AVX2 inline __m256 avx_last_row()
+{
+    return _mm256_setr_ps(0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+UTIL_AVX2 inline __m256 avx_combine_affine(__m256 a_rows, __m256 b0, __m256 b1, __m256 b2)
+{
+    __m256 rows = _mm256_mul_ps(_mm256_shuffle_ps(a_rows, a_rows, 0x00), b0);
+    rows = _mm256_fmadd_ps(_mm256_shuffle_ps(a_rows, a_rows, 0x55), b1, rows);
+    rows = _mm256_fmadd_ps(_mm256_shuffle_ps(a_rows, a_rows, 0xAA), b2, rows);
+    return _mm256_fmadd_ps(_mm256_shuffle_ps(a_rows, a_rows, 0xFF), avx_last_row(), rows);
+}
+
+UTIL_AVX2 void amul_avx2(const Affine3f& a, const Affine3f& b, Affine3f& res)
+{
+    const __m256 b0 = avx_dup(sse_row(b, 0));
+    const __m256 b1 = avx_dup(sse_row(b, 1));
+    const __m256 b2 = avx_dup(sse_row(b, 2));
+
+    // rows 0 and 1 together, then row 2 in the low lane only.
+    _mm256_storeu_ps(res.mat[0], avx_combine_affine(_mm256_loadu_ps(a.mat[0]), b0, b1, b2));
+    const __m256 row2 = avx_combine_affine(avx_dup(sse_row(a, 2)), b0, b1, b2);
+    _mm_storeu_ps(res.mat[2], _mm256_castps256_ps128(row2));
+}
+
+UTIL_AVX2 void amul_batch_avx2(const Affine3f& lhs, const Affine3f* rhs, Affine3f* out,
+                               size_t count)
+{
+    // As mul_batch_avx2(), two right hand sides per iteration.
+    __m256 l[3][3];
+    // lhs[rr][3] * (0, 0, 0, 1), the same for every right hand side, starts
+    // each row.
+    __m256 l3[3];
+    for (int rr = 0; rr < 3; ++rr)
+    {
+        for (int kk = 0; kk < 3; ++kk)
+        {
+            l[rr][kk] = _mm256_set1_ps(lhs.mat[rr][kk]);
+        }
+        l3[rr] = _mm256_mul_ps(_mm256_set1_ps(lhs.mat[rr][3]), avx_last_row());
+    }
+
+    size_t ii = 0;
+    for (; ii + 2 <= count; ii += 2)
+    {
+        const Affine3f& m0 = rhs[ii];
+        const Affine3f& m1 = rhs[ii + 1];
+        const __m256 b0 = avx_pair(m0.mat[0], m1.mat[0]);
+        const __m256 b1 = avx_pair(m0.mat[1], m1.mat[1]);
+        const __m256 b2 = avx_pair(m0.mat[2], m1.mat[2]);
+
+        for (int rr = 0; rr < 3; ++rr)
+        {
+            __m256 row = _mm256_fmadd_ps(l[rr][0], b0, l3[rr]);
+            row = _mm256_fmadd_ps(l[rr][1], b1, row);
+            row = _mm256_fmadd_ps(l[rr][2], b2, row);
+            avx_store_pair(out[ii].mat[rr], out[ii + 1].mat[rr], row);
+        }
+    }
+
+    if (ii < count)
+    {
+        amul_avx2(lhs, rhs[ii], out[ii]);
+    }
+}
+
+UTIL_AVX2 void mamul_avx2(const Mat4x4f& a, const Affine3f& b, Mat4x4f& res)
+{
+    const __m256 b0 = avx_dup(sse_row(b, 0));
+    const __m256 b1 = avx_dup(sse_row(b, 1));
+    const __m256 b2 = avx_dup(sse_row(b, 2));
+
+    for (int ii = 0; ii < 4; ii += 2)
+    {
+        _mm256_storeu_ps(res.mat[ii],
+                         avx_combine_affine(_mm256_loadu_ps(a.mat[ii]), b0, b1, b2));
+    }
+}
+
+UTIL_AVX2 void mamul_batch_avx2(const Mat4x4f& lhs, const Affine3f* rhs, Mat4x4f* out,
+                                size_t count)
+{
+    __m256 l[4][3];
+    // lhs[rr][3] * (0, 0, 0, 1), the same for every right hand side, starts
+    // each row.
+    __m256 l3[4];
+    for (int rr = 0; rr < 4; ++rr)
+    {
+        for (int kk = 0; kk < 3; ++kk)
+        {
+            l[rr][kk] = _mm256_set1_ps(lhs.mat[rr][kk]);
+        }
+        l3[rr] = _mm256_mul_ps(_mm256_set1_ps(lhs.mat[rr][3]), avx_last_row());
+    }
+
+    size_t ii = 0;
+    for (; ii + 2 <= count; ii += 2)
+    {
+        const Affine3f& m0 = rhs[ii];
+        const Affine3f& m1 = rhs[ii + 1];
+        const __m256 b0 = avx_pair(m0.mat[0], m1.mat[0]);
+        const __m256 b1 = avx_pair(m0.mat[1], m1.mat[1]);
+        const __m256 b2 = avx_pair(m0.mat[2], m1.mat[2]);
+
+        for (int rr = 0; rr < 4; ++rr)
+        {
+            __m256 row = _mm256_fmadd_ps(l[rr][0], b0, l3[rr]);
+            row = _mm256_fmadd_ps(l[rr][1], b1, row);
+            row = _mm256_fmadd_ps(l[rr][2], b2, row);
+            avx_store_pair(out[ii].mat[rr], out[ii + 1].mat[rr], row);
+        }
+    }
+
+    if (ii < count)
+    {
+        mamul_avx2(lhs, rhs[ii], out[ii]);
+    }
+}
+
+// The quaternion kernels on 8 quaternions at a time. The 128 bit lanes are
+// transposed separately, so the low lane holds the even quaternions and the
+// high lane the odd ones.
+
+struct Avx2Quats
+{
+    __m256 x, y, z, w;
+};
+
+UTIL_AVX2 inline void avx_transpose(__m256& r0, __m256& r1, __m256& r2, __m256& r3)
+{
+    const __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    const __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+    const __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+    const __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    r0 = _mm256_shuffle_ps(t0, t1, 0x44);
+    r1 = _mm256_shuffle_ps(t0, t1, 0xEE);
+    r2 = _mm256_shuffle_ps(t2, t3, 0x44);
+    r3 = _mm256_shuffle_ps(t2, t3, 0xEE);
+}
+
+UTIL_AVX2 inline Avx2Quats avx_load_quats(const float* p, size_t stride)
+{
+    Avx2Quats q{ avx_pair(p, p + stride), avx_pair(p + 2 * stride, p + 3 * stride),
+                 avx_pair(p + 4 * stride, p + 5 * stride), avx_pair(p + 6 * stride, p + 7 * stride) };
+    avx_transpose(q.x, q.y, q.z, q.w);
+    return q;
+}
+
+UTIL_AVX2 inline void avx_store_quats(Avx2Quats q, float* p, size_t stride)
+{
+    avx_transpose(q.x, q.y, q.z, q.w);
+    avx_store_pair(p, p + stride, q.x);
+    avx_store_pair(p + 2 * stride, p + 3 * stride, q.y);
+    avx_store_pair(p + 4 * stride, p + 5 * stride, q.z);
+    avx_store_pair(p + 6 * stride, p + 7 * stride, q.w);
+}
+
+UTIL_AVX2 inline Avx2Quats avx_set1_quat(const Quatf& q)
+{
+    return { _mm256_set1_ps(q.x), _mm256_set1_ps(q.y), _mm256_set1_ps(q.z),
+             _mm256_set1_ps(q.w) };
+}
+
+UTIL_AVX2 inline Avx2Quats avx_quat_mul(const Avx2Quats& a, const Avx2Quats& b)
+{
+    Avx2Quats r;
+    r.x = _mm256_mul_ps(a.w, b.x);
+    r.x = _mm256_fmadd_ps(a.x, b.w, r.x);
+    r.x = _mm256_fmadd_ps(a.y, b.z, r.x);
+    r.x = _mm256_fnmadd_ps(a.z, b.y, r.x);
+    r.y = _mm256_mul_ps(a.w, b.y);
+    r.y = _mm256_fnmadd_ps(a.x, b.z, r.y);
+    r.y = _mm256_fmadd_ps(a.y, b.w, r.y);
+    r.y = _mm256_fmadd_ps(a.z, b.x, r.y);
+    r.z = _mm256_mul_ps(a.w, b.z);
+    r.z = _mm256_fmadd_ps(a.x, b.y, r.z);
+    r.z = _mm256_fnmadd_ps(a.y, b.x, r.z);
+    r.z = _mm256_fmadd_ps(a.z, b.w, r.z);
+    r.w = _mm256_mul_ps(a.w, b.w);
+    r.w = _mm256_fnmadd_ps(a.x, b.x, r.w);
+    r.w = _mm256_fnmadd_ps(a.y, b.y, r.w);
+    r.w = _mm256_fnmadd_ps(a.z, b.z, r.w);
+    return r;
+}
+
+UTIL_AVX2 inline __m256 avx_quat_dot(const Avx2Quats& a, const Avx2Quats& b)
+{
+    __m256 d = _mm256_mul_ps(a.x, b.x);
+    d = _mm256_fmadd_ps(a.y, b.y, d);
+    d = _mm256_fmadd_ps(a.z, b.z, d);
+    return _mm256_fmadd_ps(a.w, b.w, d);
+}
+
+// As sse_store_matrices(), for 8 matrices.
+UTIL_AVX2 inline void avx_store_matrices(const Avx2Quats& q, __m256 c3x, __m256 c3y, __m256 c3z,
+                                         Mat4x4f* out)
+{
+    const __m256 x2 = _mm256_add_ps(q.x, q.x);
+    const __m256 y2 = _mm256_add_ps(q.y, q.y);
+    const __m256 z2 = _mm256_add_ps(q.z, q.z);
+    const __m256 xx = _mm256_mul_ps(q.x, x2);
+    const __m256 yy = _mm256_mul_ps(q.y, y2);
+    const __m256 zz = _mm256_mul_ps(q.z, z2);
+    const __m256 xy = _mm256_mul_ps(q.x, y2);
+    const __m256 xz = _mm256_mul_ps(q.x, z2);
+    const __m256 yz = _mm256_mul_ps(q.y, z2);
+    const __m256 wx = _mm256_mul_ps(q.w, x2);
+    const __m256 wy = _mm256_mul_ps(q.w, y2);
+    const __m256 wz = _mm256_mul_ps(q.w, z2);
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    __m256 rows[3][4] = {
+        { _mm256_sub_ps(one, _mm256_add_ps(yy, zz)), _mm256_sub_ps(xy, wz),
+          _mm256_add_ps(xz, wy), c3x },
+        { _mm256_add_ps(xy, wz), _mm256_sub_ps(one, _mm256_add_ps(xx, zz)),
+          _mm256_sub_ps(yz, wx), c3y },
+        { _mm256_sub_ps(xz, wy), _mm256_add_ps(yz, wx),
+          _mm256_sub_ps(one, _mm256_add_ps(xx, yy)), c3z },
+    };
+    const __m128 last = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    for (int rr = 0; rr < 3; ++rr)
+    {
+        avx_transpose(rows[rr][0], rows[rr][1], rows[rr][2], rows[rr][3]);
+        for (int mm = 0; mm < 4; ++mm)
+        {
+            avx_store_pair(out[2 * mm].mat[rr], out[2 * mm + 1].mat[rr], rows[rr][mm]);
+        }
+    }
+    for (int mm = 0; mm < 8; ++mm)
+    {
+        _mm_storeu_ps(out[mm].mat[3], last);
+    }
+}
+
+UTIL_AVX2 void qmul_batch_avx2(const Quatf& lhs, const Quatf* rhs, Quatf* out, size_t count)
+{
+    const Avx2Quats a = avx_set1_quat(lhs);
+    size_t ii = 0;
+    for (; ii + 8 <= count; ii += 8)
+    {
+        const Avx2Quats b = avx_load_quats(&rhs[ii].x, quat_stride);
+        avx_store_quats(avx_quat_mul(a, b), &out[ii].x, quat_stride);
+    }
+    qmul_batch_sse(lhs, rhs + ii, out + ii, count - ii);
+}
+
+UTIL_AVX2 void dqmul_batch_avx2(const DualQuatf& lhs, const DualQuatf* rhs, DualQuatf* out,
+                                size_t count)
+{
+    const Avx2Quats a_real = avx_set1_quat(lhs.real);
+    const Avx2Quats a_dual = avx_set1_quat(lhs.dual);
+    size_t ii = 0;
+    for (; ii + 8 <= count; ii += 8)
+    {
+        const Avx2Quats b_real = avx_load_quats(&rhs[ii].real.x, dual_stride);
+        const Avx2Quats b_dual = avx_load_quats(&rhs[ii].dual.x, dual_stride);
+        const Avx2Quats p = avx_quat_mul(a_real, b_dual);
+        const Avx2Quats q = avx_quat_mul(a_dual, b_real);
+        const Avx2Quats dual{ _mm256_add_ps(p.x, q.x), _mm256_add_ps(p.y, q.y),
+                              _mm256_add_ps(p.z, q.z), _mm256_add_ps(p.w, q.w) };
+        avx_store_quats(avx_quat_mul(a_real, b_real), &out[ii].real.x, dual_stride);
+        avx_store_quats(dual, &out[ii].dual.x, dual_stride);
+    }
+    dqmul_batch_sse(lhs, rhs + ii, out + ii, count - ii);
+}
+
+UTIL_AVX2 void nlerp_batch_avx2(const Quatf* a, const Quatf* b, float t, Quatf* out, size_t count)
+{
+    const __m256 tt = _mm256_set1_ps(t);
+    const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+    size_t ii = 0;
+    for (; ii + 8 <= count; ii += 8)
+    {
+        const Avx2Quats qa = avx_load_quats(&a[ii].x, quat_stride);
+        const Avx2Quats qb = avx_load_quats(&b[ii].x, quat_stride);
+        const __m256 sign = _mm256_and_ps(
+            _mm256_cmp_ps(avx_quat_dot(qa, qb), _mm256_setzero_ps(), _CMP_LT_OQ), sign_bit);
+        const auto lerp = [&](__m256 ca, __m256 cb) UTIL_AVX2 {
+            return _mm256_fmadd_ps(tt, _mm256_sub_ps(_mm256_xor_ps(cb, sign), ca), ca);
+        };
+        Avx2Quats r{ lerp(qa.x, qb.x), lerp(qa.y, qb.y), lerp(qa.z, qb.z), lerp(qa.w, qb.w) };
+        const __m256 len = _mm256_sqrt_ps(avx_quat_dot(r, r));
+        r.x = _mm256_div_ps(r.x, len);
+        r.y = _mm256_div_ps(r.y, len);
+        r.z = _mm256_div_ps(r.z, len);
+        r.w = _mm256_div_ps(r.w, len);
+        avx_store_quats(r, &out[ii].x, quat_stride);
+    }
+    nlerp_batch_sse(a + ii, b + ii, t, out + ii, count - ii);
+}
+
+UTIL_AVX2 void qmatrix_batch_avx2(const Quatf* quats, Mat4x4f* out, size_t count)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    size_t ii = 0;
+    for (; ii + 8 <= count; ii += 8)
+    {
+        avx_store_matrices(avx_load_quats(&quats[ii].x, quat_stride), zero, zero, zero,
+                           out + ii);
+    }
+    qmatrix_batch_sse(quats + ii, out + ii, count - ii);
+}
+
+UTIL_AVX2 void dqmatrix_batch_avx2(const DualQuatf* quats, Mat4x4f* out, size_t count)
+{
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    size_t ii = 0;
+    for (; ii + 8 <= count; ii += 8)
+    {
+        const Avx2Quats real = avx_load_quats(&quats[ii].real.x, dual_stride);
+        const Avx2Quats dual = avx_load_quats(&quats[ii].dual.x, dual_stride);
+        const Avx2Quats conj{ _mm256_xor_ps(real.x, sign), _mm256_xor_ps(real.y, sign),
+                              _mm256_xor_ps(real.z, sign), real.w };
+        const Avx2Quats t = avx_quat_mul(dual, conj);
+        avx_store_matrices(real, _mm256_add_ps(t.x, t.x), _mm256_add_ps(t.y, t.y),
+                           _mm256_add_ps(t.z, t.z), out + ii);
+    }
+    dqmatrix_batch_sse(quats + ii, out + ii, count - ii);
+}
+
+#undef UTIL_AVX2
+
+constexpr Kernels avx2_kernels{ mul_avx2,         mul_batch_avx2,     xform3_avx2,
+                                xform4_avx2,      amul_avx2,          amul_batch_avx2,
+                                mamul_avx2,       mamul_batch_avx2,   qmul_batch_avx2,
+                                dqmul_batch_avx2, nlerp_batch_avx2,   qmatrix_batch_avx2,
+                                dqmatrix_batch_avx2 };
+
+#endif // UTIL_SIMD_X86
+
+const Kernels& kernels_for(simd::Isa isa)
+{
+    switch (isa)
+    {
+#ifdef UTIL_SIMD_X86
+        case simd::Isa::avx2:
+            return avx2_kernels;
+        case simd::Isa::sse:
+            return sse_kernels;
+#endif
+        default:
+            return scalar_kernels;
+    }
+}
+
+// Constant initialized to the scalar kernels so that matrix products computed
+// during static initialization of other translation units are safe.
+simd::Isa active_isa = simd::Isa::scalar;
+const Kernels* active_kernels = &scalar_kernels;
+
+[[maybe_unused]] const bool kernels_selected = (simd::set_active(simd::detect()), true);
+
+} // end of anonymous namespace
+
+namespace simd
+{
+
+Isa detect()
+{
+#ifdef UTIL_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return Isa::avx2;
+    }
+    return Isa::sse;
+#else
+    return Isa::scalar;
+#endif
+}
+
+Isa active() { return active_isa; }
+
+void set_active(Isa isa)
+{
+    const Isa best = detect();
+    if (static_cast<int>(isa) > static_cast<int>(best))
+    {
+        isa = best;
+    }
+    active_isa = isa;
+    active_kernels = &kernels_for(isa);
+}
+
+const char* name(Isa isa)
+{
+    switch (isa)
+    {
+        case Isa::scalar:
+            return "scalar";
+        case Isa::sse:
+            return "sse";
+        case Isa::avx2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+}
+
+void Mat4x4f::multiply(const Mat4x4f& a, const Mat4x4f& b, Mat4x4f& res)
+{
+    active_kernels->mul(a, b, res);
+}
+
+void multiply_batch(const Mat4x4f& lhs, const Mat4x4f* rhs, Mat4x4f* out, size_t count)
+{
+    active_kernels->mul_batch(lhs, rhs, out, count);
+}
+
+void transform_points(const Mat4x4f& mat, const Vec3f* points, Vec4f* out, size_t count)
+{
+    active_kernels->xform3(mat, points, out, count);
+}
+
+void transform_points(const Mat4x4f& mat, const Vec4f* points, Vec4f* out, size_t count)
+{
+    active_kernels->xform4(mat, points, out, count);
+}
+
+Affine3f Affine3f::operator*(const Affine3f& other) const
+{
+    Affine3f res;
+    active_kernels->amul(*this, other, res);
+    return res;
+}
+
+Mat4x4f operator*(const Mat4x4f& lhs, const Affine3f& rhs)
+{
+    Mat4x4f res;
+    active_kernels->mamul(lhs, rhs, res);
+    return res;
+}
+
+void multiply_batch(const Affine3f& lhs, const Affine3f* rhs, Affine3f* out, size_t count)
+{
+    active_kernels->amul_batch(lhs, rhs, out, count);
+}
+
+void multiply_batch(const Mat4x4f& lhs, const Affine3f* rhs, Mat4x4f* out, size_t count)
+{
+    active_kernels->mamul_batch(lhs, rhs, out, count);
+}
+
+void multiply_batch(const Quatf& lhs, const Quatf* rhs, Quatf* out, size_t count)
+{
+    active_kernels->qmul_batch(lhs, rhs, out, count);
+}
+
+void multiply_batch(const DualQuatf& lhs, const DualQuatf* rhs, DualQuatf* out, size_t count)
+{
+    active_kernels->dqmul_batch(lhs, rhs, out, count);
+}
+
+void nlerp_batch(const Quatf* a, const Quatf* b, float t, Quatf* out, size_t count)
+{
+    active_kernels->nlerp_batch(a, b, t, out, count);
+}
+
+void to_matrix_batch(const Quatf* quats, Mat4x4f* out, size_t count)
+{
+    active_kernels->qmatrix_batch(quats, out, count);
+}
+
+void to_matrix_batch(const DualQuatf* quats, Mat4x4f* out, size_t count)
+{
+    active_kernels->dqmatrix_batch(quats, out, count);
+}
+
+}
@@ -0,0 +1,1086 @@
+#include <util/simd.hpp>
+#include <util/soft_raster.hpp>
+#include <util/thread_pool.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if !defined(UTIL_SIMD_DISABLED) && (defined(__x86_64__) || defined(__i386__))
+#define UTIL_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace util
+{
+
+namespace
+{
+
+constexpr int subpixel_bits = 4;
+constexpr int subpixel = 1 << subpixel_bits;
+constexpr int tile_size = SoftRasterizer::tile_size;
+constexpr int tile_pixels = tile_size * tile_size;
+
+// Vertex attributes interpolated across a triangle: r, g, b, u, v.
+constexpr int num_varyings = 5;
+// Interpolated planes of a triangle: depth, 1 / w, then varying / w.
+constexpr int plane_z = 0;
+constexpr int plane_inv_w = 1;
+constexpr int plane_varyings = 2;
+constexpr int num_planes = plane_varyings + num_varyings;
+
+// Bounds of the edge function thresholds of a tile, beyond what the tile
+// local part of an edge function reaches: at most 2^17 * 16 * 64 per axis
+// for 4 bit sub-pixel coordinates up to max_size.
+constexpr int64_t max_threshold = int64_t{ 1 } << 30;
+
+int64_t floor_div(int64_t value, int64_t divisor)
+{
+    return (value >= 0) ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+int64_t ceil_div(int64_t value, int64_t divisor) { return -floor_div(-value, divisor); }
+
+uint32_t pack_rgba(float r, float g, float b, float a)
+{
+    const auto to_byte = [](float value) {
+        return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    };
+    const uint8_t rgba[4] = { to_byte(r), to_byte(g), to_byte(b), to_byte(a) };
+    uint32_t packed;
+    std::memcpy(&packed, rgba, sizeof(packed));
+    return packed;
+}
+
+// std::floor is a library call on the x86-64 baseline.
+int floor_to_int(float value)
+{
+    const int truncated = static_cast<int>(value);
+    return truncated - (value < static_cast<float>(truncated));
+}
+
+// Texture coordinates beyond this are clamped, which keeps the conversions to
+// int defined; farther than that, repeating textures have lost their
+// fractional part anyway.
+constexpr float max_tex_coord = 1 << 20;
+
+// Texel coordinate along one axis of size texels for GL_NEAREST, and the two
+// neighbours and the weight of the second for GL_LINEAR. Repeating textures
+// wrap the coordinate to [0, 1] first, so that texel indices only need to
+// wrap around by one. The AVX2 kernel follows the same steps.
+int nearest_texel(float coordinate, int size, bool repeat)
+{
+    if (repeat)
+    {
+        coordinate = std::clamp(coordinate, -max_tex_coord, max_tex_coord);
+        coordinate -= static_cast<float>(floor_to_int(coordinate));
+        const int texel = floor_to_int(coordinate * static_cast<float>(size));
+        return texel >= size ? 0 : texel;
+    }
+    coordinate = std::clamp(coordinate, -1.0f, 2.0f);
+    return std::clamp(floor_to_int(coordinate * static_cast<float>(size)), 0, size - 1);
+}
+
+void linear_texels(float coordinate, int size, bool repeat, int& texel0, int& texel1,
+                   float& weight)
+{
+    if (repeat)
+    {
+        coordinate = std::clamp(coordinate, -max_tex_coord, max_tex_coord);
+        coordinate -= static_cast<float>(floor_to_int(coordinate));
+    }
+    else
+    {
+        coordinate = std::clamp(coordinate, -1.0f, 2.0f);
+    }
+    coordinate = coordinate * static_cast<float>(size) - 0.5f;
+    const int texel = floor_to_int(coordinate);
+    weight = coordinate - static_cast<float>(texel);
+    if (repeat)
+    {
+        texel0 = texel < 0 ? size - 1 : texel;
+        texel1 = texel + 1 >= size ? 0 : texel + 1;
+    }
+    else
+    {
+        texel0 = std::clamp(texel, 0, size - 1);
+        texel1 = std::clamp(texel + 1, 0, size - 1);
+    }
+}
+
+// texture(t, uv) into rgba.
+void sample(const SoftTexture& texture, float u, float v, float (&rgba)[4])
+{
+    constexpr float to_unit = 1.0f / 255.0f;
+    const int width = texture.width;
+    const uint8_t* texels = texture.texels.data();
+    if (!texture.linear)
+    {
+        const int x = nearest_texel(u, width, texture.repeat);
+        const int y = nearest_texel(v, texture.height, texture.repeat);
+        const uint8_t* t = texels + (static_cast<size_t>(y) * width + x) * 4;
+        for (int cc = 0; cc < 4; ++cc)
+            rgba[cc] = t[cc] * to_unit;
+        return;
+    }
+
+    int x0, x1, y0, y1;
+    float fx, fy;
+    linear_texels(u, width, texture.repeat, x0, x1, fx);
+    linear_texels(v, texture.height, texture.repeat, y0, y1, fy);
+    const uint8_t* t00 = texels + (static_cast<size_t>(y0) * width + x0) * 4;
+    const uint8_t* t10 = texels + (static_cast<size_t>(y0) * width + x1) * 4;
+    const uint8_t* t01 = texels + (static_cast<size_t>(y1) * width + x0) * 4;
+    const uint8_t* t11 = texels + (static_cast<size_t>(y1) * width + x1) * 4;
+    for (int cc = 0; cc < 4; ++cc)
+    {
+        const float bottom = t00[cc] + fx * (t10[cc] - t00[cc]);
+        const float top = t01[cc] + fx * (t11[cc] - t01[cc]);
+        rgba[cc] = (bottom + fy * (top - bottom)) * to_unit;
+    }
+}
+
+// The edge functions of a triangle within one tile, relative to its first
+// pixel: pixel (x, y) of the tile is inside edge kk when
+// step_x[kk] * x + step_y[kk] * y >= threshold[kk], which fits in 32 bits.
+struct TileEdges
+{
+    int32_t step_x[3];
+    int32_t step_y[3];
+    int32_t threshold[3];
+    // step_x * lane for the lanes of a block of 8 pixels.
+    alignas(32) int32_t lanes[3][8];
+};
+
+template <typename Fn> void run_on_workers(ThreadPool* pool, size_t count, Fn fn)
+{
+    if (count == 1)
+    {
+        fn(0);
+        return;
+    }
+    TaskGroup group(*pool);
+    for (size_t ii = 1; ii < count; ++ii)
+        group.submit([&fn, ii] { fn(ii); });
+    fn(0);
+    group.wait();
+}
+
+// Interpolated planes of a triangle, see SoftRasterizer::Triangle.
+using Planes = float[num_planes][3];
+
+// Block kernels. cover returns the mask of the pixels (x, y) to (x + 7, y)
+// of a tile that are inside the triangle. depth runs the depth test on the
+// pixels of mask, the depth of pixel x + lane being z + dzdx * lane, updates
+// the depth buffer at depth and returns the mask of those that passed. shade
+// writes the colors of the pixels of mask to out, (dx, dy) being the first
+// pixel relative to the origin of the planes.
+
+unsigned cover_scalar(const TileEdges& edges, int x, int y)
+{
+    unsigned mask = 0xff;
+    for (int kk = 0; kk < 3; ++kk)
+    {
+        const int32_t base = edges.step_x[kk] * x + edges.step_y[kk] * y;
+        unsigned inside = 0;
+        for (int lane = 0; lane < 8; ++lane)
+        {
+            if (base + edges.lanes[kk][lane] >= edges.threshold[kk])
+                inside |= 1u << lane;
+        }
+        mask &= inside;
+    }
+    return mask;
+}
+
+unsigned depth_scalar(unsigned mask, float z, float dzdx, float* depth)
+{
+    unsigned passed = 0;
+    for (int lane = 0; lane < 8; ++lane)
+    {
+        const float fragment = z + dzdx * static_cast<float>(lane);
+        if ((mask & (1u << lane)) && fragment < depth[lane])
+        {
+            depth[lane] = fragment;
+            passed |= 1u << lane;
+        }
+    }
+    return passed;
+}
+
+void shade_scalar(const Planes& planes, const SoftTexture* texture, unsigned mask, float dx,
+                  float dy, uint32_t* out)
+{
+    const auto plane = [&planes, dy](int pp, float x) {
+        return planes[pp][0] + planes[pp][1] * x + planes[pp][2] * dy;
+    };
+    for (; mask; mask &= mask - 1)
+    {
+        const int lane = __builtin_ctz(mask);
+        const float x = dx + static_cast<float>(lane);
+        const float w = 1.0f / plane(plane_inv_w, x);
+        float rgba[4] = { plane(plane_varyings + 0, x) * w, plane(plane_varyings + 1, x) * w,
+                          plane(plane_varyings + 2, x) * w, 1.0f };
+        if (texture)
+        {
+            float texel[4];
+            sample(*texture, plane(plane_varyings + 3, x) * w, plane(plane_varyings + 4, x) * w,
+                   texel);
+            for (int cc = 0; cc < 4; ++cc)
+                rgba[cc] *= texel[cc];
+        }
+        out[lane] = pack_rgba(rgba[0], rgba[1], rgba[2], rgba[3]);
+    }
+}
+
+#ifdef UTIL_SIMD_X86
+
+// SSE kernels, the block as two halves of 4 pixels.
+
+unsigned cover_sse(const TileEdges& edges, int x, int y)
+{
+    __m128i inside_lo = _mm_set1_epi32(-1);
+    __m128i inside_hi = inside_lo;
+    for (int kk = 0; kk < 3; ++kk)
+    {
+        const __m128i base = _mm_set1_epi32(edges.step_x[kk] * x + edges.step_y[kk] * y);
+        const __m128i threshold = _mm_set1_epi32(edges.threshold[kk] - 1);
+        const __m128i lo = _mm_add_epi32(
+            base, _mm_load_si128(reinterpret_cast<const __m128i*>(&edges.lanes[kk][0])));
+        const __m128i hi = _mm_add_epi32(
+            base, _mm_load_si128(reinterpret_cast<const __m128i*>(&edges.lanes[kk][4])));
+        inside_lo = _mm_and_si128(inside_lo, _mm_cmpgt_epi32(lo, threshold));
+        inside_hi = _mm_and_si128(inside_hi, _mm_cmpgt_epi32(hi, threshold));
+    }
+    return static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(inside_lo))
+                                 | (_mm_movemask_ps(_mm_castsi128_ps(inside_hi)) << 4));
+}
+
+unsigned depth_sse(unsigned mask, float z, float dzdx, float* depth)
+{
+    unsigned passed = 0;
+    for (int half = 0; half < 2; ++half)
+    {
+        const unsigned bits = (mask >> (4 * half)) & 0xf;
+        if (!bits)
+            continue;
+        // z + dzdx * lane, rounded like the other kernels.
+        const __m128 lanes = _mm_add_ps(_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f),
+                                        _mm_set1_ps(static_cast<float>(4 * half)));
+        const __m128 fragment =
+            _mm_add_ps(_mm_set1_ps(z), _mm_mul_ps(_mm_set1_ps(dzdx), lanes));
+        const __m128i select = _mm_setr_epi32(1, 2, 4, 8);
+        const __m128 in_mask = _mm_castsi128_ps(_mm_cmpeq_epi32(
+            _mm_and_si128(_mm_set1_epi32(static_cast<int>(bits)), select), select));
+        float* out = depth + 4 * half;
+        const __m128 current = _mm_loadu_ps(out);
+        const __m128 pass = _mm_and_ps(in_mask, _mm_cmplt_ps(fragment, current));
+        _mm_storeu_ps(out, _mm_or_ps(_mm_and_ps(pass, fragment), _mm_andnot_ps(pass, current)));
+        passed |= static_cast<unsigned>(_mm_movemask_ps(pass)) << (4 * half);
+    }
+    return passed;
+}
+
+// AVX2 kernels, the block in one register. Without FMA, which would fuse
+// their products and sums and round differently from the other kernels.
+
+#define UTIL_AVX2 __attribute__((target("avx2")))
+
+UTIL_AVX2 unsigned cover_avx2(const TileEdges& edges, int x, int y)
+{
+    __m256i inside = _mm256_set1_epi32(-1);
+    for (int kk = 0; kk < 3; ++kk)
+    {
+        const __m256i base = _mm256_set1_epi32(edges.step_x[kk] * x + edges.step_y[kk] * y);
+        const __m256i values = _mm256_add_epi32(
+            base, _mm256_load_si256(reinterpret_cast<const __m256i*>(edges.lanes[kk])));
+        inside = _mm256_and_si256(
+            inside, _mm256_cmpgt_epi32(values, _mm256_set1_epi32(edges.threshold[kk] - 1)));
+    }
+    return static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(inside)));
+}
+
+UTIL_AVX2 unsigned depth_avx2(unsigned mask, float z, float dzdx, float* depth)
+{
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 fragment
+        = _mm256_add_ps(_mm256_set1_ps(z), _mm256_mul_ps(_mm256_set1_ps(dzdx), lanes));
+    const __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256 in_mask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+        _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(mask)), select), select));
+    const __m256 current = _mm256_loadu_ps(depth);
+    const __m256 pass = _mm256_and_ps(in_mask, _mm256_cmp_ps(fragment, current, _CMP_LT_OQ));
+    _mm256_storeu_ps(depth, _mm256_blendv_ps(current, fragment, pass));
+    return static_cast<unsigned>(_mm256_movemask_ps(pass));
+}
+
+// The texels along one axis for 8 coordinates, as in linear_texels().
+UTIL_AVX2 void linear_texels_avx2(__m256 coordinate, int size, bool repeat, __m256i& texel0,
+                                  __m256i& texel1, __m256& weight)
+{
+    const __m256i last = _mm256_set1_epi32(size - 1);
+    if (repeat)
+    {
+        coordinate = _mm256_min_ps(_mm256_max_ps(coordinate, _mm256_set1_ps(-max_tex_coord)),
+                                   _mm256_set1_ps(max_tex_coord));
+        coordinate = _mm256_sub_ps(coordinate, _mm256_floor_ps(coordinate));
+    }
+    else
+    {
+        coordinate = _mm256_min_ps(_mm256_max_ps(coordinate, _mm256_set1_ps(-1.0f)),
+                                   _mm256_set1_ps(2.0f));
+    }
+    coordinate = _mm256_sub_ps(_mm256_mul_ps(coordinate, _mm256_set1_ps(static_cast<float>(size))),
+                               _mm256_set1_ps(0.5f));
+    const __m256 floor = _mm256_floor_ps(coordinate);
+    weight = _mm256_sub_ps(coordinate, floor);
+    const __m256i texel = _mm256_cvttps_epi32(floor);
+    const __m256i next = _mm256_add_epi32(texel, _mm256_set1_epi32(1));
+    if (repeat)
+    {
+        // texel is -1 to size - 1.
+        texel0 = _mm256_blendv_epi8(texel, last, _mm256_cmpgt_epi32(_mm256_setzero_si256(), texel));
+        texel1 = _mm256_andnot_si256(_mm256_cmpgt_epi32(next, last), next);
+    }
+    else
+    {
+        texel0 = _mm256_max_epi32(_mm256_min_epi32(texel, last), _mm256_setzero_si256());
+        texel1 = _mm256_max_epi32(_mm256_min_epi32(next, last), _mm256_setzero_si256());
+    }
+}
+
+UTIL_AVX2 __m256 channel_avx2(__m256i texels, int channel)
+{
+    return _mm256_cvtepi32_ps(
+        _mm256_and_si256(_mm256_srli_epi32(texels, 8 * channel), _mm256_set1_epi32(0xff)));
+}
+
+// GL_LINEAR textures, 4 gathers of 8 texels; GL_NEAREST ones go through
+// sample().
+UTIL_AVX2 void sample_avx2(const SoftTexture& texture, __m256 u, __m256 v, __m256 (&rgba)[4])
+{
+    __m256i x0, x1, y0, y1;
+    __m256 fx, fy;
+    linear_texels_avx2(u, texture.width, texture.repeat, x0, x1, fx);
+    linear_texels_avx2(v, texture.height, texture.repeat, y0, y1, fy);
+    const __m256i width = _mm256_set1_epi32(texture.width);
+    const __m256i row0 = _mm256_mullo_epi32(y0, width);
+    const __m256i row1 = _mm256_mullo_epi32(y1, width);
+    const int* texels = reinterpret_cast<const int*>(texture.texels.data());
+    const __m256i t00 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x0), 4);
+    const __m256i t10 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row0, x1), 4);
+    const __m256i t01 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x0), 4);
+    const __m256i t11 = _mm256_i32gather_epi32(texels, _mm256_add_epi32(row1, x1), 4);
+    const __m256 to_unit = _mm256_set1_ps(1.0f / 255.0f);
+    for (int cc = 0; cc < 4; ++cc)
+    {
+        const __m256 c00 = channel_avx2(t00, cc);
+        const __m256 c01 = channel_avx2(t01, cc);
+        const __m256 bottom = _mm256_add_ps(c00, _mm256_mul_ps(fx, _mm256_sub_ps(channel_avx2(t10, cc), c00)));
+        const __m256 top = _mm256_add_ps(c01, _mm256_mul_ps(fx, _mm256_sub_ps(channel_avx2(t11, cc), c01)));
+        rgba[cc] = _mm256_mul_ps(_mm256_add_ps(bottom, _mm256_mul_ps(fy, _mm256_sub_ps(top, bottom))),
+                                 to_unit);
+    }
+}
+
+UTIL_AVX2 void shade_avx2(const Planes& planes, const SoftTexture* texture, unsigned mask,
+                          float dx, float dy, uint32_t* out)
+{
+    if (texture && !texture->linear)
+    {
+        shade_scalar(planes, texture, mask, dx, dy, out);
+        return;
+    }
+
+    const __m256 x = _mm256_add_ps(_mm256_set1_ps(dx),
+                                   _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f));
+    const auto plane = [&planes, &x, dy](int pp) UTIL_AVX2 {
+        return _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(planes[pp][0]),
+                                           _mm256_mul_ps(_mm256_set1_ps(planes[pp][1]), x)),
+                             _mm256_set1_ps(planes[pp][2] * dy));
+    };
+    const __m256 w = _mm256_div_ps(_mm256_set1_ps(1.0f), plane(plane_inv_w));
+    __m256 rgba[4] = { _mm256_mul_ps(plane(plane_varyings + 0), w),
+                       _mm256_mul_ps(plane(plane_varyings + 1), w),
+                       _mm256_mul_ps(plane(plane_varyings + 2), w), _mm256_set1_ps(1.0f) };
+    if (texture)
+    {
+        __m256 texel[4];
+        sample_avx2(*texture, _mm256_mul_ps(plane(plane_varyings + 3), w),
+                    _mm256_mul_ps(plane(plane_varyings + 4), w), texel);
+        for (int cc = 0; cc < 4; ++cc)
+            rgba[cc] = _mm256_mul_ps(rgba[cc], texel[cc]);
+    }
+
+    // As pack_rgba(): bytes r, g, b, a.
+    __m256i packed = _mm256_setzero_si256();
+    for (int cc = 0; cc < 4; ++cc)
+    {
+        const __m256 unit = _mm256_min_ps(_mm256_max_ps(rgba[cc], _mm256_setzero_ps()),
+                                          _mm256_set1_ps(1.0f));
+        const __m256i byte = _mm256_cvttps_epi32(
+            _mm256_add_ps(_mm256_mul_ps(unit, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+        packed = _mm256_or_si256(packed, _mm256_slli_epi32(byte, 8 * cc));
+    }
+    const __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i lanes = _mm256_cmpeq_epi32(
+        _mm256_and_si256(_mm256_set1_epi32(static_cast<int>(mask)), select), select);
+    _mm256_maskstore_epi32(reinterpret_cast<int*>(out), lanes, packed);
+}
+
+#undef UTIL_AVX2
+
+#endif // UTIL_SIMD_X86
+
+} // end of anonymous namespace
+
+struct SoftRasterizer::Kernels
+{
+    unsigned (*cover)(const TileEdges& edges, int x, int y);
+    unsigned (*depth)(unsigned mask, float z, float dzdx, float* depth);
+    void (*shade)(const Planes& planes, const SoftTexture* texture, unsigned mask, float dx,
+                  float dy, uint32_t* out);
+
+    // SSE shades one pixel at a time: without gathers, blends and masked
+    // stores there is little to gain from 4 lanes.
+    static const Kernels& of(simd::Isa isa)
+    {
+        static const Kernels scalar{ cover_scalar, depth_scalar, shade_scalar };
+#ifdef UTIL_SIMD_X86
+        static const Kernels sse{ cover_sse, depth_sse, shade_scalar };
+        static const Kernels avx2{ cover_avx2, depth_avx2, shade_avx2 };
+        switch (isa)
+        {
+            case simd::Isa::avx2:
+                return avx2;
+            case simd::Isa::sse:
+                return sse;
+            default:
+                break;
+        }
+#endif
+        (void)isa;
+        return scalar;
+    }
+};
+
+struct SoftRasterizer::ClipVertex
+{
+    float pos[4];
+    float varyings[num_varyings];
+
+    // Signed distance to the plane side of the clip volume, -w <= x, y, z <= w.
+    float distance(int side) const
+    {
+        const float coordinate = pos[side / 2];
+        return (side % 2 == 0) ? pos[3] + coordinate : pos[3] - coordinate;
+    }
+
+    unsigned outcode() const
+    {
+        unsigned code = 0;
+        for (int side = 0; side < 6; ++side)
+        {
+            if (distance(side) < 0.0f)
+                code |= 1u << side;
+        }
+        return code;
+    }
+
+    // Sutherland-Hodgman: clips the polygon in against the planes in code,
+    // using out as scratch. Returns the number of vertices left in in.
+    static int clip(ClipVertex* in, int count, unsigned code, ClipVertex* out)
+    {
+        for (int side = 0; side < 6 && count >= 3; ++side)
+        {
+            if (!(code & (1u << side)))
+                continue;
+            int kept = 0;
+            for (int ii = 0; ii < count; ++ii)
+            {
+                const ClipVertex& v0 = in[ii];
+                const ClipVertex& v1 = in[(ii + 1) % count];
+                const float d0 = v0.distance(side);
+                const float d1 = v1.distance(side);
+                if (d0 >= 0.0f)
+                    out[kept++] = v0;
+                if ((d0 >= 0.0f) != (d1 >= 0.0f))
+                {
+                    const float t = d0 / (d0 - d1);
+                    ClipVertex& v = out[kept++];
+                    for (int cc = 0; cc < 4; ++cc)
+                        v.pos[cc] = v0.pos[cc] + t * (v1.pos[cc] - v0.pos[cc]);
+                    for (int cc = 0; cc < num_varyings; ++cc)
+                        v.varyings[cc] = v0.varyings[cc] + t * (v1.varyings[cc] - v0.varyings[cc]);
+                }
+            }
+            std::copy(out, out + kept, in);
+            count = kept;
+        }
+        return count;
+    }
+};
+
+struct SoftRasterizer::Draw
+{
+    DrawState state;
+    VertexLayout layout;
+    const uint8_t* vertices;
+    size_t vertex_count;
+    // Null for glDrawArrays.
+    const void* indices;
+    int index_size;
+    size_t triangle_count;
+    // Of the draw's first vertex in clip_positions, and of its first
+    // triangle among those of all draws.
+    size_t first_vertex;
+    size_t first_triangle;
+};
+
+struct SoftRasterizer::Triangle
+{
+    // Edge functions a * x + b * y + c of the sub-pixel coordinates, counter
+    // clockwise, >= 0 inside. c includes the fill rule.
+    int32_t a[3];
+    int32_t b[3];
+    int64_t c[3];
+    // Pixels whose centers may be inside.
+    int min_x, min_y, max_x, max_y;
+    // Plane pp is planes[pp][0] + planes[pp][1] * (x - x0) + planes[pp][2] * (y - y0).
+    float x0, y0;
+    Planes planes;
+    uint32_t draw;
+};
+
+struct SoftRasterizer::Worker
+{
+    std::vector<Triangle> triangles;
+    // Indices in triangles of the triangles overlapping each tile.
+    std::vector<std::vector<uint32_t>> bins;
+    Stats stats;
+};
+
+SoftRasterizer::SoftRasterizer(int width, int height, ThreadPool* pool_)
+    : error{ false }
+    , fb_width{ width }
+    , fb_height{ height }
+    , pool{ pool_ }
+{
+    if (width < 1 || height < 1 || width > max_size || height > max_size)
+    {
+        std::cerr << "[ERROR] SoftRasterizer: unsupported size " << width << "x" << height
+                  << ", at most " << max_size << "x" << max_size << '\n';
+        error = true;
+        return;
+    }
+
+    tiles_x = (width + tile_size - 1) / tile_size;
+    tiles_y = (height + tile_size - 1) / tile_size;
+    const size_t num_tiles = static_cast<size_t>(tiles_x) * tiles_y;
+    tile_color.assign(num_tiles * tile_pixels, 0);
+    tile_depth.assign(num_tiles * tile_pixels, 1.0f);
+    image.assign(static_cast<size_t>(width) * height * 4, 0);
+
+    workers.resize(pool ? pool->size() + 1 : 1);
+    for (Worker& worker: workers)
+        worker.bins.resize(num_tiles);
+    tile_queues = std::vector<TileQueue>(workers.size());
+}
+
+SoftRasterizer::~SoftRasterizer() = default;
+
+void SoftRasterizer::clear(float r, float g, float b, float a, float depth)
+{
+    clear_pending = true;
+    clear_color = pack_rgba(r, g, b, a);
+    clear_depth = depth;
+}
+
+void SoftRasterizer::draw(const DrawState& state, const VertexLayout& layout, const void* vertices,
+                          size_t vertex_count, std::span<const uint16_t> indices)
+{
+    add_draw(state, layout, vertices, vertex_count, indices.data(), indices.size(),
+             sizeof(uint16_t));
+}
+
+void SoftRasterizer::draw(const DrawState& state, const VertexLayout& layout, const void* vertices,
+                          size_t vertex_count, std::span<const uint32_t> indices)
+{
+    add_draw(state, layout, vertices, vertex_count, indices.data(), indices.size(),
+             sizeof(uint32_t));
+}
+
+void SoftRasterizer::draw(const DrawState& state, const VertexLayout& layout, const void* vertices,
+                          size_t vertex_count)
+{
+    add_draw(state, layout, vertices, vertex_count, nullptr, vertex_count, 0);
+}
+
+void SoftRasterizer::add_draw(const DrawState& state, const VertexLayout& layout,
+                              const void* vertices, size_t vertex_count, const void* indices,
+                              size_t index_count, int index_size)
+{
+    if (error || layout.position < 0 || index_count < 3)
+        return;
+
+    Draw draw{ state,
+               layout,
+               static_cast<const uint8_t*>(vertices),
+               vertex_count,
+               indices,
+               index_size,
+               index_count / 3,
+               total_vertices,
+               total_triangles };
+    if (draw.state.texture && (draw.state.texture->width < 1 || draw.state.texture->height < 1))
+        draw.state.texture = nullptr;
+    draws.push_back(draw);
+    total_vertices += vertex_count;
+    total_triangles += draw.triangle_count;
+}
+
+void SoftRasterizer::finish()
+{
+    if (error)
+        return;
+
+    clip_positions.resize(total_vertices);
+    run_on_workers(pool, workers.size(), [this](size_t worker) { transform_vertices(worker); });
+    run_on_workers(pool, workers.size(), [this](size_t worker) { setup_triangles(worker); });
+
+    // Every thread starts on an even share of the tiles, in rows.
+    const uint64_t num_tiles = static_cast<uint64_t>(tiles_x) * tiles_y;
+    for (size_t ii = 0; ii < workers.size(); ++ii)
+    {
+        const uint64_t begin = num_tiles * ii / workers.size();
+        const uint64_t end = num_tiles * (ii + 1) / workers.size();
+        tile_queues[ii].range.store((begin << 32) | end, std::memory_order_relaxed);
+    }
+    const Kernels& kernels = Kernels::of(simd::active());
+    run_on_workers(pool, workers.size(),
+                   [this, &kernels](size_t worker) { rasterize_tiles(worker, kernels); });
+
+    raster_stats = Stats{};
+    for (Worker& worker: workers)
+    {
+        raster_stats.triangles += worker.stats.triangles;
+        raster_stats.culled += worker.stats.culled;
+        raster_stats.clipped += worker.stats.clipped;
+        raster_stats.rasterized += worker.stats.rasterized;
+        raster_stats.fragments += worker.stats.fragments;
+        raster_stats.tiles_stolen += worker.stats.tiles_stolen;
+    }
+
+    clear_pending = false;
+    draws.clear();
+    total_vertices = 0;
+    total_triangles = 0;
+}
+
+void SoftRasterizer::transform_vertices(size_t worker)
+{
+    const size_t begin = total_vertices * worker / workers.size();
+    const size_t end = total_vertices * (worker + 1) / workers.size();
+
+    // Gathered from the vertices for util::transform_points.
+    constexpr size_t chunk = 256;
+    Vec3f positions[chunk];
+    for (const Draw& draw: draws)
+    {
+        const size_t first = std::max(begin, draw.first_vertex);
+        const size_t last = std::min(end, draw.first_vertex + draw.vertex_count);
+        for (size_t ii = first; ii < last; ii += chunk)
+        {
+            const size_t count = std::min(chunk, last - ii);
+            for (size_t jj = 0; jj < count; ++jj)
+            {
+                const uint8_t* vertex
+                    = draw.vertices + (ii + jj - draw.first_vertex) * draw.layout.stride;
+                std::memcpy(&positions[jj].x, vertex + draw.layout.position, sizeof(float));
+                std::memcpy(&positions[jj].y, vertex + draw.layout.position + sizeof(float),
+                            sizeof(float));
+                std::memcpy(&positions[jj].z, vertex + draw.layout.position + 2 * sizeof(float),
+                            sizeof(float));
+            }
+            transform_points(draw.state.transform, positions, &clip_positions[ii], count);
+        }
+    }
+}
+
+void SoftRasterizer::setup_triangles(size_t index)
+{
+    Worker& worker = workers[index];
+    worker.stats = Stats{};
+    worker.triangles.clear();
+    for (std::vector<uint32_t>& bin: worker.bins)
+        bin.clear();
+
+    const size_t begin = total_triangles * index / workers.size();
+    const size_t end = total_triangles * (index + 1) / workers.size();
+    // The draw of the first triangle.
+    size_t draw = std::upper_bound(draws.begin(), draws.end(), begin,
+                                   [](size_t triangle, const Draw& draw) {
+                                       return triangle < draw.first_triangle;
+                                   })
+                - draws.begin();
+    draw = draw > 0 ? draw - 1 : 0;
+
+    for (size_t triangle = begin; triangle < end; ++triangle)
+    {
+        while (triangle >= draws[draw].first_triangle + draws[draw].triangle_count)
+            ++draw;
+        const Draw& current = draws[draw];
+        const size_t first = 3 * (triangle - current.first_triangle);
+        uint32_t vertices[3];
+        for (int kk = 0; kk < 3; ++kk)
+        {
+            if (current.index_size == sizeof(uint16_t))
+                vertices[kk] = static_cast<const uint16_t*>(current.indices)[first + kk];
+            else if (current.index_size == sizeof(uint32_t))
+                vertices[kk] = static_cast<const uint32_t*>(current.indices)[first + kk];
+            else
+                vertices[kk] = static_cast<uint32_t>(first + kk);
+        }
+        setup_triangle(worker, static_cast<uint32_t>(draw), vertices);
+    }
+}
+
+void SoftRasterizer::setup_triangle(Worker& worker, uint32_t draw_index,
+                                    const uint32_t (&vertices)[3])
+{
+    const Draw& draw = draws[draw_index];
+    ++worker.stats.triangles;
+
+    // Room for the vertices a polygon gains on each of the six planes.
+    ClipVertex polygon[12];
+    ClipVertex clipped[12];
+    unsigned all_outside = 0x3f;
+    unsigned any_outside = 0;
+    for (int kk = 0; kk < 3; ++kk)
+    {
+        if (vertices[kk] >= draw.vertex_count)
+            return;
+        ClipVertex& v = polygon[kk];
+        const Vec4f& position = clip_positions[draw.first_vertex + vertices[kk]];
+        v.pos[0] = position.x;
+        v.pos[1] = position.y;
+        v.pos[2] = position.z;
+        v.pos[3] = position.w;
+
+        const uint8_t* vertex = draw.vertices + vertices[kk] * draw.layout.stride;
+        if (draw.layout.color >= 0)
+            std::memcpy(&v.varyings[0], vertex + draw.layout.color, 3 * sizeof(float));
+        else
+            v.varyings[0] = v.varyings[1] = v.varyings[2] = 1.0f;
+        if (draw.layout.tex_coord >= 0)
+            std::memcpy(&v.varyings[3], vertex + draw.layout.tex_coord, 2 * sizeof(float));
+        else
+            v.varyings[3] = v.varyings[4] = 0.0f;
+
+        const unsigned code = v.outcode();
+        all_outside &= code;
+        any_outside |= code;
+    }
+
+    if (all_outside)
+    {
+        ++worker.stats.clipped;
+        return;
+    }
+    if (!any_outside)
+    {
+        emit_triangle(worker, draw_index, polygon[0], polygon[1], polygon[2]);
+        return;
+    }
+
+    const int count = ClipVertex::clip(polygon, 3, any_outside, clipped);
+    if (count < 3)
+    {
+        ++worker.stats.clipped;
+        return;
+    }
+    for (int ii = 1; ii + 1 < count; ++ii)
+        emit_triangle(worker, draw_index, polygon[0], polygon[ii], polygon[ii + 1]);
+}
+
+void SoftRasterizer::emit_triangle(Worker& worker, uint32_t draw_index, const ClipVertex& v0,
+                                   const ClipVertex& v1, const ClipVertex& v2)
+{
+    const Draw& draw = draws[draw_index];
+    const ClipVertex* v[3] = { &v0, &v1, &v2 };
+
+    // Window coordinates, y up like GL, snapped to the sub-pixel grid.
+    int64_t x[3], y[3];
+    float z[3], inv_w[3];
+    for (int kk = 0; kk < 3; ++kk)
+    {
+        if (!(v[kk]->pos[3] > 0.0f))
+        {
+            ++worker.stats.culled;
+            return;
+        }
+        inv_w[kk] = 1.0f / v[kk]->pos[3];
+        const float window_x = (v[kk]->pos[0] * inv_w[kk] + 1.0f) * 0.5f * fb_width;
+        const float window_y = (v[kk]->pos[1] * inv_w[kk] + 1.0f) * 0.5f * fb_height;
+        x[kk] = std::llrint(window_x * subpixel);
+        y[kk] = std::llrint(window_y * subpixel);
+        z[kk] = v[kk]->pos[2] * inv_w[kk] * 0.5f + 0.5f;
+    }
+
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    const bool front = (area > 0) == (draw.state.front_face == FrontFace::ccw);
+    const CullFace cull = draw.state.cull_face;
+    if (area == 0 || cull == CullFace::front_and_back || (cull == CullFace::back && !front)
+        || (cull == CullFace::front && front))
+    {
+        ++worker.stats.culled;
+        return;
+    }
+
+    // Counter clockwise from here on.
+    int order[3] = { 0, 1, 2 };
+    if (area < 0)
+    {
+        std::swap(order[1], order[2]);
+        area = -area;
+    }
+
+    Triangle triangle;
+    const int64_t min_x = std::min({ x[0], x[1], x[2] });
+    const int64_t max_x = std::max({ x[0], x[1], x[2] });
+    const int64_t min_y = std::min({ y[0], y[1], y[2] });
+    const int64_t max_y = std::max({ y[0], y[1], y[2] });
+    // Pixel centers are at half pixels.
+    triangle.min_x = static_cast<int>(std::max<int64_t>(0, ceil_div(min_x - subpixel / 2, subpixel)));
+    triangle.min_y = static_cast<int>(std::max<int64_t>(0, ceil_div(min_y - subpixel / 2, subpixel)));
+    triangle.max_x = static_cast<int>(
+        std::min<int64_t>(fb_width - 1, floor_div(max_x - subpixel / 2, subpixel)));
+    triangle.max_y = static_cast<int>(
+        std::min<int64_t>(fb_height - 1, floor_div(max_y - subpixel / 2, subpixel)));
+    if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y)
+        return;
+
+    for (int kk = 0; kk < 3; ++kk)
+    {
+        const int from = order[kk];
+        const int to = order[(kk + 1) % 3];
+        const int64_t a = y[from] - y[to];
+        const int64_t b = x[to] - x[from];
+        triangle.a[kk] = static_cast<int32_t>(a);
+        triangle.b[kk] = static_cast<int32_t>(b);
+        triangle.c[kk] = -(a * x[from] + b * y[from]);
+        // Top-left rule: pixel centers on an edge belong to the triangle to
+        // its right or below it. Counter clockwise, those are the edges going
+        // down and the horizontal ones going left.
+        const bool top_left = a > 0 || (a == 0 && b < 0);
+        if (!top_left)
+            triangle.c[kk] -= 1;
+    }
+
+    // Gradients of the planes from their values at the vertices.
+    const int o0 = order[0], o1 = order[1], o2 = order[2];
+    triangle.x0 = static_cast<float>(x[o0]) / subpixel;
+    triangle.y0 = static_cast<float>(y[o0]) / subpixel;
+    const double d1x = static_cast<double>(x[o1] - x[o0]) / subpixel;
+    const double d1y = static_cast<double>(y[o1] - y[o0]) / subpixel;
+    const double d2x = static_cast<double>(x[o2] - x[o0]) / subpixel;
+    const double d2y = static_cast<double>(y[o2] - y[o0]) / subpixel;
+    const double det = static_cast<double>(area) / (subpixel * subpixel);
+    for (int pp = 0; pp < num_planes; ++pp)
+    {
+        double values[3];
+        for (int kk = 0; kk < 3; ++kk)
+        {
+            const int vv = order[kk];
+            if (pp == plane_z)
+                values[kk] = z[vv];
+            else if (pp == plane_inv_w)
+                values[kk] = inv_w[vv];
+            else
+                values[kk] = v[vv]->varyings[pp - plane_varyings] * inv_w[vv];
+        }
+        const double df1 = values[1] - values[0];
+        const double df2 = values[2] - values[0];
+        triangle.planes[pp][0] = static_cast<float>(values[0]);
+        triangle.planes[pp][1] = static_cast<float>((df1 * d2y - df2 * d1y) / det);
+        triangle.planes[pp][2] = static_cast<float>((df2 * d1x - df1 * d2x) / det);
+    }
+    triangle.draw = draw_index;
+
+    const uint32_t id = static_cast<uint32_t>(worker.triangles.size());
+    worker.triangles.push_back(triangle);
+    ++worker.stats.rasterized;
+
+    const int tile_x0 = triangle.min_x / tile_size;
+    const int tile_x1 = triangle.max_x / tile_size;
+    const int tile_y0 = triangle.min_y / tile_size;
+    const int tile_y1 = triangle.max_y / tile_size;
+    if (tile_x0 == tile_x1 && tile_y0 == tile_y1)
+    {
+        worker.bins[tile_y0 * tiles_x + tile_x0].push_back(id);
+        return;
+    }
+    for (int ty = tile_y0; ty <= tile_y1; ++ty)
+    {
+        const int py0 = std::max(triangle.min_y, ty * tile_size);
+        const int py1 = std::min(triangle.max_y, ty * tile_size + tile_size - 1);
+        for (int tx = tile_x0; tx <= tile_x1; ++tx)
+        {
+            const int px0 = std::max(triangle.min_x, tx * tile_size);
+            const int px1 = std::min(triangle.max_x, tx * tile_size + tile_size - 1);
+            // The edge functions are linear, so their largest value over the
+            // pixels of the tile is at one of its corners.
+            bool overlaps = true;
+            for (int kk = 0; kk < 3 && overlaps; ++kk)
+            {
+                const int64_t px = (triangle.a[kk] > 0) ? px1 : px0;
+                const int64_t py = (triangle.b[kk] > 0) ? py1 : py0;
+                overlaps = triangle.a[kk] * (px * subpixel + subpixel / 2)
+                             + triangle.b[kk] * (py * subpixel + subpixel / 2) + triangle.c[kk]
+                         >= 0;
+            }
+            if (overlaps)
+                worker.bins[ty * tiles_x + tx].push_back(id);
+        }
+    }
+}
+
+bool SoftRasterizer::take_tile(size_t worker, int& tile, bool& stolen)
+{
+    const auto take = [](TileQueue& queue, bool from_back, int& tile) {
+        uint64_t range = queue.range.load(std::memory_order_relaxed);
+        while (true)
+        {
+            const uint64_t begin = range >> 32;
+            const uint64_t end = range & 0xffffffffu;
+            if (begin >= end)
+                return false;
+            const uint64_t taken = from_back ? end - 1 : begin;
+            const uint64_t rest = from_back ? (begin << 32) | (end - 1) : ((begin + 1) << 32) | end;
+            if (queue.range.compare_exchange_weak(range, rest, std::memory_order_relaxed))
+            {
+                tile = static_cast<int>(taken);
+                return true;
+            }
+        }
+    };
+
+    stolen = false;
+    if (take(tile_queues[worker], false, tile))
+        return true;
+    stolen = true;
+    for (size_t ii = 1; ii < tile_queues.size(); ++ii)
+    {
+        if (take(tile_queues[(worker + ii) % tile_queues.size()], true, tile))
+            return true;
+    }
+    return false;
+}
+
+void SoftRasterizer::rasterize_tiles(size_t index, const Kernels& kernels)
+{
+    Stats& stats = workers[index].stats;
+    int tile;
+    bool stolen;
+    while (take_tile(index, tile, stolen))
+    {
+        if (stolen)
+            ++stats.tiles_stolen;
+        if (clear_pending)
+        {
+            std::fill_n(&tile_color[static_cast<size_t>(tile) * tile_pixels], tile_pixels,
+                        clear_color);
+            std::fill_n(&tile_depth[static_cast<size_t>(tile) * tile_pixels], tile_pixels,
+                        clear_depth);
+        }
+        // In the order of the draws: the workers set up consecutive ranges
+        // of triangles.
+        for (const Worker& worker: workers)
+        {
+            for (uint32_t id: worker.bins[tile])
+                rasterize(worker.triangles[id], tile, kernels, stats);
+        }
+        resolve(tile);
+    }
+}
+
+void SoftRasterizer::rasterize(const Triangle& triangle, int tile, const Kernels& kernels,
+                               Stats& stats)
+{
+    const int tile_x = (tile % tiles_x) * tile_size;
+    const int tile_y = (tile / tiles_x) * tile_size;
+    const int tile_end_x = std::min(fb_width, tile_x + tile_size);
+    const int x0 = std::max(triangle.min_x, tile_x);
+    const int x1 = std::min(triangle.max_x, tile_end_x - 1);
+    const int y0 = std::max(triangle.min_y, tile_y);
+    const int y1 = std::min(triangle.max_y, tile_y + tile_size - 1);
+    if (x0 > x1 || y0 > y1)
+        return;
+
+    TileEdges edges;
+    for (int kk = 0; kk < 3; ++kk)
+    {
+        const int64_t origin = triangle.a[kk] * int64_t{ tile_x * subpixel + subpixel / 2 }
+                             + triangle.b[kk] * int64_t{ tile_y * subpixel + subpixel / 2 }
+                             + triangle.c[kk];
+        edges.step_x[kk] = triangle.a[kk] * subpixel;
+        edges.step_y[kk] = triangle.b[kk] * subpixel;
+        edges.threshold[kk] = static_cast<int32_t>(std::clamp(-origin, -max_threshold, max_threshold));
+        for (int lane = 0; lane < 8; ++lane)
+            edges.lanes[kk][lane] = edges.step_x[kk] * lane;
+    }
+
+    const Draw& draw = draws[triangle.draw];
+    const SoftTexture* texture = draw.state.texture;
+    uint32_t* color = &tile_color[static_cast<size_t>(tile) * tile_pixels];
+    float* depth = &tile_depth[static_cast<size_t>(tile) * tile_pixels];
+    const auto plane = [&triangle](int pp, float dx, float dy) {
+        return triangle.planes[pp][0] + triangle.planes[pp][1] * dx + triangle.planes[pp][2] * dy;
+    };
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        const int local_y = y - tile_y;
+        const float dy = static_cast<float>(y) + 0.5f - triangle.y0;
+        // Blocks of 8 pixels aligned within the tile.
+        for (int x = tile_x + ((x0 - tile_x) & ~7); x <= x1; x += 8)
+        {
+            const int local_x = x - tile_x;
+            unsigned mask = kernels.cover(edges, local_x, local_y);
+            if (x + 8 > tile_end_x)
+                mask &= (1u << (tile_end_x - x)) - 1;
+            if (!mask)
+                continue;
+
+            const float dx = static_cast<float>(x) + 0.5f - triangle.x0;
+            const int offset = local_y * tile_size + local_x;
+            if (draw.state.depth_test)
+            {
+                mask = kernels.depth(mask, plane(plane_z, dx, dy), triangle.planes[plane_z][1],
+                                     depth + offset);
+                if (!mask)
+                    continue;
+            }
+            stats.fragments += static_cast<size_t>(__builtin_popcount(mask));
+            kernels.shade(triangle.planes, texture, mask, dx, dy, color + offset);
+        }
+    }
+}
+
+void SoftRasterizer::resolve(int tile)
+{
+    const int tile_x = (tile % tiles_x) * tile_size;
+    const int tile_y = (tile / tiles_x) * tile_size;
+    const int width = std::min(fb_width - tile_x, tile_size);
+    const int height = std::min(fb_height - tile_y, tile_size);
+    const uint32_t* color = &tile_color[static_cast<size_t>(tile) * tile_pixels];
+    for (int yy = 0; yy < height; ++yy)
+    {
+        std::memcpy(&image[(static_cast<size_t>(tile_y + yy) * fb_width + tile_x) * 4],
+                    color + yy * tile_size, static_cast<size_t>(width) * 4);
+    }
+}
+
+}
@@ -0,0 +1,170 @@
+#include <util/stream_buffer.hpp>
+#include <util/fence.hpp>
+#include <util/gl_ext.hpp>
+#include <util/gl_state.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace util
+{
+
+StreamBuffer::StreamBuffer(GLenum target_, size_t frame_bytes, int regions, bool allow_persistent)
+    : error{ true }
+    , target{ target_ }
+    , region_bytes{ frame_bytes }
+    , num_regions{ std::clamp(regions, 1, max_regions) }
+{
+    if (frame_bytes == 0)
+    {
+        std::cerr << "[ERROR] A stream buffer needs a non-zero frame size\n";
+        return;
+    }
+
+    glGenBuffers(1, &buffer);
+    gl_state().bind_buffer(target, buffer);
+    if (allow_persistent && gl_ext::buffer_storage_supported())
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        const size_t total = region_bytes * static_cast<size_t>(num_regions);
+        gl_ext::buffer_storage(target, static_cast<GLsizeiptr>(total), nullptr, flags);
+        mapped_base =
+            static_cast<unsigned char*>(glMapBufferRange(target, 0, total, flags));
+        if (!mapped_base)
+        {
+            std::cerr << "[ERROR] Could not map the stream buffer persistently\n";
+            return;
+        }
+    }
+    else
+    {
+        // Orphaning hands out fresh storage every frame, one region is enough.
+        num_regions = 1;
+        glBufferData(target, static_cast<GLsizeiptr>(region_bytes), nullptr, GL_STREAM_DRAW);
+    }
+    error = false;
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    for (GLsync& fence: fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    if (!buffer)
+        return;
+    if (mapped_base || mapped_range)
+    {
+        gl_state().bind_buffer(target, buffer);
+        glUnmapBuffer(target);
+    }
+    gl_state().forget_buffer(buffer);
+    glDeleteBuffers(1, &buffer);
+}
+
+StreamBuffer::Slice StreamBuffer::allocate(size_t bytes, size_t alignment)
+{
+    if (error)
+        return {};
+    if (!frame_started)
+    {
+        frame_started = true;
+        used = 0;
+        if (mapped_base)
+        {
+            wait_for_region();
+        }
+        else
+        {
+            gl_state().bind_buffer(target, buffer);
+            glBufferData(target, static_cast<GLsizeiptr>(region_bytes), nullptr, GL_STREAM_DRAW);
+            ++stream_stats.orphans;
+        }
+    }
+
+    // Offsets are aligned from the start of the buffer, the regions start at
+    // multiples of region_bytes which need not be aligned themselves.
+    const size_t region_start = static_cast<size_t>(region) * region_bytes;
+    const size_t local =
+        ((region_start + used + alignment - 1) & ~(alignment - 1)) - region_start;
+    if (local + bytes > region_bytes)
+    {
+        ++stream_stats.overflows;
+        return {};
+    }
+    used = local + bytes;
+    stream_stats.bytes += bytes;
+
+    if (mapped_base)
+        return Slice{ mapped_base + region_start + local, region_start + local };
+
+    // Maps the rest of the buffer on the first allocation after a flush();
+    // nothing else writes to it this frame, so the driver need not sync.
+    if (!mapped_range)
+    {
+        gl_state().bind_buffer(target, buffer);
+        const GLbitfield flags =
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+        mapped_range = static_cast<unsigned char*>(
+            glMapBufferRange(target, local, region_bytes - local, flags));
+        mapped_offset = local;
+        if (!mapped_range)
+        {
+            std::cerr << "[ERROR] Could not map the stream buffer\n";
+            return {};
+        }
+    }
+    return Slice{ mapped_range + (local - mapped_offset), local };
+}
+
+void StreamBuffer::flush()
+{
+    if (!mapped_range)
+        return;
+    gl_state().bind_buffer(target, buffer);
+    glUnmapBuffer(target);
+    mapped_range = nullptr;
+}
+
+void StreamBuffer::end_frame()
+{
+    if (error)
+        return;
+    flush();
+    if (mapped_base && frame_started)
+    {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region = (region + 1) % num_regions;
+    }
+    frame_started = false;
+    ++stream_stats.frames;
+}
+
+void StreamBuffer::wait_for_region()
+{
+    GLsync& fence = fences[region];
+    if (!fence)
+        return;
+
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        using clock = std::chrono::steady_clock;
+        const auto start = clock::now();
+        ++stream_stats.stalls;
+        status = wait_fence(fence);
+        stream_stats.stall_ms +=
+            std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    }
+    if (status == GL_WAIT_FAILED)
+        std::cerr << "[ERROR] Waiting for a stream buffer fence failed\n";
+    else if (status == GL_TIMEOUT_EXPIRED)
+        std::cerr << "[ERROR] Stream buffer region still in use after " << max_fence_wait_s
+                  << " s, overwriting it\n";
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+}
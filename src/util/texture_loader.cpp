@@ -0,0 +1,203 @@
+#include <util/texture_loader.hpp>
+#include <util/gl_state.hpp>
+#include <util/mapped_file.hpp>
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace util
+{
+
+namespace
+{
+
+// Flipped here rather than with stbi_set_flip_vertically_on_load(), which is
+// a global setting shared by all the decoding threads.
+void flip_rows(unsigned char* pixels, int width, int height, int channels)
+{
+    const size_t row_bytes = static_cast<size_t>(width) * channels;
+    std::vector<unsigned char> row(row_bytes);
+    for (int top = 0, bottom = height - 1; top < bottom; ++top, --bottom)
+    {
+        unsigned char* top_row = pixels + top * row_bytes;
+        unsigned char* bottom_row = pixels + bottom * row_bytes;
+        std::memcpy(row.data(), top_row, row_bytes);
+        std::memcpy(top_row, bottom_row, row_bytes);
+        std::memcpy(bottom_row, row.data(), row_bytes);
+    }
+}
+
+size_t image_bytes(int width, int height, int channels)
+{
+    return static_cast<size_t>(width) * height * channels;
+}
+
+} // end of anonymous namespace
+
+TextureLoader::TextureLoader(size_t threads, size_t upload_budget_)
+    : upload_budget{ upload_budget_ }
+    , workers{ threads }
+{
+    glGenBuffers(1, &pixel_buffer);
+}
+
+TextureLoader::~TextureLoader()
+{
+    // Queued decodes only check the flag, so this returns quickly.
+    cancelled = true;
+    workers.wait_idle();
+    for (Decoded& image: decoded)
+        stbi_image_free(image.pixels);
+
+    for (GLuint texture: textures)
+        gl_state().forget_texture(texture);
+    glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+    gl_state().forget_buffer(pixel_buffer);
+    glDeleteBuffers(1, &pixel_buffer);
+}
+
+TextureHandle TextureLoader::load(const std::string& path, const TextureOptions& options)
+{
+    auto state = std::make_shared<TextureHandle::State>();
+    state->path = path;
+    state->options = options;
+
+    glGenTextures(1, &state->texture);
+    textures.push_back(state->texture);
+    gl_state().bind_texture(0, GL_TEXTURE_2D, state->texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, options.wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, options.wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, options.min_filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, options.mag_filter);
+    // A 1x1 level 0 is a complete mipmap chain, so the placeholder can be
+    // sampled with any filter.
+    gl_state().bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                 options.placeholder);
+
+    ++num_pending;
+    workers.submit([this, state] { decode(state); });
+    return TextureHandle(std::move(state));
+}
+
+// Runs on a worker thread.
+void TextureLoader::decode(std::shared_ptr<TextureHandle::State> state)
+{
+    Decoded image;
+    if (!cancelled)
+    {
+        // Decode straight from the mapped file rather than letting stb_image
+        // read it through a FILE* buffer.
+        const MappedFile file(state->path);
+        if (!file.error && file.size() > 0 && file.size() <= INT_MAX)
+            image.pixels = stbi_load_from_memory(file.data(), static_cast<int>(file.size()),
+                                                 &image.width, &image.height, &image.channels, 0);
+        if (image.pixels && state->options.flip_vertically)
+            flip_rows(image.pixels, image.width, image.height, image.channels);
+    }
+    image.state = std::move(state);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        decoded.push_back(std::move(image));
+    }
+    decoded_available.notify_one();
+}
+
+std::vector<TextureLoader::Decoded> TextureLoader::take_decoded(bool wait)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (wait)
+        decoded_available.wait(lock, [this] { return !decoded.empty(); });
+
+    size_t count = 0;
+    size_t bytes = 0;
+    while (count < decoded.size() && (count == 0 || bytes < upload_budget))
+    {
+        const Decoded& image = decoded[count++];
+        bytes += image_bytes(image.width, image.height, image.channels);
+    }
+
+    std::vector<Decoded> taken(std::make_move_iterator(decoded.begin()),
+                               std::make_move_iterator(decoded.begin() + count));
+    decoded.erase(decoded.begin(), decoded.begin() + count);
+    return taken;
+}
+
+size_t TextureLoader::poll()
+{
+    if (num_pending == 0)
+        return 0;
+
+    const std::vector<Decoded> images = take_decoded(false);
+    for (const Decoded& image: images)
+        upload(image);
+    return images.size();
+}
+
+void TextureLoader::finish()
+{
+    while (num_pending)
+    {
+        for (const Decoded& image: take_decoded(true))
+            upload(image);
+    }
+}
+
+void TextureLoader::upload(const Decoded& image)
+{
+    TextureHandle::State& state = *image.state;
+    --num_pending;
+    if (!image.pixels)
+    {
+        std::cerr << "[ERROR] Failed to load the texture " << state.path << '\n';
+        state.status = TextureHandle::Status::failed;
+        return;
+    }
+
+    constexpr GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+    constexpr GLint internal_formats[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+    const GLenum format = formats[image.channels - 1];
+    const size_t bytes = image_bytes(image.width, image.height, image.channels);
+
+    // Copy the pixels into a fresh pixel buffer (the previous storage is
+    // orphaned, so this does not wait for the last upload) and let the texture
+    // read them from there.
+    gl_state().bind_buffer(GL_PIXEL_UNPACK_BUFFER, pixel_buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr,
+                 GL_STREAM_DRAW);
+    const void* source = nullptr; // offset 0 of the pixel buffer.
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes),
+                                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped)
+        std::memcpy(mapped, image.pixels, bytes);
+    if (!mapped || glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) != GL_TRUE)
+    {
+        // Fall back to uploading from client memory.
+        gl_state().bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        source = image.pixels;
+    }
+
+    gl_state().bind_texture(0, GL_TEXTURE_2D, state.texture);
+    // Rows of RGB and single channel images need not be 4 byte aligned.
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_formats[image.channels - 1], image.width,
+                 image.height, 0, format, GL_UNSIGNED_BYTE, source);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (state.options.mipmaps)
+        glGenerateMipmap(GL_TEXTURE_2D);
+    // Other uploads from client memory would read from the buffer otherwise.
+    gl_state().bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    stbi_image_free(image.pixels);
+
+    state.width = image.width;
+    state.height = image.height;
+    state.status = TextureHandle::Status::ready;
+}
+
+}
@@ -0,0 +1,107 @@
+#include <util/thread_pool.hpp>
+
+#include <algorithm>
+
+namespace util
+{
+
+ThreadPool::ThreadPool(size_t threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    workers.reserve(threads);
+    for (size_t ii = 0; ii < threads; ++ii)
+        workers.emplace_back(&ThreadPool::run, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (std::thread& worker: workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    work_available.notify_one();
+}
+
+void ThreadPool::wait_idle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return tasks.empty() && running == 0; });
+}
+
+void ThreadPool::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        work_available.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty())
+            return; // stopping and nothing left to do.
+
+        std::function<void()> task = std::move(tasks.front());
+        tasks.pop_front();
+        ++running;
+        lock.unlock();
+        task();
+        lock.lock();
+        --running;
+        if (tasks.empty() && running == 0)
+            idle.notify_all();
+    }
+}
+
+TaskGroup::TaskGroup(ThreadPool& pool_)
+    : pool{ pool_ }
+    , state{ std::make_shared<State>() }
+{
+}
+
+TaskGroup::~TaskGroup() { wait(); }
+
+void TaskGroup::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->tasks.push_back(std::move(task));
+        ++state->pending;
+    }
+    pool.submit([state = state] { state->run_next(); });
+}
+
+void TaskGroup::wait()
+{
+    while (state->run_next())
+    {
+    }
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done.wait(lock, [this] { return state->pending == 0; });
+}
+
+bool TaskGroup::State::run_next()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (tasks.empty())
+        return false;
+    std::function<void()> task = std::move(tasks.front());
+    tasks.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+    if (--pending == 0)
+        done.notify_all();
+    return true;
+}
+
+}
@@ -0,0 +1,74 @@
+#include <util/uniform_block.hpp>
+#include <util/gl_state.hpp>
+
+#include <iostream>
+
+namespace util
+{
+
+UniformBlockBase::UniformBlockBase(const char* name, GLuint binding, size_t size)
+    : error{ true }
+    , block_name{ name }
+    , binding_point{ binding }
+    , block_size{ size }
+{
+    GLint max_bindings = 0;
+    glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &max_bindings);
+    if (binding >= static_cast<GLuint>(max_bindings))
+    {
+        std::cerr << "[ERROR] Uniform block " << block_name << ": binding point " << binding
+                  << " is beyond GL_MAX_UNIFORM_BUFFER_BINDINGS (" << max_bindings << ")\n";
+        return;
+    }
+
+    glGenBuffers(1, &ubo);
+    gl_state().bind_buffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_DYNAMIC_DRAW);
+    gl_state().bind_buffer_base(GL_UNIFORM_BUFFER, binding, ubo);
+    error = false;
+}
+
+UniformBlockBase::~UniformBlockBase()
+{
+    if (!ubo)
+        return;
+    gl_state().forget_buffer(ubo);
+    glDeleteBuffers(1, &ubo);
+}
+
+bool UniformBlockBase::attach(GLuint program) const
+{
+    if (error)
+        return false;
+
+    const GLuint index = glGetUniformBlockIndex(program, block_name.c_str());
+    if (index == GL_INVALID_INDEX)
+    {
+        std::cerr << "[ERROR] Program " << program << " has no active uniform block "
+                  << block_name << '\n';
+        return false;
+    }
+
+    GLint size = 0;
+    glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+    if (static_cast<size_t>(size) != block_size)
+    {
+        std::cerr << "[ERROR] Uniform block " << block_name << " is " << size
+                  << " bytes in program " << program << " but " << block_size
+                  << " bytes in C++\n";
+        return false;
+    }
+
+    glUniformBlockBinding(program, index, binding_point);
+    return true;
+}
+
+void UniformBlockBase::upload(const void* data, size_t size) const
+{
+    if (error)
+        return;
+    gl_state().bind_buffer(GL_UNIFORM_BUFFER, ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, static_cast<GLsizeiptr>(size), data);
+}
+
+}
@@ -0,0 +1,123 @@
+#include <util/uniform_table.hpp>
+#include <util/hash.hpp>
+
+namespace util
+{
+
+size_t UniformTable::num_driver_queries = 0;
+
+// static
+GLint UniformTable::query_location(GLuint program, const char* name)
+{
+    ++num_driver_queries;
+    return glGetUniformLocation(program, name);
+}
+
+void UniformTable::reflect(GLuint program)
+{
+    clear();
+
+    GLint num_uniforms = 0;
+    GLint max_name_len = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &num_uniforms);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_len);
+
+    std::string name(static_cast<size_t>(max_name_len), '\0');
+    for (GLint ii = 0; ii < num_uniforms; ++ii)
+    {
+        GLsizei len = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(program, static_cast<GLuint>(ii), max_name_len, &len, &size, &type,
+                           name.data());
+        std::string_view uname(name.data(), static_cast<size_t>(len));
+        // Members of uniform blocks have no location; they are set through buffers.
+        const GLint location = query_location(program, name.c_str());
+        if (location == inactive)
+        {
+            continue;
+        }
+
+        insert(uname, location);
+        // Arrays are reported as "name[0]", but are usually set as "name".
+        if (uname.ends_with("[0]"))
+        {
+            insert(uname.substr(0, uname.size() - 3), location);
+        }
+    }
+}
+
+const GLint* UniformTable::find(std::string_view name) const
+{
+    if (slots.empty())
+    {
+        return nullptr;
+    }
+
+    const uint64_t hh = fnv1a(name);
+    const size_t mask = slots.size() - 1;
+    for (size_t idx = hh & mask;; idx = (idx + 1) & mask)
+    {
+        const Slot& slot = slots[idx];
+        if (slot.name.empty())
+        {
+            return nullptr;
+        }
+        if (slot.hash == hh && slot.name == name)
+        {
+            return &slot.location;
+        }
+    }
+}
+
+void UniformTable::insert(std::string_view name, GLint location)
+{
+    // Keep the load factor at or below 1/2 so probe sequences stay short.
+    if ((count + 1) * 2 > slots.size())
+    {
+        grow();
+    }
+
+    const uint64_t hh = fnv1a(name);
+    const size_t mask = slots.size() - 1;
+    for (size_t idx = hh & mask;; idx = (idx + 1) & mask)
+    {
+        Slot& slot = slots[idx];
+        if (slot.name.empty())
+        {
+            slot.hash = hh;
+            slot.location = location;
+            slot.name = name;
+            ++count;
+            return;
+        }
+        if (slot.hash == hh && slot.name == name)
+        {
+            slot.location = location;
+            return;
+        }
+    }
+}
+
+void UniformTable::clear()
+{
+    slots.clear();
+    count = 0;
+}
+
+void UniformTable::grow()
+{
+    std::vector<Slot> old = std::move(slots);
+    slots.clear();
+    slots.resize(old.empty() ? 16 : old.size() * 2);
+    count = 0;
+    for (Slot& slot: old)
+    {
+        if (!slot.name.empty())
+        {
+            insert(slot.name, slot.location);
+        }
+    }
+}
+
+}
@@ -3,15 +3,60 @@
 
 using namespace util;
 
+Uniform::Stats Uniform::upload_stats;
+
+bool Uniform::changed(void* last, const void* value, size_t size)
+{
+    if (uploaded && std::memcmp(last, value, size) == 0)
+    {
+        ++upload_stats.elided;
+        return false;
+    }
+    std::memcpy(last, value, size);
+    uploaded = true;
+    ++upload_stats.issued;
+    return true;
+}
+
 void Uniform1f::set(float vv)
 {
     value = vv;
-    glUniform1f(location, value);
+    if (changed(&last, &value, sizeof(value)))
+        glUniform1f(location, value);
+}
+
+void Uniform1i::set(int vv)
+{
+    value = vv;
+    if (changed(&last, &value, sizeof(value)))
+        glUniform1i(location, value);
+}
+
+void Uniform2f::set(float x, float y)
+{
+    const float vv[2] = { x, y };
+    if (changed(last, vv, sizeof(vv)))
+        glUniform2fv(location, 1, vv);
+}
+
+void Uniform3f::set(float x, float y, float z)
+{
+    const float vv[3] = { x, y, z };
+    if (changed(last, vv, sizeof(vv)))
+        glUniform3fv(location, 1, vv);
+}
+
+void Uniform4f::set(float x, float y, float z, float w)
+{
+    const float vv[4] = { x, y, z, w };
+    if (changed(last, vv, sizeof(vv)))
+        glUniform4fv(location, 1, vv);
 }
 
 void Matrix4f::set()
 {
-    glUniformMatrix4fv(location, 1, GL_TRUE /* already in row major form */, get_ptr());
+    if (changed(last, mat, sizeof(mat)))
+        glUniformMatrix4fv(location, 1, GL_TRUE /* already in row major form */, get_ptr());
 }
 
 void Matrix4f::set(const mat4x4f_t& mat_)
@@ -28,6 +73,14 @@ void Matrix4f::set(const Mat4x4f& mat_)
     set();
 }
 
+void Matrix4f::set(const glm::mat4& mat_)
+{
+    for (int ii = 0; ii < 4; ++ii)
+        for (int jj = 0; jj < 4; ++jj)
+            mat[ii][jj] = mat_[jj][ii];
+    set();
+}
+
 mat4x4f_t& Matrix4f::get() { return mat; }
 
 float* Matrix4f::get_ptr() { return &mat[0][0]; }